@@ -98,6 +98,7 @@ static int zpool_do_clear(int, char **);
 static int zpool_do_reopen(int, char **);
 
 static int zpool_do_reguid(int, char **);
+static int zpool_do_ddt_prune(int, char **);
 
 static int zpool_do_attach(int, char **);
 static int zpool_do_detach(int, char **);
@@ -180,7 +181,8 @@ typedef enum {
 	HELP_REGUID,
 	HELP_REOPEN,
 	HELP_VERSION,
-	HELP_WAIT
+	HELP_WAIT,
+	HELP_DDT_PRUNE
 } zpool_help_t;
 
 
@@ -319,6 +321,7 @@ static zpool_command_t command_table[] = {
 	{ "export",	zpool_do_export,	HELP_EXPORT		},
 	{ "upgrade",	zpool_do_upgrade,	HELP_UPGRADE		},
 	{ "reguid",	zpool_do_reguid,	HELP_REGUID		},
+	{ "ddtprune",	zpool_do_ddt_prune,	HELP_DDT_PRUNE		},
 	{ NULL },
 	{ "history",	zpool_do_history,	HELP_HISTORY		},
 	{ "events",	zpool_do_events,	HELP_EVENTS		},
@@ -401,7 +404,8 @@ get_usage(zpool_help_t idx)
 		return (gettext("\tinitialize [-c | -s] [-w] <pool> "
 		    "[<device> ...]\n"));
 	case HELP_SCRUB:
-		return (gettext("\tscrub [-s | -p] [-w] <pool> ...\n"));
+		return (gettext("\tscrub [-s | -p] [-w] [-e] "
+		    "[--since-txg txg | --since-last] <pool> ...\n"));
 	case HELP_RESILVER:
 		return (gettext("\tresilver <pool> ...\n"));
 	case HELP_TRIM:
@@ -435,6 +439,8 @@ get_usage(zpool_help_t idx)
 	case HELP_WAIT:
 		return (gettext("\twait [-Hp] [-T d|u] [-t <activity>[,...]] "
 		    "<pool> [interval]\n"));
+	case HELP_DDT_PRUNE:
+		return (gettext("\tddtprune -d <days> <pool>\n"));
 	default:
 		__builtin_unreachable();
 	}
@@ -6553,9 +6559,17 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing,
 	    rebuild);
 
-	if (ret == 0 && wait)
-		ret = zpool_wait(zhp,
-		    replacing ? ZPOOL_WAIT_REPLACE : ZPOOL_WAIT_RESILVER);
+	if (ret == 0 && wait) {
+		zpool_wait_activity_t activity = ZPOOL_WAIT_RESILVER;
+		char raidz_prefix[] = "raidz";
+		if (replacing) {
+			activity = ZPOOL_WAIT_REPLACE;
+		} else if (strncmp(old_disk,
+		    raidz_prefix, strlen(raidz_prefix)) == 0) {
+			activity = ZPOOL_WAIT_RAIDZ_EXPAND;
+		}
+		ret = zpool_wait(zhp, activity);
+	}
 
 	nvlist_free(props);
 	nvlist_free(nvroot);
@@ -7116,6 +7130,73 @@ zpool_do_reguid(int argc, char **argv)
 }
 
 
+/*
+ * zpool ddtprune -d <days> <pool>
+ *
+ *	-d <days>	Remove dedup table entries that have been unique for at
+ *			least this many days.
+ */
+int
+zpool_do_ddt_prune(int argc, char **argv)
+{
+	int c;
+	char *poolname, *end;
+	zpool_handle_t *zhp;
+	uint64_t days = 0;
+	boolean_t have_days = B_FALSE;
+	int ret;
+
+	/* check options */
+	while ((c = getopt(argc, argv, "d:")) != -1) {
+		switch (c) {
+		case 'd':
+			errno = 0;
+			days = strtoull(optarg, &end, 10);
+			if (errno != 0 || *end != '\0' || optarg[0] == '-' ||
+			    days > UINT64_MAX / (24 * 60 * 60)) {
+				(void) fprintf(stderr,
+				    gettext("invalid number of days '%s'\n"),
+				    optarg);
+				usage(B_FALSE);
+			}
+			have_days = B_TRUE;
+			break;
+		case '?':
+			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
+			    optopt);
+			usage(B_FALSE);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (!have_days) {
+		(void) fprintf(stderr, gettext("missing -d option\n"));
+		usage(B_FALSE);
+	}
+
+	/* get pool name and check number of arguments */
+	if (argc < 1) {
+		(void) fprintf(stderr, gettext("missing pool name\n"));
+		usage(B_FALSE);
+	}
+
+	if (argc > 1) {
+		(void) fprintf(stderr, gettext("too many arguments\n"));
+		usage(B_FALSE);
+	}
+
+	poolname = argv[0];
+	if ((zhp = zpool_open(g_zfs, poolname)) == NULL)
+		return (1);
+
+	ret = zpool_ddt_prune(zhp, days * 24 * 60 * 60, NULL);
+
+	zpool_close(zhp);
+	return (ret == 0 ? 0 : 1);
+}
+
 /*
  * zpool reopen <pool>
  *
@@ -7154,6 +7235,8 @@ zpool_do_reopen(int argc, char **argv)
 typedef struct scrub_cbdata {
 	int	cb_type;
 	pool_scrub_cmd_t cb_scrub_cmd;
+	uint64_t cb_txgstart;
+	boolean_t cb_since_last;
 } scrub_cbdata_t;
 
 static boolean_t
@@ -7197,10 +7280,21 @@ scrub_callback(zpool_handle_t *zhp, void *data)
 		return (1);
 	}
 
-	err = zpool_scan(zhp, cb->cb_type, cb->cb_scrub_cmd);
+	uint64_t txgstart = cb->cb_txgstart;
+	if (cb->cb_since_last) {
+		txgstart = zpool_get_prop_int(zhp, ZPOOL_PROP_LAST_SCRUBBED_TXG,
+		    NULL);
+	}
+
+	if (txgstart != 0)
+		err = zpool_scan_range(zhp, cb->cb_type, cb->cb_scrub_cmd,
+		    txgstart, 0);
+	else
+		err = zpool_scan(zhp, cb->cb_type, cb->cb_scrub_cmd);
 
 	if (err == 0 && zpool_has_checkpoint(zhp) &&
-	    cb->cb_type == POOL_SCAN_SCRUB) {
+	    (cb->cb_type == POOL_SCAN_SCRUB ||
+	    cb->cb_type == POOL_SCAN_ERRORSCRUB)) {
 		(void) printf(gettext("warning: will not scrub state that "
 		    "belongs to the checkpoint of pool '%s'\n"),
 		    zpool_get_name(zhp));
@@ -7216,27 +7310,61 @@ wait_callback(zpool_handle_t *zhp, void *data)
 	return (zpool_wait(zhp, *act));
 }
 
+#define	SINCE_TXG_OPT	1024
+#define	SINCE_LAST_OPT	1025
+
 /*
- * zpool scrub [-s | -p] [-w] <pool> ...
+ * zpool scrub [-s | -p] [-w] [-e] [--since-txg txg | --since-last] <pool> ...
  *
- *	-s	Stop.  Stops any in-progress scrub.
- *	-p	Pause. Pause in-progress scrub.
- *	-w	Wait.  Blocks until scrub has completed.
+ *	-e		Error. Only scrub blocks in the error log.
+ *	-s		Stop.  Stops any in-progress scrub.
+ *	-p		Pause. Pause in-progress scrub.
+ *	-w		Wait.  Blocks until scrub has completed.
+ *	--since-txg	Only scrub blocks born after the given txg.
+ *	--since-last	Only scrub blocks born since the last completed scrub.
  */
 int
 zpool_do_scrub(int argc, char **argv)
 {
 	int c;
-	scrub_cbdata_t cb;
+	scrub_cbdata_t cb = { 0 };
 	boolean_t wait = B_FALSE;
+	boolean_t is_error_scrub = B_FALSE;
+	boolean_t since_txg = B_FALSE;
+	char *endptr;
 	int error;
 
+	struct option long_options[] = {
+		{"since-txg", required_argument, NULL, SINCE_TXG_OPT},
+		{"since-last", no_argument, NULL, SINCE_LAST_OPT},
+		{0, 0, 0, 0}
+	};
+
 	cb.cb_type = POOL_SCAN_SCRUB;
 	cb.cb_scrub_cmd = POOL_SCRUB_NORMAL;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "spw")) != -1) {
+	while ((c = getopt_long(argc, argv, "spwe", long_options,
+	    NULL)) != -1) {
 		switch (c) {
+		case SINCE_TXG_OPT:
+			errno = 0;
+			cb.cb_txgstart = strtoull(optarg, &endptr, 0);
+			if (errno != 0 || *endptr != '\0' ||
+			    cb.cb_txgstart == 0) {
+				(void) fprintf(stderr,
+				    gettext("invalid txg value '%s'\n"),
+				    optarg);
+				usage(B_FALSE);
+			}
+			since_txg = B_TRUE;
+			break;
+		case SINCE_LAST_OPT:
+			cb.cb_since_last = B_TRUE;
+			break;
+		case 'e':
+			is_error_scrub = B_TRUE;
+			break;
 		case 's':
 			cb.cb_type = POOL_SCAN_NONE;
 			break;
@@ -7267,6 +7395,31 @@ zpool_do_scrub(int argc, char **argv)
 		usage(B_FALSE);
 	}
 
+	if (is_error_scrub) {
+		if (cb.cb_type == POOL_SCAN_NONE ||
+		    cb.cb_scrub_cmd == POOL_SCRUB_PAUSE) {
+			(void) fprintf(stderr, gettext("invalid option "
+			    "combination: -e cannot be used with -p or -s\n"));
+			usage(B_FALSE);
+		}
+		cb.cb_type = POOL_SCAN_ERRORSCRUB;
+	}
+
+	if (since_txg && cb.cb_since_last) {
+		(void) fprintf(stderr, gettext("invalid option combination: "
+		    "--since-txg and --since-last are mutually exclusive\n"));
+		usage(B_FALSE);
+	}
+
+	if ((since_txg || cb.cb_since_last) &&
+	    (cb.cb_type != POOL_SCAN_SCRUB ||
+	    cb.cb_scrub_cmd == POOL_SCRUB_PAUSE)) {
+		(void) fprintf(stderr, gettext("invalid option combination: "
+		    "--since-txg and --since-last can only be used when "
+		    "starting a scrub\n"));
+		usage(B_FALSE);
+	}
+
 	argc -= optind;
 	argv += optind;
 
@@ -7296,7 +7449,7 @@ int
 zpool_do_resilver(int argc, char **argv)
 {
 	int c;
-	scrub_cbdata_t cb;
+	scrub_cbdata_t cb = { 0 };
 
 	cb.cb_type = POOL_SCAN_RESILVER;
 	cb.cb_scrub_cmd = POOL_SCRUB_NORMAL;
@@ -7481,6 +7634,61 @@ secs_to_dhms(uint64_t total, char *buf)
 	}
 }
 
+/*
+ * Print out detailed error scrub status.
+ */
+static void
+print_err_scrub_status(pool_scan_stat_t *ps)
+{
+	time_t start, end, pause;
+	uint64_t examined, to_be_examined;
+	char time_buf[32];
+
+	if (ps == NULL || ps->pss_error_scrub_func != POOL_SCAN_ERRORSCRUB) {
+		return;
+	}
+
+	(void) printf(gettext(" scrub: "));
+
+	start = ps->pss_error_scrub_start;
+	end = ps->pss_error_scrub_end;
+	pause = ps->pss_pass_error_scrub_pause;
+	examined = ps->pss_error_scrub_examined;
+	to_be_examined = ps->pss_error_scrub_to_be_examined;
+
+	if (ps->pss_error_scrub_state == DSS_FINISHED) {
+		secs_to_dhms(end - start, time_buf);
+		(void) printf(gettext("scrubbed %llu error blocks in %s "
+		    "with %llu errors on %s"), (u_longlong_t)examined,
+		    time_buf, (u_longlong_t)ps->pss_error_scrub_errors,
+		    ctime(&end));
+		return;
+	} else if (ps->pss_error_scrub_state == DSS_CANCELED) {
+		(void) printf(gettext("error scrub canceled on %s"),
+		    ctime(&end));
+		return;
+	}
+	assert(ps->pss_error_scrub_state == DSS_ERRORSCRUBBING);
+
+	/* Error scrub is in progress. */
+	if (pause == 0) {
+		(void) printf(gettext("error scrub in progress since %s"),
+		    ctime(&start));
+	} else {
+		(void) printf(gettext("error scrub paused since %s"),
+		    ctime(&pause));
+		(void) printf(gettext("\terror scrub started on %s"),
+		    ctime(&start));
+	}
+
+	double fraction_done = (to_be_examined + examined) == 0 ? 0 :
+	    (double)examined / (to_be_examined + examined);
+	(void) printf(gettext("\t%.2f%% done, issued I/O for %llu error"
+	    " blocks"), 100 * fraction_done, (u_longlong_t)examined);
+
+	(void) printf("\n");
+}
+
 /*
  * Print out detailed scrub status.
  */
@@ -7829,6 +8037,13 @@ print_scan_status(zpool_handle_t *zhp, nvlist_t *nvroot)
 	if (have_scrub)
 		print_scan_scrub_resilver_status(ps);
 
+	/*
+	 * The error scrub fields were appended to pool_scan_stat_t, so only
+	 * print them when the kernel provided the full structure.
+	 */
+	if (ps != NULL && c >= sizeof (pool_scan_stat_t) / sizeof (uint64_t))
+		print_err_scrub_status(ps);
+
 	/*
 	 * When there is an active resilver or rebuild print its status.
 	 * Otherwise print the status of the last resilver or rebuild.
@@ -7952,6 +8167,97 @@ print_removal_status(zpool_handle_t *zhp, pool_removal_stat_t *prs)
 	}
 }
 
+/*
+ * Print out detailed raidz expansion status.
+ */
+static void
+print_raidz_expand_status(zpool_handle_t *zhp, pool_raidz_expand_stat_t *pres)
+{
+	char copied_buf[7];
+
+	if (pres == NULL || pres->pres_state == DSS_NONE)
+		return;
+
+	/*
+	 * Determine name of vdev.
+	 */
+	nvlist_t *config = zpool_get_config(zhp, NULL);
+	nvlist_t *nvroot = fnvlist_lookup_nvlist(config,
+	    ZPOOL_CONFIG_VDEV_TREE);
+	nvlist_t **child;
+	uint_t children;
+	verify(nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) == 0);
+	assert(pres->pres_expanding_vdev < children);
+
+	printf_color(ANSI_BOLD, gettext("expand: "));
+
+	time_t start = pres->pres_start_time;
+	time_t end = pres->pres_end_time;
+	char *vname =
+	    zpool_vdev_name(g_zfs, zhp, child[pres->pres_expanding_vdev], 0);
+	zfs_nicenum(pres->pres_reflowed, copied_buf, sizeof (copied_buf));
+
+	/*
+	 * Expansion is finished or canceled.
+	 */
+	if (pres->pres_state == DSS_FINISHED) {
+		char time_buf[32];
+		secs_to_dhms(end - start, time_buf);
+
+		(void) printf(gettext("expanded %s-%u copied %s in %s, "
+		    "on %s"), vname, (int)pres->pres_expanding_vdev,
+		    copied_buf, time_buf, ctime((time_t *)&end));
+	} else {
+		char examined_buf[7], total_buf[7], rate_buf[7];
+		uint64_t copied, total, elapsed, rate, secs_left;
+		double fraction_done;
+
+		assert(pres->pres_state == DSS_SCANNING);
+
+		/*
+		 * Expansion is in progress.
+		 */
+		(void) printf(gettext(
+		    "expansion of %s-%u in progress since %s"),
+		    vname, (int)pres->pres_expanding_vdev, ctime(&start));
+
+		copied = pres->pres_reflowed > 0 ? pres->pres_reflowed : 1;
+		total = pres->pres_to_reflow;
+		fraction_done = (double)MIN(copied, total) / total;
+
+		/* elapsed time for this pass */
+		elapsed = time(NULL) - pres->pres_start_time;
+		elapsed = elapsed > 0 ? elapsed : 1;
+		rate = copied / elapsed;
+		rate = rate > 0 ? rate : 1;
+		secs_left = copied < total ? (total - copied) / rate : 0;
+
+		zfs_nicenum(copied, examined_buf, sizeof (examined_buf));
+		zfs_nicenum(total, total_buf, sizeof (total_buf));
+		zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
+
+		/*
+		 * do not print estimated time if hours_left is more than
+		 * 30 days
+		 */
+		(void) printf(gettext("\t%s / %s copied at %s/s, %.2f%% done"),
+		    examined_buf, total_buf, rate_buf, 100 * fraction_done);
+		if (pres->pres_waiting_for_resilver) {
+			(void) printf(gettext(", paused for resilver or "
+			    "clear\n"));
+		} else if (secs_left < (30 * 24 * 3600)) {
+			char time_buf[32];
+			secs_to_dhms(secs_left, time_buf);
+			(void) printf(gettext(", %s to go\n"), time_buf);
+		} else {
+			(void) printf(gettext(
+			    ", (copy is slow, no estimated time)\n"));
+		}
+	}
+	free(vname);
+}
+
 static void
 print_checkpoint_status(pool_checkpoint_stat_t *pcs)
 {
@@ -8531,6 +8837,7 @@ status_callback(zpool_handle_t *zhp, void *data)
 		uint_t nspares, nl2cache;
 		pool_checkpoint_stat_t *pcs = NULL;
 		pool_removal_stat_t *prs = NULL;
+		pool_raidz_expand_stat_t *pres = NULL;
 
 		print_scan_status(zhp, nvroot);
 
@@ -8538,6 +8845,10 @@ status_callback(zpool_handle_t *zhp, void *data)
 		    ZPOOL_CONFIG_REMOVAL_STATS, (uint64_t **)&prs, &c);
 		print_removal_status(zhp, prs);
 
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
+		print_raidz_expand_status(zhp, pres);
+
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t **)&pcs, &c);
 		print_checkpoint_status(pcs);
@@ -10484,8 +10795,9 @@ print_wait_status_row(wait_data_t *wd, zpool_handle_t *zhp, int row)
 	pool_checkpoint_stat_t *pcs = NULL;
 	pool_scan_stat_t *pss = NULL;
 	pool_removal_stat_t *prs = NULL;
+	pool_raidz_expand_stat_t *pres = NULL;
 	const char *const headers[] = {"DISCARD", "FREE", "INITIALIZE",
-	    "REPLACE", "REMOVE", "RESILVER", "SCRUB", "TRIM"};
+	    "REPLACE", "REMOVE", "RESILVER", "SCRUB", "TRIM", "RAIDZ_EXPAND"};
 	int col_widths[ZPOOL_WAIT_NUM_ACTIVITIES];
 
 	/* Calculate the width of each column */
@@ -10530,6 +10842,13 @@ print_wait_status_row(wait_data_t *wd, zpool_handle_t *zhp, int row)
 		bytes_rem[ZPOOL_WAIT_REMOVE] = prs->prs_to_copy -
 		    prs->prs_copied;
 
+	(void) nvlist_lookup_uint64_array(nvroot,
+	    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
+	if (pres != NULL && pres->pres_state == DSS_SCANNING) {
+		int64_t rem = pres->pres_to_reflow - pres->pres_reflowed;
+		bytes_rem[ZPOOL_WAIT_RAIDZ_EXPAND] = rem;
+	}
+
 	(void) nvlist_lookup_uint64_array(nvroot,
 	    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&pss, &c);
 	if (pss != NULL && pss->pss_state == DSS_SCANNING &&
@@ -10683,7 +11002,8 @@ zpool_do_wait(int argc, char **argv)
 			for (char *tok; (tok = strsep(&optarg, ",")); ) {
 				static const char *const col_opts[] = {
 				    "discard", "free", "initialize", "replace",
-				    "remove", "resilver", "scrub", "trim" };
+				    "remove", "resilver", "scrub", "trim",
+				    "raidz_expand" };
 
 				for (i = 0; i < ARRAY_SIZE(col_opts); ++i)
 					if (strcmp(tok, col_opts[i]) == 0) {
@@ -153,7 +153,7 @@ print_scan_status(nvlist_t *nvroot, const char *pool_name)
 	pool_scan_stat_t *ps = NULL;
 	double pct_done;
 	const char *const state[DSS_NUM_STATES] = {
-	    "none", "scanning", "finished", "canceled"};
+	    "none", "scanning", "finished", "canceled", "errorscrubbing"};
 	const char *func;
 
 	(void) nvlist_lookup_uint64_array(nvroot,
@@ -189,6 +189,9 @@ print_scan_status(nvlist_t *nvroot, const char *pool_name)
 	case POOL_SCAN_RESILVER:
 		func = "resilver";
 		break;
+	case POOL_SCAN_ERRORSCRUB:
+		func = "errorscrub";
+		break;
 #ifdef POOL_SCAN_REBUILD
 	case POOL_SCAN_REBUILD:
 		func = "rebuild";
@@ -118,7 +118,9 @@
 #include <sys/dsl_scan.h>
 #include <sys/zio_checksum.h>
 #include <sys/zfs_refcount.h>
+#include <sys/zfs_rlock.h>
 #include <sys/zfeature.h>
+#include <sys/ddt.h>
 #include <sys/dsl_userhold.h>
 #include <sys/abd.h>
 #include <sys/blake3.h>
@@ -310,9 +312,9 @@ typedef struct bufwad {
  * still need to map from object ID to rangelock_t.
  */
 typedef enum {
-	RL_READER,
-	RL_WRITER,
-	RL_APPEND
+	ZTRL_READER,
+	ZTRL_WRITER,
+	ZTRL_APPEND
 } rl_type_t;
 
 typedef struct rll {
@@ -396,10 +398,12 @@ ztest_func_t ztest_zil_remount;
 ztest_func_t ztest_dmu_read_write_zcopy;
 ztest_func_t ztest_dmu_objset_create_destroy;
 ztest_func_t ztest_dmu_prealloc;
+ztest_func_t ztest_bclone;
 ztest_func_t ztest_fzap;
 ztest_func_t ztest_dmu_snapshot_create_destroy;
 ztest_func_t ztest_dsl_prop_get_set;
 ztest_func_t ztest_spa_prop_get_set;
+ztest_func_t ztest_ddt_prune;
 ztest_func_t ztest_spa_create_destroy;
 ztest_func_t ztest_fault_inject;
 ztest_func_t ztest_dmu_snapshot_hold;
@@ -421,6 +425,7 @@ ztest_func_t ztest_trim;
 ztest_func_t ztest_blake3;
 ztest_func_t ztest_fletcher;
 ztest_func_t ztest_fletcher_incr;
+ztest_func_t ztest_rangelock_shards;
 ztest_func_t ztest_verify_dnode_bt;
 
 uint64_t zopt_always = 0ULL * NANOSEC;		/* all the time */
@@ -450,9 +455,11 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_dmu_objset_create_destroy, 1, &zopt_often),
 	ZTI_INIT(ztest_dsl_prop_get_set, 1, &zopt_often),
 	ZTI_INIT(ztest_spa_prop_get_set, 1, &zopt_sometimes),
+	ZTI_INIT(ztest_ddt_prune, 1, &zopt_rarely),
 #if 0
 	ZTI_INIT(ztest_dmu_prealloc, 1, &zopt_sometimes),
 #endif
+	ZTI_INIT(ztest_bclone, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_fzap, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_dmu_snapshot_create_destroy, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_spa_create_destroy, 1, &zopt_sometimes),
@@ -475,6 +482,7 @@ ztest_info_t ztest_info[] = {
 	ZTI_INIT(ztest_blake3, 1, &zopt_rarely),
 	ZTI_INIT(ztest_fletcher, 1, &zopt_rarely),
 	ZTI_INIT(ztest_fletcher_incr, 1, &zopt_rarely),
+	ZTI_INIT(ztest_rangelock_shards, 1, &zopt_sometimes),
 	ZTI_INIT(ztest_verify_dnode_bt, 1, &zopt_sometimes),
 };
 
@@ -525,6 +533,18 @@ static boolean_t ztest_device_removal_active = B_FALSE;
 static boolean_t ztest_pool_scrubbed = B_FALSE;
 static kmutex_t ztest_checkpoint_lock;
 
+/*
+ * Sharded range lock exercised by ztest_rangelock_shards().  Each slot of
+ * SPA_MINBLOCKSIZE bytes counts the readers holding it, or is set to
+ * ZTEST_RL_WRITER while held by a writer.  The shards are assigned regions
+ * of 8 slots, so that ranges often span multiple shards.
+ */
+#define	ZTEST_RL_SLOTS		64
+#define	ZTEST_RL_SHARDS		4
+#define	ZTEST_RL_WRITER		(1U << 31)
+static zfs_rangelock_t ztest_shard_rl;
+static uint32_t ztest_shard_rl_slots[ZTEST_RL_SLOTS];
+
 /*
  * The ztest_name_lock protects the pool and dataset namespace used by
  * the individual tests. To modify the namespace, consumers must grab
@@ -1613,7 +1633,7 @@ ztest_rll_lock(rll_t *rll, rl_type_t type)
 {
 	mutex_enter(&rll->rll_lock);
 
-	if (type == RL_READER) {
+	if (type == ZTRL_READER) {
 		while (rll->rll_writer != NULL)
 			(void) cv_wait(&rll->rll_cv, &rll->rll_lock);
 		rll->rll_readers++;
@@ -2069,7 +2089,7 @@ ztest_replay_remove(void *arg1, void *arg2, boolean_t byteswap)
 	    zap_lookup(os, lr->lr_doid, name, sizeof (object), 1, &object));
 	ASSERT3U(object, !=, 0);
 
-	ztest_object_lock(zd, object, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_WRITER);
 
 	VERIFY0(dmu_object_info(os, object, &doi));
 
@@ -2139,8 +2159,8 @@ ztest_replay_write(void *arg1, void *arg2, boolean_t byteswap)
 	if (bt->bt_magic != BT_MAGIC)
 		bt = NULL;
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
-	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
+	rl = ztest_range_lock(zd, lr->lr_foid, offset, length, ZTRL_WRITER);
 
 	VERIFY0(dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -2242,9 +2262,9 @@ ztest_replay_truncate(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_READER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_READER);
 	rl = ztest_range_lock(zd, lr->lr_foid, lr->lr_offset, lr->lr_length,
-	    RL_WRITER);
+	    ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -2284,7 +2304,7 @@ ztest_replay_setattr(void *arg1, void *arg2, boolean_t byteswap)
 	if (byteswap)
 		byteswap_uint64_array(lr, sizeof (*lr));
 
-	ztest_object_lock(zd, lr->lr_foid, RL_WRITER);
+	ztest_object_lock(zd, lr->lr_foid, ZTRL_WRITER);
 
 	VERIFY0(dmu_bonus_hold(os, lr->lr_foid, FTAG, &db));
 
@@ -2367,6 +2387,7 @@ zil_replay_func_t *ztest_replay_vector[TX_MAX_TYPE] = {
 	NULL,			/* TX_MKDIR_ACL_ATTR */
 	NULL,			/* TX_WRITE2 */
 	NULL,			/* TX_SETSAXATTR */
+	NULL,			/* TX_CLONE_RANGE */
 };
 
 /*
@@ -2410,7 +2431,7 @@ ztest_get_data(void *arg, uint64_t arg2, lr_write_t *lr, char *buf,
 	ASSERT3P(zio, !=, NULL);
 	ASSERT3U(size, !=, 0);
 
-	ztest_object_lock(zd, object, RL_READER);
+	ztest_object_lock(zd, object, ZTRL_READER);
 	error = dmu_bonus_hold(os, object, FTAG, &db);
 	if (error) {
 		ztest_object_unlock(zd, object);
@@ -2435,7 +2456,7 @@ ztest_get_data(void *arg, uint64_t arg2, lr_write_t *lr, char *buf,
 
 	if (buf != NULL) {	/* immediate write */
 		zgd->zgd_lr = (struct zfs_locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_read(os, object, offset, size, buf,
 		    DMU_READ_NO_PREFETCH);
@@ -2450,7 +2471,7 @@ ztest_get_data(void *arg, uint64_t arg2, lr_write_t *lr, char *buf,
 		}
 
 		zgd->zgd_lr = (struct zfs_locked_range *)ztest_range_lock(zd,
-		    object, offset, size, RL_READER);
+		    object, offset, size, ZTRL_READER);
 
 		error = dmu_buf_hold(os, object, offset, zgd, &db,
 		    DMU_READ_NO_PREFETCH);
@@ -2527,7 +2548,7 @@ ztest_lookup(ztest_ds_t *zd, ztest_od_t *od, int count)
 			ASSERT3U(od->od_object, !=, 0);
 			ASSERT0(missing);	/* there should be no gaps */
 
-			ztest_object_lock(zd, od->od_object, RL_READER);
+			ztest_object_lock(zd, od->od_object, ZTRL_READER);
 			VERIFY0(dmu_bonus_hold(zd->zd_os, od->od_object,
 			    FTAG, &db));
 			dmu_object_info_from_db(db, &doi);
@@ -2700,8 +2721,8 @@ ztest_prealloc(ztest_ds_t *zd, uint64_t object, uint64_t offset, uint64_t size)
 
 	txg_wait_synced(dmu_objset_pool(os), 0);
 
-	ztest_object_lock(zd, object, RL_READER);
-	rl = ztest_range_lock(zd, object, offset, size, RL_WRITER);
+	ztest_object_lock(zd, object, ZTRL_READER);
+	rl = ztest_range_lock(zd, object, offset, size, ZTRL_WRITER);
 
 	tx = dmu_tx_create(os);
 
@@ -5252,6 +5273,93 @@ ztest_dmu_prealloc(ztest_ds_t *zd, uint64_t id)
 	umem_free(od, sizeof (ztest_od_t));
 }
 
+/*
+ * Verify that blocks cloned from one object to another read back the
+ * same data.  The objects are recreated each time so the cloned blocks
+ * are freed through the BRT on the next pass.
+ */
+void
+ztest_bclone(ztest_ds_t *zd, uint64_t id)
+{
+	objset_t *os = zd->zd_os;
+	ztest_od_t *od;
+	dnode_t *dn;
+	dmu_tx_t *tx;
+	blkptr_t *bps;
+	uint64_t blocksize = ztest_random_blocksize();
+	uint64_t nblocks = ztest_random(8) + 1;
+	uint64_t size;
+	uint64_t txg;
+	size_t nbps;
+	void *buf, *cbuf;
+
+	if (!spa_feature_is_enabled(zd->zd_os->os_spa,
+	    SPA_FEATURE_BLOCK_CLONING))
+		return;
+
+	od = umem_alloc(2 * sizeof (ztest_od_t), UMEM_NOFAIL);
+	ztest_od_init(&od[0], id, FTAG, 0, DMU_OT_UINT64_OTHER, blocksize,
+	    0, 0);
+	ztest_od_init(&od[1], id, FTAG, 1, DMU_OT_UINT64_OTHER, blocksize,
+	    0, 0);
+
+	if (ztest_object_init(zd, od, 2 * sizeof (ztest_od_t), B_TRUE) != 0 ||
+	    od[0].od_blocksize != od[1].od_blocksize) {
+		umem_free(od, 2 * sizeof (ztest_od_t));
+		return;
+	}
+
+	/* Clones are made of whole blocks of the size actually in use. */
+	blocksize = od[0].od_blocksize;
+	size = nblocks * blocksize;
+
+	buf = umem_alloc(size, UMEM_NOFAIL);
+	cbuf = umem_alloc(size, UMEM_NOFAIL);
+	bps = umem_alloc(nblocks * sizeof (blkptr_t), UMEM_NOFAIL);
+
+	for (uint64_t i = 0; i < size / sizeof (uint64_t); i++)
+		((uint64_t *)buf)[i] = ztest_random(-1ULL);
+
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_write(tx, od[0].od_object, 0, size);
+	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
+	if (txg == 0)
+		goto out;
+	dmu_write(os, od[0].od_object, 0, size, buf, tx);
+	dmu_tx_commit(tx);
+
+	/* Only blocks which reached the disk can be cloned. */
+	txg_wait_synced(dmu_objset_pool(os), txg);
+
+	nbps = nblocks;
+	if (dmu_read_l0_bps(os, od[0].od_object, 0, size, bps, &nbps) != 0)
+		goto out;
+	ASSERT3U(nbps, ==, nblocks);
+
+	VERIFY0(dnode_hold(os, od[1].od_object, FTAG, &dn));
+	tx = dmu_tx_create(os);
+	dmu_tx_hold_clone_by_dnode(tx, dn, 0, size);
+	txg = ztest_tx_assign(tx, TXG_WAIT, FTAG);
+	if (txg == 0) {
+		dnode_rele(dn, FTAG);
+		goto out;
+	}
+	dmu_brt_clone(os, od[1].od_object, 0, size, tx, bps, nbps);
+	dmu_tx_commit(tx);
+	dnode_rele(dn, FTAG);
+
+	txg_wait_synced(dmu_objset_pool(os), txg);
+
+	VERIFY0(dmu_read(os, od[1].od_object, 0, size, cbuf,
+	    DMU_READ_NO_PREFETCH));
+	VERIFY0(memcmp(buf, cbuf, size));
+out:
+	umem_free(bps, nblocks * sizeof (blkptr_t));
+	umem_free(cbuf, size);
+	umem_free(buf, size);
+	umem_free(od, 2 * sizeof (ztest_od_t));
+}
+
 /*
  * Verify that zap_{create,destroy,add,remove,update} work as expected.
  */
@@ -5794,7 +5902,7 @@ ztest_verify_dnode_bt(ztest_ds_t *zd, uint64_t id)
 		dmu_object_info_t doi;
 		dmu_buf_t *db;
 
-		ztest_object_lock(zd, obj, RL_READER);
+		ztest_object_lock(zd, obj, ZTRL_READER);
 		if (dmu_bonus_hold(os, obj, FTAG, &db) != 0) {
 			ztest_object_unlock(zd, obj);
 			continue;
@@ -5848,6 +5956,8 @@ ztest_spa_prop_get_set(ztest_ds_t *zd, uint64_t id)
 	(void) pthread_rwlock_rdlock(&ztest_name_lock);
 
 	(void) ztest_spa_prop_set_uint64(ZPOOL_PROP_AUTOTRIM, ztest_random(2));
+	(void) ztest_spa_prop_set_uint64(ZPOOL_PROP_DEDUP_TABLE_QUOTA,
+	    ztest_random(4) == 0 ? ztest_random(1 << 20) : UINT64_MAX);
 
 	VERIFY0(spa_prop_get(ztest_spa, &props));
 
@@ -5859,6 +5969,30 @@ ztest_spa_prop_get_set(ztest_ds_t *zd, uint64_t id)
 	(void) pthread_rwlock_unlock(&ztest_name_lock);
 }
 
+/*
+ * Prune every unique DDT entry, so that the blocks they describe are later
+ * freed without the DDT.
+ */
+void
+ztest_ddt_prune(ztest_ds_t *zd, uint64_t id)
+{
+	(void) zd, (void) id;
+	uint64_t pruned;
+
+	(void) pthread_rwlock_rdlock(&ztest_name_lock);
+
+	int error = ddt_prune_unique_entries(ztest_spa, 0, &pruned);
+	if (error == ENOTSUP || error == ENOSPC)
+		error = 0;
+	ASSERT0(error);
+
+	if (ztest_opts.zo_verbose >= 6)
+		(void) printf("pruned %llu DDT entries\n",
+		    (u_longlong_t)pruned);
+
+	(void) pthread_rwlock_unlock(&ztest_name_lock);
+}
+
 static int
 user_release_one(const char *snapname, const char *holdname)
 {
@@ -6342,6 +6476,23 @@ ztest_scrub(ztest_ds_t *zd, uint64_t id)
 	if (error == EBUSY)
 		error = 0;
 	ASSERT0(error);
+
+	/*
+	 * Now and then follow up with a scrub of only the blocks born since
+	 * the last completed scrub.
+	 */
+	if (ztest_random(2) == 0) {
+		uint64_t last = spa->spa_scrubbed_last_txg;
+
+		error = spa_scan_range(spa, POOL_SCAN_SCRUB, last, 0);
+		if (error == 0) {
+			while (dsl_scan_scrubbing(spa_get_dsl(spa)))
+				txg_wait_synced(spa_get_dsl(spa), 0);
+			ASSERT3U(spa->spa_scrubbed_last_txg, >=, last);
+		} else if (error != EBUSY) {
+			ASSERT0(error);
+		}
+	}
 }
 
 /*
@@ -6610,6 +6761,88 @@ ztest_fletcher_incr(ztest_ds_t *zd, uint64_t id)
 	}
 }
 
+/*
+ * Lock random, often overlapping, ranges of the sharded range lock and
+ * verify that no range is ever granted to a writer and another holder.
+ */
+static void
+ztest_rangelock_shards_thread(void *arg)
+{
+	(void) arg;
+
+	for (int i = 0; i < 10000; i++) {
+		uint64_t first = ztest_random(ZTEST_RL_SLOTS);
+		uint64_t count = 1 + ztest_random(MIN(16,
+		    ZTEST_RL_SLOTS - first));
+		uint64_t off = first << SPA_MINBLOCKSHIFT;
+		uint64_t len = count << SPA_MINBLOCKSHIFT;
+		zfs_rangelock_type_t type = (ztest_random(2) == 0) ?
+		    RL_READER : RL_WRITER;
+		zfs_locked_range_t *lr;
+
+		if (ztest_random(4) == 0) {
+			lr = zfs_rangelock_tryenter(&ztest_shard_rl, off, len,
+			    type);
+			if (lr == NULL)
+				continue;
+		} else {
+			lr = zfs_rangelock_enter(&ztest_shard_rl, off, len,
+			    type);
+		}
+
+		for (uint64_t s = first; s < first + count; s++) {
+			uint32_t *slot = &ztest_shard_rl_slots[s];
+
+			if (type == RL_READER) {
+				VERIFY0(atomic_inc_32_nv(slot) &
+				    ZTEST_RL_WRITER);
+			} else {
+				VERIFY0(atomic_cas_32(slot, 0,
+				    ZTEST_RL_WRITER));
+			}
+		}
+
+		for (uint64_t s = first; s < first + count; s++) {
+			uint32_t *slot = &ztest_shard_rl_slots[s];
+
+			if (type == RL_READER) {
+				atomic_dec_32(slot);
+			} else {
+				VERIFY3U(atomic_cas_32(slot, ZTEST_RL_WRITER,
+				    0), ==, ZTEST_RL_WRITER);
+			}
+		}
+
+		zfs_rangelock_exit(lr);
+	}
+}
+
+/*
+ * Stress the sharded range lock from several threads at once, including
+ * ranges spanning multiple shards.
+ */
+void
+ztest_rangelock_shards(ztest_ds_t *zd, uint64_t id)
+{
+	(void) zd, (void) id;
+	int threads = 8;
+	hrtime_t start = gethrtime();
+
+	taskq_t *tq = taskq_create("ztest_rangelock", threads, defclsyspri,
+	    threads, threads, TASKQ_PREPOPULATE);
+	for (int t = 0; t < threads; t++) {
+		VERIFY3U(taskq_dispatch(tq, ztest_rangelock_shards_thread,
+		    NULL, TQ_SLEEP), !=, TASKQID_INVALID);
+	}
+	taskq_wait(tq);
+	taskq_destroy(tq);
+
+	if (ztest_opts.zo_verbose >= 6) {
+		(void) printf("rangelock shards: %d threads, %llu us\n",
+		    threads, (u_longlong_t)NSEC2USEC(gethrtime() - start));
+	}
+}
+
 static int
 ztest_set_global_vars(void)
 {
@@ -7526,6 +7759,8 @@ ztest_run(ztest_shared_t *zs)
 	mutex_init(&ztest_vdev_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&ztest_checkpoint_lock, NULL, MUTEX_DEFAULT, NULL);
 	VERIFY0(pthread_rwlock_init(&ztest_name_lock, NULL));
+	zfs_rangelock_init_sharded(&ztest_shard_rl, ZTEST_RL_SHARDS,
+	    SPA_MINBLOCKSHIFT + 3);
 
 	zs->zs_thread_start = gethrtime();
 	zs->zs_thread_stop =
@@ -7731,6 +7966,7 @@ ztest_run(ztest_shared_t *zs)
 	(void) pthread_rwlock_destroy(&ztest_name_lock);
 	mutex_destroy(&ztest_vdev_lock);
 	mutex_destroy(&ztest_checkpoint_lock);
+	zfs_rangelock_fini(&ztest_shard_rl);
 }
 
 static void
@@ -132,6 +132,32 @@ AC_DEFUN([ZFS_AC_KERNEL_BLK_QUEUE_DISCARD], [
 	])
 ])
 
+dnl #
+dnl # 5.19: bdev_write_cache() available
+dnl # 4.7: QUEUE_FLAG_WC tested directly in the queue flags
+dnl #
+AC_DEFUN([ZFS_AC_KERNEL_SRC_BDEV_WRITE_CACHE], [
+	ZFS_LINUX_TEST_SRC([bdev_write_cache], [
+		#include <linux/blkdev.h>
+	],[
+		struct block_device *bdev __attribute__ ((unused)) = NULL;
+		bool wc __attribute__ ((unused));
+
+		wc = bdev_write_cache(bdev);
+	])
+])
+
+AC_DEFUN([ZFS_AC_KERNEL_BDEV_WRITE_CACHE], [
+	AC_MSG_CHECKING([whether bdev_write_cache() is available])
+	ZFS_LINUX_TEST_RESULT([bdev_write_cache], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_BDEV_WRITE_CACHE, 1,
+		    [bdev_write_cache() is available])
+	],[
+		AC_MSG_RESULT(no)
+	])
+])
+
 dnl #
 dnl # 5.19: bdev_max_secure_erase_sectors() available
 dnl # 4.8: blk_queue_secure_erase() available
@@ -395,6 +421,7 @@ AC_DEFUN([ZFS_AC_KERNEL_SRC_BLK_QUEUE], [
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_UPDATE_READAHEAD
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_DISCARD
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_SECURE_ERASE
+	ZFS_AC_KERNEL_SRC_BDEV_WRITE_CACHE
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_FLAG_SET
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_FLAG_CLEAR
 	ZFS_AC_KERNEL_SRC_BLK_QUEUE_FLUSH
@@ -409,6 +436,7 @@ AC_DEFUN([ZFS_AC_KERNEL_BLK_QUEUE], [
 	ZFS_AC_KERNEL_BLK_QUEUE_UPDATE_READAHEAD
 	ZFS_AC_KERNEL_BLK_QUEUE_DISCARD
 	ZFS_AC_KERNEL_BLK_QUEUE_SECURE_ERASE
+	ZFS_AC_KERNEL_BDEV_WRITE_CACHE
 	ZFS_AC_KERNEL_BLK_QUEUE_FLAG_SET
 	ZFS_AC_KERNEL_BLK_QUEUE_FLAG_CLEAR
 	ZFS_AC_KERNEL_BLK_QUEUE_FLUSH
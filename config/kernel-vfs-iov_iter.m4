@@ -93,6 +93,43 @@ AC_DEFUN([ZFS_AC_KERNEL_SRC_VFS_IOV_ITER], [
 		struct iov_iter iter = { 0 };
 		__attribute__((unused)) enum iter_type i = iov_iter_type(&iter);
 	])
+
+	ZFS_LINUX_TEST_SRC([iov_iter_get_pages2], [
+		#include <linux/uio.h>
+	],[
+		struct iov_iter iter = { 0 };
+		struct page **pages = NULL;
+		size_t maxsize = 4096;
+		unsigned maxpages = 1;
+		size_t start;
+		ssize_t ret __attribute__ ((unused));
+
+		ret = iov_iter_get_pages2(&iter, pages, maxsize, maxpages,
+		    &start);
+	])
+
+	ZFS_LINUX_TEST_SRC([iov_iter_get_pages], [
+		#include <linux/uio.h>
+	],[
+		struct iov_iter iter = { 0 };
+		struct page **pages = NULL;
+		size_t maxsize = 4096;
+		unsigned maxpages = 1;
+		size_t start;
+		ssize_t ret __attribute__ ((unused));
+
+		ret = iov_iter_get_pages(&iter, pages, maxsize, maxpages,
+		    &start);
+	])
+
+	ZFS_LINUX_TEST_SRC([user_backed_iter], [
+		#include <linux/uio.h>
+	],[
+		struct iov_iter iter = { 0 };
+		bool ret __attribute__ ((unused));
+
+		ret = user_backed_iter(&iter);
+	])
 ])
 
 AC_DEFUN([ZFS_AC_KERNEL_VFS_IOV_ITER], [
@@ -191,6 +228,41 @@ AC_DEFUN([ZFS_AC_KERNEL_VFS_IOV_ITER], [
 		AC_MSG_RESULT(no)
 	])
 
+	dnl #
+	dnl # Kernel 6.0 changed iov_iter_get_pages() to iov_iter_get_pages2(),
+	dnl # which also advances the iov_iter.  Either is used to pin user
+	dnl # pages for Direct I/O, without them a bounce buffer is used.
+	dnl #
+	AC_MSG_CHECKING([whether iov_iter_get_pages2() is available])
+	ZFS_LINUX_TEST_RESULT([iov_iter_get_pages2], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_IOV_ITER_GET_PAGES2, 1,
+		    [iov_iter_get_pages2() is available])
+	],[
+		AC_MSG_RESULT(no)
+		AC_MSG_CHECKING([whether iov_iter_get_pages() is available])
+		ZFS_LINUX_TEST_RESULT([iov_iter_get_pages], [
+			AC_MSG_RESULT(yes)
+			AC_DEFINE(HAVE_IOV_ITER_GET_PAGES, 1,
+			    [iov_iter_get_pages() is available])
+		],[
+			AC_MSG_RESULT(no)
+		])
+	])
+
+	dnl #
+	dnl # Kernel 6.1 added user_backed_iter(), before that only iovec
+	dnl # iov_iters are backed by user memory.
+	dnl #
+	AC_MSG_CHECKING([whether user_backed_iter() is available])
+	ZFS_LINUX_TEST_RESULT([user_backed_iter], [
+		AC_MSG_RESULT(yes)
+		AC_DEFINE(HAVE_USER_BACKED_ITER, 1,
+		    [user_backed_iter() is available])
+	],[
+		AC_MSG_RESULT(no)
+	])
+
 	dnl #
 	dnl # As of the 4.9 kernel support is provided for iovecs, kvecs,
 	dnl # bvecs and pipes in the iov_iter structure.  As long as the
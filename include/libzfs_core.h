@@ -155,6 +155,10 @@ _LIBZFS_CORE_H int lzc_get_bootenv(const char *, nvlist_t **);
 _LIBZFS_CORE_H int lzc_get_vdev_prop(const char *, nvlist_t *, nvlist_t **);
 _LIBZFS_CORE_H int lzc_set_vdev_prop(const char *, nvlist_t *, nvlist_t **);
 
+_LIBZFS_CORE_H int lzc_ddt_prune(const char *, uint64_t, uint64_t *);
+_LIBZFS_CORE_H int lzc_scrub(const char *, pool_scan_func_t, pool_scrub_cmd_t,
+    uint64_t, uint64_t);
+
 #ifdef	__cplusplus
 }
 #endif
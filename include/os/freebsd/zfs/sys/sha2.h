@@ -160,6 +160,94 @@ SHA2Final(void *p, SHA2_CTX *c)
 	}
 }
 
+/*
+ * The kernel uses the crypto(9) SHA-2 implementation, so there is only a
+ * single implementation to select.
+ */
+static inline int
+sha256_get_impl_count(void)
+{
+	return (1);
+}
+
+static inline int
+sha256_get_impl_id(void)
+{
+	return (0);
+}
+
+static inline const char *
+sha256_get_impl_name(void)
+{
+	return ("generic");
+}
+
+static inline void
+sha256_set_impl_fastest(uint32_t id)
+{
+	(void) id;
+}
+
+static inline void
+sha256_set_impl_id(uint32_t id)
+{
+	(void) id;
+}
+
+static inline int
+sha256_set_impl_name(const char *name)
+{
+	return (strcmp(name, "generic") == 0 ||
+	    strcmp(name, "fastest") == 0 ? 0 : -EINVAL);
+}
+
+static inline void
+sha256_setup_impl(void)
+{
+}
+
+static inline int
+sha512_get_impl_count(void)
+{
+	return (1);
+}
+
+static inline int
+sha512_get_impl_id(void)
+{
+	return (0);
+}
+
+static inline const char *
+sha512_get_impl_name(void)
+{
+	return ("generic");
+}
+
+static inline void
+sha512_set_impl_fastest(uint32_t id)
+{
+	(void) id;
+}
+
+static inline void
+sha512_set_impl_id(uint32_t id)
+{
+	(void) id;
+}
+
+static inline int
+sha512_set_impl_name(const char *name)
+{
+	return (strcmp(name, "generic") == 0 ||
+	    strcmp(name, "fastest") == 0 ? 0 : -EINVAL);
+}
+
+static inline void
+sha512_setup_impl(void)
+{
+}
+
 #ifdef _SHA2_IMPL
 /*
  * The following types/functions are all private to the implementation
@@ -542,6 +542,27 @@ bdev_secure_discard_supported(struct block_device *bdev)
 #endif
 }
 
+/*
+ * 5.19 API,
+ *   bdev_write_cache()
+ *
+ * 4.7 API,
+ *   QUEUE_FLAG_WC
+ *
+ * Older kernels are assumed to always have a volatile write cache.
+ */
+static inline boolean_t
+bdev_write_cache_enabled(struct block_device *bdev)
+{
+#if defined(HAVE_BDEV_WRITE_CACHE)
+	return (!!bdev_write_cache(bdev));
+#elif defined(QUEUE_FLAG_WC)
+	return (!!test_bit(QUEUE_FLAG_WC, &bdev_get_queue(bdev)->queue_flags));
+#else
+	return (B_TRUE);
+#endif
+}
+
 /*
  * A common holder for vdev_bdev_open() is used to relax the exclusive open
  * semantics slightly.  Internal vdev disk callers may pass VDEV_HOLDER to
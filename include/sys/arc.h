@@ -100,11 +100,6 @@ struct arc_prune {
 	zfs_refcount_t		p_refcnt;
 };
 
-typedef enum arc_strategy {
-	ARC_STRATEGY_META_ONLY		= 0, /* Evict only meta data buffers */
-	ARC_STRATEGY_META_BALANCED	= 1, /* Evict data buffers if needed */
-} arc_strategy_t;
-
 typedef enum arc_flags
 {
 	/*
@@ -85,10 +85,16 @@ typedef struct arc_state {
 	 */
 	zfs_refcount_t arcs_esize[ARC_BUFC_NUMTYPES] ____cacheline_aligned;
 	/*
-	 * total amount of data in this state; this includes: evictable,
-	 * non-evictable, ARC_BUFC_DATA, and ARC_BUFC_METADATA.
+	 * total amount of data in this state; this includes both evictable
+	 * and non-evictable buffers, split by ARC_BUFC_DATA and
+	 * ARC_BUFC_METADATA.
 	 */
-	zfs_refcount_t arcs_size;
+	zfs_refcount_t arcs_size[ARC_BUFC_NUMTYPES] ____cacheline_aligned;
+	/*
+	 * amount of hits to the ghost lists, in bytes; used by arc_evict()
+	 * to adapt the targets of the other states
+	 */
+	wmsum_t arcs_hits[ARC_BUFC_NUMTYPES];
 } arc_state_t;
 
 typedef struct arc_callback arc_callback_t;
@@ -560,7 +566,21 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_hash_collisions;
 	kstat_named_t arcstat_hash_chains;
 	kstat_named_t arcstat_hash_chain_max;
-	kstat_named_t arcstat_p;
+	/*
+	 * Target fraction of arc_c to be used by metadata, in units of
+	 * 1/2^32 (i.e. 1ULL << 32 is 100%).
+	 */
+	kstat_named_t arcstat_meta;
+	/*
+	 * Target fraction of the data part of arc_c to be used by the MRU,
+	 * in the same units as arcstat_meta.
+	 */
+	kstat_named_t arcstat_pd;
+	/*
+	 * Target fraction of the metadata part of arc_c to be used by the
+	 * MRU, in the same units as arcstat_meta.
+	 */
+	kstat_named_t arcstat_pm;
 	kstat_named_t arcstat_c;
 	kstat_named_t arcstat_c_min;
 	kstat_named_t arcstat_c_max;
@@ -633,6 +653,16 @@ typedef struct arc_stats {
 	 * are all included in this value.
 	 */
 	kstat_named_t arcstat_anon_size;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_DATA residing in the arc_anon state.
+	 */
+	kstat_named_t arcstat_anon_data;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_METADATA residing in the arc_anon state.
+	 */
+	kstat_named_t arcstat_anon_metadata;
 	/*
 	 * Number of bytes consumed by ARC buffers that meet the
 	 * following criteria: backing buffers of type ARC_BUFC_DATA,
@@ -654,6 +684,16 @@ typedef struct arc_stats {
 	 * are all included in this value.
 	 */
 	kstat_named_t arcstat_mru_size;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_DATA residing in the arc_mru state.
+	 */
+	kstat_named_t arcstat_mru_data;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_METADATA residing in the arc_mru state.
+	 */
+	kstat_named_t arcstat_mru_metadata;
 	/*
 	 * Number of bytes consumed by ARC buffers that meet the
 	 * following criteria: backing buffers of type ARC_BUFC_DATA,
@@ -678,6 +718,16 @@ typedef struct arc_stats {
 	 * buffers *would have* consumed this number of bytes.
 	 */
 	kstat_named_t arcstat_mru_ghost_size;
+	/*
+	 * Number of bytes *would have been* consumed by ARC buffers of type
+	 * ARC_BUFC_DATA residing in the arc_mru_ghost state.
+	 */
+	kstat_named_t arcstat_mru_ghost_data;
+	/*
+	 * Number of bytes *would have been* consumed by ARC buffers of type
+	 * ARC_BUFC_METADATA residing in the arc_mru_ghost state.
+	 */
+	kstat_named_t arcstat_mru_ghost_metadata;
 	/*
 	 * Number of bytes that *would have been* consumed by ARC
 	 * buffers that are eligible for eviction, of type
@@ -697,6 +747,16 @@ typedef struct arc_stats {
 	 * are all included in this value.
 	 */
 	kstat_named_t arcstat_mfu_size;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_DATA residing in the arc_mfu state.
+	 */
+	kstat_named_t arcstat_mfu_data;
+	/*
+	 * Number of bytes consumed by ARC buffers of type
+	 * ARC_BUFC_METADATA residing in the arc_mfu state.
+	 */
+	kstat_named_t arcstat_mfu_metadata;
 	/*
 	 * Number of bytes consumed by ARC buffers that are eligible for
 	 * eviction, of type ARC_BUFC_DATA, and reside in the arc_mfu
@@ -715,6 +775,16 @@ typedef struct arc_stats {
 	 * arcstat_mru_ghost_size for more details.
 	 */
 	kstat_named_t arcstat_mfu_ghost_size;
+	/*
+	 * Number of bytes *would have been* consumed by ARC buffers of type
+	 * ARC_BUFC_DATA residing in the arc_mfu_ghost state.
+	 */
+	kstat_named_t arcstat_mfu_ghost_data;
+	/*
+	 * Number of bytes *would have been* consumed by ARC buffers of type
+	 * ARC_BUFC_METADATA residing in the arc_mfu_ghost state.
+	 */
+	kstat_named_t arcstat_mfu_ghost_metadata;
 	/*
 	 * Number of bytes that *would have been* consumed by ARC
 	 * buffers that are eligible for eviction, of type
@@ -839,10 +909,8 @@ typedef struct arc_stats {
 	kstat_named_t arcstat_loaned_bytes;
 	kstat_named_t arcstat_prune;
 	kstat_named_t arcstat_meta_used;
-	kstat_named_t arcstat_meta_limit;
 	kstat_named_t arcstat_dnode_limit;
 	kstat_named_t arcstat_meta_max;
-	kstat_named_t arcstat_meta_min;
 	kstat_named_t arcstat_async_upgrade_sync;
 	kstat_named_t arcstat_demand_hit_predictive_prefetch;
 	kstat_named_t arcstat_demand_hit_prescient_prefetch;
@@ -958,7 +1026,9 @@ typedef struct arc_evict_waiter {
 #define	ARCSTAT_BUMPDOWN(stat)	ARCSTAT_INCR(stat, -1)
 
 #define	arc_no_grow	ARCSTAT(arcstat_no_grow) /* do not grow cache size */
-#define	arc_p		ARCSTAT(arcstat_p)	/* target size of MRU */
+#define	arc_meta	ARCSTAT(arcstat_meta)	/* target frac of metadata */
+#define	arc_pd		ARCSTAT(arcstat_pd)	/* target frac of data MRU */
+#define	arc_pm		ARCSTAT(arcstat_pm)	/* target frac of meta MRU */
 #define	arc_c		ARCSTAT(arcstat_c)	/* target size of cache */
 #define	arc_c_min	ARCSTAT(arcstat_c_min)	/* min target cache size */
 #define	arc_c_max	ARCSTAT(arcstat_c_max)	/* max target cache size */
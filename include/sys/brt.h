@@ -0,0 +1,149 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright (c) 2022 by the OpenZFS contributors. All rights reserved.
+ */
+
+#ifndef _SYS_BRT_H
+#define	_SYS_BRT_H
+
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/fs/zfs.h>
+#include <sys/zio.h>
+#include <sys/dmu.h>
+#include <sys/avl.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Every top-level vdev is divided into regions of BRT_RANGESIZE bytes and
+ * for each region we keep the number of BRT entries which live in it.  This
+ * lets brt_maybe_exists() answer "definitely not cloned" for the common case
+ * without touching the on-disk table.
+ */
+#define	BRT_RANGESIZE		(64 * 1024 * 1024)
+#define	BRT_BLOCKSIZE		(32 * 1024)
+#define	BRT_NCOUNTERS_TO_NBLOCKS(n)	\
+	(((n) * sizeof (uint16_t) - 1) / BRT_BLOCKSIZE + 1)
+
+#define	BRT_LITTLE_ENDIAN	0
+#define	BRT_BIG_ENDIAN		1
+#ifdef _ZFS_LITTLE_ENDIAN
+#define	BRT_NATIVE_BYTEORDER		BRT_LITTLE_ENDIAN
+#define	BRT_NON_NATIVE_BYTEORDER	BRT_BIG_ENDIAN
+#else
+#define	BRT_NATIVE_BYTEORDER		BRT_BIG_ENDIAN
+#define	BRT_NON_NATIVE_BYTEORDER	BRT_LITTLE_ENDIAN
+#endif
+
+/*
+ * On-disk per-vdev BRT header, stored in the bonus buffer of the object
+ * holding the region entry counts.
+ */
+typedef struct brt_vdev_phys {
+	uint64_t	bvp_mos_entries;	/* ZAP object of BRT entries */
+	uint64_t	bvp_size;		/* number of region counters */
+	uint64_t	bvp_byteorder;		/* byteorder of the counters */
+	uint64_t	bvp_totalcount;		/* sum of all refcounts */
+	uint64_t	bvp_rangesize;		/* bytes covered by a counter */
+	uint64_t	bvp_usedspace;		/* space of cloned blocks */
+	uint64_t	bvp_savedspace;		/* space saved by cloning */
+} brt_vdev_phys_t;
+
+/*
+ * In-core BRT entry.  The key is the offset of the first DVA of the cloned
+ * block on its top-level vdev, the value is the number of additional
+ * references created by cloning.  A block without an entry has exactly one
+ * reference and is freed normally.
+ */
+typedef struct brt_entry {
+	uint64_t	bre_offset;
+	uint64_t	bre_refcount;
+	avl_node_t	bre_node;
+} brt_entry_t;
+
+/*
+ * Clones issued in open context, waiting to be applied in syncing context.
+ */
+typedef struct brt_pending_entry {
+	blkptr_t	bpe_bp;
+	int		bpe_count;
+	avl_node_t	bpe_node;
+} brt_pending_entry_t;
+
+typedef struct brt_vdev {
+	uint64_t	bv_vdevid;	/* top-level vdev id */
+	boolean_t	bv_initiated;	/* on-disk objects exist */
+	uint64_t	bv_mos_brtvdev;	/* object with counters and header */
+	uint64_t	bv_mos_entries;	/* ZAP object with BRT entries */
+	avl_tree_t	bv_tree;	/* entries modified in this txg */
+	uint16_t	*bv_entcount;	/* per-region entry counts */
+	uint64_t	bv_size;	/* number of entries in bv_entcount */
+	uint8_t		*bv_dirty;	/* dirty BRT_BLOCKSIZE counter blocks */
+	uint64_t	bv_nblocks;	/* number of entries in bv_dirty */
+	boolean_t	bv_meta_dirty;	/* header needs to be written */
+	boolean_t	bv_entcount_dirty; /* some counter block is dirty */
+	uint64_t	bv_totalcount;
+	uint64_t	bv_usedspace;
+	uint64_t	bv_savedspace;
+} brt_vdev_t;
+
+struct brt {
+	krwlock_t	brt_lock;
+	spa_t		*brt_spa;
+	uint64_t	brt_rangesize;
+	uint64_t	brt_usedspace;
+	uint64_t	brt_savedspace;
+	avl_tree_t	brt_pending_tree[TXG_SIZE];
+	kmutex_t	brt_pending_lock[TXG_SIZE];
+	brt_vdev_t	*brt_vdevs;
+	uint64_t	brt_nvdevs;
+};
+
+extern void brt_init(void);
+extern void brt_fini(void);
+
+extern void brt_create(spa_t *spa);
+extern int brt_load(spa_t *spa);
+extern void brt_unload(spa_t *spa);
+extern void brt_sync(spa_t *spa, uint64_t txg);
+
+extern void brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx);
+extern void brt_pending_apply(spa_t *spa, uint64_t txg);
+
+extern boolean_t brt_maybe_exists(spa_t *spa, const blkptr_t *bp);
+extern boolean_t brt_entry_decref(spa_t *spa, const blkptr_t *bp);
+extern uint64_t brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp);
+
+extern uint64_t brt_get_dspace(spa_t *spa);
+extern uint64_t brt_get_used(spa_t *spa);
+extern uint64_t brt_get_saved(spa_t *spa);
+extern uint64_t brt_get_ratio(spa_t *spa);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_BRT_H */
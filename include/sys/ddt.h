@@ -59,7 +59,8 @@ enum ddt_class {
 #define	DDT_TYPE_CURRENT		0
 
 #define	DDT_COMPRESS_BYTEORDER_MASK	0x80
-#define	DDT_COMPRESS_FUNCTION_MASK	0x7f
+#define	DDT_COMPRESS_CLASS_START_MASK	0x40	/* value has dde_class_start */
+#define	DDT_COMPRESS_FUNCTION_MASK	0x3f
 
 /*
  * On-disk ddt entry:  key (name) and physical storage (value).
@@ -125,18 +126,108 @@ struct ddt_entry {
 	struct abd	*dde_repair_abd;
 	enum ddt_type	dde_type;
 	enum ddt_class	dde_class;
+	enum ddt_type	dde_ztype;	/* location in the ZAP objects */
+	enum ddt_class	dde_zclass;
+	uint64_t	dde_class_start; /* time entered dde_class, or 0 */
 	uint8_t		dde_loading;
 	uint8_t		dde_loaded;
 	kcondvar_t	dde_cv;
 	avl_node_t	dde_node;
 };
 
+/*
+ * DDT log.
+ *
+ * Updating the DDT ZAP objects for every entry modified in a txg turns each
+ * dedup write or free into a random read-modify-write of a ZAP leaf block,
+ * which dominates txg sync time once the DDT no longer fits in the ARC.
+ * Instead, modified entries are appended to a log object and kept in
+ * memory, and the log is flushed into the ZAP objects a slice at a time
+ * over many txgs.  Each DDT has two logs: the active log receives new
+ * entries while the flushing log is drained, and they trade places once
+ * the flushing log is empty.
+ */
+#define	DDT_LOG_VERSION		1
+
+#define	DDT_LOG_FLAG_FLUSHING	(1ULL << 0)	/* log is being flushed */
+#define	DDT_LOG_FLAG_CHECKPOINT	(1ULL << 1)	/* dlh_checkpoint is valid */
+
+/*
+ * On-disk log header, stored in the bonus buffer of the log object.
+ */
+typedef struct ddt_log_header {
+	uint64_t	dlh_version;
+	uint64_t	dlh_flags;
+	uint64_t	dlh_length;	/* bytes of records in the object */
+	uint64_t	dlh_first_txg;	/* txg of the first record */
+	ddt_key_t	dlh_checkpoint;	/* last key flushed to the ZAP */
+} ddt_log_header_t;
+
+/*
+ * On-disk log record.  A record holds the complete state of the entry as
+ * of the txg it was written in, so only the last record for each key
+ * matters when the log is loaded.  It also records where the entry lives
+ * in the ZAP objects, so that flushing it doesn't need a lookup.
+ */
+typedef struct ddt_log_record {
+	uint64_t	dlr_info;
+	ddt_key_t	dlr_key;
+	ddt_phys_t	dlr_phys[DDT_PHYS_TYPES];
+} ddt_log_record_t;
+
+#define	DLR_GET_TYPE(dlr)	BF64_GET((dlr)->dlr_info, 0, 8)
+#define	DLR_SET_TYPE(dlr, x)	BF64_SET((dlr)->dlr_info, 0, 8, x)
+#define	DLR_GET_CLASS(dlr)	BF64_GET((dlr)->dlr_info, 8, 8)
+#define	DLR_SET_CLASS(dlr, x)	BF64_SET((dlr)->dlr_info, 8, 8, x)
+#define	DLR_GET_CLASS_START(dlr)	BF64_GET((dlr)->dlr_info, 16, 48)
+#define	DLR_SET_CLASS_START(dlr, x)	BF64_SET((dlr)->dlr_info, 16, 48, x)
+
+/*
+ * In-core log entry
+ */
+typedef struct ddt_log_entry {
+	ddt_key_t	ddle_key;
+	ddt_phys_t	ddle_phys[DDT_PHYS_TYPES];
+	enum ddt_type	ddle_ztype;	/* location in the ZAP objects */
+	enum ddt_class	ddle_zclass;
+	uint64_t	ddle_class_start;
+	avl_node_t	ddle_node;
+} ddt_log_entry_t;
+
+/*
+ * In-core log
+ */
+typedef struct ddt_log {
+	uint64_t	ddl_object;
+	uint64_t	ddl_flags;
+	uint64_t	ddl_length;
+	uint64_t	ddl_first_txg;
+	ddt_key_t	ddl_checkpoint;
+	avl_tree_t	ddl_tree;
+} ddt_log_t;
+
+/*
+ * The in-core entries of a DDT are spread over DDT_SHARDS trees by their
+ * checksum, each with its own lock, so that writes and frees of different
+ * blocks don't serialize on one lock per checksum.  The shard lock of an
+ * entry is taken with ddt_enter() and protects the entry itself.
+ */
+#define	DDT_SHARDS	64
+
+typedef struct ddt_shard {
+	kmutex_t	ddts_lock;
+	avl_tree_t	ddts_tree;
+} ____cacheline_aligned ddt_shard_t;
+
 /*
  * In-core ddt
+ *
+ * ddt_lock protects the log trees, the histograms and the repair tree.  It
+ * may be taken while holding a shard lock, but not the other way around.
  */
 struct ddt {
+	ddt_shard_t	*ddt_shards;
 	kmutex_t	ddt_lock;
-	avl_tree_t	ddt_tree;
 	avl_tree_t	ddt_repair_tree;
 	enum zio_checksum ddt_checksum;
 	spa_t		*ddt_spa;
@@ -146,6 +237,11 @@ struct ddt {
 	ddt_histogram_t	ddt_histogram[DDT_TYPES][DDT_CLASSES];
 	ddt_histogram_t	ddt_histogram_cache[DDT_TYPES][DDT_CLASSES];
 	ddt_object_t	ddt_object_stats[DDT_TYPES][DDT_CLASSES];
+	ddt_log_t	ddt_log[2];
+	ddt_log_t	*ddt_log_active;
+	ddt_log_t	*ddt_log_flushing;
+	uint64_t	ddt_flush_rate;		/* log entries per txg */
+	boolean_t	ddt_flush_force;	/* flush the logs completely */
 	avl_node_t	ddt_node;
 };
 
@@ -218,18 +314,22 @@ extern void ddt_get_dedup_histogram(spa_t *spa, ddt_histogram_t *ddh);
 extern void ddt_get_dedup_stats(spa_t *spa, ddt_stat_t *dds_total);
 
 extern uint64_t ddt_get_dedup_dspace(spa_t *spa);
+extern uint64_t ddt_get_ddt_dsize(spa_t *spa);
+extern boolean_t ddt_over_quota(spa_t *spa);
 extern uint64_t ddt_get_pool_dedup_ratio(spa_t *spa);
 
 extern size_t ddt_compress(void *src, uchar_t *dst, size_t s_len, size_t d_len);
 extern void ddt_decompress(uchar_t *src, void *dst, size_t s_len, size_t d_len);
 
 extern ddt_t *ddt_select(spa_t *spa, const blkptr_t *bp);
-extern void ddt_enter(ddt_t *ddt);
-extern void ddt_exit(ddt_t *ddt);
+extern void ddt_enter(ddt_t *ddt, const ddt_key_t *ddk);
+extern void ddt_exit(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_tree_empty(ddt_t *ddt);
 extern void ddt_init(void);
 extern void ddt_fini(void);
 extern ddt_entry_t *ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add);
 extern void ddt_prefetch(spa_t *spa, const blkptr_t *bp);
+extern boolean_t ddt_addref(spa_t *spa, const blkptr_t *bp);
 extern void ddt_remove(ddt_t *ddt, ddt_entry_t *dde);
 
 extern boolean_t ddt_class_contains(spa_t *spa, enum ddt_class max_class,
@@ -238,6 +338,7 @@ extern boolean_t ddt_class_contains(spa_t *spa, enum ddt_class max_class,
 extern ddt_entry_t *ddt_repair_start(ddt_t *ddt, const blkptr_t *bp);
 extern void ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde);
 
+extern int ddt_key_compare(const ddt_key_t *k1, const ddt_key_t *k2);
 extern int ddt_entry_compare(const void *x1, const void *x2);
 
 extern void ddt_create(spa_t *spa);
@@ -245,11 +346,33 @@ extern int ddt_load(spa_t *spa);
 extern void ddt_unload(spa_t *spa);
 extern void ddt_sync(spa_t *spa, uint64_t txg);
 extern int ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde);
+extern boolean_t ddt_walk_ready(spa_t *spa);
+extern int ddt_prune_unique_entries(spa_t *spa, uint64_t age,
+    uint64_t *pruned);
 extern int ddt_object_update(ddt_t *ddt, enum ddt_type type,
     enum ddt_class clazz, ddt_entry_t *dde, dmu_tx_t *tx);
 
 extern const ddt_ops_t ddt_zap_ops;
 
+extern void ddt_log_init(void);
+extern void ddt_log_fini(void);
+extern void ddt_log_alloc(ddt_t *ddt);
+extern void ddt_log_free(ddt_t *ddt);
+extern void ddt_log_name(ddt_t *ddt, uint_t n, char *name);
+extern boolean_t ddt_log_exists(ddt_t *ddt);
+extern boolean_t ddt_log_empty(ddt_t *ddt);
+extern void ddt_log_create(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx);
+extern int ddt_log_load(ddt_t *ddt);
+extern ddt_log_entry_t *ddt_log_find(ddt_t *ddt, const ddt_key_t *ddk);
+extern boolean_t ddt_log_add(ddt_t *ddt, const ddt_entry_t *dde,
+    ddt_log_record_t *dlr);
+extern void ddt_log_write(ddt_t *ddt, const ddt_log_record_t *dlr,
+    uint64_t count, dmu_tx_t *tx);
+extern void ddt_log_swap(ddt_t *ddt, dmu_tx_t *tx);
+extern void ddt_log_flushed(ddt_t *ddt, ddt_log_entry_t *ddle);
+extern void ddt_log_checkpoint(ddt_t *ddt, dmu_tx_t *tx);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -190,6 +190,7 @@ typedef enum {
 	ZFS_PROP_REDACTED,
 	ZFS_PROP_REDACT_SNAPS,
 	ZFS_PROP_SNAPSHOTS_CHANGED,
+	ZFS_PROP_DIRECT,
 	ZFS_NUM_PROPS
 } zfs_prop_t;
 
@@ -252,6 +253,9 @@ typedef enum {
 	ZPOOL_PROP_LOAD_GUID,
 	ZPOOL_PROP_AUTOTRIM,
 	ZPOOL_PROP_COMPATIBILITY,
+	ZPOOL_PROP_DEDUP_TABLE_SIZE,
+	ZPOOL_PROP_DEDUP_TABLE_QUOTA,
+	ZPOOL_PROP_LAST_SCRUBBED_TXG,
 	ZPOOL_NUM_PROPS
 } zpool_prop_t;
 
@@ -354,6 +358,29 @@ typedef enum {
 	VDEV_PROP_BYTES_TRIM,
 	VDEV_PROP_REMOVING,
 	VDEV_PROP_ALLOCATING,
+	VDEV_PROP_SEQUENTIAL,
+	VDEV_PROP_AGGREGATION_LIMIT,
+	VDEV_PROP_READ_GAP_LIMIT,
+	VDEV_PROP_SYNC_READ_MAX_ACTIVE,
+	VDEV_PROP_SYNC_WRITE_MAX_ACTIVE,
+	VDEV_PROP_ASYNC_READ_MAX_ACTIVE,
+	VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE,
+	VDEV_PROP_SCRUB_MAX_ACTIVE,
+	VDEV_PROP_REMOVAL_MAX_ACTIVE,
+	VDEV_PROP_INITIALIZING_MAX_ACTIVE,
+	VDEV_PROP_TRIM_MAX_ACTIVE,
+	VDEV_PROP_REBUILD_MAX_ACTIVE,
+	VDEV_PROP_TRIM_EXTENT_BYTES_MAX,
+	VDEV_PROP_TRIM_EXTENT_BYTES_MIN,
+	VDEV_PROP_QUEUE_DEPTH_PCT,
+	VDEV_PROP_SYNC_READ_LATENCY,
+	VDEV_PROP_SYNC_WRITE_LATENCY,
+	VDEV_PROP_ASYNC_READ_LATENCY,
+	VDEV_PROP_ASYNC_WRITE_LATENCY,
+	VDEV_PROP_QUEUE_ACTIVE,
+	VDEV_PROP_QUEUE_PENDING,
+	VDEV_PROP_AGGREGATED_IOS,
+	VDEV_PROP_UNAGGREGATED_IOS,
 	VDEV_NUM_PROPS
 } vdev_prop_t;
 
@@ -483,6 +510,12 @@ typedef enum {
 	ZFS_SYNC_DISABLED = 2
 } zfs_sync_type_t;
 
+typedef enum {
+	ZFS_DIRECT_STANDARD = 0,
+	ZFS_DIRECT_ALWAYS = 1,
+	ZFS_DIRECT_DISABLED = 2
+} zfs_direct_type_t;
+
 typedef enum {
 	ZFS_XATTR_OFF = 0,
 	ZFS_XATTR_DIR = 1,
@@ -705,6 +738,7 @@ typedef struct zpool_load_policy {
 #define	ZPOOL_CONFIG_SCAN_STATS		"scan_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_REMOVAL_STATS	"removal_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_CHECKPOINT_STATS	"checkpoint_stats" /* not on disk */
+#define	ZPOOL_CONFIG_RAIDZ_EXPAND_STATS	"raidz_expand_stats" /* not on disk */
 #define	ZPOOL_CONFIG_VDEV_STATS		"vdev_stats"	/* not stored on disk */
 #define	ZPOOL_CONFIG_INDIRECT_SIZE	"indirect_size"	/* not stored on disk */
 
@@ -770,6 +804,8 @@ typedef struct zpool_load_policy {
 #define	ZPOOL_CONFIG_SPARES		"spares"
 #define	ZPOOL_CONFIG_IS_SPARE		"is_spare"
 #define	ZPOOL_CONFIG_NPARITY		"nparity"
+#define	ZPOOL_CONFIG_RAIDZ_EXPANDING	"raidz_expanding"
+#define	ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS	"raidz_expand_txgs"
 #define	ZPOOL_CONFIG_HOSTID		"hostid"
 #define	ZPOOL_CONFIG_HOSTNAME		"hostname"
 #define	ZPOOL_CONFIG_LOADED_TIME	"initial_load_time"
@@ -887,6 +923,15 @@ typedef struct zpool_load_policy {
 #define	VDEV_TOP_ZAP_ALLOCATION_BIAS \
 	"org.zfsonlinux:allocation_bias"
 
+#define	VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE \
+	"org.openzfs:raidz_expand_state"
+#define	VDEV_TOP_ZAP_RAIDZ_EXPAND_START_TIME \
+	"org.openzfs:raidz_expand_start_time"
+#define	VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME \
+	"org.openzfs:raidz_expand_end_time"
+#define	VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED \
+	"org.openzfs:raidz_expand_bytes_copied"
+
 /* vdev metaslab allocation bias */
 #define	VDEV_ALLOC_BIAS_LOG		"log"
 #define	VDEV_ALLOC_BIAS_SPECIAL		"special"
@@ -1024,6 +1069,7 @@ typedef enum pool_scan_func {
 	POOL_SCAN_NONE,
 	POOL_SCAN_SCRUB,
 	POOL_SCAN_RESILVER,
+	POOL_SCAN_ERRORSCRUB,
 	POOL_SCAN_FUNCS
 } pool_scan_func_t;
 
@@ -1087,6 +1133,18 @@ typedef struct pool_scan_stat {
 	uint64_t	pss_pass_scrub_spent_paused;
 	uint64_t	pss_pass_issued; /* issued bytes per scan pass */
 	uint64_t	pss_issued;	/* total bytes checked by scanner */
+
+	/* error scrub values stored on disk */
+	uint64_t	pss_error_scrub_func;	/* pool_scan_func_t */
+	uint64_t	pss_error_scrub_state;	/* dsl_scan_state_t */
+	uint64_t	pss_error_scrub_start;	/* error scrub start time */
+	uint64_t	pss_error_scrub_end;	/* error scrub end time */
+	uint64_t	pss_error_scrub_examined; /* error blocks issued I/O */
+	uint64_t	pss_error_scrub_errors;	/* error scrub I/O errors */
+
+	/* error scrub values not stored on disk */
+	uint64_t	pss_error_scrub_to_be_examined; /* error blocks left */
+	uint64_t	pss_pass_error_scrub_pause; /* error scrub pause time */
 } pool_scan_stat_t;
 
 typedef struct pool_removal_stat {
@@ -1103,11 +1161,22 @@ typedef struct pool_removal_stat {
 	uint64_t prs_mapping_memory;
 } pool_removal_stat_t;
 
+typedef struct pool_raidz_expand_stat {
+	uint64_t pres_state; /* dsl_scan_state_t */
+	uint64_t pres_expanding_vdev;
+	uint64_t pres_start_time;
+	uint64_t pres_end_time;
+	uint64_t pres_to_reflow; /* bytes that need to be moved */
+	uint64_t pres_reflowed; /* bytes moved so far */
+	uint64_t pres_waiting_for_resilver;
+} pool_raidz_expand_stat_t;
+
 typedef enum dsl_scan_state {
 	DSS_NONE,
 	DSS_SCANNING,
 	DSS_FINISHED,
 	DSS_CANCELED,
+	DSS_ERRORSCRUBBING,
 	DSS_NUM_STATES
 } dsl_scan_state_t;
 
@@ -1442,6 +1511,8 @@ typedef enum zfs_ioc {
 	ZFS_IOC_WAIT_FS,			/* 0x5a54 */
 	ZFS_IOC_VDEV_GET_PROPS,			/* 0x5a55 */
 	ZFS_IOC_VDEV_SET_PROPS,			/* 0x5a56 */
+	ZFS_IOC_DDT_PRUNE,			/* 0x5a57 */
+	ZFS_IOC_POOL_SCRUB,			/* 0x5a58 */
 
 	/*
 	 * Per-platform (Optional) - 8/128 numbers reserved.
@@ -1536,6 +1607,7 @@ typedef enum {
 	ZFS_ERR_BADPROP,
 	ZFS_ERR_VDEV_NOTSUP,
 	ZFS_ERR_NOT_USER_NAMESPACE,
+	ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS,
 } zfs_errno_t;
 
 /*
@@ -1560,6 +1632,7 @@ typedef enum {
 	ZPOOL_WAIT_RESILVER,
 	ZPOOL_WAIT_SCRUB,
 	ZPOOL_WAIT_TRIM,
+	ZPOOL_WAIT_RAIDZ_EXPAND,
 	ZPOOL_WAIT_NUM_ACTIVITIES
 } zpool_wait_activity_t;
 
@@ -1639,6 +1712,20 @@ typedef enum {
 #define	ZPOOL_VDEV_PROPS_SET_VDEV	"vdevprops_set_vdev"
 #define	ZPOOL_VDEV_PROPS_SET_PROPS	"vdevprops_set_props"
 
+/*
+ * The following are names used when invoking ZFS_IOC_DDT_PRUNE.
+ */
+#define	DDT_PRUNE_AGE			"ddt_prune_age"
+#define	DDT_PRUNE_PRUNED		"ddt_prune_pruned"
+
+/*
+ * The following are names used when invoking ZFS_IOC_POOL_SCRUB.
+ */
+#define	ZPOOL_SCRUB_TYPE		"scan_type"
+#define	ZPOOL_SCRUB_COMMAND		"scan_command"
+#define	ZPOOL_SCRUB_TXG_START		"scan_txg_start"
+#define	ZPOOL_SCRUB_TXG_END		"scan_txg_end"
+
 /*
  * The following are names used when invoking ZFS_IOC_WAIT_FS.
  */
@@ -423,6 +423,8 @@ struct metaslab {
 	 * facilitate efficient trimming.
 	 */
 	range_tree_t	*ms_trim;
+	uint64_t	ms_trim_passes;	/* autotrim passes over metaslab */
+	zfs_btree_t	*ms_trim_defer;	/* first pass of deferred ranges */
 
 	boolean_t	ms_condensing;	/* condensing? */
 	boolean_t	ms_condense_wanted;
@@ -529,6 +531,7 @@ struct metaslab {
 	zfs_btree_t		ms_allocatable_by_size;
 	zfs_btree_t		ms_unflushed_frees_by_size;
 	uint64_t	ms_lbas[MAX_LBAS];
+	uint64_t	ms_seq_wp;	/* sequential vdev write pointer */
 
 	metaslab_group_t *ms_group;	/* metaslab group		*/
 	avl_node_t	ms_group_node;	/* node in metaslab group tree	*/
@@ -64,6 +64,7 @@ typedef struct zilog zilog_t;
 typedef struct spa_aux_vdev spa_aux_vdev_t;
 typedef struct ddt ddt_t;
 typedef struct ddt_entry ddt_entry_t;
+typedef struct brt brt_t;
 typedef struct zbookmark_phys zbookmark_phys_t;
 
 struct bpobj;
@@ -819,6 +820,8 @@ extern void spa_l2cache_drop(spa_t *spa);
 
 /* scanning */
 extern int spa_scan(spa_t *spa, pool_scan_func_t func);
+extern int spa_scan_range(spa_t *spa, pool_scan_func_t func, uint64_t txgstart,
+    uint64_t txgend);
 extern int spa_scan_stop(spa_t *spa);
 extern int spa_scrub_pause_resume(spa_t *spa, pool_scrub_cmd_t flag);
 
@@ -938,6 +941,20 @@ typedef struct spa_iostats {
 	kstat_named_t	simple_trim_bytes_skipped;
 	kstat_named_t	simple_trim_extents_failed;
 	kstat_named_t	simple_trim_bytes_failed;
+	kstat_named_t	trim_bytes_pending;
+	kstat_named_t	trim_queue_depth;
+	kstat_named_t	scan_walk_blocks;
+	kstat_named_t	scan_walk_bytes;
+	kstat_named_t	scan_walk_time_ns;
+	kstat_named_t	scan_issue_bytes;
+	kstat_named_t	scan_issue_time_ns;
+	kstat_named_t	metaslab_loads;
+	kstat_named_t	metaslab_unloads;
+	kstat_named_t	metaslab_load_time_ns;
+	kstat_named_t	flush_issued;
+	kstat_named_t	flush_skipped;
+	kstat_named_t	bg_limit_decreases;
+	kstat_named_t	bg_limit_increases;
 } spa_iostats_t;
 
 extern void spa_stats_init(spa_t *spa);
@@ -961,6 +978,16 @@ extern void spa_iostats_trim_add(spa_t *spa, trim_type_t type,
     uint64_t extents_written, uint64_t bytes_written,
     uint64_t extents_skipped, uint64_t bytes_skipped,
     uint64_t extents_failed, uint64_t bytes_failed);
+extern void spa_iostats_scan_walk_add(spa_t *spa, uint64_t blocks,
+    uint64_t bytes, hrtime_t time);
+extern void spa_iostats_scan_issue_add(spa_t *spa, uint64_t bytes,
+    hrtime_t time);
+extern void spa_iostats_metaslab_load(spa_t *spa, hrtime_t time);
+extern void spa_iostats_metaslab_unload(spa_t *spa);
+extern void spa_iostats_flush_add(spa_t *spa, uint64_t issued,
+    uint64_t skipped);
+extern void spa_iostats_bg_limit_add(spa_t *spa, uint64_t decreases,
+    uint64_t increases);
 extern void spa_import_progress_add(spa_t *spa);
 extern void spa_import_progress_remove(uint64_t spa_guid);
 extern int spa_import_progress_set_mmp_check(uint64_t pool_guid,
@@ -1147,6 +1174,11 @@ extern void zfs_post_remove(spa_t *spa, vdev_t *vd);
 extern void zfs_post_state_change(spa_t *spa, vdev_t *vd, uint64_t laststate);
 extern void zfs_post_autoreplace(spa_t *spa, vdev_t *vd);
 extern uint64_t spa_get_errlog_size(spa_t *spa);
+extern uint64_t spa_get_last_errlog_size(spa_t *spa);
+typedef void (spa_errlog_cb_t)(spa_t *spa, const zbookmark_phys_t *zb,
+    uint64_t birth, void *arg);
+extern boolean_t spa_errlog_walk_last(spa_t *spa, uint64_t *cursorp,
+    uint64_t limit, spa_errlog_cb_t *cb, void *arg);
 extern int spa_get_errlog(spa_t *spa, void *uaddr, uint64_t *count);
 extern void spa_errlog_rotate(spa_t *spa);
 extern void spa_errlog_drain(spa_t *spa);
@@ -1166,6 +1198,8 @@ extern void vdev_cache_stat_fini(void);
 /* vdev mirror */
 extern void vdev_mirror_stat_init(void);
 extern void vdev_mirror_stat_fini(void);
+extern void vdev_queue_stat_init(void);
+extern void vdev_queue_stat_fini(void);
 
 /* Initialization and termination */
 extern void spa_init(spa_mode_t mode);
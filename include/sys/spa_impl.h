@@ -291,6 +291,8 @@ struct spa {
 	uint64_t	spa_scan_pass_start;	/* start time per pass/reboot */
 	uint64_t	spa_scan_pass_scrub_pause; /* scrub pause time */
 	uint64_t	spa_scan_pass_scrub_spent_paused; /* total paused */
+	uint64_t	spa_scan_pass_errorscrub_pause; /* error scrub pause */
+	uint64_t	spa_scrubbed_last_txg;	/* last txg fully scrubbed */
 	uint64_t	spa_scan_pass_exam;	/* examined bytes per pass */
 	uint64_t	spa_scan_pass_issued;	/* issued bytes per pass */
 
@@ -312,6 +314,9 @@ struct spa {
 	spa_removing_phys_t spa_removing_phys;
 	spa_vdev_removal_t *spa_vdev_removal;
 
+	struct vdev_raidz_expand *spa_raidz_expand; /* expansion in progress */
+	zthr_t		*spa_raidz_expand_zthr;	/* zthr doing the reflow */
+
 	spa_condensing_indirect_phys_t	spa_condensing_indirect_phys;
 	spa_condensing_indirect_t	*spa_condensing_indirect;
 	zthr_t		*spa_condense_zthr;	/* zthr doing condense. */
@@ -378,6 +383,8 @@ struct spa {
 	ddt_t		*spa_ddt[ZIO_CHECKSUM_FUNCTIONS]; /* in-core DDTs */
 	uint64_t	spa_ddt_stat_object;	/* DDT statistics */
 	uint64_t	spa_dedup_dspace;	/* Cache get_dedup_dspace() */
+	uint64_t	spa_dedup_table_quota;	/* property DDT maximum size */
+	brt_t		*spa_brt;		/* in-core BRT */
 	uint64_t	spa_dedup_checksum;	/* default dedup checksum */
 	uint64_t	spa_dspace;		/* dspace in normal class */
 	kmutex_t	spa_vdev_top_lock;	/* dueling offline/remove */
@@ -406,6 +413,7 @@ struct spa {
 	uint64_t	spa_all_vdev_zaps;	/* ZAP of per-vd ZAP obj #s */
 	spa_avz_action_t	spa_avz_action;	/* destroy/rebuild AVZ? */
 	uint64_t	spa_autotrim;		/* automatic background trim? */
+	uint64_t	spa_trim_pending;	/* bytes in ms_trim trees */
 	uint64_t	spa_errata;		/* errata issues detected */
 	spa_stats_t	spa_stats;		/* assorted spa statistics */
 	spa_keystore_t	spa_keystore;		/* loaded crypto keys */
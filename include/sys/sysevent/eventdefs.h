@@ -113,6 +113,11 @@ extern "C" {
 #define	ESC_ZFS_SCRUB_ABORT		"scrub_abort"
 #define	ESC_ZFS_SCRUB_RESUME		"scrub_resume"
 #define	ESC_ZFS_SCRUB_PAUSED		"scrub_paused"
+#define	ESC_ZFS_ERRORSCRUB_START	"errorscrub_start"
+#define	ESC_ZFS_ERRORSCRUB_FINISH	"errorscrub_finish"
+#define	ESC_ZFS_ERRORSCRUB_ABORT	"errorscrub_abort"
+#define	ESC_ZFS_ERRORSCRUB_RESUME	"errorscrub_resume"
+#define	ESC_ZFS_ERRORSCRUB_PAUSED	"errorscrub_paused"
 #define	ESC_ZFS_VDEV_SPARE		"vdev_spare"
 #define	ESC_ZFS_VDEV_AUTOEXPAND		"vdev_autoexpand"
 #define	ESC_ZFS_BOOTFS_VDEV_ATTACH	"bootfs_vdev_attach"
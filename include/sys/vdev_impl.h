@@ -73,7 +73,8 @@ typedef void	vdev_fini_func_t(vdev_t *vd);
 typedef int	vdev_open_func_t(vdev_t *vd, uint64_t *size, uint64_t *max_size,
     uint64_t *ashift, uint64_t *pshift);
 typedef void	vdev_close_func_t(vdev_t *vd);
-typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize);
+typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 typedef uint64_t vdev_min_asize_func_t(vdev_t *vd);
 typedef uint64_t vdev_min_alloc_func_t(vdev_t *vd);
 typedef void	vdev_io_start_func_t(zio_t *zio);
@@ -149,6 +150,7 @@ struct vdev_cache {
 
 typedef struct vdev_queue_class {
 	uint32_t	vqc_active;
+	hrtime_t	vqc_latency;	/* Average completion latency (ns). */
 
 	/*
 	 * Sorted by offset or timestamp, depending on if the queue is
@@ -168,6 +170,17 @@ struct vdev_queue {
 	zio_priority_t	vq_last_prio;	/* Last sent I/O priority. */
 	uint32_t	vq_ia_active;	/* Active interactive I/Os. */
 	uint32_t	vq_nia_credit;	/* Non-interactive I/Os credit. */
+	uint32_t	vq_bg_limit;	/* Latency-driven background limit. */
+	hrtime_t	vq_bg_limit_ts;	/* Last vq_bg_limit adjustment. */
+	hrtime_t	vq_sync_ts;	/* Last sync I/O completion. */
+	uint64_t	vq_aggregation_limit; /* Property, UINT64_MAX = auto. */
+	uint64_t	vq_read_gap_limit; /* Property, UINT64_MAX = auto. */
+	/* Per-class *_max_active properties, UINT64_MAX = auto. */
+	uint64_t	vq_max_active[ZIO_PRIORITY_NUM_QUEUEABLE];
+	hrtime_t	vq_read_lat[2];	/* Average small/large read latency. */
+	uint64_t	vq_read_size[2]; /* Average small/large read size. */
+	uint64_t	vq_agg_ios;	/* Aggregated I/Os issued. */
+	uint64_t	vq_unagg_ios;	/* I/Os issued without aggregation. */
 	hrtime_t	vq_io_complete_ts; /* time last i/o completed */
 	hrtime_t	vq_io_delta_ts;
 	zio_t		vq_io_search; /* used as local for stack reduction */
@@ -267,6 +280,7 @@ struct vdev {
 	vdev_stat_t	vdev_stat;	/* virtual device statistics	*/
 	vdev_stat_ex_t	vdev_stat_ex;	/* extended statistics		*/
 	boolean_t	vdev_expanding;	/* expand the vdev?		*/
+	boolean_t	vdev_rz_expanding; /* raidz is being expanded?	*/
 	boolean_t	vdev_reopening;	/* reopen in progress?		*/
 	boolean_t	vdev_nonrot;	/* true if solid state		*/
 	int		vdev_load_error; /* error on last load		*/
@@ -296,6 +310,8 @@ struct vdev {
 	uint64_t	vdev_deflate_ratio; /* deflation ratio (x512)	*/
 	uint64_t	vdev_islog;	/* is an intent log device	*/
 	uint64_t	vdev_noalloc;	/* device is passivated?	*/
+	boolean_t	vdev_sequential; /* append-only allocation?	*/
+	uint64_t	vdev_queue_depth_pct; /* alloc queue depth property */
 	uint64_t	vdev_removing;	/* device is being removed?	*/
 	boolean_t	vdev_ishole;	/* is a hole in the namespace	*/
 	uint64_t	vdev_top_zap;
@@ -339,6 +355,8 @@ struct vdev {
 	uint64_t	vdev_trim_partial;	/* requested partial TRIM */
 	uint64_t	vdev_trim_secure;	/* requested secure TRIM */
 	uint64_t	vdev_trim_action_time;	/* start and end time */
+	uint64_t	vdev_trim_extent_bytes_max; /* property or UINT64_MAX */
+	uint64_t	vdev_trim_extent_bytes_min; /* property or UINT64_MAX */
 
 	/* Rebuild related */
 	boolean_t	vdev_rebuilding;
@@ -421,7 +439,7 @@ struct vdev {
 	char		*vdev_fru;	/* physical FRU location	*/
 	uint64_t	vdev_not_present; /* not present during import	*/
 	uint64_t	vdev_unspare;	/* unspare when resilvering done */
-	boolean_t	vdev_nowritecache; /* true if flushwritecache failed */
+	boolean_t	vdev_nowritecache; /* true if no cache flush needed */
 	boolean_t	vdev_has_trim;	/* TRIM is supported		*/
 	boolean_t	vdev_has_securetrim; /* secure TRIM is supported */
 	boolean_t	vdev_checkremove; /* temporary online test	*/
@@ -592,6 +610,9 @@ extern void vdev_sync(vdev_t *vd, uint64_t txg);
 extern void vdev_sync_done(vdev_t *vd, uint64_t txg);
 extern void vdev_dirty(vdev_t *vd, int flags, void *arg, uint64_t txg);
 extern void vdev_dirty_leaves(vdev_t *vd, int flags, uint64_t txg);
+extern int vdev_uberblock_sync_list(vdev_t **svd, int svdcount,
+    struct uberblock *ub, int flags);
+extern int vdev_check_boot_reserve(spa_t *spa, vdev_t *childvd);
 
 /*
  * Available vdev types.
@@ -614,7 +635,8 @@ extern vdev_ops_t vdev_indirect_ops;
  */
 extern void vdev_default_xlate(vdev_t *vd, const range_seg64_t *logical_rs,
     range_seg64_t *physical_rs, range_seg64_t *remain_rs);
-extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize);
+extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 extern uint64_t vdev_default_min_asize(vdev_t *vd);
 extern uint64_t vdev_get_min_asize(vdev_t *vd);
 extern void vdev_set_min_asize(vdev_t *vd);
@@ -26,6 +26,8 @@
 #define	_SYS_VDEV_RAIDZ_H
 
 #include <sys/types.h>
+#include <sys/zfs_rlock.h>
+#include <sys/spa.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -35,6 +37,7 @@ struct zio;
 struct raidz_col;
 struct raidz_row;
 struct raidz_map;
+struct vdev;
 #if !defined(_KERNEL)
 struct kernel_param {};
 #endif
@@ -44,6 +47,8 @@ struct kernel_param {};
  */
 struct raidz_map *vdev_raidz_map_alloc(struct zio *, uint64_t, uint64_t,
     uint64_t);
+struct raidz_map *vdev_raidz_map_alloc_expanded(struct zio *, uint64_t,
+    uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, boolean_t);
 void vdev_raidz_map_free(struct raidz_map *);
 void vdev_raidz_generate_parity_row(struct raidz_map *, struct raidz_row *);
 void vdev_raidz_generate_parity(struct raidz_map *);
@@ -65,11 +70,109 @@ int vdev_raidz_math_reconstruct(struct raidz_map *, struct raidz_row *,
     const int *, const int *, const int);
 int vdev_raidz_impl_set(const char *);
 
+/*
+ * In-core state of a RAID-Z expansion (the "reflow" of the existing data
+ * onto the new, wider layout after a disk was attached).
+ */
+typedef struct vdev_raidz_expand {
+	uint64_t vre_vdev_id;
+
+	kmutex_t vre_lock;
+	kcondvar_t vre_cv;
+
+	/*
+	 * Next offset to issue i/o for.
+	 */
+	uint64_t vre_offset;
+
+	/*
+	 * Lowest offset of a failed expansion i/o.  The expansion will retry
+	 * from here.  Once the expansion thread notices the failure and exits,
+	 * vre_failed_offset is reset back to UINT64_MAX, and
+	 * vre_waiting_for_resilver will be set.
+	 */
+	uint64_t vre_failed_offset;
+	boolean_t vre_waiting_for_resilver;
+
+	/*
+	 * Bytes of reflow i/o which have been issued but not yet completed.
+	 */
+	uint64_t vre_outstanding_bytes;
+
+	/*
+	 * Offset that is completing each txg
+	 */
+	uint64_t vre_offset_pertxg[TXG_SIZE];
+
+	/*
+	 * Bytes copied in each txg.
+	 */
+	uint64_t vre_bytes_copied_pertxg[TXG_SIZE];
+
+	/*
+	 * The rangelock prevents normal read/write zio's from happening while
+	 * there are expansion (reflow) i/os in progress to the same offsets.
+	 */
+	zfs_rangelock_t vre_rangelock;
+
+	/*
+	 * These fields are stored on-disk in the vdev_top_zap:
+	 */
+	dsl_scan_state_t vre_state;
+	uint64_t vre_start_time;
+	uint64_t vre_end_time;
+	uint64_t vre_bytes_copied;
+} vdev_raidz_expand_t;
+
+/*
+ * The logical width of a RAID-Z vdev changes every time it is expanded.
+ * Blocks born before an expansion completed keep the logical width they
+ * were written with, so we remember the txg at which each width took
+ * effect.
+ */
+typedef struct reflow_node {
+	uint64_t re_txg;
+	uint64_t re_logical_width;
+	avl_node_t re_link;
+} reflow_node_t;
+
 typedef struct vdev_raidz {
-	int vd_logical_width;
+	/*
+	 * Number of child vdevs when this raidz vdev was created (i.e. before
+	 * any raidz expansions).
+	 */
+	int vd_original_width;
+
+	/*
+	 * The current number of child vdevs, which may be more than the
+	 * original width if an expansion is in progress or has completed.
+	 */
+	int vd_physical_width;
+
 	int vd_nparity;
+
+	/*
+	 * Tree of reflow_node_t's.  The lock protects the avl tree only.
+	 * The reflow_node_t's describe past RAIDZ expansions.  This is used to
+	 * determine the logical width of a given block based on its birth txg.
+	 */
+	avl_tree_t vd_expand_txgs;
+	kmutex_t vd_expand_lock;
+
+	/*
+	 * If this vdev is being expanded, spa_raidz_expand is set to this
+	 */
+	vdev_raidz_expand_t vn_vre;
 } vdev_raidz_t;
 
+extern int vdev_raidz_attach_check(struct vdev *);
+extern void vdev_raidz_attach_sync(void *, dmu_tx_t *);
+extern void spa_start_raidz_expansion_thread(spa_t *);
+extern int spa_raidz_expand_get_stats(spa_t *, pool_raidz_expand_stat_t *);
+extern int vdev_raidz_load(struct vdev *);
+extern void raidz_dtl_reassessed(struct vdev *);
+extern void vdev_raidz_reflow_copy_scratch(spa_t *);
+
 #ifdef	__cplusplus
 }
 #endif
@@ -30,6 +30,7 @@
 #include <sys/kstat.h>
 #include <sys/abd.h>
 #include <sys/vdev_impl.h>
+#include <sys/zfs_rlock.h>
 
 #ifdef  __cplusplus
 extern "C" {
@@ -106,6 +107,9 @@ typedef struct raidz_col {
 	uint64_t rc_devidx;		/* child device index for I/O */
 	uint64_t rc_offset;		/* device offset */
 	uint64_t rc_size;		/* I/O size */
+	int rc_shadow_devidx;		/* for double write during expansion */
+	uint64_t rc_shadow_offset;	/* for double write during expansion */
+	int rc_shadow_error;		/* for double write during expansion */
 	abd_t rc_abdstruct;		/* rc_abd probably points here */
 	abd_t *rc_abd;			/* I/O data */
 	abd_t *rc_orig_data;		/* pre-reconstruction */
@@ -138,6 +142,8 @@ typedef struct raidz_map {
 	int rm_nrows;			/* Regular row count */
 	int rm_nskip;			/* RAIDZ sectors skipped for padding */
 	int rm_skipstart;		/* Column index of padding start */
+	boolean_t rm_expanded;		/* Map of an expanded RAIDZ vdev */
+	zfs_locked_range_t *rm_lr;	/* Held while reflow in progress */
 	const raidz_impl_ops_t *rm_ops;	/* RAIDZ math operations */
 	raidz_row_t *rm_row[0];		/* flexible array of rows */
 } raidz_map_t;
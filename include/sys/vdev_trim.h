@@ -46,6 +46,8 @@ extern void vdev_autotrim_stop_wait(vdev_t *vd);
 extern void vdev_autotrim_restart(spa_t *spa);
 extern int vdev_trim_simple(vdev_t *vd, uint64_t start, uint64_t size);
 extern void vdev_trim_l2arc(spa_t *spa);
+extern uint64_t vdev_trim_queue_depth(vdev_t *vd);
+extern void vdev_trim_defer_clear(metaslab_t *msp);
 
 #ifdef	__cplusplus
 }
@@ -50,6 +50,9 @@ typedef struct zfs_rangelock {
 	kmutex_t rl_lock;
 	zfs_rangelock_cb_t *rl_cb;
 	void *rl_arg;
+	struct zfs_rangelock *rl_shards; /* per-region locks, if sharded */
+	uint_t rl_nshards;	/* number of shards */
+	uint_t rl_shard_shift;	/* log2 of offset region size */
 } zfs_rangelock_t;
 
 typedef struct zfs_locked_range {
@@ -64,9 +67,11 @@ typedef struct zfs_locked_range {
 	uint8_t lr_proxy;	/* acting for original range */
 	uint8_t lr_write_wanted; /* writer wants to lock this range */
 	uint8_t lr_read_wanted;	/* reader wants to lock this range */
+	struct zfs_locked_range *lr_next; /* next shard lock of this range */
 } zfs_locked_range_t;
 
 void zfs_rangelock_init(zfs_rangelock_t *, zfs_rangelock_cb_t *, void *);
+void zfs_rangelock_init_sharded(zfs_rangelock_t *, uint_t, uint_t);
 void zfs_rangelock_fini(zfs_rangelock_t *);
 
 zfs_locked_range_t *zfs_rangelock_enter(zfs_rangelock_t *,
@@ -35,6 +35,13 @@
 
 #define	ZVOL_EXCL	0x8
 
+/*
+ * The zvol range lock is sharded by 1 MiB regions of the volume, so that
+ * concurrent I/O to different regions doesn't contend on a single mutex.
+ */
+#define	ZVOL_RL_SHARDS		16
+#define	ZVOL_RL_SHARD_SHIFT	20
+
 /*
  * The in-core state of each volume.
  */
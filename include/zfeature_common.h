@@ -78,6 +78,10 @@ typedef enum spa_feature {
 	SPA_FEATURE_ZILSAXATTR,
 	SPA_FEATURE_HEAD_ERRLOG,
 	SPA_FEATURE_BLAKE3,
+	SPA_FEATURE_BLOCK_CLONING,
+	SPA_FEATURE_DEDUP_LOG,
+	SPA_FEATURE_DEDUP_CLASS_START,
+	SPA_FEATURE_RAIDZ_EXPANSION,
 	SPA_FEATURES
 } spa_feature_t;
 
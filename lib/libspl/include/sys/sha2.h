@@ -111,6 +111,34 @@ extern void SHA2Update(SHA2_CTX *, const void *, size_t);
 
 extern void SHA2Final(void *, SHA2_CTX *);
 
+/* return number of supported implementations */
+extern int sha256_get_impl_count(void);
+extern int sha512_get_impl_count(void);
+
+/* return id of selected implementation */
+extern int sha256_get_impl_id(void);
+extern int sha512_get_impl_id(void);
+
+/* return name of selected implementation */
+extern const char *sha256_get_impl_name(void);
+extern const char *sha512_get_impl_name(void);
+
+/* setup id as fastest implementation */
+extern void sha256_set_impl_fastest(uint32_t id);
+extern void sha512_set_impl_fastest(uint32_t id);
+
+/* set implementation by id */
+extern void sha256_set_impl_id(uint32_t id);
+extern void sha512_set_impl_id(uint32_t id);
+
+/* set implementation by name */
+extern int sha256_set_impl_name(const char *name);
+extern int sha512_set_impl_name(const char *name);
+
+/* set startup implementation */
+extern void sha256_setup_impl(void);
+extern void sha512_setup_impl(void);
+
 #ifdef _SHA2_IMPL
 /*
  * The following types/functions are all private to the implementation
@@ -339,6 +339,7 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *buf,
 		case ZPOOL_PROP_ASHIFT:
 		case ZPOOL_PROP_MAXBLOCKSIZE:
 		case ZPOOL_PROP_MAXDNODESIZE:
+		case ZPOOL_PROP_DEDUP_TABLE_SIZE:
 			if (literal)
 				(void) snprintf(buf, len, "%llu",
 				    (u_longlong_t)intval);
@@ -346,6 +347,17 @@ zpool_get_prop(zpool_handle_t *zhp, zpool_prop_t prop, char *buf,
 				(void) zfs_nicenum(intval, buf, len);
 			break;
 
+		case ZPOOL_PROP_DEDUP_TABLE_QUOTA:
+			if (intval == UINT64_MAX) {
+				(void) strlcpy(buf, "none", len);
+			} else if (literal) {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			} else {
+				(void) zfs_nicebytes(intval, buf, len);
+			}
+			break;
+
 		case ZPOOL_PROP_EXPANDSZ:
 		case ZPOOL_PROP_CHECKPOINT:
 			if (intval == 0) {
@@ -1619,6 +1631,28 @@ zpool_discard_checkpoint(zpool_handle_t *zhp)
 	return (0);
 }
 
+/*
+ * Remove unique entries from the pool's dedup tables that have been unique
+ * for at least 'age' seconds.
+ */
+int
+zpool_ddt_prune(zpool_handle_t *zhp, uint64_t age, uint64_t *pruned)
+{
+	libzfs_handle_t *hdl = zhp->zpool_hdl;
+	char errbuf[ERRBUFLEN];
+	int error;
+
+	error = lzc_ddt_prune(zhp->zpool_name, age, pruned);
+	if (error != 0) {
+		(void) snprintf(errbuf, sizeof (errbuf), dgettext(TEXT_DOMAIN,
+		    "cannot prune dedup table on '%s'"), zhp->zpool_name);
+		(void) zpool_standard_error(hdl, error, errbuf);
+		return (-1);
+	}
+
+	return (0);
+}
+
 /*
  * Add the given vdevs to the pool.  The caller must have already performed the
  * necessary verification to ensure that the vdev specification is well-formed.
@@ -2544,6 +2578,17 @@ out:
  */
 int
 zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
+{
+	return (zpool_scan_range(zhp, func, cmd, 0, 0));
+}
+
+/*
+ * Scan the pool, limiting a scrub to blocks born after txgstart and up to
+ * txgend.  Zero leaves the respective end of the range unbounded.
+ */
+int
+zpool_scan_range(zpool_handle_t *zhp, pool_scan_func_t func,
+    pool_scrub_cmd_t cmd, uint64_t txgstart, uint64_t txgend)
 {
 	zfs_cmd_t zc = {"\0"};
 	char errbuf[ERRBUFLEN];
@@ -2554,14 +2599,20 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 	zc.zc_cookie = func;
 	zc.zc_flags = cmd;
 
-	if (zfs_ioctl(hdl, ZFS_IOC_POOL_SCAN, &zc) == 0)
+	err = lzc_scrub(zhp->zpool_name, func, cmd, txgstart, txgend);
+	if (err == 0)
 		return (0);
 
-	err = errno;
+	/* Fall back to the legacy ioctl on older kernel modules. */
+	if (err == ZFS_ERR_IOC_CMD_UNAVAIL && txgstart == 0 && txgend == 0) {
+		if (zfs_ioctl(hdl, ZFS_IOC_POOL_SCAN, &zc) == 0)
+			return (0);
+		err = errno;
+	}
 
 	/* ECANCELED on a scrub means we resumed a paused scrub */
-	if (err == ECANCELED && func == POOL_SCAN_SCRUB &&
-	    cmd == POOL_SCRUB_NORMAL)
+	if (err == ECANCELED && (func == POOL_SCAN_SCRUB ||
+	    func == POOL_SCAN_ERRORSCRUB) && cmd == POOL_SCRUB_NORMAL)
 		return (0);
 
 	if (err == ENOENT && func != POOL_SCAN_NONE && cmd == POOL_SCRUB_NORMAL)
@@ -2578,6 +2629,11 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 			    dgettext(TEXT_DOMAIN, "cannot scrub %s"),
 			    zc.zc_name);
 		}
+	} else if (func == POOL_SCAN_ERRORSCRUB) {
+		assert(cmd == POOL_SCRUB_NORMAL);
+		(void) snprintf(errbuf, sizeof (errbuf),
+		    dgettext(TEXT_DOMAIN, "cannot scrub errors in %s"),
+		    zc.zc_name);
 	} else if (func == POOL_SCAN_RESILVER) {
 		assert(cmd == POOL_SCRUB_NORMAL);
 		(void) snprintf(errbuf, sizeof (errbuf), dgettext(TEXT_DOMAIN,
@@ -2598,7 +2654,17 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 		    ZPOOL_CONFIG_VDEV_TREE);
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &psc);
-		if (ps && ps->pss_func == POOL_SCAN_SCRUB &&
+		if (ps &&
+		    psc >= sizeof (pool_scan_stat_t) / sizeof (uint64_t) &&
+		    ps->pss_error_scrub_func == POOL_SCAN_ERRORSCRUB &&
+		    ps->pss_error_scrub_state == DSS_ERRORSCRUBBING) {
+			if (cmd == POOL_SCRUB_PAUSE)
+				return (zfs_error(hdl, EZFS_ERRORSCRUB_PAUSED,
+				    errbuf));
+			else
+				return (zfs_error(hdl, EZFS_ERRORSCRUBBING,
+				    errbuf));
+		} else if (ps && ps->pss_func == POOL_SCAN_SCRUB &&
 		    ps->pss_state == DSS_SCANNING) {
 			if (cmd == POOL_SCRUB_PAUSE)
 				return (zfs_error(hdl, EZFS_SCRUB_PAUSED,
@@ -2612,6 +2678,10 @@ zpool_scan(zpool_handle_t *zhp, pool_scan_func_t func, pool_scrub_cmd_t cmd)
 		return (zfs_error(hdl, EZFS_NO_SCRUB, errbuf));
 	} else if (err == ENOTSUP && func == POOL_SCAN_RESILVER) {
 		return (zfs_error(hdl, EZFS_NO_RESILVER_DEFER, errbuf));
+	} else if (err == ZFS_ERR_IOC_CMD_UNAVAIL) {
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "the loaded zfs "
+		    "module does not support scrubbing a txg range"));
+		return (zfs_error(hdl, EZFS_IOC_NOTSUPPORTED, errbuf));
 	} else {
 		return (zpool_standard_error(hdl, err, errbuf));
 	}
@@ -3284,10 +3354,14 @@ zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
 				    "device_rebuild feature must be enabled "
 				    "in order to use sequential "
 				    "reconstruction"));
+			} else if (strncmp(old_disk, "raidz", 5) == 0) {
+				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+				    "raidz_expansion feature must be enabled "
+				    "in order to attach a device to raidz"));
 			} else {
 				zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
-				    "can only attach to mirrors and top-level "
-				    "disks"));
+				    "can only attach to mirrors, raidz "
+				    "vdevs, and top-level disks"));
 			}
 		}
 		(void) zfs_error(hdl, EZFS_BADTARGET, errbuf);
@@ -3335,6 +3409,40 @@ zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
 		(void) zfs_error(hdl, EZFS_DEVOVERFLOW, errbuf);
 		break;
 
+	case ENXIO:
+		/*
+		 * The existing raidz vdev has offline children
+		 */
+		if (strncmp(old_disk, "raidz", 5) == 0) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "raidz vdev has devices that are offline or "
+			    "being replaced"));
+			(void) zfs_error(hdl, EZFS_BADDEV, errbuf);
+		} else {
+			(void) zpool_standard_error(hdl, errno, errbuf);
+		}
+		break;
+
+	case EADDRINUSE:
+		/*
+		 * The boot reserved area is already being used (FreeBSD)
+		 */
+		if (strncmp(old_disk, "raidz", 5) == 0) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "the reserved boot area needed for the expansion "
+			    "is already being used by a boot loader"));
+			(void) zfs_error(hdl, EZFS_BADDEV, errbuf);
+		} else {
+			(void) zpool_standard_error(hdl, errno, errbuf);
+		}
+		break;
+
+	case ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS:
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "a raidz expansion is already in progress"));
+		(void) zfs_error(hdl, EZFS_RAIDZ_EXPAND_IN_PROGRESS, errbuf);
+		break;
+
 	default:
 		(void) zpool_standard_error(hdl, errno, errbuf);
 	}
@@ -4949,6 +5057,10 @@ zpool_get_vdev_prop_value(nvlist_t *nvprop, vdev_prop_t prop, char *prop_name,
 		case VDEV_PROP_BYTES_FREE:
 		case VDEV_PROP_BYTES_CLAIM:
 		case VDEV_PROP_BYTES_TRIM:
+		case VDEV_PROP_QUEUE_ACTIVE:
+		case VDEV_PROP_QUEUE_PENDING:
+		case VDEV_PROP_AGGREGATED_IOS:
+		case VDEV_PROP_UNAGGREGATED_IOS:
 			if (literal) {
 				(void) snprintf(buf, len, "%llu",
 				    (u_longlong_t)intval);
@@ -4975,6 +5087,47 @@ zpool_get_vdev_prop_value(nvlist_t *nvprop, vdev_prop_t prop, char *prop_name,
 				    (u_longlong_t)intval);
 			}
 			break;
+		case VDEV_PROP_AGGREGATION_LIMIT:
+		case VDEV_PROP_READ_GAP_LIMIT:
+		case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+		case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+			if (intval == UINT64_MAX) {
+				(void) strlcpy(buf, "auto", len);
+			} else if (literal) {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			} else {
+				(void) zfs_nicebytes(intval, buf, len);
+			}
+			break;
+		case VDEV_PROP_SYNC_READ_MAX_ACTIVE:
+		case VDEV_PROP_SYNC_WRITE_MAX_ACTIVE:
+		case VDEV_PROP_ASYNC_READ_MAX_ACTIVE:
+		case VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE:
+		case VDEV_PROP_SCRUB_MAX_ACTIVE:
+		case VDEV_PROP_REMOVAL_MAX_ACTIVE:
+		case VDEV_PROP_INITIALIZING_MAX_ACTIVE:
+		case VDEV_PROP_TRIM_MAX_ACTIVE:
+		case VDEV_PROP_REBUILD_MAX_ACTIVE:
+		case VDEV_PROP_QUEUE_DEPTH_PCT:
+			if (intval == UINT64_MAX) {
+				(void) strlcpy(buf, "auto", len);
+			} else {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			}
+			break;
+		case VDEV_PROP_SYNC_READ_LATENCY:
+		case VDEV_PROP_SYNC_WRITE_LATENCY:
+		case VDEV_PROP_ASYNC_READ_LATENCY:
+		case VDEV_PROP_ASYNC_WRITE_LATENCY:
+			if (literal) {
+				(void) snprintf(buf, len, "%llu",
+				    (u_longlong_t)intval);
+			} else {
+				(void) zfs_nicetime(intval, buf, len);
+			}
+			break;
 		case VDEV_PROP_FRAGMENTATION:
 			if (intval == UINT64_MAX) {
 				(void) strlcpy(buf, "-", len);
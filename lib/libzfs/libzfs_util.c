@@ -302,6 +302,14 @@ libzfs_error_description(libzfs_handle_t *hdl)
 	case EZFS_NOT_USER_NAMESPACE:
 		return (dgettext(TEXT_DOMAIN, "the provided file "
 		    "was not a user namespace file"));
+	case EZFS_RAIDZ_EXPAND_IN_PROGRESS:
+		return (dgettext(TEXT_DOMAIN, "raidz expansion in progress"));
+	case EZFS_ERRORSCRUBBING:
+		return (dgettext(TEXT_DOMAIN, "currently error scrubbing; "
+		    "use 'zpool scrub -s' to cancel error scrub"));
+	case EZFS_ERRORSCRUB_PAUSED:
+		return (dgettext(TEXT_DOMAIN, "error scrub is paused; "
+		    "use 'zpool scrub -e' to resume error scrub"));
 	case EZFS_UNKNOWN:
 		return (dgettext(TEXT_DOMAIN, "unknown error"));
 	default:
@@ -728,6 +736,9 @@ zpool_standard_error_fmt(libzfs_handle_t *hdl, int error, const char *fmt, ...)
 	case ZFS_ERR_VDEV_NOTSUP:
 		zfs_verror(hdl, EZFS_VDEV_NOTSUP, fmt, ap);
 		break;
+	case ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS:
+		zfs_verror(hdl, EZFS_RAIDZ_EXPAND_IN_PROGRESS, fmt, ap);
+		break;
 	case ZFS_ERR_IOC_CMD_UNAVAIL:
 		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN, "the loaded zfs "
 		    "module does not support this operation. A reboot may "
@@ -1672,6 +1683,41 @@ zprop_parse_value(libzfs_handle_t *hdl, nvpair_t *elem, int prop,
 			*ivalp = UINT64_MAX;
 		}
 
+		/*
+		 * Likewise for "dedup_table_quota=none".
+		 */
+		if (type == ZFS_TYPE_POOL && isnone &&
+		    prop == ZPOOL_PROP_DEDUP_TABLE_QUOTA) {
+			*ivalp = UINT64_MAX;
+		}
+
+		/*
+		 * Likewise, per-vdev I/O tunables use UINT64_MAX for 'auto'.
+		 */
+		if (type == ZFS_TYPE_VDEV && isauto) {
+			switch (prop) {
+			case VDEV_PROP_AGGREGATION_LIMIT:
+			case VDEV_PROP_READ_GAP_LIMIT:
+			case VDEV_PROP_SYNC_READ_MAX_ACTIVE:
+			case VDEV_PROP_SYNC_WRITE_MAX_ACTIVE:
+			case VDEV_PROP_ASYNC_READ_MAX_ACTIVE:
+			case VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE:
+			case VDEV_PROP_SCRUB_MAX_ACTIVE:
+			case VDEV_PROP_REMOVAL_MAX_ACTIVE:
+			case VDEV_PROP_INITIALIZING_MAX_ACTIVE:
+			case VDEV_PROP_TRIM_MAX_ACTIVE:
+			case VDEV_PROP_REBUILD_MAX_ACTIVE:
+			case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+			case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+			case VDEV_PROP_QUEUE_DEPTH_PCT:
+				*ivalp = UINT64_MAX;
+				isauto = B_FALSE;
+				break;
+			default:
+				break;
+			}
+		}
+
 		/*
 		 * Special handling for setting 'refreservation' to 'auto'.  Use
 		 * UINT64_MAX to tell the caller to use zfs_fix_auto_resv().
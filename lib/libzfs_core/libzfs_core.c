@@ -1889,3 +1889,52 @@ lzc_get_bootenv(const char *pool, nvlist_t **outnvl)
 {
 	return (lzc_ioctl(ZFS_IOC_GET_BOOTENV, pool, NULL, outnvl));
 }
+
+/*
+ * Remove unique entries from the pool's dedup tables that have been unique
+ * for at least 'age' seconds.  The number of entries removed is returned in
+ * 'pruned', if it is not NULL.
+ */
+int
+lzc_ddt_prune(const char *pool, uint64_t age, uint64_t *pruned)
+{
+	nvlist_t *args = fnvlist_alloc();
+	nvlist_t *result = NULL;
+
+	fnvlist_add_uint64(args, DDT_PRUNE_AGE, age);
+
+	int error = lzc_ioctl(ZFS_IOC_DDT_PRUNE, pool, args, &result);
+
+	if (error == 0 && pruned != NULL)
+		*pruned = fnvlist_lookup_uint64(result, DDT_PRUNE_PRUNED);
+
+	fnvlist_free(args);
+	fnvlist_free(result);
+
+	return (error);
+}
+
+/*
+ * Start, pause or stop a scrub or resilver of the pool.  A scrub may be
+ * limited to blocks born after 'txgstart' and up to 'txgend'; zero means the
+ * respective end of the range is unbounded.
+ */
+int
+lzc_scrub(const char *pool, pool_scan_func_t func, pool_scrub_cmd_t cmd,
+    uint64_t txgstart, uint64_t txgend)
+{
+	nvlist_t *args = fnvlist_alloc();
+
+	fnvlist_add_uint64(args, ZPOOL_SCRUB_TYPE, (uint64_t)func);
+	fnvlist_add_uint64(args, ZPOOL_SCRUB_COMMAND, (uint64_t)cmd);
+	if (txgstart != 0)
+		fnvlist_add_uint64(args, ZPOOL_SCRUB_TXG_START, txgstart);
+	if (txgend != 0)
+		fnvlist_add_uint64(args, ZPOOL_SCRUB_TXG_END, txgend);
+
+	int error = lzc_ioctl(ZFS_IOC_POOL_SCRUB, pool, args, NULL);
+
+	fnvlist_free(args);
+
+	return (error);
+}
@@ -44,6 +44,8 @@
 #define	IMPL_CYCLE	(UINT32_MAX-1)
 #ifdef CAN_USE_GCM_ASM
 #define	IMPL_AVX	(UINT32_MAX-2)
+#define	IMPL_AVX2_VAES	(UINT32_MAX-3)
+#define	IMPL_AVX512_VAES	(UINT32_MAX-4)
 #endif
 #define	GCM_IMPL_READ(i) (*(volatile uint32_t *) &(i))
 static uint32_t icp_gcm_impl = IMPL_FASTEST;
@@ -54,17 +56,29 @@ static uint32_t user_sel_impl = IMPL_FASTEST;
 boolean_t gcm_avx_can_use_movbe = B_FALSE;
 /*
  * Whether to use the optimized openssl gcm and ghash implementations.
- * Set to true if module parameter icp_gcm_impl == "avx".
+ * Set to true if module parameter icp_gcm_impl == "avx", "avx2-vaes" or
+ * "avx512-vaes".
  */
 static boolean_t gcm_use_avx = B_FALSE;
 #define	GCM_IMPL_USE_AVX	(*(volatile boolean_t *)&gcm_use_avx)
+/*
+ * The assembler routines doing the bulk en/decryption of new avx contexts,
+ * a gcm_simd_impl_t.  The fastest supported ones unless set otherwise.
+ */
+static uint32_t gcm_simd_impl = GSI_OSSL_AVX;
+#define	GCM_SIMD_IMPL_READ	(*(volatile uint32_t *)&gcm_simd_impl)
 
 extern boolean_t atomic_toggle_boolean_nv(volatile boolean_t *);
 
 static inline boolean_t gcm_avx_will_work(void);
 static inline void gcm_set_avx(boolean_t);
 static inline boolean_t gcm_toggle_avx(void);
-static inline size_t gcm_simd_get_htab_size(boolean_t);
+static inline boolean_t gcm_simd_will_work(gcm_simd_impl_t);
+static inline gcm_simd_impl_t gcm_simd_fastest(void);
+static inline void gcm_set_simd_impl(gcm_simd_impl_t);
+static inline gcm_simd_impl_t gcm_ctx_simd_impl(void);
+static inline gcm_simd_impl_t gcm_sel_to_simd_impl(uint32_t);
+static inline size_t gcm_simd_get_htab_size(gcm_simd_impl_t);
 
 static int gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *, char *, size_t,
     crypto_data_t *, size_t);
@@ -647,7 +661,9 @@ gcm_init_ctx(gcm_ctx_t *gcm_ctx, char *param, size_t block_size,
 	}
 	/* Allocate Htab memory as needed. */
 	if (gcm_ctx->gcm_use_avx == B_TRUE) {
-		size_t htab_len = gcm_simd_get_htab_size(gcm_ctx->gcm_use_avx);
+		gcm_ctx->gcm_simd_impl = gcm_ctx_simd_impl();
+		size_t htab_len =
+		    gcm_simd_get_htab_size(gcm_ctx->gcm_simd_impl);
 
 		if (htab_len == 0) {
 			return (CRYPTO_MECHANISM_PARAM_INVALID);
@@ -722,7 +738,9 @@ gmac_init_ctx(gcm_ctx_t *gcm_ctx, char *param, size_t block_size,
 	}
 	/* Allocate Htab memory as needed. */
 	if (gcm_ctx->gcm_use_avx == B_TRUE) {
-		size_t htab_len = gcm_simd_get_htab_size(gcm_ctx->gcm_use_avx);
+		gcm_ctx->gcm_simd_impl = gcm_ctx_simd_impl();
+		size_t htab_len =
+		    gcm_simd_get_htab_size(gcm_ctx->gcm_simd_impl);
 
 		if (htab_len == 0) {
 			return (CRYPTO_MECHANISM_PARAM_INVALID);
@@ -829,6 +847,8 @@ gcm_impl_get_ops(void)
 		break;
 #ifdef CAN_USE_GCM_ASM
 	case IMPL_AVX:
+	case IMPL_AVX2_VAES:
+	case IMPL_AVX512_VAES:
 		/*
 		 * Make sure that we return a valid implementation while
 		 * switching to the avx implementation since there still
@@ -897,6 +917,7 @@ gcm_impl_init(void)
 		}
 #endif
 		if (GCM_IMPL_READ(user_sel_impl) == IMPL_FASTEST) {
+			gcm_set_simd_impl(gcm_simd_fastest());
 			gcm_set_avx(B_TRUE);
 		}
 	}
@@ -915,6 +936,12 @@ static const struct {
 #ifdef CAN_USE_GCM_ASM
 		{ "avx",	IMPL_AVX },
 #endif
+#ifdef CAN_USE_GCM_VAES
+		{ "avx2-vaes",	IMPL_AVX2_VAES },
+#endif
+#ifdef CAN_USE_GCM_VAES512
+		{ "avx512-vaes",	IMPL_AVX512_VAES },
+#endif
 };
 
 /*
@@ -949,8 +976,10 @@ gcm_impl_set(const char *val)
 	/* Check mandatory options */
 	for (i = 0; i < ARRAY_SIZE(gcm_impl_opts); i++) {
 #ifdef CAN_USE_GCM_ASM
-		/* Ignore avx implementation if it won't work. */
-		if (gcm_impl_opts[i].sel == IMPL_AVX && !gcm_avx_will_work()) {
+		/* Ignore avx implementations which won't work. */
+		gcm_simd_impl_t simd = gcm_sel_to_simd_impl(
+		    gcm_impl_opts[i].sel);
+		if (simd != GSI_NUM_IMPL && !gcm_simd_will_work(simd)) {
 			continue;
 		}
 #endif
@@ -974,11 +1003,13 @@ gcm_impl_set(const char *val)
 	}
 #ifdef CAN_USE_GCM_ASM
 	/*
-	 * Use the avx implementation if available and the requested one is
-	 * avx or fastest.
+	 * Use an avx implementation if available and the requested one is
+	 * one of them, or fastest, which picks the fastest supported one.
 	 */
-	if (gcm_avx_will_work() == B_TRUE &&
-	    (impl == IMPL_AVX || impl == IMPL_FASTEST)) {
+	gcm_simd_impl_t simd = (impl == IMPL_FASTEST) ?
+	    gcm_simd_fastest() : gcm_sel_to_simd_impl(impl);
+	if (simd != GSI_NUM_IMPL && gcm_simd_will_work(simd)) {
+		gcm_set_simd_impl(simd);
 		gcm_set_avx(B_TRUE);
 	} else {
 		gcm_set_avx(B_FALSE);
@@ -1015,8 +1046,10 @@ icp_gcm_impl_get(char *buffer, zfs_kernel_param_t *kp)
 	/* list mandatory options */
 	for (i = 0; i < ARRAY_SIZE(gcm_impl_opts); i++) {
 #ifdef CAN_USE_GCM_ASM
-		/* Ignore avx implementation if it won't work. */
-		if (gcm_impl_opts[i].sel == IMPL_AVX && !gcm_avx_will_work()) {
+		/* Ignore avx implementations which won't work. */
+		gcm_simd_impl_t simd = gcm_sel_to_simd_impl(
+		    gcm_impl_opts[i].sel);
+		if (simd != GSI_NUM_IMPL && !gcm_simd_will_work(simd)) {
 			continue;
 		}
 #endif
@@ -1052,6 +1085,19 @@ MODULE_PARM_DESC(icp_gcm_impl, "Select gcm implementation.");
  */
 #define	GCM_AVX_MAX_CHUNK_SIZE \
 	(((128*1024)/GCM_AVX_MIN_DECRYPT_BYTES) * GCM_AVX_MIN_DECRYPT_BYTES)
+/*
+ * The vector AES routines process 8 (AVX2) or 16 (AVX-512) blocks at once.
+ * Their chunk size is a multiple of both.
+ */
+#define	GCM_VAES_AVX2_MIN_BYTES (GCM_BLOCK_LEN * 8)
+#define	GCM_VAES_AVX512_MIN_BYTES (GCM_BLOCK_LEN * 16)
+#define	GCM_VAES_MAX_CHUNK_SIZE (128*1024)
+
+/* The openssl Htable, followed by the vector AES one if used. */
+#define	GCM_OSSL_HTAB_SIZE (2 * 6 * 2 * sizeof (uint64_t))
+#define	GCM_VAES_HTAB_SIZE (16 * 2 * sizeof (uint64_t))
+#define	GCM_VAES_HTAB(ctx) \
+	((ctx)->gcm_Htable + GCM_OSSL_HTAB_SIZE / sizeof (uint64_t))
 
 /* Clear the FPU registers since they hold sensitive internal state. */
 #define	clear_fpu_regs() clear_fpu_regs_avx()
@@ -1072,6 +1118,18 @@ MODULE_PARM_DESC(icp_gcm_impl, "Select gcm implementation.");
 static uint32_t gcm_avx_chunk_size =
 	((32 * 1024) / GCM_AVX_MIN_DECRYPT_BYTES) * GCM_AVX_MIN_DECRYPT_BYTES;
 
+#ifdef CAN_USE_GCM_VAES
+#define	GCM_VAES_CHUNK_SIZE_READ *(volatile uint32_t *) &gcm_vaes_chunk_size
+
+/*
+ * Module parameter: like gcm_avx_chunk_size, but for the vector AES
+ * routines.  They are fast enough to process a whole 128k record in about
+ * the time the openssl routines take for a default sized chunk.  Rounded
+ * down to the next GCM_VAES_AVX512_MIN_BYTES byte boundary.
+ */
+static uint32_t gcm_vaes_chunk_size = GCM_VAES_MAX_CHUNK_SIZE;
+#endif
+
 extern void clear_fpu_regs_avx(void);
 extern void gcm_xor_avx(const uint8_t *src, uint8_t *dst);
 extern void aes_encrypt_intel(const uint32_t rk[], int nr,
@@ -1087,6 +1145,23 @@ extern size_t aesni_gcm_encrypt(const uint8_t *, uint8_t *, size_t,
 extern size_t aesni_gcm_decrypt(const uint8_t *, uint8_t *, size_t,
     const void *, uint64_t *, uint64_t *);
 
+#ifdef CAN_USE_GCM_VAES
+extern void gcm_init_htab_vaes(uint64_t *htab, const uint64_t H[2]);
+
+extern size_t aes_gcm_enc_vaes_avx2(const uint8_t *, uint8_t *, size_t,
+    const void *, uint64_t *, uint64_t *, const uint64_t *);
+
+extern size_t aes_gcm_dec_vaes_avx2(const uint8_t *, uint8_t *, size_t,
+    const void *, uint64_t *, uint64_t *, const uint64_t *);
+#endif
+#ifdef CAN_USE_GCM_VAES512
+extern size_t aes_gcm_enc_vaes_avx512(const uint8_t *, uint8_t *, size_t,
+    const void *, uint64_t *, uint64_t *, const uint64_t *);
+
+extern size_t aes_gcm_dec_vaes_avx512(const uint8_t *, uint8_t *, size_t,
+    const void *, uint64_t *, uint64_t *, const uint64_t *);
+#endif
+
 static inline boolean_t
 gcm_avx_will_work(void)
 {
@@ -1114,18 +1189,181 @@ gcm_toggle_avx(void)
 	}
 }
 
-static inline size_t
-gcm_simd_get_htab_size(boolean_t simd_mode)
+static inline boolean_t
+gcm_simd_will_work(gcm_simd_impl_t impl)
+{
+	if (gcm_avx_will_work() == B_FALSE)
+		return (B_FALSE);
+
+	switch (impl) {
+	case GSI_OSSL_AVX:
+		return (B_TRUE);
+#ifdef CAN_USE_GCM_VAES
+	case GSI_VAES_AVX2:
+		return (zfs_avx2_available() && zfs_vaes_available() &&
+		    zfs_vpclmulqdq_available());
+#endif
+#ifdef CAN_USE_GCM_VAES512
+	case GSI_VAES_AVX512:
+		return (zfs_avx512f_available() && zfs_avx512bw_available() &&
+		    zfs_vaes_available() && zfs_vpclmulqdq_available());
+#endif
+	default:
+		return (B_FALSE);
+	}
+}
+
+static inline gcm_simd_impl_t
+gcm_simd_fastest(void)
 {
-	switch (simd_mode) {
-	case B_TRUE:
-		return (2 * 6 * 2 * sizeof (uint64_t));
+	int impl;
+
+	for (impl = GSI_NUM_IMPL - 1; impl > GSI_OSSL_AVX; impl--) {
+		if (gcm_simd_will_work(impl))
+			break;
+	}
+	return (impl);
+}
+
+static inline void
+gcm_set_simd_impl(gcm_simd_impl_t impl)
+{
+	atomic_swap_32(&gcm_simd_impl, impl);
+}
+
+/*
+ * Returns the bulk routines to use for a new avx context.  The "cycle"
+ * implementation cycles through all supported ones.
+ */
+static inline gcm_simd_impl_t
+gcm_ctx_simd_impl(void)
+{
+	static volatile uint32_t cycle_simd_idx = 0;
+	gcm_simd_impl_t impl;
+
+	if (GCM_IMPL_READ(icp_gcm_impl) != IMPL_CYCLE)
+		return (GCM_SIMD_IMPL_READ);
 
+	do {
+		impl = atomic_inc_32_nv(&cycle_simd_idx) % GSI_NUM_IMPL;
+	} while (!gcm_simd_will_work(impl));
+
+	return (impl);
+}
+
+/*
+ * Returns the bulk routines selected by the icp_gcm_impl value sel, or
+ * GSI_NUM_IMPL if sel doesn't select an avx implementation.
+ */
+static inline gcm_simd_impl_t
+gcm_sel_to_simd_impl(uint32_t sel)
+{
+	switch (sel) {
+	case IMPL_AVX:
+		return (GSI_OSSL_AVX);
+	case IMPL_AVX2_VAES:
+		return (GSI_VAES_AVX2);
+	case IMPL_AVX512_VAES:
+		return (GSI_VAES_AVX512);
+	default:
+		return (GSI_NUM_IMPL);
+	}
+}
+
+static inline size_t
+gcm_simd_get_htab_size(gcm_simd_impl_t impl)
+{
+	switch (impl) {
+	case GSI_OSSL_AVX:
+		return (GCM_OSSL_HTAB_SIZE);
+	case GSI_VAES_AVX2:
+	case GSI_VAES_AVX512:
+		return (GCM_OSSL_HTAB_SIZE + GCM_VAES_HTAB_SIZE);
 	default:
 		return (0);
 	}
 }
 
+/* Number of bytes to process while owning the FPU. */
+static inline size_t
+gcm_simd_chunk_size(const gcm_ctx_t *ctx)
+{
+#ifdef CAN_USE_GCM_VAES
+	if (ctx->gcm_simd_impl != GSI_OSSL_AVX)
+		return ((size_t)GCM_VAES_CHUNK_SIZE_READ);
+#else
+	(void) ctx;
+#endif
+	return ((size_t)GCM_CHUNK_SIZE_READ);
+}
+
+/* Minimum number of bytes the bulk routines process in one call. */
+static inline size_t
+gcm_simd_min_bytes(const gcm_ctx_t *ctx, boolean_t encrypt)
+{
+	switch (ctx->gcm_simd_impl) {
+	case GSI_VAES_AVX2:
+		return (GCM_VAES_AVX2_MIN_BYTES);
+	case GSI_VAES_AVX512:
+		return (GCM_VAES_AVX512_MIN_BYTES);
+	default:
+		return (encrypt ? GCM_AVX_MIN_ENCRYPT_BYTES :
+		    GCM_AVX_MIN_DECRYPT_BYTES);
+	}
+}
+
+/*
+ * Bulk encrypt as much of len bytes as the routines of ctx handle at once,
+ * updating the counter block and the GHASH.  Returns the number of bytes
+ * processed.  The caller must own the FPU.
+ */
+static inline size_t
+gcm_simd_encrypt(gcm_ctx_t *ctx, const uint8_t *in, uint8_t *out,
+    size_t len)
+{
+	const void *key = ctx->gcm_keysched;
+
+	switch (ctx->gcm_simd_impl) {
+#ifdef CAN_USE_GCM_VAES
+	case GSI_VAES_AVX2:
+		return (aes_gcm_enc_vaes_avx2(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash, GCM_VAES_HTAB(ctx)));
+#endif
+#ifdef CAN_USE_GCM_VAES512
+	case GSI_VAES_AVX512:
+		return (aes_gcm_enc_vaes_avx512(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash, GCM_VAES_HTAB(ctx)));
+#endif
+	default:
+		return (aesni_gcm_encrypt(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash));
+	}
+}
+
+/* Like gcm_simd_encrypt(), in may equal out. */
+static inline size_t
+gcm_simd_decrypt(gcm_ctx_t *ctx, const uint8_t *in, uint8_t *out,
+    size_t len)
+{
+	const void *key = ctx->gcm_keysched;
+
+	switch (ctx->gcm_simd_impl) {
+#ifdef CAN_USE_GCM_VAES
+	case GSI_VAES_AVX2:
+		return (aes_gcm_dec_vaes_avx2(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash, GCM_VAES_HTAB(ctx)));
+#endif
+#ifdef CAN_USE_GCM_VAES512
+	case GSI_VAES_AVX512:
+		return (aes_gcm_dec_vaes_avx512(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash, GCM_VAES_HTAB(ctx)));
+#endif
+	default:
+		return (aesni_gcm_decrypt(in, out, len, key, ctx->gcm_cb,
+		    ctx->gcm_ghash));
+	}
+}
+
 /*
  * Clear sensitive data in the context.
  *
@@ -1159,8 +1397,9 @@ gcm_incr_counter_block_by(gcm_ctx_t *ctx, int n)
 
 /*
  * Encrypt multiple blocks of data in GCM mode.
- * This is done in gcm_avx_chunk_size chunks, utilizing AVX assembler routines
- * if possible. While processing a chunk the FPU is "locked".
+ * This is done in gcm_avx_chunk_size (or gcm_vaes_chunk_size) chunks,
+ * utilizing AVX assembler routines if possible. While processing a chunk
+ * the FPU is "locked".
  */
 static int
 gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
@@ -1170,11 +1409,12 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 	size_t need = 0;
 	size_t done = 0;
 	uint8_t *datap = (uint8_t *)data;
-	size_t chunk_size = (size_t)GCM_CHUNK_SIZE_READ;
+	size_t chunk_size = gcm_simd_chunk_size(ctx);
+	size_t min_bytes = gcm_simd_min_bytes(ctx, B_TRUE);
 	const aes_key_t *key = ((aes_key_t *)ctx->gcm_keysched);
-	uint64_t *ghash = ctx->gcm_ghash;
 	uint64_t *cb = ctx->gcm_cb;
 	uint8_t *ct_buf = NULL;
+	size_t ct_buf_len = 0;
 	uint8_t *tmp = (uint8_t *)ctx->gcm_tmp;
 	int rv = CRYPTO_SUCCESS;
 
@@ -1204,9 +1444,13 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 		}
 	}
 
-	/* Allocate a buffer to encrypt to if there is enough input. */
-	if (bleft >= GCM_AVX_MIN_ENCRYPT_BYTES) {
-		ct_buf = vmem_alloc(chunk_size, KM_SLEEP);
+	/*
+	 * Allocate a buffer to encrypt to if there is enough input, no
+	 * larger than needed, since the chunk size may exceed the record.
+	 */
+	if (bleft >= min_bytes) {
+		ct_buf_len = MIN(bleft, chunk_size);
+		ct_buf = vmem_alloc(ct_buf_len, KM_SLEEP);
 		if (ct_buf == NULL) {
 			return (CRYPTO_HOST_MEMORY);
 		}
@@ -1234,8 +1478,7 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 	/* Do the bulk encryption in chunk_size blocks. */
 	for (; bleft >= chunk_size; bleft -= chunk_size) {
 		kfpu_begin();
-		done = aesni_gcm_encrypt(
-		    datap, ct_buf, chunk_size, key, cb, ghash);
+		done = gcm_simd_encrypt(ctx, datap, ct_buf, chunk_size);
 
 		clear_fpu_regs();
 		kfpu_end();
@@ -1257,8 +1500,8 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 	}
 	/* Bulk encrypt the remaining data. */
 	kfpu_begin();
-	if (bleft >= GCM_AVX_MIN_ENCRYPT_BYTES) {
-		done = aesni_gcm_encrypt(datap, ct_buf, bleft, key, cb, ghash);
+	if (bleft >= min_bytes) {
+		done = gcm_simd_encrypt(ctx, datap, ct_buf, bleft);
 		if (done == 0) {
 			rv = CRYPTO_FAILED;
 			goto out;
@@ -1273,7 +1516,7 @@ gcm_mode_encrypt_contiguous_blocks_avx(gcm_ctx_t *ctx, char *data,
 		bleft -= done;
 
 	}
-	/* Less than GCM_AVX_MIN_ENCRYPT_BYTES remain, operate on blocks. */
+	/* Less than min_bytes remain, operate on blocks. */
 	while (bleft > 0) {
 		if (bleft < block_size) {
 			memcpy(ctx->gcm_remainder, datap, bleft);
@@ -1302,7 +1545,7 @@ out:
 	kfpu_end();
 out_nofpu:
 	if (ct_buf != NULL) {
-		vmem_free(ct_buf, chunk_size);
+		vmem_free(ct_buf, ct_buf_len);
 	}
 	return (rv);
 }
@@ -1381,7 +1624,8 @@ gcm_decrypt_final_avx(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size)
 	ASSERT3U(ctx->gcm_processed_data_len, ==, ctx->gcm_pt_buf_len);
 	ASSERT3U(block_size, ==, 16);
 
-	size_t chunk_size = (size_t)GCM_CHUNK_SIZE_READ;
+	size_t chunk_size = gcm_simd_chunk_size(ctx);
+	size_t min_bytes = gcm_simd_min_bytes(ctx, B_FALSE);
 	size_t pt_len = ctx->gcm_processed_data_len - ctx->gcm_tag_len;
 	uint8_t *datap = ctx->gcm_pt_buf;
 	const aes_key_t *key = ((aes_key_t *)ctx->gcm_keysched);
@@ -1394,12 +1638,12 @@ gcm_decrypt_final_avx(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size)
 	/*
 	 * Decrypt in chunks of gcm_avx_chunk_size, which is asserted to be
 	 * greater or equal than GCM_AVX_MIN_ENCRYPT_BYTES, and a multiple of
-	 * GCM_AVX_MIN_DECRYPT_BYTES.
+	 * GCM_AVX_MIN_DECRYPT_BYTES (or of gcm_vaes_chunk_size, a multiple
+	 * of both GCM_VAES_*_MIN_BYTES).
 	 */
 	for (bleft = pt_len; bleft >= chunk_size; bleft -= chunk_size) {
 		kfpu_begin();
-		done = aesni_gcm_decrypt(datap, datap, chunk_size,
-		    (const void *)key, ctx->gcm_cb, ghash);
+		done = gcm_simd_decrypt(ctx, datap, datap, chunk_size);
 		clear_fpu_regs();
 		kfpu_end();
 		if (done != chunk_size) {
@@ -1409,9 +1653,8 @@ gcm_decrypt_final_avx(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size)
 	}
 	/* Decrypt remainder, which is less than chunk size, in one go. */
 	kfpu_begin();
-	if (bleft >= GCM_AVX_MIN_DECRYPT_BYTES) {
-		done = aesni_gcm_decrypt(datap, datap, bleft,
-		    (const void *)key, ctx->gcm_cb, ghash);
+	if (bleft >= min_bytes) {
+		done = gcm_simd_decrypt(ctx, datap, datap, bleft);
 		if (done == 0) {
 			clear_fpu_regs();
 			kfpu_end();
@@ -1420,11 +1663,10 @@ gcm_decrypt_final_avx(gcm_ctx_t *ctx, crypto_data_t *out, size_t block_size)
 		datap += done;
 		bleft -= done;
 	}
-	ASSERT(bleft < GCM_AVX_MIN_DECRYPT_BYTES);
+	ASSERT3U(bleft, <, min_bytes);
 
 	/*
-	 * Now less than GCM_AVX_MIN_DECRYPT_BYTES bytes remain,
-	 * decrypt them block by block.
+	 * Now less than min_bytes bytes remain, decrypt them block by block.
 	 */
 	while (bleft > 0) {
 		/* Incomplete last block. */
@@ -1494,7 +1736,7 @@ gcm_init_avx(gcm_ctx_t *ctx, unsigned char *iv, size_t iv_len,
 	const void *keysched = ((aes_key_t *)ctx->gcm_keysched)->encr_ks.ks32;
 	int aes_rounds = ((aes_key_t *)ctx->gcm_keysched)->nr;
 	uint8_t *datap = auth_data;
-	size_t chunk_size = (size_t)GCM_CHUNK_SIZE_READ;
+	size_t chunk_size = gcm_simd_chunk_size(ctx);
 	size_t bleft;
 
 	ASSERT(block_size == GCM_BLOCK_LEN);
@@ -1507,6 +1749,10 @@ gcm_init_avx(gcm_ctx_t *ctx, unsigned char *iv, size_t iv_len,
 	    (const uint32_t *)H, (uint32_t *)H);
 
 	gcm_init_htab_avx(ctx->gcm_Htable, H);
+#ifdef CAN_USE_GCM_VAES
+	if (ctx->gcm_simd_impl != GSI_OSSL_AVX)
+		gcm_init_htab_vaes(GCM_VAES_HTAB(ctx), H);
+#endif
 
 	if (iv_len == 12) {
 		memcpy(cb, iv, 12);
@@ -1591,5 +1837,34 @@ module_param_call(icp_gcm_avx_chunk_size, icp_gcm_avx_set_chunk_size,
 MODULE_PARM_DESC(icp_gcm_avx_chunk_size,
 	"How many bytes to process while owning the FPU");
 
+#ifdef CAN_USE_GCM_VAES
+static int
+icp_gcm_vaes_set_chunk_size(const char *buf, zfs_kernel_param_t *kp)
+{
+	unsigned long val;
+	char val_rounded[16];
+	int error = 0;
+
+	error = kstrtoul(buf, 0, &val);
+	if (error)
+		return (error);
+
+	val = (val / GCM_VAES_AVX512_MIN_BYTES) * GCM_VAES_AVX512_MIN_BYTES;
+
+	if (val < GCM_VAES_AVX512_MIN_BYTES || val > GCM_VAES_MAX_CHUNK_SIZE)
+		return (-EINVAL);
+
+	snprintf(val_rounded, 16, "%u", (uint32_t)val);
+	error = param_set_uint(val_rounded, kp);
+	return (error);
+}
+
+module_param_call(icp_gcm_vaes_chunk_size, icp_gcm_vaes_set_chunk_size,
+    param_get_uint, &gcm_vaes_chunk_size, 0644);
+
+MODULE_PARM_DESC(icp_gcm_vaes_chunk_size,
+	"How many bytes to process while owning the FPU (vaes)");
+#endif
+
 #endif /* defined(__KERNEL) */
 #endif /* ifdef CAN_USE_GCM_ASM */
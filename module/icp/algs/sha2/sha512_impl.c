@@ -0,0 +1,289 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/simd.h>
+#define	_SHA2_IMPL
+#include <sys/sha2.h>
+#include <sha2/sha2_impl.h>
+
+#if defined(__x86_64)
+extern void SHA512TransformBlocks(SHA2_CTX *ctx, const void *in, size_t num);
+
+static boolean_t
+sha512_x64_is_supported(void)
+{
+	return (B_TRUE);
+}
+
+static const sha2_ops_t sha512_x64_impl = {
+	.transform = SHA512TransformBlocks,
+	.is_supported = sha512_x64_is_supported,
+	.name = "x64"
+};
+
+#if defined(HAVE_AVX2)
+extern void zfs_sha512_transform_avx2(uint64_t state[8], const void *in,
+    size_t num);
+
+static void
+sha512_avx2_transform(SHA2_CTX *ctx, const void *in, size_t num)
+{
+	kfpu_begin();
+	zfs_sha512_transform_avx2(ctx->state.s64, in, num);
+	kfpu_end();
+}
+
+static boolean_t
+sha512_avx2_is_supported(void)
+{
+	return (kfpu_allowed() && zfs_avx2_available() &&
+	    zfs_bmi1_available() && zfs_bmi2_available());
+}
+
+static const sha2_ops_t sha512_avx2_impl = {
+	.transform = sha512_avx2_transform,
+	.is_supported = sha512_avx2_is_supported,
+	.name = "avx2"
+};
+#endif /* HAVE_AVX2 */
+#endif /* __x86_64 */
+
+/* in order of expected performance, the last supported one is preferred */
+static const sha2_ops_t *const sha512_impls[] = {
+	&sha512_generic_impl,
+#if defined(__x86_64)
+	&sha512_x64_impl,
+#if defined(HAVE_AVX2)
+	&sha512_avx2_impl,
+#endif
+#endif
+};
+
+/* this pointer holds current ops for implementation */
+static const sha2_ops_t *sha512_selected_impl = &sha512_generic_impl;
+
+/* special implementation selections */
+#define	IMPL_FASTEST	(UINT32_MAX)
+#define	IMPL_CYCLE	(UINT32_MAX-1)
+#define	IMPL_USER	(UINT32_MAX-2)
+#define	IMPL_PARAM	(UINT32_MAX-3)
+
+#define	IMPL_READ(i) (*(volatile uint32_t *) &(i))
+static uint32_t icp_sha512_impl = IMPL_FASTEST;
+
+#define	SHA2_IMPL_NAME_MAX	16
+
+/* id of fastest implementation, unless set by the benchmark the last one */
+static uint32_t sha512_fastest_id = IMPL_FASTEST;
+
+/* currently used id */
+static uint32_t sha512_current_id = 0;
+
+/* id of module parameter (-1 == unused) */
+static int sha512_param_id = -1;
+
+/* return number of supported implementations */
+int
+sha512_get_impl_count(void)
+{
+	static int impls = 0;
+	int i;
+
+	if (impls)
+		return (impls);
+
+	for (i = 0; i < ARRAY_SIZE(sha512_impls); i++) {
+		if (!sha512_impls[i]->is_supported()) continue;
+		impls++;
+	}
+
+	return (impls);
+}
+
+/* return id of selected implementation */
+int
+sha512_get_impl_id(void)
+{
+	return (sha512_current_id);
+}
+
+/* return name of selected implementation */
+const char *
+sha512_get_impl_name(void)
+{
+	return (sha512_selected_impl->name);
+}
+
+/* setup id as fastest implementation */
+void
+sha512_set_impl_fastest(uint32_t id)
+{
+	sha512_fastest_id = id;
+}
+
+/* set implementation by id */
+void
+sha512_set_impl_id(uint32_t id)
+{
+	int i, cid;
+
+	/* select fastest */
+	if (id == IMPL_FASTEST) {
+		id = sha512_fastest_id;
+		if (id == IMPL_FASTEST)
+			id = sha512_get_impl_count() - 1;
+	}
+
+	/* select next or first */
+	if (id == IMPL_CYCLE)
+		id = (++sha512_current_id) % sha512_get_impl_count();
+
+	/* 0..N for the real impl */
+	for (i = 0, cid = 0; i < ARRAY_SIZE(sha512_impls); i++) {
+		if (!sha512_impls[i]->is_supported()) continue;
+		if (cid == id) {
+			sha512_current_id = cid;
+			sha512_selected_impl = sha512_impls[i];
+			return;
+		}
+		cid++;
+	}
+}
+
+/* set implementation by name */
+int
+sha512_set_impl_name(const char *name)
+{
+	int i, cid;
+
+	if (strcmp(name, "fastest") == 0) {
+		atomic_swap_32(&icp_sha512_impl, IMPL_FASTEST);
+		sha512_set_impl_id(IMPL_FASTEST);
+		return (0);
+	} else if (strcmp(name, "cycle") == 0) {
+		atomic_swap_32(&icp_sha512_impl, IMPL_CYCLE);
+		sha512_set_impl_id(IMPL_CYCLE);
+		return (0);
+	}
+
+	for (i = 0, cid = 0; i < ARRAY_SIZE(sha512_impls); i++) {
+		if (!sha512_impls[i]->is_supported()) continue;
+		if (strcmp(name, sha512_impls[i]->name) == 0) {
+			if (icp_sha512_impl == IMPL_PARAM) {
+				sha512_param_id = cid;
+				return (0);
+			}
+			sha512_selected_impl = sha512_impls[i];
+			sha512_current_id = cid;
+			return (0);
+		}
+		cid++;
+	}
+
+	return (-EINVAL);
+}
+
+/* setup implementation */
+void
+sha512_setup_impl(void)
+{
+	switch (IMPL_READ(icp_sha512_impl)) {
+	case IMPL_PARAM:
+		sha512_set_impl_id(sha512_param_id);
+		atomic_swap_32(&icp_sha512_impl, IMPL_USER);
+		break;
+	case IMPL_FASTEST:
+		sha512_set_impl_id(IMPL_FASTEST);
+		break;
+	case IMPL_CYCLE:
+		sha512_set_impl_id(IMPL_CYCLE);
+		break;
+	default:
+		sha512_set_impl_id(sha512_current_id);
+		break;
+	}
+}
+
+/* return selected implementation */
+const sha2_ops_t *
+sha512_get_ops(void)
+{
+	/* each call to ops will cycle */
+	if (icp_sha512_impl == IMPL_CYCLE)
+		sha512_set_impl_id(IMPL_CYCLE);
+
+	return (sha512_selected_impl);
+}
+
+#if defined(_KERNEL) && defined(__linux__)
+static int
+icp_sha512_impl_set(const char *name, zfs_kernel_param_t *kp)
+{
+	char req_name[SHA2_IMPL_NAME_MAX];
+	size_t i;
+
+	/* sanitize input */
+	i = strnlen(name, SHA2_IMPL_NAME_MAX);
+	if (i == 0 || i >= SHA2_IMPL_NAME_MAX)
+		return (-EINVAL);
+
+	strlcpy(req_name, name, SHA2_IMPL_NAME_MAX);
+	while (i > 0 && isspace(req_name[i-1]))
+		i--;
+	req_name[i] = '\0';
+
+	atomic_swap_32(&icp_sha512_impl, IMPL_PARAM);
+	return (sha512_set_impl_name(req_name));
+}
+
+static int
+icp_sha512_impl_get(char *buffer, zfs_kernel_param_t *kp)
+{
+	int i, cid, cnt = 0;
+	char *fmt;
+
+	/* cycling */
+	fmt = (icp_sha512_impl == IMPL_CYCLE) ? "[cycle] " : "cycle ";
+	cnt += sprintf(buffer + cnt, fmt);
+
+	/* fastest one */
+	fmt = (icp_sha512_impl == IMPL_FASTEST) ? "[fastest] " : "fastest ";
+	cnt += sprintf(buffer + cnt, fmt);
+
+	/* user selected */
+	for (i = 0, cid = 0; i < ARRAY_SIZE(sha512_impls); i++) {
+		if (!sha512_impls[i]->is_supported()) continue;
+		fmt = (icp_sha512_impl == IMPL_USER &&
+		    cid == sha512_current_id) ? "[%s] " : "%s ";
+		cnt += sprintf(buffer + cnt, fmt, sha512_impls[i]->name);
+		cid++;
+	}
+
+	buffer[cnt] = 0;
+
+	return (cnt);
+}
+
+module_param_call(icp_sha512_impl, icp_sha512_impl_set, icp_sha512_impl_get,
+    NULL, 0644);
+MODULE_PARM_DESC(icp_sha512_impl, "Select SHA-384/512 implementation.");
+#endif
@@ -43,6 +43,28 @@ extern "C" {
     defined(HAVE_AES) && defined(HAVE_PCLMULQDQ)
 #define	CAN_USE_GCM_ASM
 extern boolean_t gcm_avx_can_use_movbe;
+
+/*
+ * The vector AES routines additionally need AVX2 (or AVX512F and AVX512BW
+ * for the 512-bit flavor), VAES and VPCLMULQDQ.
+ */
+#if defined(HAVE_AVX2) && defined(HAVE_VAES) && defined(HAVE_VPCLMULQDQ)
+#define	CAN_USE_GCM_VAES
+#if defined(HAVE_AVX512F) && defined(HAVE_AVX512BW)
+#define	CAN_USE_GCM_VAES512
+#endif
+#endif
+
+/*
+ * Assembler routines doing the bulk of the work of an avx context, in
+ * increasing order of speed.
+ */
+typedef enum gcm_simd_impl {
+	GSI_OSSL_AVX,		/* openssl aesni_gcm_{en,de}crypt() */
+	GSI_VAES_AVX2,		/* aes_gcm_{enc,dec}_vaes_avx2() */
+	GSI_VAES_AVX512,	/* aes_gcm_{enc,dec}_vaes_avx512() */
+	GSI_NUM_IMPL
+} gcm_simd_impl_t;
 #endif
 
 #define	ECB_MODE			0x00000002
@@ -201,7 +223,8 @@ typedef struct ccm_ctx {
  * gcm_H:		Subkey.
  *
  * gcm_Htable:		Pre-computed and pre-shifted H, H^2, ... H^6 for the
- *			Karatsuba Algorithm in host byte order.
+ *			Karatsuba Algorithm in host byte order, followed by
+ *			H, ... H^16 for the vector AES routines if used.
  *
  * gcm_J0:		Pre-counter block generated from the IV.
  *
@@ -229,6 +252,7 @@ typedef struct gcm_ctx {
 	uint8_t *gcm_pt_buf;
 #ifdef CAN_USE_GCM_ASM
 	boolean_t gcm_use_avx;
+	gcm_simd_impl_t gcm_simd_impl;
 #endif
 } gcm_ctx_t;
 
@@ -57,6 +57,25 @@ typedef struct sha2_hmac_ctx {
 	SHA2_CTX		hc_ocontext;	/* outer SHA2 context */
 } sha2_hmac_ctx_t;
 
+typedef void (*sha2_transform_f)(SHA2_CTX *ctx, const void *in, size_t num);
+typedef boolean_t (*sha2_is_supported_f)(void);
+
+/*
+ * Block transform implementation, processing num consecutive blocks of
+ * 64 (SHA-256) or 128 (SHA-384/512) bytes.
+ */
+typedef struct sha2_ops {
+	sha2_transform_f transform;
+	sha2_is_supported_f is_supported;
+	const char *name;
+} sha2_ops_t;
+
+extern const sha2_ops_t sha256_generic_impl;
+extern const sha2_ops_t sha512_generic_impl;
+
+extern const sha2_ops_t *sha256_get_ops(void);
+extern const sha2_ops_t *sha512_get_ops(void);
+
 #ifdef	__cplusplus
 }
 #endif
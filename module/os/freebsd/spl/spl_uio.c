@@ -105,3 +105,15 @@ zfs_uio_fault_move(void *p, size_t n, zfs_uio_rw_t dir, zfs_uio_t *uio)
 	ASSERT3U(zfs_uio_rw(uio), ==, dir);
 	return (vn_io_fault_uiomove(p, n, GET_UIO_STRUCT(uio)));
 }
+
+/*
+ * User pages are not mapped for Direct I/O, the caller copies the data
+ * through a bounce buffer instead.
+ */
+int
+zfs_uio_get_dio_abd(zfs_uio_t *uio, zfs_uio_rw_t rw, size_t n,
+    struct abd **abdp)
+{
+	(void) uio, (void) rw, (void) n, (void) abdp;
+	return (ENOTSUP);
+}
@@ -171,8 +171,9 @@ arc_prune_task(void *arg)
 /*
  * Notify registered consumers they must drop holds on a portion of the ARC
  * buffered they reference.  This provides a mechanism to ensure the ARC can
- * honor the arc_meta_limit and reclaim otherwise pinned ARC buffers.  This
- * is analogous to dnlc_reduce_cache() but more generic.
+ * reclaim otherwise pinned ARC buffers when the metadata target or the
+ * arc_dnode_limit cannot be met.  This is analogous to dnlc_reduce_cache()
+ * but more generic.
  *
  * This operation is performed asynchronously so it may be safely called
  * in the context of the arc_reclaim_thread().  A reference is taken here
@@ -43,6 +43,12 @@ static taskq_t *vdev_file_taskq;
 static unsigned long vdev_file_logical_ashift = SPA_MINBLOCKSHIFT;
 static unsigned long vdev_file_physical_ashift = SPA_MINBLOCKSHIFT;
 
+/*
+ * Treat file vdevs as devices without a volatile write cache, so that cache
+ * flushes are never issued to them.  This is only useful for testing.
+ */
+static int vdev_file_nowritecache = 0;
+
 void
 vdev_file_init(void)
 {
@@ -174,6 +180,9 @@ skip_open:
 	*logical_ashift = vdev_file_logical_ashift;
 	*physical_ashift = vdev_file_physical_ashift;
 
+	/* Clear or set the nowritecache bit; vdev_reopen() picks it up. */
+	vd->vdev_nowritecache = !!vdev_file_nowritecache;
+
 	return (0);
 }
 
@@ -354,3 +363,5 @@ ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, logical_ashift, ULONG, ZMOD_RW,
 	"Logical ashift for file-based devices");
 ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, physical_ashift, ULONG, ZMOD_RW,
 	"Physical ashift for file-based devices");
+ZFS_MODULE_PARAM(zfs_vdev_file, vdev_file_, nowritecache, INT, ZMOD_RW,
+	"Never flush the write cache of file-based devices");
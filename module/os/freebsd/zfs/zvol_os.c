@@ -1413,7 +1413,8 @@ zvol_os_create_minor(const char *name)
 	}
 	(void) strlcpy(zv->zv_name, name, MAXPATHLEN);
 	rw_init(&zv->zv_suspend_lock, NULL, RW_DEFAULT, NULL);
-	zfs_rangelock_init(&zv->zv_rangelock, NULL, NULL);
+	zfs_rangelock_init_sharded(&zv->zv_rangelock, ZVOL_RL_SHARDS,
+	    ZVOL_RL_SHARD_SHIFT);
 
 	if (dmu_objset_is_snapshot(os) || !spa_writeable(dmu_objset_spa(os)))
 		zv->zv_flags |= ZVOL_RDONLY;
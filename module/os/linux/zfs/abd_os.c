@@ -1143,6 +1143,57 @@ abd_bio_map_off(struct bio *bio, abd_t *abd,
 	return (io_size);
 }
 
+/*
+ * Wrap an array of pages which are not owned by the ABD layer, such as
+ * user pages pinned for Direct I/O, in a scatter ABD.  The ABD takes over
+ * the page references and drops them when it is freed.
+ */
+abd_t *
+abd_alloc_from_pages(struct page **pages, uint_t npages)
+{
+	struct scatterlist *sg = NULL;
+	struct sg_table table;
+	gfp_t gfp = __GFP_NOWARN | GFP_NOIO;
+	int i = 0;
+
+	ASSERT3U(npages, >, 0);
+	ASSERT3U(npages, <=, abd_chunkcnt_for_bytes(SPA_MAXBLOCKSIZE));
+
+	while (sg_alloc_table(&table, npages, gfp)) {
+		ABDSTAT_BUMP(abdstat_scatter_sg_table_retry);
+		schedule_timeout_interruptible(1);
+	}
+	ASSERT3U(table.nents, ==, npages);
+
+	abd_t *abd = abd_alloc_struct(npages << PAGE_SHIFT);
+	abd->abd_flags |= ABD_FLAG_FROM_PAGES;
+	abd->abd_size = npages << PAGE_SHIFT;
+	ABD_SCATTER(abd).abd_offset = 0;
+	ABD_SCATTER(abd).abd_sgl = table.sgl;
+	ABD_SCATTER(abd).abd_nents = npages;
+
+	abd_for_each_sg(abd, sg, npages, i) {
+		sg_set_page(sg, pages[i], PAGESIZE, 0);
+	}
+
+	return (abd);
+}
+
+void
+abd_free_from_pages(abd_t *abd)
+{
+	struct scatterlist *sg = NULL;
+	int nr_pages = ABD_SCATTER(abd).abd_nents;
+	int i = 0;
+
+	ASSERT(abd->abd_flags & ABD_FLAG_FROM_PAGES);
+
+	abd_for_each_sg(abd, sg, nr_pages, i) {
+		put_page(sg_page(sg));
+	}
+	abd_free_sg_table(abd);
+}
+
 /* Tunable Parameters */
 module_param(zfs_abd_scatter_enabled, int, 0644);
 MODULE_PARM_DESC(zfs_abd_scatter_enabled,
@@ -320,8 +320,12 @@ vdev_disk_open(vdev_t *v, uint64_t *psize, uint64_t *max_psize,
 	/*  Determine the logical block size */
 	int logical_block_size = bdev_logical_block_size(vd->vd_bdev);
 
-	/* Clear the nowritecache bit, causes vdev_reopen() to try again. */
-	v->vdev_nowritecache = B_FALSE;
+	/*
+	 * Clear the nowritecache bit, causes vdev_reopen() to try again.
+	 * Devices without a volatile write cache, such as persistent memory,
+	 * complete writes only once they are stable, so never flush them.
+	 */
+	v->vdev_nowritecache = !bdev_write_cache_enabled(vd->vd_bdev);
 
 	/* Set when device reports it supports TRIM. */
 	v->vdev_has_trim = bdev_discard_supported(vd->vd_bdev);
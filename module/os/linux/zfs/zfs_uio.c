@@ -45,6 +45,8 @@
 #include <sys/uio_impl.h>
 #include <sys/sysmacros.h>
 #include <sys/string.h>
+#include <sys/abd.h>
+#include <sys/spa.h>
 #include <linux/kmap_compat.h>
 #include <linux/uaccess.h>
 
@@ -471,4 +473,99 @@ zfs_uioskip(zfs_uio_t *uio, size_t n)
 }
 EXPORT_SYMBOL(zfs_uioskip);
 
+#if defined(HAVE_VFS_IOV_ITER) && \
+	(defined(HAVE_IOV_ITER_GET_PAGES2) || defined(HAVE_IOV_ITER_GET_PAGES))
+static boolean_t
+zfs_uio_user_backed(zfs_uio_t *uio)
+{
+#if defined(HAVE_USER_BACKED_ITER)
+	return (user_backed_iter(uio->uio_iter));
+#else
+	return (iter_is_iovec(uio->uio_iter));
+#endif
+}
+
+/*
+ * Pin the user pages backing the next n bytes of the uio and return them
+ * as an ABD, so that Direct I/O can be issued to and from them without an
+ * intermediate copy.  Like zfs_uiocopy() the uio is not advanced, the
+ * caller skips over the data once the I/O succeeded.  ENOTSUP is returned
+ * if the uio can't be mapped this way (i.e. it is not backed by page
+ * aligned user memory), in which case the caller must fall back to copying
+ * the data.
+ */
+int
+zfs_uio_get_dio_abd(zfs_uio_t *uio, zfs_uio_rw_t rw, size_t n, abd_t **abdp)
+{
+	struct iov_iter *iter;
+	struct page **pages;
+	uint_t npages = n >> PAGE_SHIFT;
+	size_t count, done = 0;
+	unsigned long align;
+
+	if (uio->uio_segflg != UIO_ITER || uio->uio_skip != 0 ||
+	    !IS_P2ALIGNED(n, PAGESIZE) || n == 0 || n > SPA_MAXBLOCKSIZE ||
+	    n > uio->uio_resid || !zfs_uio_user_backed(uio))
+		return (ENOTSUP);
+
+	iter = uio->uio_iter;
+	count = iov_iter_count(iter);
+	iov_iter_truncate(iter, n);
+	align = iov_iter_alignment(iter);
+	iov_iter_reexpand(iter, count);
+	if (!IS_P2ALIGNED(align, PAGESIZE))
+		return (ENOTSUP);
+
+	pages = kmem_alloc(npages * sizeof (struct page *), KM_SLEEP);
+	while (done < n) {
+		uint_t idx = done >> PAGE_SHIFT;
+		size_t start;
+		ssize_t cnt;
+
+#if defined(HAVE_IOV_ITER_GET_PAGES2)
+		cnt = iov_iter_get_pages2(iter, &pages[idx], n - done,
+		    npages - idx, &start);
+#else
+		cnt = iov_iter_get_pages(iter, &pages[idx], n - done,
+		    npages - idx, &start);
+		if (cnt > 0)
+			iov_iter_advance(iter, cnt);
+#endif
+		if (cnt <= 0) {
+			for (uint_t i = 0; i < idx; i++)
+				put_page(pages[i]);
+			iov_iter_revert(iter, done);
+			kmem_free(pages, npages * sizeof (struct page *));
+			return (EFAULT);
+		}
+		ASSERT0(start);
+		ASSERT(IS_P2ALIGNED(cnt, PAGESIZE));
+		done += cnt;
+	}
+
+	/*
+	 * Data read from disk lands in these pages behind the back of the
+	 * VM, so mark them dirty before they can be reclaimed.
+	 */
+	if (rw == UIO_READ) {
+		for (uint_t i = 0; i < npages; i++)
+			set_page_dirty_lock(pages[i]);
+	}
+
+	*abdp = abd_alloc_from_pages(pages, npages);
+	kmem_free(pages, npages * sizeof (struct page *));
+	iov_iter_revert(iter, n);
+
+	return (0);
+}
+#else
+int
+zfs_uio_get_dio_abd(zfs_uio_t *uio, zfs_uio_rw_t rw, size_t n, abd_t **abdp)
+{
+	(void) uio, (void) rw, (void) n, (void) abdp;
+	return (ENOTSUP);
+}
+#endif
+EXPORT_SYMBOL(zfs_uio_get_dio_abd);
+
 #endif /* _KERNEL */
@@ -222,6 +222,82 @@ zvol_os_is_zvol(const char *path)
 	return (B_FALSE);
 }
 
+/*
+ * Largest write passed to zvol_write_blocks() at once, unless a single
+ * volume block is larger.  This bounds both the ARC buffers loaned per
+ * transaction and the array tracking them.
+ */
+#define	ZVOL_WRITE_BLOCKS_MAX	(1024 * 1024)
+
+/*
+ * Write the next "bytes" of the uio, which cover full, aligned volume
+ * blocks.  The data is copied into loaned ARC buffers before the
+ * transaction is assigned, and the buffers are then handed to the DMU as
+ * the new block contents, instead of filling dbufs from the bio while
+ * holding the txg open.
+ */
+static int
+zvol_write_blocks(zvol_state_t *zv, zfs_uio_t *uio, uint64_t bytes,
+    boolean_t sync)
+{
+	uint64_t blksz = zv->zv_volblocksize;
+	uint64_t off = zfs_uio_offset(uio);
+	int nbufs = bytes / blksz;
+	int loaned = 0, assigned = 0;
+	arc_buf_t **bufs;
+	zfs_uio_t uio_copy;
+	dmu_tx_t *tx;
+	int error = 0;
+
+	ASSERT0(P2PHASE(off, blksz));
+	ASSERT0(P2PHASE(bytes, blksz));
+	ASSERT3U(bytes, <=, MAX(ZVOL_WRITE_BLOCKS_MAX, blksz));
+
+	bufs = kmem_alloc(nbufs * sizeof (arc_buf_t *), KM_SLEEP);
+	memcpy(&uio_copy, uio, sizeof (zfs_uio_t));
+	while (loaned < nbufs) {
+		bufs[loaned] = arc_loan_buf(dmu_objset_spa(zv->zv_objset),
+		    B_FALSE, blksz);
+		error = zfs_uiomove(bufs[loaned++]->b_data, blksz, UIO_WRITE,
+		    &uio_copy);
+		if (error)
+			goto out;
+	}
+
+	tx = dmu_tx_create(zv->zv_objset);
+	dmu_tx_hold_write_by_dnode(tx, zv->zv_dn, off, bytes);
+
+	/* This will only fail for ENOSPC */
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error) {
+		dmu_tx_abort(tx);
+		goto out;
+	}
+	while (assigned < nbufs) {
+		error = dmu_assign_arcbuf_by_dnode(zv->zv_dn,
+		    off + assigned * blksz, bufs[assigned], tx);
+		if (error)
+			break;
+		assigned++;
+	}
+
+	/*
+	 * The blocks assigned before any failure are part of the committed
+	 * transaction, so they must be logged and accounted as written.
+	 */
+	if (assigned > 0) {
+		zvol_log_write(zv, tx, off, assigned * blksz, sync);
+		zfs_uioskip(uio, assigned * blksz);
+	}
+	dmu_tx_commit(tx);
+out:
+	while (assigned < loaned)
+		dmu_return_arcbuf(bufs[assigned++]);
+	kmem_free(bufs, nbufs * sizeof (arc_buf_t *));
+
+	return (error);
+}
+
 static void
 zvol_write(zv_request_t *zvr)
 {
@@ -276,14 +352,32 @@ zvol_write(zv_request_t *zvr)
 	    uio.uio_loffset, uio.uio_resid, RL_WRITER);
 
 	uint64_t volsize = zv->zv_volsize;
+	uint64_t blksz = zv->zv_volblocksize;
 	while (uio.uio_resid > 0 && uio.uio_loffset < volsize) {
 		uint64_t bytes = MIN(uio.uio_resid, DMU_MAX_ACCESS >> 1);
 		uint64_t off = uio.uio_loffset;
-		dmu_tx_t *tx = dmu_tx_create(zv->zv_objset);
+		uint64_t phase = P2PHASE(off, blksz);
 
 		if (bytes > volsize - off)	/* don't write past the end */
 			bytes = volsize - off;
 
+		if (phase == 0 && bytes >= blksz) {
+			bytes = MIN(bytes, MAX(ZVOL_WRITE_BLOCKS_MAX, blksz));
+			error = zvol_write_blocks(zv, &uio,
+			    P2ALIGN(bytes, blksz), sync);
+			if (error)
+				break;
+			continue;
+		}
+
+		/*
+		 * Stop at the block boundary when full blocks follow, so
+		 * they can be written by zvol_write_blocks().
+		 */
+		if (phase != 0 && bytes >= 2 * blksz - phase)
+			bytes = blksz - phase;
+
+		dmu_tx_t *tx = dmu_tx_create(zv->zv_objset);
 		dmu_tx_hold_write_by_dnode(tx, zv->zv_dn, off, bytes);
 
 		/* This will only fail for ENOSPC */
@@ -1176,7 +1270,8 @@ zvol_alloc(dev_t dev, const char *name)
 	zv->zv_open_count = 0;
 	strlcpy(zv->zv_name, name, MAXNAMELEN);
 
-	zfs_rangelock_init(&zv->zv_rangelock, NULL, NULL);
+	zfs_rangelock_init_sharded(&zv->zv_rangelock, ZVOL_RL_SHARDS,
+	    ZVOL_RL_SHARD_SHIFT);
 	rw_init(&zv->zv_suspend_lock, NULL, RW_DEFAULT, NULL);
 
 	zso->zvo_disk->major = zvol_major;
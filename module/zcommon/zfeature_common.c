@@ -725,6 +725,28 @@ zpool_feature_init(void)
 		    blake3_deps, sfeatures);
 	}
 
+	zfeature_register(SPA_FEATURE_BLOCK_CLONING,
+	    "org.openzfs:block_cloning", "block_cloning",
+	    "Support for block cloning via Block Reference Table.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, ZFEATURE_TYPE_BOOLEAN, NULL,
+	    sfeatures);
+
+	zfeature_register(SPA_FEATURE_DEDUP_LOG,
+	    "org.openzfs:dedup_log", "dedup_log",
+	    "Log dedup table updates and flush them incrementally.",
+	    ZFEATURE_FLAG_READONLY_COMPAT, ZFEATURE_TYPE_BOOLEAN, NULL,
+	    sfeatures);
+
+	zfeature_register(SPA_FEATURE_DEDUP_CLASS_START,
+	    "org.openzfs:dedup_class_start", "dedup_class_start",
+	    "Record when dedup table entries became unique, for pruning.",
+	    0, ZFEATURE_TYPE_BOOLEAN, NULL, sfeatures);
+
+	zfeature_register(SPA_FEATURE_RAIDZ_EXPANSION,
+	    "org.openzfs:raidz_expansion", "raidz_expansion",
+	    "Support for raidz expansion.",
+	    ZFEATURE_FLAG_MOS, ZFEATURE_TYPE_BOOLEAN, NULL, sfeatures);
+
 	zfs_mod_list_supported_free(sfeatures);
 }
 
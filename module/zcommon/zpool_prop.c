@@ -116,6 +116,12 @@ zpool_prop_init(void)
 	zprop_register_number(ZPOOL_PROP_DEDUPRATIO, "dedupratio", 0,
 	    PROP_READONLY, ZFS_TYPE_POOL, "<1.00x or higher if deduped>",
 	    "DEDUP", B_FALSE, sfeatures);
+	zprop_register_number(ZPOOL_PROP_DEDUP_TABLE_SIZE, "dedup_table_size",
+	    0, PROP_READONLY, ZFS_TYPE_POOL, "<size>", "DDTSIZE", B_FALSE,
+	    sfeatures);
+	zprop_register_number(ZPOOL_PROP_LAST_SCRUBBED_TXG,
+	    "last_scrubbed_txg", 0, PROP_READONLY, ZFS_TYPE_POOL, "<txg>",
+	    "LAST_SCRUBBED_TXG", B_FALSE, sfeatures);
 
 	/* default number properties */
 	zprop_register_number(ZPOOL_PROP_VERSION, "version", SPA_VERSION,
@@ -124,6 +130,9 @@ zpool_prop_init(void)
 	zprop_register_number(ZPOOL_PROP_ASHIFT, "ashift", 0, PROP_DEFAULT,
 	    ZFS_TYPE_POOL, "<ashift, 9-16, or 0=default>", "ASHIFT", B_FALSE,
 	    sfeatures);
+	zprop_register_number(ZPOOL_PROP_DEDUP_TABLE_QUOTA,
+	    "dedup_table_quota", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_POOL,
+	    "<size> | none", "DDTQUOTA", B_FALSE, sfeatures);
 
 	/* default index (boolean) properties */
 	zprop_register_index(ZPOOL_PROP_DELEGATION, "delegation", 1,
@@ -408,8 +417,74 @@ vdev_prop_init(void)
 	zprop_register_number(VDEV_PROP_BYTES_TRIM, "trim_bytes", 0,
 	    PROP_READONLY, ZFS_TYPE_VDEV, "<bytes>", "TRIMBYTE", B_FALSE,
 	    sfeatures);
+	zprop_register_number(VDEV_PROP_SYNC_READ_LATENCY,
+	    "sync_read_latency", 0, PROP_READONLY, ZFS_TYPE_VDEV, "<time>",
+	    "SRLAT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_SYNC_WRITE_LATENCY,
+	    "sync_write_latency", 0, PROP_READONLY, ZFS_TYPE_VDEV, "<time>",
+	    "SWLAT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_ASYNC_READ_LATENCY,
+	    "async_read_latency", 0, PROP_READONLY, ZFS_TYPE_VDEV, "<time>",
+	    "ARLAT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_ASYNC_WRITE_LATENCY,
+	    "async_write_latency", 0, PROP_READONLY, ZFS_TYPE_VDEV, "<time>",
+	    "AWLAT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_QUEUE_ACTIVE, "queue_active", 0,
+	    PROP_READONLY, ZFS_TYPE_VDEV, "<count>", "QACTIVE", B_FALSE,
+	    sfeatures);
+	zprop_register_number(VDEV_PROP_QUEUE_PENDING, "queue_pending", 0,
+	    PROP_READONLY, ZFS_TYPE_VDEV, "<count>", "QPEND", B_FALSE,
+	    sfeatures);
+	zprop_register_number(VDEV_PROP_AGGREGATED_IOS, "aggregated_ios", 0,
+	    PROP_READONLY, ZFS_TYPE_VDEV, "<count>", "AGGIOS", B_FALSE,
+	    sfeatures);
+	zprop_register_number(VDEV_PROP_UNAGGREGATED_IOS, "unaggregated_ios",
+	    0, PROP_READONLY, ZFS_TYPE_VDEV, "<count>", "UNAGGIOS", B_FALSE,
+	    sfeatures);
 
 	/* default numeric properties */
+	zprop_register_number(VDEV_PROP_AGGREGATION_LIMIT,
+	    "aggregation_limit", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<size> | auto", "AGGLIMIT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_READ_GAP_LIMIT, "read_gap_limit",
+	    UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV, "<size> | auto",
+	    "RDGAPLIMIT", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_SYNC_READ_MAX_ACTIVE,
+	    "sync_read_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "SRMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_SYNC_WRITE_MAX_ACTIVE,
+	    "sync_write_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "SWMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_ASYNC_READ_MAX_ACTIVE,
+	    "async_read_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "ARMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE,
+	    "async_write_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "AWMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_SCRUB_MAX_ACTIVE,
+	    "scrub_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "SCRUBMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_REMOVAL_MAX_ACTIVE,
+	    "removal_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "REMOVEMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_INITIALIZING_MAX_ACTIVE,
+	    "initializing_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "INITMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_TRIM_MAX_ACTIVE,
+	    "trim_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "TRIMMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_REBUILD_MAX_ACTIVE,
+	    "rebuild_max_active", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<count> | auto", "REBUILDMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_TRIM_EXTENT_BYTES_MAX,
+	    "trim_extent_bytes_max", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<size> | auto", "TRIMEXTMAX", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_TRIM_EXTENT_BYTES_MIN,
+	    "trim_extent_bytes_min", UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV,
+	    "<size> | auto", "TRIMEXTMIN", B_FALSE, sfeatures);
+	zprop_register_number(VDEV_PROP_QUEUE_DEPTH_PCT, "queue_depth_pct",
+	    UINT64_MAX, PROP_DEFAULT, ZFS_TYPE_VDEV, "<percent> | auto",
+	    "QDEPTHPCT", B_FALSE, sfeatures);
 
 	/* default index (boolean) properties */
 	zprop_register_index(VDEV_PROP_REMOVING, "removing", 0,
@@ -418,6 +493,9 @@ vdev_prop_init(void)
 	zprop_register_index(VDEV_PROP_ALLOCATING, "allocating", 1,
 	    PROP_DEFAULT, ZFS_TYPE_VDEV, "on | off", "ALLOCATING",
 	    boolean_na_table, sfeatures);
+	zprop_register_index(VDEV_PROP_SEQUENTIAL, "sequential", 0,
+	    PROP_DEFAULT, ZFS_TYPE_VDEV, "on | off", "SEQUENTIAL",
+	    boolean_na_table, sfeatures);
 
 	/* default index properties */
 
@@ -0,0 +1,1002 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright (c) 2022 by the OpenZFS contributors. All rights reserved.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zio.h>
+#include <sys/brt.h>
+#include <sys/ddt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/arc.h>
+#include <sys/dsl_pool.h>
+#include <sys/vdev_impl.h>
+#include <sys/zfeature.h>
+#include <sys/byteorder.h>
+
+/*
+ * Block Reference Table (BRT)
+ *
+ * Block cloning lets a file reference blocks already owned by another file
+ * (or by another range of the same file) without copying the data.  The new
+ * block pointer is an exact copy of the original one, so the only thing we
+ * have to track is how many extra references a given block has, and we must
+ * not release its space until the last of them is gone.  That is what the
+ * BRT is for.  It is much simpler than the DDT: cloned blocks are identified
+ * by the offset of their first DVA, no checksums are involved and nothing
+ * needs to be looked up when blocks are written, only when they are freed.
+ *
+ * The table is kept per top-level vdev.  For every vdev which has at least
+ * one cloned block we store in the MOS:
+ *
+ * - a ZAP object mapping the DVA offset of every cloned block to the number
+ *   of additional references (a block with no entry has a single reference
+ *   and is freed normally),
+ *
+ * - an object holding an array of 16-bit counters, one per BRT_RANGESIZE
+ *   region of the vdev, each counting the ZAP entries which live in that
+ *   region; its bonus buffer holds the brt_vdev_phys_t header.
+ *
+ * The counter array is always kept in memory.  Freeing a block consults it
+ * first (brt_maybe_exists()) and only when the region has cloned blocks do
+ * we go to the ZAP, so pools without (or with few) clones pay close to
+ * nothing on the free path.  Once a counter saturates at UINT16_MAX it is
+ * never decremented again, which only costs us some unnecessary lookups.
+ *
+ * Clones are created in open context, where we only remember the block
+ * pointer in a per-txg pending tree (brt_pending_add()).  If the clone is
+ * undone before the txg syncs (e.g. the cloned range is overwritten or
+ * freed), the block is simply freed again in the same txg, which cancels
+ * out the pending reference.  At the beginning of spa_sync() the pending
+ * entries are applied to the in-core per-vdev trees (brt_pending_apply()),
+ * which are then written out by brt_sync() together with the DDT.  Cloned
+ * blocks which are also dedup-ed simply get an additional DDT reference
+ * instead of a BRT entry.
+ *
+ * Frees are routed through the ZIO_STAGE_BRT_FREE stage, which decrements
+ * the reference count and tells the pipeline whether the block has to be
+ * released now (brt_entry_decref()).
+ */
+
+static kmem_cache_t *brt_entry_cache;
+static kmem_cache_t *brt_pending_entry_cache;
+
+#define	BRT_RANGESIZE_TO_INDEX(brt, offset)	\
+	((offset) / (brt)->brt_rangesize)
+
+static void
+brt_rlock(brt_t *brt)
+{
+	rw_enter(&brt->brt_lock, RW_READER);
+}
+
+static void
+brt_wlock(brt_t *brt)
+{
+	rw_enter(&brt->brt_lock, RW_WRITER);
+}
+
+static void
+brt_unlock(brt_t *brt)
+{
+	rw_exit(&brt->brt_lock);
+}
+
+static int
+brt_entry_compare(const void *x1, const void *x2)
+{
+	const brt_entry_t *bre1 = x1;
+	const brt_entry_t *bre2 = x2;
+
+	return (TREE_CMP(bre1->bre_offset, bre2->bre_offset));
+}
+
+static int
+brt_pending_entry_compare(const void *x1, const void *x2)
+{
+	const blkptr_t *bp1 = &((const brt_pending_entry_t *)x1)->bpe_bp;
+	const blkptr_t *bp2 = &((const brt_pending_entry_t *)x2)->bpe_bp;
+	int cmp;
+
+	cmp = TREE_CMP(DVA_GET_VDEV(&bp1->blk_dva[0]),
+	    DVA_GET_VDEV(&bp2->blk_dva[0]));
+	if (cmp == 0) {
+		cmp = TREE_CMP(DVA_GET_OFFSET(&bp1->blk_dva[0]),
+		    DVA_GET_OFFSET(&bp2->blk_dva[0]));
+	}
+	if (cmp == 0)
+		cmp = TREE_CMP(BP_PHYSICAL_BIRTH(bp1), BP_PHYSICAL_BIRTH(bp2));
+
+	return (cmp);
+}
+
+static void
+brt_vdev_name(uint64_t vdevid, char *name, size_t size)
+{
+	(void) snprintf(name, size, "%s%llu", DMU_POOL_BRT_VDEV_PREFIX,
+	    (u_longlong_t)vdevid);
+}
+
+static uint16_t
+brt_vdev_entcount_get(const brt_vdev_t *bv, uint64_t idx)
+{
+	ASSERT3U(idx, <, bv->bv_size);
+
+	return (bv->bv_entcount[idx]);
+}
+
+static void
+brt_vdev_entcount_dirty(brt_vdev_t *bv, uint64_t idx)
+{
+	uint64_t blk = (idx * sizeof (uint16_t)) / BRT_BLOCKSIZE;
+
+	ASSERT3U(blk, <, bv->bv_nblocks);
+	bv->bv_dirty[blk] = 1;
+	bv->bv_entcount_dirty = B_TRUE;
+}
+
+static void
+brt_vdev_entcount_inc(brt_vdev_t *bv, uint64_t idx)
+{
+	ASSERT3U(idx, <, bv->bv_size);
+
+	if (bv->bv_entcount[idx] < UINT16_MAX) {
+		bv->bv_entcount[idx]++;
+		brt_vdev_entcount_dirty(bv, idx);
+	}
+}
+
+static void
+brt_vdev_entcount_dec(brt_vdev_t *bv, uint64_t idx)
+{
+	ASSERT3U(idx, <, bv->bv_size);
+	ASSERT3U(bv->bv_entcount[idx], >, 0);
+
+	/* A saturated counter no longer tells us anything, leave it be. */
+	if (bv->bv_entcount[idx] < UINT16_MAX) {
+		bv->bv_entcount[idx]--;
+		brt_vdev_entcount_dirty(bv, idx);
+	}
+}
+
+/*
+ * Grow the in-core counter array so it covers at least nranges regions.
+ * The array only ever grows; vdevs cannot shrink.
+ */
+static void
+brt_vdev_realloc(brt_t *brt, brt_vdev_t *bv, uint64_t nranges)
+{
+	uint16_t *entcount;
+	uint8_t *dirty;
+	uint64_t nblocks;
+
+	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+
+	if (nranges <= bv->bv_size)
+		return;
+
+	nblocks = BRT_NCOUNTERS_TO_NBLOCKS(nranges);
+	entcount = kmem_zalloc(nranges * sizeof (uint16_t), KM_SLEEP);
+	dirty = kmem_zalloc(nblocks, KM_SLEEP);
+
+	if (bv->bv_entcount != NULL) {
+		memcpy(entcount, bv->bv_entcount,
+		    bv->bv_size * sizeof (uint16_t));
+		memcpy(dirty, bv->bv_dirty, bv->bv_nblocks);
+		kmem_free(bv->bv_entcount, bv->bv_size * sizeof (uint16_t));
+		kmem_free(bv->bv_dirty, bv->bv_nblocks);
+	}
+
+	bv->bv_entcount = entcount;
+	bv->bv_size = nranges;
+	bv->bv_dirty = dirty;
+	bv->bv_nblocks = nblocks;
+	bv->bv_meta_dirty = B_TRUE;
+}
+
+/*
+ * Make sure the counter array covers the whole top-level vdev.  Called in
+ * syncing context, where the config lock is held.
+ */
+static void
+brt_vdev_resize(brt_t *brt, brt_vdev_t *bv)
+{
+	spa_t *spa = brt->brt_spa;
+	vdev_t *vd;
+
+	ASSERT(spa_config_held(spa, SCL_VDEV, RW_READER) != 0 ||
+	    spa_config_held(spa, SCL_CONFIG, RW_READER) != 0);
+
+	vd = vdev_lookup_top(spa, bv->bv_vdevid);
+	ASSERT(vd != NULL);
+
+	brt_vdev_realloc(brt, bv,
+	    MAX(1, howmany(vd->vdev_asize, brt->brt_rangesize)));
+}
+
+static void
+brt_vdevs_expand(brt_t *brt, uint64_t nvdevs)
+{
+	brt_vdev_t *vdevs;
+
+	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+
+	if (nvdevs <= brt->brt_nvdevs)
+		return;
+
+	vdevs = kmem_zalloc(sizeof (brt_vdev_t) * nvdevs, KM_SLEEP);
+	if (brt->brt_nvdevs > 0) {
+		ASSERT(brt->brt_vdevs != NULL);
+
+		memcpy(vdevs, brt->brt_vdevs,
+		    sizeof (brt_vdev_t) * brt->brt_nvdevs);
+		kmem_free(brt->brt_vdevs,
+		    sizeof (brt_vdev_t) * brt->brt_nvdevs);
+	}
+	for (uint64_t vdevid = brt->brt_nvdevs; vdevid < nvdevs; vdevid++) {
+		brt_vdev_t *bv = &vdevs[vdevid];
+
+		bv->bv_vdevid = vdevid;
+		bv->bv_initiated = B_FALSE;
+		avl_create(&bv->bv_tree, brt_entry_compare,
+		    sizeof (brt_entry_t), offsetof(brt_entry_t, bre_node));
+	}
+
+	brt->brt_vdevs = vdevs;
+	brt->brt_nvdevs = nvdevs;
+}
+
+static brt_vdev_t *
+brt_vdev(brt_t *brt, uint64_t vdevid)
+{
+	ASSERT(RW_LOCK_HELD(&brt->brt_lock));
+
+	if (vdevid < brt->brt_nvdevs)
+		return (&brt->brt_vdevs[vdevid]);
+
+	return (NULL);
+}
+
+static void
+brt_vdev_create(brt_t *brt, brt_vdev_t *bv, dmu_tx_t *tx)
+{
+	spa_t *spa = brt->brt_spa;
+	objset_t *mos = spa->spa_meta_objset;
+	char name[64];
+
+	ASSERT(!bv->bv_initiated);
+	ASSERT0(bv->bv_mos_brtvdev);
+	ASSERT0(bv->bv_mos_entries);
+
+	bv->bv_mos_entries = zap_create_flags(mos, 0,
+	    ZAP_FLAG_HASH64 | ZAP_FLAG_UINT64_KEY, DMU_OTN_ZAP_METADATA,
+	    12, 12, DMU_OT_NONE, 0, tx);
+	VERIFY(bv->bv_mos_entries != 0);
+
+	bv->bv_mos_brtvdev = dmu_object_alloc(mos, DMU_OTN_UINT8_METADATA,
+	    BRT_BLOCKSIZE, DMU_OTN_UINT64_METADATA, sizeof (brt_vdev_phys_t),
+	    tx);
+	VERIFY(bv->bv_mos_brtvdev != 0);
+
+	brt_vdev_name(bv->bv_vdevid, name, sizeof (name));
+	VERIFY0(zap_add(mos, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &bv->bv_mos_brtvdev, tx));
+
+	/* The whole counter array has to be written out. */
+	memset(bv->bv_dirty, 1, bv->bv_nblocks);
+	bv->bv_entcount_dirty = B_TRUE;
+	bv->bv_meta_dirty = B_TRUE;
+	bv->bv_initiated = B_TRUE;
+
+	spa_feature_incr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+}
+
+static void
+brt_vdev_destroy(brt_t *brt, brt_vdev_t *bv, dmu_tx_t *tx)
+{
+	spa_t *spa = brt->brt_spa;
+	objset_t *mos = spa->spa_meta_objset;
+	char name[64];
+
+	ASSERT(bv->bv_initiated);
+	ASSERT0(bv->bv_totalcount);
+	ASSERT0(bv->bv_usedspace);
+	ASSERT0(bv->bv_savedspace);
+
+	VERIFY0(zap_destroy(mos, bv->bv_mos_entries, tx));
+	bv->bv_mos_entries = 0;
+
+	VERIFY0(dmu_object_free(mos, bv->bv_mos_brtvdev, tx));
+	bv->bv_mos_brtvdev = 0;
+
+	brt_vdev_name(bv->bv_vdevid, name, sizeof (name));
+	VERIFY0(zap_remove(mos, DMU_POOL_DIRECTORY_OBJECT, name, tx));
+
+	/* Forget saturated counters, there is nothing left to count. */
+	if (bv->bv_entcount != NULL)
+		memset(bv->bv_entcount, 0, bv->bv_size * sizeof (uint16_t));
+	if (bv->bv_dirty != NULL)
+		memset(bv->bv_dirty, 0, bv->bv_nblocks);
+	bv->bv_entcount_dirty = B_FALSE;
+	bv->bv_meta_dirty = B_FALSE;
+	bv->bv_initiated = B_FALSE;
+
+	spa_feature_decr(spa, SPA_FEATURE_BLOCK_CLONING, tx);
+}
+
+static int
+brt_vdev_load(brt_t *brt, brt_vdev_t *bv)
+{
+	objset_t *mos = brt->brt_spa->spa_meta_objset;
+	const brt_vdev_phys_t *bvphys;
+	dmu_buf_t *db;
+	char name[64];
+	int error;
+
+	ASSERT(!bv->bv_initiated);
+
+	brt_vdev_name(bv->bv_vdevid, name, sizeof (name));
+	error = zap_lookup(mos, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &bv->bv_mos_brtvdev);
+	if (error != 0)
+		return (error);
+	ASSERT(bv->bv_mos_brtvdev != 0);
+
+	error = dmu_bonus_hold(mos, bv->bv_mos_brtvdev, FTAG, &db);
+	if (error != 0)
+		return (error);
+
+	bvphys = db->db_data;
+	if (bvphys->bvp_rangesize != brt->brt_rangesize) {
+		dmu_buf_rele(db, FTAG);
+		return (SET_ERROR(EINVAL));
+	}
+
+	brt_vdev_realloc(brt, bv, MAX(1, bvphys->bvp_size));
+	error = dmu_read(mos, bv->bv_mos_brtvdev, 0,
+	    bvphys->bvp_size * sizeof (uint16_t), bv->bv_entcount,
+	    DMU_READ_NO_PREFETCH);
+	if (error != 0) {
+		dmu_buf_rele(db, FTAG);
+		return (error);
+	}
+	if (bvphys->bvp_byteorder != BRT_NATIVE_BYTEORDER) {
+		for (uint64_t i = 0; i < bvphys->bvp_size; i++)
+			bv->bv_entcount[i] = BSWAP_16(bv->bv_entcount[i]);
+		/* Rewrite the counters in our byte order on next sync. */
+		memset(bv->bv_dirty, 1, bv->bv_nblocks);
+		bv->bv_entcount_dirty = B_TRUE;
+	} else {
+		memset(bv->bv_dirty, 0, bv->bv_nblocks);
+		bv->bv_entcount_dirty = B_FALSE;
+	}
+
+	bv->bv_mos_entries = bvphys->bvp_mos_entries;
+	ASSERT(bv->bv_mos_entries != 0);
+	bv->bv_totalcount = bvphys->bvp_totalcount;
+	bv->bv_usedspace = bvphys->bvp_usedspace;
+	bv->bv_savedspace = bvphys->bvp_savedspace;
+	bv->bv_meta_dirty = B_FALSE;
+	bv->bv_initiated = B_TRUE;
+
+	brt->brt_usedspace += bv->bv_usedspace;
+	brt->brt_savedspace += bv->bv_savedspace;
+
+	dmu_buf_rele(db, FTAG);
+
+	return (0);
+}
+
+static void
+brt_vdev_dealloc(brt_vdev_t *bv)
+{
+	brt_entry_t *bre;
+	void *c = NULL;
+
+	while ((bre = avl_destroy_nodes(&bv->bv_tree, &c)) != NULL)
+		kmem_cache_free(brt_entry_cache, bre);
+	avl_destroy(&bv->bv_tree);
+
+	if (bv->bv_entcount != NULL) {
+		kmem_free(bv->bv_entcount, bv->bv_size * sizeof (uint16_t));
+		bv->bv_entcount = NULL;
+	}
+	if (bv->bv_dirty != NULL) {
+		kmem_free(bv->bv_dirty, bv->bv_nblocks);
+		bv->bv_dirty = NULL;
+	}
+	bv->bv_size = 0;
+	bv->bv_nblocks = 0;
+	bv->bv_initiated = B_FALSE;
+}
+
+static void
+brt_vdev_sync(brt_t *brt, brt_vdev_t *bv, dmu_tx_t *tx)
+{
+	objset_t *mos = brt->brt_spa->spa_meta_objset;
+	brt_vdev_phys_t *bvphys;
+	dmu_buf_t *db;
+
+	ASSERT(bv->bv_initiated);
+
+	if (bv->bv_entcount_dirty) {
+		uint64_t size = bv->bv_size * sizeof (uint16_t);
+
+		for (uint64_t blk = 0; blk < bv->bv_nblocks; blk++) {
+			uint64_t off = blk * BRT_BLOCKSIZE;
+
+			if (!bv->bv_dirty[blk])
+				continue;
+			dmu_write(mos, bv->bv_mos_brtvdev, off,
+			    MIN(BRT_BLOCKSIZE, size - off),
+			    (char *)bv->bv_entcount + off, tx);
+			bv->bv_dirty[blk] = 0;
+		}
+		bv->bv_entcount_dirty = B_FALSE;
+	}
+
+	VERIFY0(dmu_bonus_hold(mos, bv->bv_mos_brtvdev, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	bvphys = db->db_data;
+	bvphys->bvp_mos_entries = bv->bv_mos_entries;
+	bvphys->bvp_size = bv->bv_size;
+	bvphys->bvp_byteorder = BRT_NATIVE_BYTEORDER;
+	bvphys->bvp_totalcount = bv->bv_totalcount;
+	bvphys->bvp_rangesize = brt->brt_rangesize;
+	bvphys->bvp_usedspace = bv->bv_usedspace;
+	bvphys->bvp_savedspace = bv->bv_savedspace;
+	dmu_buf_rele(db, FTAG);
+
+	bv->bv_meta_dirty = B_FALSE;
+}
+
+/*
+ * Look up the on-disk reference count of the block at the given offset.
+ * The BRT lock is dropped for the ZAP lookup; the caller has to revalidate
+ * its in-core state afterwards.
+ */
+static int
+brt_entry_lookup_ondisk(brt_t *brt, brt_vdev_t *bv, uint64_t offset,
+    uint64_t *refcountp)
+{
+	objset_t *mos = brt->brt_spa->spa_meta_objset;
+	uint64_t mos_entries;
+	int error;
+
+	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+
+	if (!bv->bv_initiated)
+		return (SET_ERROR(ENOENT));
+
+	mos_entries = bv->bv_mos_entries;
+	brt_unlock(brt);
+	error = zap_lookup_uint64(mos, mos_entries, &offset, 1,
+	    sizeof (uint64_t), 1, refcountp);
+	brt_wlock(brt);
+
+	return (error);
+}
+
+/*
+ * Find the in-core entry for the given block, loading it from disk if
+ * needed.  Returns NULL if the block has no BRT entry at all.
+ */
+static brt_entry_t *
+brt_entry_find(brt_t *brt, uint64_t vdevid, uint64_t offset, boolean_t create)
+{
+	brt_entry_t bre_search, *bre;
+	brt_vdev_t *bv;
+	uint64_t refcount;
+	avl_index_t where;
+	int error;
+
+	ASSERT(RW_WRITE_HELD(&brt->brt_lock));
+
+	bv = brt_vdev(brt, vdevid);
+	ASSERT(bv != NULL);
+
+	bre_search.bre_offset = offset;
+	bre = avl_find(&bv->bv_tree, &bre_search, NULL);
+	if (bre != NULL)
+		return (bre);
+
+	error = brt_entry_lookup_ondisk(brt, bv, offset, &refcount);
+	if (error == ENOENT) {
+		if (!create)
+			return (NULL);
+		refcount = 0;
+	} else {
+		VERIFY0(error);
+	}
+
+	/* The lock was dropped, someone else may have loaded the entry. */
+	bv = brt_vdev(brt, vdevid);
+	bre = avl_find(&bv->bv_tree, &bre_search, &where);
+	if (bre != NULL)
+		return (bre);
+
+	bre = kmem_cache_alloc(brt_entry_cache, KM_SLEEP);
+	bre->bre_offset = offset;
+	bre->bre_refcount = refcount;
+	avl_insert(&bv->bv_tree, bre, where);
+
+	return (bre);
+}
+
+static void
+brt_entry_addref(brt_t *brt, const blkptr_t *bp)
+{
+	spa_t *spa = brt->brt_spa;
+	uint64_t vdevid = DVA_GET_VDEV(&bp->blk_dva[0]);
+	uint64_t offset = DVA_GET_OFFSET(&bp->blk_dva[0]);
+	uint64_t idx = BRT_RANGESIZE_TO_INDEX(brt, offset);
+	uint64_t dsize = bp_get_dsize_sync(spa, bp);
+	brt_entry_t *bre;
+	brt_vdev_t *bv;
+
+	brt_wlock(brt);
+
+	brt_vdevs_expand(brt, vdevid + 1);
+	bv = brt_vdev(brt, vdevid);
+	if (idx >= bv->bv_size)
+		brt_vdev_resize(brt, bv);
+	ASSERT3U(idx, <, bv->bv_size);
+
+	bre = brt_entry_find(brt, vdevid, offset, B_TRUE);
+	bv = brt_vdev(brt, vdevid);
+	if (bre->bre_refcount == 0) {
+		brt_vdev_entcount_inc(bv, idx);
+		bv->bv_usedspace += dsize;
+		brt->brt_usedspace += dsize;
+	}
+	bre->bre_refcount++;
+
+	bv->bv_totalcount++;
+	bv->bv_savedspace += dsize;
+	brt->brt_savedspace += dsize;
+	bv->bv_meta_dirty = B_TRUE;
+
+	brt_unlock(brt);
+}
+
+/*
+ * Drop one reference of a block which is being freed.  Returns B_TRUE if
+ * this was the last reference and the block has to be freed for real,
+ * B_FALSE if the block is still referenced by clones.
+ */
+boolean_t
+brt_entry_decref(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	uint64_t vdevid = DVA_GET_VDEV(&bp->blk_dva[0]);
+	uint64_t offset = DVA_GET_OFFSET(&bp->blk_dva[0]);
+	uint64_t dsize;
+	brt_entry_t *bre;
+	brt_vdev_t *bv;
+
+	if (brt == NULL)
+		return (B_TRUE);
+
+	brt_wlock(brt);
+
+	bv = brt_vdev(brt, vdevid);
+	if (bv == NULL ||
+	    (!bv->bv_initiated && avl_numnodes(&bv->bv_tree) == 0)) {
+		brt_unlock(brt);
+		return (B_TRUE);
+	}
+
+	bre = brt_entry_find(brt, vdevid, offset, B_FALSE);
+	if (bre == NULL || bre->bre_refcount == 0) {
+		brt_unlock(brt);
+		return (B_TRUE);
+	}
+
+	bv = brt_vdev(brt, vdevid);
+	dsize = bp_get_dsize_sync(spa, bp);
+
+	bre->bre_refcount--;
+	if (bre->bre_refcount == 0) {
+		brt_vdev_entcount_dec(bv, BRT_RANGESIZE_TO_INDEX(brt, offset));
+		ASSERT3U(bv->bv_usedspace, >=, dsize);
+		bv->bv_usedspace -= dsize;
+		brt->brt_usedspace -= dsize;
+	}
+
+	ASSERT3U(bv->bv_totalcount, >, 0);
+	bv->bv_totalcount--;
+	ASSERT3U(bv->bv_savedspace, >=, dsize);
+	bv->bv_savedspace -= dsize;
+	brt->brt_savedspace -= dsize;
+	bv->bv_meta_dirty = B_TRUE;
+
+	brt_unlock(brt);
+
+	return (B_FALSE);
+}
+
+/*
+ * Return the number of additional references the given block has.
+ */
+uint64_t
+brt_entry_get_refcount(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	uint64_t vdevid = DVA_GET_VDEV(&bp->blk_dva[0]);
+	uint64_t offset = DVA_GET_OFFSET(&bp->blk_dva[0]);
+	uint64_t refcount = 0;
+	brt_entry_t *bre;
+
+	if (brt == NULL)
+		return (0);
+
+	brt_wlock(brt);
+	if (brt_vdev(brt, vdevid) != NULL) {
+		bre = brt_entry_find(brt, vdevid, offset, B_FALSE);
+		if (bre != NULL)
+			refcount = bre->bre_refcount;
+	}
+	brt_unlock(brt);
+
+	return (refcount);
+}
+
+/*
+ * Cheap check whether the given block may have a BRT entry.  Only level 0
+ * blocks of user data can be cloned.
+ */
+boolean_t
+brt_maybe_exists(spa_t *spa, const blkptr_t *bp)
+{
+	brt_t *brt = spa->spa_brt;
+	boolean_t mayexists = B_FALSE;
+	uint64_t vdevid, idx;
+	brt_vdev_t *bv;
+
+	if (brt == NULL || BP_IS_HOLE(bp) || BP_IS_EMBEDDED(bp) ||
+	    BP_GET_LEVEL(bp) > 0 || BP_IS_METADATA(bp))
+		return (B_FALSE);
+
+	vdevid = DVA_GET_VDEV(&bp->blk_dva[0]);
+	idx = BRT_RANGESIZE_TO_INDEX(brt, DVA_GET_OFFSET(&bp->blk_dva[0]));
+
+	brt_rlock(brt);
+	bv = brt_vdev(brt, vdevid);
+	if (bv != NULL && idx < bv->bv_size &&
+	    brt_vdev_entcount_get(bv, idx) > 0)
+		mayexists = B_TRUE;
+	brt_unlock(brt);
+
+	return (mayexists);
+}
+
+void
+brt_pending_add(spa_t *spa, const blkptr_t *bp, dmu_tx_t *tx)
+{
+	brt_t *brt = spa->spa_brt;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	brt_pending_entry_t *bpe, *newbpe;
+	avl_tree_t *pending_tree;
+	kmutex_t *pending_lock;
+	avl_index_t where;
+
+	ASSERT(brt != NULL);
+	ASSERT(!BP_IS_HOLE(bp));
+	ASSERT(!BP_IS_EMBEDDED(bp));
+
+	newbpe = kmem_cache_alloc(brt_pending_entry_cache, KM_SLEEP);
+	newbpe->bpe_bp = *bp;
+	newbpe->bpe_count = 1;
+
+	pending_tree = &brt->brt_pending_tree[txg & TXG_MASK];
+	pending_lock = &brt->brt_pending_lock[txg & TXG_MASK];
+
+	mutex_enter(pending_lock);
+	bpe = avl_find(pending_tree, newbpe, &where);
+	if (bpe == NULL) {
+		avl_insert(pending_tree, newbpe, where);
+		newbpe = NULL;
+	} else {
+		bpe->bpe_count++;
+	}
+	mutex_exit(pending_lock);
+
+	if (newbpe != NULL)
+		kmem_cache_free(brt_pending_entry_cache, newbpe);
+}
+
+/*
+ * Move the clones created in open context for the given txg into the
+ * in-core BRT.  Called at the very beginning of spa_sync(), before any
+ * frees of this txg are issued.
+ */
+void
+brt_pending_apply(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	brt_pending_entry_t *bpe;
+	avl_tree_t *pending_tree;
+	kmutex_t *pending_lock;
+	void *c = NULL;
+
+	ASSERT3U(txg, !=, 0);
+
+	if (brt == NULL)
+		return;
+
+	pending_tree = &brt->brt_pending_tree[txg & TXG_MASK];
+	pending_lock = &brt->brt_pending_lock[txg & TXG_MASK];
+
+	mutex_enter(pending_lock);
+	while ((bpe = avl_destroy_nodes(pending_tree, &c)) != NULL) {
+		mutex_exit(pending_lock);
+
+		for (int i = 0; i < bpe->bpe_count; i++) {
+			/*
+			 * If the block has a DDT entry, bump its reference
+			 * count there instead, the DDT free path will then
+			 * take care of it.
+			 */
+			if (BP_GET_DEDUP(&bpe->bpe_bp) &&
+			    ddt_addref(spa, &bpe->bpe_bp))
+				continue;
+			brt_entry_addref(brt, &bpe->bpe_bp);
+		}
+
+		kmem_cache_free(brt_pending_entry_cache, bpe);
+		mutex_enter(pending_lock);
+	}
+	mutex_exit(pending_lock);
+}
+
+static void
+brt_sync_table(brt_t *brt, dmu_tx_t *tx)
+{
+	objset_t *mos = brt->brt_spa->spa_meta_objset;
+	brt_entry_t *bre;
+	brt_vdev_t *bv;
+	void *c;
+
+	brt_wlock(brt);
+
+	for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
+		bv = &brt->brt_vdevs[vdevid];
+
+		if (!bv->bv_meta_dirty && avl_numnodes(&bv->bv_tree) == 0)
+			continue;
+
+		if (!bv->bv_initiated) {
+			if (bv->bv_totalcount == 0) {
+				/* Cloned and freed within the same txg. */
+				c = NULL;
+				while ((bre = avl_destroy_nodes(&bv->bv_tree,
+				    &c)) != NULL) {
+					ASSERT0(bre->bre_refcount);
+					kmem_cache_free(brt_entry_cache, bre);
+				}
+				bv->bv_meta_dirty = B_FALSE;
+				continue;
+			}
+			brt_vdev_create(brt, bv, tx);
+		}
+
+		c = NULL;
+		while ((bre = avl_destroy_nodes(&bv->bv_tree, &c)) != NULL) {
+			if (bre->bre_refcount == 0) {
+				int error = zap_remove_uint64(mos,
+				    bv->bv_mos_entries, &bre->bre_offset, 1,
+				    tx);
+				VERIFY(error == 0 || error == ENOENT);
+			} else {
+				VERIFY0(zap_update_uint64(mos,
+				    bv->bv_mos_entries, &bre->bre_offset, 1,
+				    sizeof (uint64_t), 1, &bre->bre_refcount,
+				    tx));
+			}
+			kmem_cache_free(brt_entry_cache, bre);
+		}
+
+		if (bv->bv_totalcount == 0)
+			brt_vdev_destroy(brt, bv, tx);
+		else
+			brt_vdev_sync(brt, bv, tx);
+	}
+
+	brt_unlock(brt);
+}
+
+void
+brt_sync(spa_t *spa, uint64_t txg)
+{
+	brt_t *brt = spa->spa_brt;
+	dmu_tx_t *tx;
+
+	ASSERT(spa_syncing_txg(spa) == txg);
+
+	if (brt == NULL)
+		return;
+
+	tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+	brt_sync_table(brt, tx);
+	dmu_tx_commit(tx);
+}
+
+static void
+brt_table_alloc(brt_t *brt)
+{
+	for (int i = 0; i < TXG_SIZE; i++) {
+		avl_create(&brt->brt_pending_tree[i],
+		    brt_pending_entry_compare, sizeof (brt_pending_entry_t),
+		    offsetof(brt_pending_entry_t, bpe_node));
+		mutex_init(&brt->brt_pending_lock[i], NULL, MUTEX_DEFAULT,
+		    NULL);
+	}
+}
+
+static void
+brt_table_free(brt_t *brt)
+{
+	for (int i = 0; i < TXG_SIZE; i++) {
+		ASSERT(avl_is_empty(&brt->brt_pending_tree[i]));
+		avl_destroy(&brt->brt_pending_tree[i]);
+		mutex_destroy(&brt->brt_pending_lock[i]);
+	}
+}
+
+void
+brt_create(spa_t *spa)
+{
+	brt_t *brt;
+
+	ASSERT(spa->spa_brt == NULL);
+
+	brt = kmem_zalloc(sizeof (*brt), KM_SLEEP);
+	rw_init(&brt->brt_lock, NULL, RW_DEFAULT, NULL);
+	brt->brt_spa = spa;
+	brt->brt_rangesize = BRT_RANGESIZE;
+	brt->brt_usedspace = 0;
+	brt->brt_savedspace = 0;
+	brt->brt_vdevs = NULL;
+	brt->brt_nvdevs = 0;
+	brt_table_alloc(brt);
+
+	spa->spa_brt = brt;
+}
+
+int
+brt_load(spa_t *spa)
+{
+	brt_t *brt;
+	int error = 0;
+
+	brt_create(spa);
+	brt = spa->spa_brt;
+
+	brt_wlock(brt);
+	brt_vdevs_expand(brt, spa->spa_root_vdev->vdev_children);
+	for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++) {
+		error = brt_vdev_load(brt, &brt->brt_vdevs[vdevid]);
+		if (error == ENOENT) {
+			error = 0;
+			continue;
+		}
+		if (error != 0)
+			break;
+	}
+	brt_unlock(brt);
+
+	return (error);
+}
+
+void
+brt_unload(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return;
+
+	for (uint64_t vdevid = 0; vdevid < brt->brt_nvdevs; vdevid++)
+		brt_vdev_dealloc(&brt->brt_vdevs[vdevid]);
+	if (brt->brt_vdevs != NULL) {
+		kmem_free(brt->brt_vdevs,
+		    sizeof (brt_vdev_t) * brt->brt_nvdevs);
+	}
+
+	brt_table_free(brt);
+	rw_destroy(&brt->brt_lock);
+	kmem_free(brt, sizeof (*brt));
+	spa->spa_brt = NULL;
+}
+
+/*
+ * Space accounting.  Cloned blocks are charged once to the pool, so the
+ * space saved by cloning is reported as additional pool capacity, the
+ * same way dedup does it.
+ */
+uint64_t
+brt_get_dspace(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return (0);
+
+	return (brt->brt_savedspace);
+}
+
+uint64_t
+brt_get_used(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return (0);
+
+	return (brt->brt_usedspace);
+}
+
+uint64_t
+brt_get_saved(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL)
+		return (0);
+
+	return (brt->brt_savedspace);
+}
+
+/*
+ * Ratio of referenced to allocated space of cloned blocks, times 100.
+ */
+uint64_t
+brt_get_ratio(spa_t *spa)
+{
+	brt_t *brt = spa->spa_brt;
+
+	if (brt == NULL || brt->brt_usedspace == 0)
+		return (100);
+
+	return ((brt->brt_usedspace + brt->brt_savedspace) * 100 /
+	    brt->brt_usedspace);
+}
+
+void
+brt_init(void)
+{
+	brt_entry_cache = kmem_cache_create("brt_entry_cache",
+	    sizeof (brt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	brt_pending_entry_cache = kmem_cache_create("brt_pending_entry_cache",
+	    sizeof (brt_pending_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+brt_fini(void)
+{
+	kmem_cache_destroy(brt_entry_cache);
+	kmem_cache_destroy(brt_pending_entry_cache);
+}
@@ -40,6 +40,10 @@ static dataset_kstat_values_t empty_dataset_kstats = {
 	{
 	{ "zil_commit_count",			KSTAT_DATA_UINT64 },
 	{ "zil_commit_writer_count",		KSTAT_DATA_UINT64 },
+	{ "zil_commit_time",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_full_count",			KSTAT_DATA_UINT64 },
+	{ "zil_lwb_timeout_count",		KSTAT_DATA_UINT64 },
+	{ "zil_lwb_immediate_count",		KSTAT_DATA_UINT64 },
 	{ "zil_itx_count",			KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_count",		KSTAT_DATA_UINT64 },
 	{ "zil_itx_indirect_bytes",		KSTAT_DATA_UINT64 },
@@ -37,6 +37,9 @@
 #include <sys/zio_compress.h>
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
+#include <sys/dmu_objset.h>
+#include <sys/zfeature.h>
+#include <sys/dsl_synctask.h>
 
 static kmem_cache_t *ddt_cache;
 static kmem_cache_t *ddt_entry_cache;
@@ -46,6 +49,19 @@ static kmem_cache_t *ddt_entry_cache;
  */
 int zfs_dedup_prefetch = 0;
 
+/*
+ * Number of txgs the active DDT log collects entries for before it is
+ * swapped out to be flushed into the ZAP objects.
+ */
+static uint_t zfs_dedup_log_txg_max = 100;
+
+/*
+ * A DDT log is flushed over about this many txgs, flushing no less than
+ * zfs_dedup_log_flush_entries_min entries in each txg.
+ */
+static uint_t zfs_dedup_log_flush_txgs = 100;
+static uint_t zfs_dedup_log_flush_entries_min = 1000;
+
 static const ddt_ops_t *const ddt_ops[DDT_TYPES] = {
 	&ddt_zap_ops,
 };
@@ -434,6 +450,8 @@ ddt_stat_update(ddt_t *ddt, ddt_entry_t *dde, uint64_t neg)
 	ddt_histogram_t *ddh;
 	int bucket;
 
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
 	ddt_stat_generate(ddt, dde, &dds);
 
 	bucket = highbit64(dds.dds_ref_blocks) - 1;
@@ -540,6 +558,46 @@ ddt_get_dedup_dspace(spa_t *spa)
 	return (spa->spa_dedup_dspace);
 }
 
+/*
+ * Space used on disk by the DDTs, as of the last txg that changed them.
+ */
+uint64_t
+ddt_get_ddt_dsize(spa_t *spa)
+{
+	uint64_t dsize = 0;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL)
+			continue;
+		for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
+			for (enum ddt_class class = 0; class < DDT_CLASSES;
+			    class++) {
+				ddt_object_t *ddo =
+				    &ddt->ddt_object_stats[type][class];
+				dsize += ddo->ddo_dspace;
+			}
+		}
+		for (int n = 0; n < 2; n++)
+			dsize += ddt->ddt_log[n].ddl_length;
+	}
+
+	return (dsize);
+}
+
+/*
+ * Returns B_TRUE if the DDTs have reached the dedup_table_quota pool
+ * property, and new entries should not be added.
+ */
+boolean_t
+ddt_over_quota(spa_t *spa)
+{
+	if (spa->spa_dedup_table_quota == UINT64_MAX)
+		return (B_FALSE);
+
+	return (ddt_get_ddt_dsize(spa) >= spa->spa_dedup_table_quota);
+}
+
 uint64_t
 ddt_get_pool_dedup_ratio(spa_t *spa)
 {
@@ -599,16 +657,35 @@ ddt_select(spa_t *spa, const blkptr_t *bp)
 	return (spa->spa_ddt[BP_GET_CHECKSUM(bp)]);
 }
 
+static ddt_shard_t *
+ddt_shard(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	return (&ddt->ddt_shards[ddk->ddk_cksum.zc_word[0] % DDT_SHARDS]);
+}
+
 void
-ddt_enter(ddt_t *ddt)
+ddt_enter(ddt_t *ddt, const ddt_key_t *ddk)
 {
-	mutex_enter(&ddt->ddt_lock);
+	mutex_enter(&ddt_shard(ddt, ddk)->ddts_lock);
 }
 
 void
-ddt_exit(ddt_t *ddt)
+ddt_exit(ddt_t *ddt, const ddt_key_t *ddk)
 {
-	mutex_exit(&ddt->ddt_lock);
+	mutex_exit(&ddt_shard(ddt, ddk)->ddts_lock);
+}
+
+/*
+ * Returns B_TRUE if there are no in-core entries, i.e. no pending changes.
+ */
+boolean_t
+ddt_tree_empty(ddt_t *ddt)
+{
+	for (int i = 0; i < DDT_SHARDS; i++) {
+		if (avl_numnodes(&ddt->ddt_shards[i].ddts_tree) != 0)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
 }
 
 void
@@ -618,11 +695,13 @@ ddt_init(void)
 	    sizeof (ddt_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 	ddt_entry_cache = kmem_cache_create("ddt_entry_cache",
 	    sizeof (ddt_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+	ddt_log_init();
 }
 
 void
 ddt_fini(void)
 {
+	ddt_log_fini();
 	kmem_cache_destroy(ddt_entry_cache);
 	kmem_cache_destroy(ddt_cache);
 }
@@ -659,42 +738,88 @@ ddt_free(ddt_entry_t *dde)
 void
 ddt_remove(ddt_t *ddt, ddt_entry_t *dde)
 {
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+	ddt_shard_t *ddts = ddt_shard(ddt, &dde->dde_key);
+
+	ASSERT(MUTEX_HELD(&ddts->ddts_lock));
 
-	avl_remove(&ddt->ddt_tree, dde);
+	avl_remove(&ddts->ddts_tree, dde);
 	ddt_free(dde);
 }
 
+/*
+ * Class a log entry would have in the ZAP objects, or DDT_CLASSES if the
+ * entry has been freed.
+ */
+static enum ddt_class
+ddt_log_entry_class(const ddt_log_entry_t *ddle)
+{
+	uint64_t refcnt = 0;
+
+	for (int p = DDT_PHYS_SINGLE; p <= DDT_PHYS_TRIPLE; p++)
+		refcnt += ddle->ddle_phys[p].ddp_refcnt;
+
+	if (refcnt == 0)
+		return (DDT_CLASSES);
+
+	return (refcnt > 1 ? DDT_CLASS_DUPLICATE : DDT_CLASS_UNIQUE);
+}
+
 ddt_entry_t *
 ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 {
 	ddt_entry_t *dde, dde_search;
+	ddt_shard_t *ddts;
 	enum ddt_type type;
 	enum ddt_class class;
 	avl_index_t where;
 	int error;
 
-	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
-
 	ddt_key_fill(&dde_search.dde_key, bp);
+	ddts = ddt_shard(ddt, &dde_search.dde_key);
 
-	dde = avl_find(&ddt->ddt_tree, &dde_search, &where);
+	ASSERT(MUTEX_HELD(&ddts->ddts_lock));
+
+	dde = avl_find(&ddts->ddts_tree, &dde_search, &where);
 	if (dde == NULL) {
 		if (!add)
 			return (NULL);
 		dde = ddt_alloc(&dde_search.dde_key);
-		avl_insert(&ddt->ddt_tree, dde, where);
+		avl_insert(&ddts->ddts_tree, dde, where);
 	}
 
 	while (dde->dde_loading)
-		cv_wait(&dde->dde_cv, &ddt->ddt_lock);
+		cv_wait(&dde->dde_cv, &ddts->ddts_lock);
 
 	if (dde->dde_loaded)
 		return (dde);
 
+	/*
+	 * The DDT log holds the most recent state of the entry, if any.
+	 */
+	mutex_enter(&ddt->ddt_lock);
+	ddt_log_entry_t *ddle = ddt_log_find(ddt, &dde->dde_key);
+	if (ddle != NULL) {
+		memcpy(dde->dde_phys, ddle->ddle_phys, sizeof (dde->dde_phys));
+		dde->dde_ztype = ddle->ddle_ztype;
+		dde->dde_zclass = ddle->ddle_zclass;
+		dde->dde_class_start = ddle->ddle_class_start;
+		dde->dde_class = ddt_log_entry_class(ddle);
+		if (dde->dde_class == DDT_CLASSES) {
+			memset(dde->dde_phys, 0, sizeof (dde->dde_phys));
+			dde->dde_type = DDT_TYPES;
+		} else {
+			dde->dde_type = DDT_TYPE_CURRENT;
+			ddt_stat_update(ddt, dde, -1ULL);
+		}
+		mutex_exit(&ddt->ddt_lock);
+		dde->dde_loaded = B_TRUE;
+		return (dde);
+	}
+	mutex_exit(&ddt->ddt_lock);
+
 	dde->dde_loading = B_TRUE;
 
-	ddt_exit(ddt);
+	mutex_exit(&ddts->ddts_lock);
 
 	error = ENOENT;
 
@@ -710,18 +835,23 @@ ddt_lookup(ddt_t *ddt, const blkptr_t *bp, boolean_t add)
 			break;
 	}
 
-	ddt_enter(ddt);
+	mutex_enter(&ddts->ddts_lock);
 
 	ASSERT(dde->dde_loaded == B_FALSE);
 	ASSERT(dde->dde_loading == B_TRUE);
 
 	dde->dde_type = type;	/* will be DDT_TYPES if no entry found */
 	dde->dde_class = class;	/* will be DDT_CLASSES if no entry found */
+	dde->dde_ztype = type;
+	dde->dde_zclass = class;
 	dde->dde_loaded = B_TRUE;
 	dde->dde_loading = B_FALSE;
 
-	if (error == 0)
+	if (error == 0) {
+		mutex_enter(&ddt->ddt_lock);
 		ddt_stat_update(ddt, dde, -1ULL);
+		mutex_exit(&ddt->ddt_lock);
+	}
 
 	cv_broadcast(&dde->dde_cv);
 
@@ -752,6 +882,47 @@ ddt_prefetch(spa_t *spa, const blkptr_t *bp)
 	}
 }
 
+/*
+ * Add a reference to a dedup-ed block which is being cloned.  Returns
+ * B_FALSE if the block has no DDT entry (anymore), in which case the caller
+ * has to track the new reference in the BRT instead.
+ */
+boolean_t
+ddt_addref(spa_t *spa, const blkptr_t *bp)
+{
+	ddt_t *ddt;
+	ddt_entry_t *dde;
+	ddt_phys_t *ddp;
+	ddt_key_t ddk;
+	boolean_t result = B_FALSE;
+
+	ASSERT(BP_GET_DEDUP(bp));
+
+	ddt = ddt_select(spa, bp);
+	ddt_key_fill(&ddk, bp);
+	ddt_enter(ddt, &ddk);
+
+	dde = ddt_lookup(ddt, bp, B_TRUE);
+	ASSERT(dde != NULL);
+
+	ddp = ddt_phys_select(dde, bp);
+	if (ddp != NULL && ddp->ddp_refcnt != 0) {
+		ddt_phys_addref(ddp);
+		result = B_TRUE;
+	} else if (dde->dde_type == DDT_TYPES &&
+	    ddt_phys_total_refcnt(dde) == 0) {
+		/*
+		 * The block was dedup-ed once, but its DDT entry is gone,
+		 * e.g. because all the other references were freed.
+		 */
+		ddt_remove(ddt, dde);
+	}
+
+	ddt_exit(ddt, &ddk);
+
+	return (result);
+}
+
 /*
  * Opaque struct used for ddt_key comparison
  */
@@ -762,12 +933,10 @@ typedef struct ddt_key_cmp {
 } ddt_key_cmp_t;
 
 int
-ddt_entry_compare(const void *x1, const void *x2)
+ddt_key_compare(const ddt_key_t *ddk1, const ddt_key_t *ddk2)
 {
-	const ddt_entry_t *dde1 = x1;
-	const ddt_entry_t *dde2 = x2;
-	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)&dde1->dde_key;
-	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)&dde2->dde_key;
+	const ddt_key_cmp_t *k1 = (const ddt_key_cmp_t *)ddk1;
+	const ddt_key_cmp_t *k2 = (const ddt_key_cmp_t *)ddk2;
 	int32_t cmp = 0;
 
 	for (int i = 0; i < DDT_KEY_CMP_LEN; i++) {
@@ -779,6 +948,15 @@ ddt_entry_compare(const void *x1, const void *x2)
 	return (TREE_ISIGN(cmp));
 }
 
+int
+ddt_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_entry_t *dde1 = x1;
+	const ddt_entry_t *dde2 = x2;
+
+	return (ddt_key_compare(&dde1->dde_key, &dde2->dde_key));
+}
+
 static ddt_t *
 ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 {
@@ -787,11 +965,18 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 	ddt = kmem_cache_alloc(ddt_cache, KM_SLEEP);
 	memset(ddt, 0, sizeof (ddt_t));
 
+	ddt->ddt_shards = kmem_zalloc(DDT_SHARDS * sizeof (ddt_shard_t),
+	    KM_SLEEP);
+	for (int i = 0; i < DDT_SHARDS; i++) {
+		ddt_shard_t *ddts = &ddt->ddt_shards[i];
+		mutex_init(&ddts->ddts_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&ddts->ddts_tree, ddt_entry_compare,
+		    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	}
 	mutex_init(&ddt->ddt_lock, NULL, MUTEX_DEFAULT, NULL);
-	avl_create(&ddt->ddt_tree, ddt_entry_compare,
-	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
 	avl_create(&ddt->ddt_repair_tree, ddt_entry_compare,
 	    sizeof (ddt_entry_t), offsetof(ddt_entry_t, dde_node));
+	ddt_log_alloc(ddt);
 	ddt->ddt_checksum = c;
 	ddt->ddt_spa = spa;
 	ddt->ddt_os = spa->spa_meta_objset;
@@ -802,10 +987,16 @@ ddt_table_alloc(spa_t *spa, enum zio_checksum c)
 static void
 ddt_table_free(ddt_t *ddt)
 {
-	ASSERT(avl_numnodes(&ddt->ddt_tree) == 0);
 	ASSERT(avl_numnodes(&ddt->ddt_repair_tree) == 0);
-	avl_destroy(&ddt->ddt_tree);
+	for (int i = 0; i < DDT_SHARDS; i++) {
+		ddt_shard_t *ddts = &ddt->ddt_shards[i];
+		ASSERT(avl_numnodes(&ddts->ddts_tree) == 0);
+		avl_destroy(&ddts->ddts_tree);
+		mutex_destroy(&ddts->ddts_lock);
+	}
+	kmem_free(ddt->ddt_shards, DDT_SHARDS * sizeof (ddt_shard_t));
 	avl_destroy(&ddt->ddt_repair_tree);
+	ddt_log_free(ddt);
 	mutex_destroy(&ddt->ddt_lock);
 	kmem_cache_free(ddt_cache, ddt);
 }
@@ -844,6 +1035,10 @@ ddt_load(spa_t *spa)
 			}
 		}
 
+		error = ddt_log_load(ddt);
+		if (error != 0)
+			return (error);
+
 		/*
 		 * Seed the cached histograms.
 		 */
@@ -883,6 +1078,16 @@ ddt_class_contains(spa_t *spa, enum ddt_class max_class, const blkptr_t *bp)
 
 	ddt_key_fill(&(dde->dde_key), bp);
 
+	mutex_enter(&ddt->ddt_lock);
+	ddt_log_entry_t *ddle = ddt_log_find(ddt, &dde->dde_key);
+	if (ddle != NULL) {
+		enum ddt_class class = ddt_log_entry_class(ddle);
+		mutex_exit(&ddt->ddt_lock);
+		kmem_cache_free(ddt_entry_cache, dde);
+		return (class <= max_class);
+	}
+	mutex_exit(&ddt->ddt_lock);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class <= max_class; class++) {
 			if (ddt_object_lookup(ddt, type, class, dde) == 0) {
@@ -906,6 +1111,18 @@ ddt_repair_start(ddt_t *ddt, const blkptr_t *bp)
 
 	dde = ddt_alloc(&ddk);
 
+	mutex_enter(&ddt->ddt_lock);
+	ddt_log_entry_t *ddle = ddt_log_find(ddt, &ddk);
+	if (ddle != NULL) {
+		enum ddt_class class = ddt_log_entry_class(ddle);
+		if (class != DDT_CLASS_UNIQUE && class != DDT_CLASSES)
+			memcpy(dde->dde_phys, ddle->ddle_phys,
+			    sizeof (dde->dde_phys));
+		mutex_exit(&ddt->ddt_lock);
+		return (dde);
+	}
+	mutex_exit(&ddt->ddt_lock);
+
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
 			/*
@@ -929,7 +1146,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 {
 	avl_index_t where;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_lock);
 
 	if (dde->dde_repair_abd != NULL && spa_writeable(ddt->ddt_spa) &&
 	    avl_find(&ddt->ddt_repair_tree, dde, &where) == NULL)
@@ -937,7 +1154,7 @@ ddt_repair_done(ddt_t *ddt, ddt_entry_t *dde)
 	else
 		ddt_free(dde);
 
-	ddt_exit(ddt);
+	mutex_exit(&ddt->ddt_lock);
 }
 
 static void
@@ -986,22 +1203,28 @@ ddt_repair_table(ddt_t *ddt, zio_t *rio)
 	if (spa_sync_pass(spa) > 1)
 		return;
 
-	ddt_enter(ddt);
+	mutex_enter(&ddt->ddt_lock);
 	for (rdde = avl_first(t); rdde != NULL; rdde = rdde_next) {
 		rdde_next = AVL_NEXT(t, rdde);
 		avl_remove(&ddt->ddt_repair_tree, rdde);
-		ddt_exit(ddt);
+		mutex_exit(&ddt->ddt_lock);
 		ddt_bp_create(ddt->ddt_checksum, &rdde->dde_key, NULL, &blk);
 		dde = ddt_repair_start(ddt, &blk);
 		ddt_repair_entry(ddt, dde, rdde, rio);
 		ddt_repair_done(ddt, dde);
-		ddt_enter(ddt);
+		mutex_enter(&ddt->ddt_lock);
 	}
-	ddt_exit(ddt);
+	mutex_exit(&ddt->ddt_lock);
 }
 
-static void
-ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
+/*
+ * Sync a changed entry.  If dlr is not NULL the change is recorded in the
+ * DDT log instead of the ZAP objects, and B_TRUE is returned if a record
+ * was filled in to be appended to the log.
+ */
+static boolean_t
+ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, ddt_log_record_t *dlr,
+    dmu_tx_t *tx, uint64_t txg)
 {
 	dsl_pool_t *dp = ddt->ddt_spa->spa_dsl_pool;
 	ddt_phys_t *ddp = dde->dde_phys;
@@ -1011,6 +1234,7 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	enum ddt_class oclass = dde->dde_class;
 	enum ddt_class nclass;
 	uint64_t total_refcnt = 0;
+	boolean_t logged = B_FALSE;
 
 	ASSERT(dde->dde_loaded);
 	ASSERT(!dde->dde_loading);
@@ -1041,7 +1265,21 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	else
 		nclass = DDT_CLASS_UNIQUE;
 
-	if (otype != DDT_TYPES &&
+	/*
+	 * Remember when the entry entered its class, so that entries which
+	 * have stayed unique for a long time can be pruned.
+	 */
+	if (total_refcnt != 0 && nclass != oclass &&
+	    spa_feature_is_active(ddt->ddt_spa, SPA_FEATURE_DEDUP_CLASS_START))
+		dde->dde_class_start = gethrestime_sec();
+
+	if (dlr != NULL) {
+		/*
+		 * The ZAP objects are brought up to date when the log
+		 * entry is flushed, see ddt_sync_flush_log().
+		 */
+		logged = ddt_log_add(ddt, dde, dlr);
+	} else if (otype != DDT_TYPES &&
 	    (otype != ntype || oclass != nclass || total_refcnt == 0)) {
 		VERIFY(ddt_object_remove(ddt, otype, oclass, dde, tx) == 0);
 		ASSERT(ddt_object_lookup(ddt, otype, oclass, dde) == ENOENT);
@@ -1050,10 +1288,19 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 	if (total_refcnt != 0) {
 		dde->dde_type = ntype;
 		dde->dde_class = nclass;
+		mutex_enter(&ddt->ddt_lock);
 		ddt_stat_update(ddt, dde, 0);
+		mutex_exit(&ddt->ddt_lock);
+		/*
+		 * The object is created even if the entry is only logged,
+		 * as its histogram is persisted with it.
+		 */
 		if (!ddt_object_exists(ddt, ntype, nclass))
 			ddt_object_create(ddt, ntype, nclass, tx);
-		VERIFY(ddt_object_update(ddt, ntype, nclass, dde, tx) == 0);
+		if (dlr == NULL) {
+			VERIFY0(ddt_object_update(ddt, ntype, nclass, dde,
+			    tx));
+		}
 
 		/*
 		 * If the class changes, the order that we scan this bp
@@ -1067,6 +1314,105 @@ ddt_sync_entry(ddt_t *ddt, ddt_entry_t *dde, dmu_tx_t *tx, uint64_t txg)
 			    ddt->ddt_checksum, dde, tx);
 		}
 	}
+
+	return (logged);
+}
+
+/*
+ * Move entries from the flushing log into the ZAP objects.  A flush is
+ * spread over zfs_dedup_log_flush_txgs txgs; once the flushing log is
+ * empty and the active log is old enough, the two are swapped.  If
+ * ddt_flush_force is set both logs are flushed completely.  Returns the
+ * number of entries flushed.
+ */
+static uint64_t
+ddt_sync_flush_log(ddt_t *ddt, dmu_tx_t *tx)
+{
+	spa_t *spa = ddt->ddt_spa;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	boolean_t force = ddt->ddt_flush_force;
+	ddt_log_entry_t *ddle;
+	ddt_entry_t *dde;
+	uint64_t total = 0;
+
+	/*
+	 * Don't dirty an otherwise clean txg just to make progress on the
+	 * flush, and never dirty the final txgs of an export (see
+	 * spa_final_dirty_txg()).
+	 */
+	if (txg > spa_final_dirty_txg(spa) ||
+	    (!force && !dmu_objset_is_dirty(spa_meta_objset(spa), txg)))
+		return (0);
+
+	dde = kmem_cache_alloc(ddt_entry_cache, KM_SLEEP);
+
+	for (;;) {
+		ddt_log_t *ddl = ddt->ddt_log_flushing;
+		ddt_log_t *active = ddt->ddt_log_active;
+		uint64_t count, flushed = 0;
+
+		if (avl_is_empty(&ddl->ddl_tree)) {
+			if (ddl->ddl_length != 0)
+				ddt_log_checkpoint(ddt, tx);
+			if (avl_is_empty(&active->ddl_tree) || (!force &&
+			    txg - active->ddl_first_txg <
+			    zfs_dedup_log_txg_max))
+				break;
+			ddt_log_swap(ddt, tx);
+			ddl = ddt->ddt_log_flushing;
+		}
+
+		if (ddt->ddt_flush_rate == 0) {
+			ddt->ddt_flush_rate = MAX(
+			    zfs_dedup_log_flush_entries_min,
+			    avl_numnodes(&ddl->ddl_tree) /
+			    MAX(zfs_dedup_log_flush_txgs, 1));
+		}
+		count = force ? UINT64_MAX : ddt->ddt_flush_rate;
+
+		while (flushed < count &&
+		    (ddle = avl_first(&ddl->ddl_tree)) != NULL) {
+			enum ddt_type otype = ddle->ddle_ztype;
+			enum ddt_class oclass = ddle->ddle_zclass;
+			enum ddt_class nclass = ddt_log_entry_class(ddle);
+
+			dde->dde_key = ddle->ddle_key;
+			memcpy(dde->dde_phys, ddle->ddle_phys,
+			    sizeof (dde->dde_phys));
+			dde->dde_class_start = ddle->ddle_class_start;
+
+			if (otype != DDT_TYPES && (otype != DDT_TYPE_CURRENT ||
+			    oclass != nclass)) {
+				VERIFY0(ddt_object_remove(ddt, otype, oclass,
+				    dde, tx));
+			}
+			if (nclass != DDT_CLASSES) {
+				if (!ddt_object_exists(ddt, DDT_TYPE_CURRENT,
+				    nclass))
+					ddt_object_create(ddt,
+					    DDT_TYPE_CURRENT, nclass, tx);
+				VERIFY0(ddt_object_update(ddt,
+				    DDT_TYPE_CURRENT, nclass, dde, tx));
+			}
+
+			ddt_log_flushed(ddt, ddle);
+			flushed++;
+		}
+
+		if (flushed > 0)
+			ddt_log_checkpoint(ddt, tx);
+		total += flushed;
+
+		if (!force)
+			break;
+	}
+
+	if (force && ddt_log_empty(ddt))
+		ddt->ddt_flush_force = B_FALSE;
+
+	kmem_cache_free(ddt_entry_cache, dde);
+
+	return (total);
 }
 
 static void
@@ -1074,9 +1420,14 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 {
 	spa_t *spa = ddt->ddt_spa;
 	ddt_entry_t *dde;
-	void *cookie = NULL;
+	ddt_log_record_t *dlr = NULL;
+	uint64_t nrecs = 0, flushed = 0;
+	uint64_t nents = 0;
 
-	if (avl_numnodes(&ddt->ddt_tree) == 0)
+	for (int i = 0; i < DDT_SHARDS; i++)
+		nents += avl_numnodes(&ddt->ddt_shards[i].ddts_tree);
+
+	if (nents == 0 && ddt_log_empty(ddt))
 		return;
 
 	ASSERT(spa->spa_uberblock.ub_version >= SPA_VERSION_DEDUP);
@@ -1087,11 +1438,49 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 		    DMU_POOL_DDT_STATS, tx);
 	}
 
-	while ((dde = avl_destroy_nodes(&ddt->ddt_tree, &cookie)) != NULL) {
-		ddt_sync_entry(ddt, dde, tx, txg);
-		ddt_free(dde);
+	/*
+	 * Once entries carry their class start time the ZAP objects can't
+	 * be read by older software, so the feature is never deactivated.
+	 */
+	if (nents != 0 &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_CLASS_START) &&
+	    !spa_feature_is_active(spa, SPA_FEATURE_DEDUP_CLASS_START))
+		spa_feature_incr(spa, SPA_FEATURE_DEDUP_CLASS_START, tx);
+
+	if (nents != 0 && !ddt_log_exists(ddt) &&
+	    spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_LOG))
+		ddt_log_create(ddt, tx);
+	if (nents != 0 && ddt_log_exists(ddt))
+		dlr = vmem_alloc(nents * sizeof (*dlr), KM_SLEEP);
+
+	for (int i = 0; i < DDT_SHARDS; i++) {
+		avl_tree_t *t = &ddt->ddt_shards[i].ddts_tree;
+		void *cookie = NULL;
+
+		while ((dde = avl_destroy_nodes(t, &cookie)) != NULL) {
+			if (ddt_sync_entry(ddt, dde,
+			    dlr == NULL ? NULL : &dlr[nrecs], tx, txg))
+				nrecs++;
+			ddt_free(dde);
+		}
+	}
+
+	if (dlr != NULL) {
+		ddt_log_write(ddt, dlr, nrecs, tx);
+		vmem_free(dlr, nents * sizeof (*dlr));
 	}
 
+	/*
+	 * Flushing is only done in the first pass, and unless entries were
+	 * moved there is nothing more to sync; updating the ZAP objects in
+	 * every pass would keep the txg from converging.
+	 */
+	if (ddt_log_exists(ddt) && spa_sync_pass(spa) == 1)
+		flushed = ddt_sync_flush_log(ddt, tx);
+	if (nents == 0 && flushed == 0)
+		return;
+
+	boolean_t objects = B_FALSE;
 	for (enum ddt_type type = 0; type < DDT_TYPES; type++) {
 		uint64_t add, count = 0;
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
@@ -1103,11 +1492,23 @@ ddt_sync_table(ddt_t *ddt, dmu_tx_t *tx, uint64_t txg)
 			}
 		}
 		for (enum ddt_class class = 0; class < DDT_CLASSES; class++) {
-			if (count == 0 && ddt_object_exists(ddt, type, class))
+			if (!ddt_object_exists(ddt, type, class))
+				continue;
+			if (count == 0 && ddt_log_empty(ddt))
 				ddt_object_destroy(ddt, type, class, tx);
+			else
+				objects = B_TRUE;
 		}
 	}
 
+	/*
+	 * The logs go away with the last entry; they are created again when
+	 * the DDT is next written to.
+	 */
+	if (ddt_log_exists(ddt) && ddt_log_empty(ddt) && !objects &&
+	    ddt->ddt_log_flushing->ddl_length == 0)
+		ddt_log_destroy(ddt, tx);
+
 	memcpy(&ddt->ddt_histogram_cache, ddt->ddt_histogram,
 	    sizeof (ddt->ddt_histogram));
 	spa->spa_dedup_dspace = ~0ULL;
@@ -1150,6 +1551,54 @@ ddt_sync(spa_t *spa, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * An entry found in the ZAP objects may have been superseded by the log.
+ * Substitute the logged state, or return B_FALSE if the entry has since
+ * been freed and should be skipped.
+ */
+static boolean_t
+ddt_walk_log(ddt_t *ddt, ddt_entry_t *dde)
+{
+	boolean_t valid = B_TRUE;
+
+	mutex_enter(&ddt->ddt_lock);
+	ddt_log_entry_t *ddle = ddt_log_find(ddt, &dde->dde_key);
+	if (ddle != NULL) {
+		if (ddt_log_entry_class(ddle) == DDT_CLASSES) {
+			valid = B_FALSE;
+		} else {
+			memcpy(dde->dde_phys, ddle->ddle_phys,
+			    sizeof (dde->dde_phys));
+			dde->dde_class_start = ddle->ddle_class_start;
+		}
+	}
+	mutex_exit(&ddt->ddt_lock);
+
+	return (valid);
+}
+
+/*
+ * A walk of the DDT only sees the ZAP objects, so entries that are only in
+ * a log would be missed.  Returns B_TRUE if the logs are empty; otherwise
+ * asks ddt_sync() to flush them and returns B_FALSE, and the caller should
+ * try again in a later txg.
+ */
+boolean_t
+ddt_walk_ready(spa_t *spa)
+{
+	boolean_t ready = B_TRUE;
+
+	for (enum zio_checksum c = 0; c < ZIO_CHECKSUM_FUNCTIONS; c++) {
+		ddt_t *ddt = spa->spa_ddt[c];
+		if (ddt == NULL || ddt_log_empty(ddt))
+			continue;
+		ddt->ddt_flush_force = B_TRUE;
+		ready = B_FALSE;
+	}
+
+	return (ready);
+}
+
 int
 ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 {
@@ -1158,11 +1607,14 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 			do {
 				ddt_t *ddt = spa->spa_ddt[ddb->ddb_checksum];
 				int error = ENOENT;
-				if (ddt_object_exists(ddt, ddb->ddb_type,
+				while (ddt_object_exists(ddt, ddb->ddb_type,
 				    ddb->ddb_class)) {
 					error = ddt_object_walk(ddt,
 					    ddb->ddb_type, ddb->ddb_class,
 					    &ddb->ddb_cursor, dde);
+					if (error != 0 ||
+					    ddt_walk_log(ddt, dde))
+						break;
 				}
 				dde->dde_type = ddb->ddb_type;
 				dde->dde_class = ddb->ddb_class;
@@ -1180,5 +1632,143 @@ ddt_walk(spa_t *spa, ddt_bookmark_t *ddb, ddt_entry_t *dde)
 	return (SET_ERROR(ENOENT));
 }
 
+/*
+ * Pruning removes unique entries that have not been deduplicated against
+ * for a given time, on the assumption that they never will be.  Their
+ * blocks stay where they are, and are freed as ordinary blocks once their
+ * entry is gone (see zio_ddt_free()).  Entries older than the
+ * dedup_class_start feature don't know their age and are never pruned.
+ *
+ * The unique class is walked in a series of sync tasks, each examining up
+ * to ddt_prune_batch entries, so that the ZAP objects can be modified
+ * without racing with ddt_sync().
+ */
+static const uint64_t ddt_prune_batch = 10000;
+
+typedef struct ddt_prune_arg {
+	enum zio_checksum dpa_checksum;
+	enum ddt_type	dpa_type;
+	uint64_t	dpa_walk;	/* serialized ZAP cursor */
+	uint64_t	dpa_cutoff;	/* prune entries unique since before */
+	uint64_t	dpa_pruned;
+	boolean_t	dpa_done;
+} ddt_prune_arg_t;
+
+static void
+ddt_prune_sync(void *arg, dmu_tx_t *tx)
+{
+	ddt_prune_arg_t *dpa = arg;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	ddt_t *ddt = spa->spa_ddt[dpa->dpa_checksum];
+	enum ddt_type type = dpa->dpa_type;
+	enum ddt_class class = DDT_CLASS_UNIQUE;
+	uint64_t pruned = 0;
+	ddt_entry_t *dde;
+
+	if (!ddt_object_exists(ddt, type, class)) {
+		dpa->dpa_done = B_TRUE;
+		return;
+	}
+
+	dde = kmem_cache_alloc(ddt_entry_cache, KM_SLEEP);
+
+	for (uint64_t n = 0; n < ddt_prune_batch; n++) {
+		if (ddt_object_walk(ddt, type, class, &dpa->dpa_walk,
+		    dde) != 0) {
+			dpa->dpa_done = B_TRUE;
+			break;
+		}
+		if (dde->dde_class_start == 0 ||
+		    dde->dde_class_start > dpa->dpa_cutoff)
+			continue;
+
+		/*
+		 * Entries that are in use this txg or have a newer state in
+		 * the log are left alone.
+		 */
+		ddt_shard_t *ddts = ddt_shard(ddt, &dde->dde_key);
+		mutex_enter(&ddts->ddts_lock);
+		mutex_enter(&ddt->ddt_lock);
+		boolean_t busy =
+		    avl_find(&ddts->ddts_tree, dde, NULL) != NULL ||
+		    ddt_log_find(ddt, &dde->dde_key) != NULL;
+		if (!busy) {
+			dde->dde_type = type;
+			dde->dde_class = class;
+			ddt_stat_update(ddt, dde, -1ULL);
+		}
+		mutex_exit(&ddt->ddt_lock);
+		mutex_exit(&ddts->ddts_lock);
+		if (busy)
+			continue;
+
+		VERIFY0(ddt_object_remove(ddt, type, class, dde, tx));
+		pruned++;
+	}
+
+	kmem_cache_free(ddt_entry_cache, dde);
+
+	if (pruned == 0)
+		return;
+
+	ddt_object_sync(ddt, type, class, tx);
+	memcpy(&ddt->ddt_histogram_cache, ddt->ddt_histogram,
+	    sizeof (ddt->ddt_histogram));
+	spa->spa_dedup_dspace = ~0ULL;
+	dpa->dpa_pruned += pruned;
+}
+
+/*
+ * Remove all unique entries that have been unique for at least age
+ * seconds.  The number of entries removed is returned in *pruned.
+ */
+int
+ddt_prune_unique_entries(spa_t *spa, uint64_t age, uint64_t *pruned)
+{
+	ddt_prune_arg_t dpa = { 0 };
+	uint64_t now = gethrestime_sec();
+	int error = 0;
+
+	*pruned = 0;
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_DEDUP_CLASS_START))
+		return (SET_ERROR(ENOTSUP));
+	if (!spa_feature_is_active(spa, SPA_FEATURE_DEDUP_CLASS_START))
+		return (0);
+
+	dpa.dpa_cutoff = age < now ? now - age : 0;
+
+	for (enum zio_checksum c = 0;
+	    c < ZIO_CHECKSUM_FUNCTIONS && error == 0; c++) {
+		if (spa->spa_ddt[c] == NULL)
+			continue;
+		for (enum ddt_type type = 0;
+		    type < DDT_TYPES && error == 0; type++) {
+			dpa.dpa_checksum = c;
+			dpa.dpa_type = type;
+			dpa.dpa_walk = 0;
+			dpa.dpa_done = B_FALSE;
+			while (!dpa.dpa_done && error == 0) {
+				error = dsl_sync_task(spa_name(spa), NULL,
+				    ddt_prune_sync, &dpa, 0,
+				    ZFS_SPACE_CHECK_EXTRA_RESERVED);
+			}
+		}
+	}
+
+	*pruned = dpa.dpa_pruned;
+
+	return (error);
+}
+
 ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, prefetch, INT, ZMOD_RW,
 	"Enable prefetching dedup-ed blks");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_txg_max, UINT, ZMOD_RW,
+	"Max transactions before starting to flush dedup logs");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_txgs, UINT, ZMOD_RW,
+	"Number of txgs to spread a dedup log flush over");
+
+ZFS_MODULE_PARAM(zfs_dedup, zfs_dedup_, log_flush_entries_min, UINT, ZMOD_RW,
+	"Min number of log entries to flush each transaction");
@@ -0,0 +1,469 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or https://opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+/*
+ * Copyright (c) 2022 by the OpenZFS contributors. All rights reserved.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/ddt.h>
+#include <sys/zap.h>
+#include <sys/dmu_tx.h>
+#include <sys/zio_checksum.h>
+#include <sys/zfeature.h>
+
+/*
+ * DDT log management.  See the comment above ddt_log_header_t for an
+ * overview; the flushing of log entries into the ZAP objects is done by
+ * ddt_sync_flush_log() in ddt.c.
+ *
+ * The log objects are created together, the first time a DDT with the
+ * dedup_log feature enabled is synced, and destroyed together when the DDT
+ * becomes empty.  Records are only ever appended to the active log.  The
+ * flushing log is drained in key order, and the last key flushed is saved
+ * in its header so that records already in the ZAP objects are not loaded
+ * again after an export or crash.  When the flushing log is empty its
+ * object is truncated and the logs can be swapped.
+ *
+ * All in-core log trees are protected by ddt_lock.  They are only
+ * modified in syncing context, but lookups may happen from open context.
+ */
+
+static kmem_cache_t *ddt_log_entry_cache;
+
+/*
+ * Amount of records read at once when loading a log.
+ */
+#define	DDT_LOG_LOAD_CHUNK	\
+	((1024 * 1024 / sizeof (ddt_log_record_t)) * sizeof (ddt_log_record_t))
+
+static int
+ddt_log_entry_compare(const void *x1, const void *x2)
+{
+	const ddt_log_entry_t *ddle1 = x1;
+	const ddt_log_entry_t *ddle2 = x2;
+
+	return (ddt_key_compare(&ddle1->ddle_key, &ddle2->ddle_key));
+}
+
+void
+ddt_log_init(void)
+{
+	ddt_log_entry_cache = kmem_cache_create("ddt_log_entry_cache",
+	    sizeof (ddt_log_entry_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+ddt_log_fini(void)
+{
+	kmem_cache_destroy(ddt_log_entry_cache);
+}
+
+static void
+ddt_log_tree_empty(ddt_log_t *ddl)
+{
+	ddt_log_entry_t *ddle;
+	void *cookie = NULL;
+
+	while ((ddle = avl_destroy_nodes(&ddl->ddl_tree, &cookie)) != NULL)
+		kmem_cache_free(ddt_log_entry_cache, ddle);
+}
+
+void
+ddt_log_alloc(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		avl_create(&ddt->ddt_log[n].ddl_tree, ddt_log_entry_compare,
+		    sizeof (ddt_log_entry_t),
+		    offsetof(ddt_log_entry_t, ddle_node));
+	}
+	ddt->ddt_log_active = &ddt->ddt_log[0];
+	ddt->ddt_log_flushing = &ddt->ddt_log[1];
+}
+
+void
+ddt_log_free(ddt_t *ddt)
+{
+	for (int n = 0; n < 2; n++) {
+		ddt_log_tree_empty(&ddt->ddt_log[n]);
+		avl_destroy(&ddt->ddt_log[n].ddl_tree);
+	}
+}
+
+void
+ddt_log_name(ddt_t *ddt, uint_t n, char *name)
+{
+	(void) snprintf(name, DDT_NAMELEN, DMU_POOL_DDT_LOG,
+	    zio_checksum_table[ddt->ddt_checksum].ci_name, n);
+}
+
+boolean_t
+ddt_log_exists(ddt_t *ddt)
+{
+	return (ddt->ddt_log[0].ddl_object != 0);
+}
+
+boolean_t
+ddt_log_empty(ddt_t *ddt)
+{
+	return (avl_is_empty(&ddt->ddt_log[0].ddl_tree) &&
+	    avl_is_empty(&ddt->ddt_log[1].ddl_tree));
+}
+
+static void
+ddt_log_sync_header(ddt_t *ddt, ddt_log_t *ddl, dmu_tx_t *tx)
+{
+	ddt_log_header_t *dlh;
+	dmu_buf_t *db;
+
+	VERIFY0(dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db));
+	dmu_buf_will_dirty(db, tx);
+	dlh = db->db_data;
+	dlh->dlh_version = DDT_LOG_VERSION;
+	dlh->dlh_flags = ddl->ddl_flags;
+	dlh->dlh_length = ddl->ddl_length;
+	dlh->dlh_first_txg = ddl->ddl_first_txg;
+	dlh->dlh_checkpoint = ddl->ddl_checkpoint;
+	dmu_buf_rele(db, FTAG);
+}
+
+void
+ddt_log_create(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(!ddt_log_exists(ddt));
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddl->ddl_object = dmu_object_alloc(ddt->ddt_os,
+		    DMU_OTN_UINT64_METADATA, SPA_OLD_MAXBLOCKSIZE,
+		    DMU_OTN_UINT64_METADATA, sizeof (ddt_log_header_t), tx);
+		ddl->ddl_flags = (ddl == ddt->ddt_log_flushing) ?
+		    DDT_LOG_FLAG_FLUSHING : 0;
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+		memset(&ddl->ddl_checkpoint, 0, sizeof (ddt_key_t));
+		ddt_log_sync_header(ddt, ddl, tx);
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_add(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+		    sizeof (uint64_t), 1, &ddl->ddl_object, tx));
+	}
+
+	spa_feature_incr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+}
+
+void
+ddt_log_destroy(ddt_t *ddt, dmu_tx_t *tx)
+{
+	char name[DDT_NAMELEN];
+
+	ASSERT(ddt_log_exists(ddt));
+	ASSERT(ddt_log_empty(ddt));
+
+	for (int n = 0; n < 2; n++) {
+		ddt_log_t *ddl = &ddt->ddt_log[n];
+
+		ddt_log_name(ddt, n, name);
+		VERIFY0(zap_remove(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT,
+		    name, tx));
+		VERIFY0(dmu_object_free(ddt->ddt_os, ddl->ddl_object, tx));
+		ddl->ddl_object = 0;
+	}
+
+	spa_feature_decr(ddt->ddt_spa, SPA_FEATURE_DEDUP_LOG, tx);
+}
+
+/*
+ * Insert or replace the in-core entry for a record.
+ */
+static void
+ddt_log_update_entry(ddt_log_t *ddl, const ddt_log_record_t *dlr)
+{
+	ddt_log_entry_t *ddle, search;
+	avl_index_t where;
+
+	search.ddle_key = dlr->dlr_key;
+	ddle = avl_find(&ddl->ddl_tree, &search, &where);
+	if (ddle == NULL) {
+		ddle = kmem_cache_alloc(ddt_log_entry_cache, KM_SLEEP);
+		ddle->ddle_key = dlr->dlr_key;
+		avl_insert(&ddl->ddl_tree, ddle, where);
+	}
+	memcpy(ddle->ddle_phys, dlr->dlr_phys, sizeof (ddle->ddle_phys));
+	ddle->ddle_ztype = DLR_GET_TYPE(dlr);
+	ddle->ddle_zclass = DLR_GET_CLASS(dlr);
+	ddle->ddle_class_start = DLR_GET_CLASS_START(dlr);
+}
+
+static int
+ddt_log_load_one(ddt_t *ddt, uint_t n)
+{
+	ddt_log_t *ddl = &ddt->ddt_log[n];
+	ddt_log_header_t dlh;
+	ddt_log_record_t *dlr;
+	char name[DDT_NAMELEN];
+	dmu_buf_t *db;
+	int error;
+
+	ddt_log_name(ddt, n, name);
+	error = zap_lookup(ddt->ddt_os, DMU_POOL_DIRECTORY_OBJECT, name,
+	    sizeof (uint64_t), 1, &ddl->ddl_object);
+	if (error != 0)
+		return (error);
+
+	error = dmu_bonus_hold(ddt->ddt_os, ddl->ddl_object, FTAG, &db);
+	if (error != 0)
+		return (error);
+	memcpy(&dlh, db->db_data, sizeof (dlh));
+	dmu_buf_rele(db, FTAG);
+
+	if (dlh.dlh_version != DDT_LOG_VERSION)
+		return (SET_ERROR(ENOTSUP));
+
+	ddl->ddl_flags = dlh.dlh_flags;
+	ddl->ddl_length = dlh.dlh_length;
+	ddl->ddl_first_txg = dlh.dlh_first_txg;
+	ddl->ddl_checkpoint = dlh.dlh_checkpoint;
+
+	dlr = vmem_alloc(DDT_LOG_LOAD_CHUNK, KM_SLEEP);
+	for (uint64_t off = 0; off < ddl->ddl_length;
+	    off += DDT_LOG_LOAD_CHUNK) {
+		uint64_t len = MIN(DDT_LOG_LOAD_CHUNK, ddl->ddl_length - off);
+
+		error = dmu_read(ddt->ddt_os, ddl->ddl_object, off, len, dlr,
+		    DMU_READ_PREFETCH);
+		if (error != 0)
+			break;
+
+		for (uint64_t i = 0; i < len / sizeof (*dlr); i++) {
+			/*
+			 * Records up to the checkpoint were already written
+			 * to the ZAP objects before the pool was exported.
+			 */
+			if ((ddl->ddl_flags & DDT_LOG_FLAG_CHECKPOINT) &&
+			    ddt_key_compare(&dlr[i].dlr_key,
+			    &ddl->ddl_checkpoint) <= 0)
+				continue;
+			ddt_log_update_entry(ddl, &dlr[i]);
+		}
+	}
+	vmem_free(dlr, DDT_LOG_LOAD_CHUNK);
+
+	return (error);
+}
+
+int
+ddt_log_load(ddt_t *ddt)
+{
+	ddt_log_entry_t *ddle, *next;
+	int error;
+
+	error = ddt_log_load_one(ddt, 0);
+	if (error == ENOENT)
+		return (0);
+	if (error == 0)
+		error = ddt_log_load_one(ddt, 1);
+	if (error != 0)
+		return (error);
+
+	if (ddt->ddt_log[0].ddl_flags & DDT_LOG_FLAG_FLUSHING) {
+		ddt->ddt_log_flushing = &ddt->ddt_log[0];
+		ddt->ddt_log_active = &ddt->ddt_log[1];
+	} else {
+		ddt->ddt_log_active = &ddt->ddt_log[0];
+		ddt->ddt_log_flushing = &ddt->ddt_log[1];
+	}
+
+	/*
+	 * The active log supersedes anything still in the flushing log.
+	 */
+	avl_tree_t *t = &ddt->ddt_log_flushing->ddl_tree;
+	for (ddle = avl_first(t); ddle != NULL; ddle = next) {
+		next = AVL_NEXT(t, ddle);
+		if (avl_find(&ddt->ddt_log_active->ddl_tree, ddle,
+		    NULL) != NULL) {
+			avl_remove(t, ddle);
+			kmem_cache_free(ddt_log_entry_cache, ddle);
+		}
+	}
+
+	ddt->ddt_flush_rate = 0;
+
+	return (0);
+}
+
+/*
+ * Find the most recent log entry for a key.  Caller must hold ddt_lock.
+ */
+ddt_log_entry_t *
+ddt_log_find(ddt_t *ddt, const ddt_key_t *ddk)
+{
+	ddt_log_entry_t search, *ddle;
+
+	ASSERT(MUTEX_HELD(&ddt->ddt_lock));
+
+	search.ddle_key = *ddk;
+	ddle = avl_find(&ddt->ddt_log_active->ddl_tree, &search, NULL);
+	if (ddle == NULL)
+		ddle = avl_find(&ddt->ddt_log_flushing->ddl_tree, &search,
+		    NULL);
+
+	return (ddle);
+}
+
+/*
+ * Record the new state of an entry in the active log.  The on-disk record
+ * is filled into dlr, to be written out with ddt_log_write().  Returns
+ * B_FALSE if nothing needs to be logged, which is the case for an entry
+ * which was freed without ever reaching the log or the ZAP objects.
+ */
+boolean_t
+ddt_log_add(ddt_t *ddt, const ddt_entry_t *dde, ddt_log_record_t *dlr)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	ddt_log_entry_t search, *ddle, *oddle;
+	avl_index_t where;
+
+	search.ddle_key = dde->dde_key;
+
+	mutex_enter(&ddt->ddt_lock);
+	oddle = avl_find(&ddt->ddt_log_flushing->ddl_tree, &search, NULL);
+	if (oddle != NULL) {
+		avl_remove(&ddt->ddt_log_flushing->ddl_tree, oddle);
+		kmem_cache_free(ddt_log_entry_cache, oddle);
+	}
+
+	ddle = avl_find(&ddl->ddl_tree, &search, &where);
+	if (ddle == NULL && oddle == NULL && dde->dde_ztype == DDT_TYPES &&
+	    ddt_phys_total_refcnt(dde) == 0) {
+		mutex_exit(&ddt->ddt_lock);
+		return (B_FALSE);
+	}
+
+	memset(dlr, 0, sizeof (*dlr));
+	dlr->dlr_key = dde->dde_key;
+	memcpy(dlr->dlr_phys, dde->dde_phys, sizeof (dlr->dlr_phys));
+	DLR_SET_TYPE(dlr, dde->dde_ztype);
+	DLR_SET_CLASS(dlr, dde->dde_zclass);
+	DLR_SET_CLASS_START(dlr, dde->dde_class_start);
+
+	ddt_log_update_entry(ddl, dlr);
+	mutex_exit(&ddt->ddt_lock);
+
+	return (B_TRUE);
+}
+
+/*
+ * Append records to the active log.
+ */
+void
+ddt_log_write(ddt_t *ddt, const ddt_log_record_t *dlr, uint64_t count,
+    dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_active;
+	uint64_t size = count * sizeof (*dlr);
+
+	ASSERT(dmu_tx_is_syncing(tx));
+
+	if (count == 0)
+		return;
+
+	dmu_write(ddt->ddt_os, ddl->ddl_object, ddl->ddl_length, size, dlr,
+	    tx);
+	if (ddl->ddl_length == 0)
+		ddl->ddl_first_txg = dmu_tx_get_txg(tx);
+	ddl->ddl_length += size;
+	ddt_log_sync_header(ddt, ddl, tx);
+}
+
+/*
+ * Make the active log the flushing one.  The flushing log must have been
+ * drained already.
+ */
+void
+ddt_log_swap(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	ASSERT(avl_is_empty(&ddl->ddl_tree));
+	ASSERT0(ddl->ddl_length);
+
+	mutex_enter(&ddt->ddt_lock);
+	ddt->ddt_log_flushing = ddt->ddt_log_active;
+	ddt->ddt_log_active = ddl;
+	mutex_exit(&ddt->ddt_lock);
+
+	ddt->ddt_log_active->ddl_flags = 0;
+	ddt->ddt_log_flushing->ddl_flags = DDT_LOG_FLAG_FLUSHING;
+	memset(&ddt->ddt_log_flushing->ddl_checkpoint, 0, sizeof (ddt_key_t));
+	ddt_log_sync_header(ddt, ddt->ddt_log_active, tx);
+	ddt_log_sync_header(ddt, ddt->ddt_log_flushing, tx);
+
+	ddt->ddt_flush_rate = 0;
+}
+
+/*
+ * Remove an entry from the flushing log once it was written to the ZAP
+ * objects.  Entries must be flushed in key order.
+ */
+void
+ddt_log_flushed(ddt_t *ddt, ddt_log_entry_t *ddle)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	ASSERT3P(ddle, ==, avl_first(&ddl->ddl_tree));
+
+	ddl->ddl_checkpoint = ddle->ddle_key;
+	ddl->ddl_flags |= DDT_LOG_FLAG_CHECKPOINT;
+
+	mutex_enter(&ddt->ddt_lock);
+	avl_remove(&ddl->ddl_tree, ddle);
+	mutex_exit(&ddt->ddt_lock);
+
+	kmem_cache_free(ddt_log_entry_cache, ddle);
+}
+
+/*
+ * Persist the flushing progress.  Once the flushing log is drained, its
+ * records are freed so it can become the active log again.
+ */
+void
+ddt_log_checkpoint(ddt_t *ddt, dmu_tx_t *tx)
+{
+	ddt_log_t *ddl = ddt->ddt_log_flushing;
+
+	if (avl_is_empty(&ddl->ddl_tree) && ddl->ddl_length != 0) {
+		VERIFY0(dmu_free_range(ddt->ddt_os, ddl->ddl_object, 0,
+		    DMU_OBJECT_END, tx));
+		ddl->ddl_length = 0;
+		ddl->ddl_first_txg = 0;
+		ddl->ddl_flags &= ~DDT_LOG_FLAG_CHECKPOINT;
+		memset(&ddl->ddl_checkpoint, 0, sizeof (ddt_key_t));
+	}
+
+	ddt_log_sync_header(ddt, ddl, tx);
+}
@@ -34,6 +34,34 @@
 static const int ddt_zap_leaf_blockshift = 12;
 static const int ddt_zap_indirect_blockshift = 12;
 
+/*
+ * Entries that know when they entered their class are stored with the
+ * time following the phys array, and DDT_COMPRESS_CLASS_START_MASK set in
+ * the version byte.  Entries without it keep the original format.
+ */
+typedef struct ddt_zap_value {
+	ddt_phys_t	dzv_phys[DDT_PHYS_TYPES];
+	uint64_t	dzv_class_start;
+} ddt_zap_value_t;
+
+#define	DDT_ZAP_CBUF_SIZE	(sizeof (ddt_zap_value_t) + 1)
+
+static void
+ddt_zap_decode(uchar_t *cbuf, uint64_t csize, ddt_entry_t *dde)
+{
+	if (cbuf[0] & DDT_COMPRESS_CLASS_START_MASK) {
+		ddt_zap_value_t dzv;
+
+		ddt_decompress(cbuf, &dzv, csize, sizeof (dzv));
+		memcpy(dde->dde_phys, dzv.dzv_phys, sizeof (dde->dde_phys));
+		dde->dde_class_start = dzv.dzv_class_start;
+	} else {
+		ddt_decompress(cbuf, dde->dde_phys, csize,
+		    sizeof (dde->dde_phys));
+		dde->dde_class_start = 0;
+	}
+}
+
 static int
 ddt_zap_create(objset_t *os, uint64_t *objectp, dmu_tx_t *tx, boolean_t prehash)
 {
@@ -62,7 +90,7 @@ ddt_zap_lookup(objset_t *os, uint64_t object, ddt_entry_t *dde)
 	uint64_t one, csize;
 	int error;
 
-	cbuf = kmem_alloc(sizeof (dde->dde_phys) + 1, KM_SLEEP);
+	cbuf = kmem_alloc(DDT_ZAP_CBUF_SIZE, KM_SLEEP);
 
 	error = zap_length_uint64(os, object, (uint64_t *)&dde->dde_key,
 	    DDT_KEY_WORDS, &one, &csize);
@@ -70,16 +98,16 @@ ddt_zap_lookup(objset_t *os, uint64_t object, ddt_entry_t *dde)
 		goto out;
 
 	ASSERT(one == 1);
-	ASSERT(csize <= (sizeof (dde->dde_phys) + 1));
+	ASSERT(csize <= DDT_ZAP_CBUF_SIZE);
 
 	error = zap_lookup_uint64(os, object, (uint64_t *)&dde->dde_key,
 	    DDT_KEY_WORDS, 1, csize, cbuf);
 	if (error)
 		goto out;
 
-	ddt_decompress(cbuf, dde->dde_phys, csize, sizeof (dde->dde_phys));
+	ddt_zap_decode(cbuf, csize, dde);
 out:
-	kmem_free(cbuf, sizeof (dde->dde_phys) + 1);
+	kmem_free(cbuf, DDT_ZAP_CBUF_SIZE);
 
 	return (error);
 }
@@ -94,11 +122,20 @@ ddt_zap_prefetch(objset_t *os, uint64_t object, ddt_entry_t *dde)
 static int
 ddt_zap_update(objset_t *os, uint64_t object, ddt_entry_t *dde, dmu_tx_t *tx)
 {
-	uchar_t cbuf[sizeof (dde->dde_phys) + 1];
+	uchar_t cbuf[DDT_ZAP_CBUF_SIZE];
 	uint64_t csize;
 
-	csize = ddt_compress(dde->dde_phys, cbuf,
-	    sizeof (dde->dde_phys), sizeof (cbuf));
+	if (dde->dde_class_start != 0) {
+		ddt_zap_value_t dzv;
+
+		memcpy(dzv.dzv_phys, dde->dde_phys, sizeof (dzv.dzv_phys));
+		dzv.dzv_class_start = dde->dde_class_start;
+		csize = ddt_compress(&dzv, cbuf, sizeof (dzv), sizeof (cbuf));
+		cbuf[0] |= DDT_COMPRESS_CLASS_START_MASK;
+	} else {
+		csize = ddt_compress(dde->dde_phys, cbuf,
+		    sizeof (dde->dde_phys), sizeof (cbuf));
+	}
 
 	return (zap_update_uint64(os, object, (uint64_t *)&dde->dde_key,
 	    DDT_KEY_WORDS, 1, csize, cbuf, tx));
@@ -131,15 +168,15 @@ ddt_zap_walk(objset_t *os, uint64_t object, ddt_entry_t *dde, uint64_t *walk)
 		zap_cursor_init_serialized(&zc, os, object, *walk);
 	}
 	if ((error = zap_cursor_retrieve(&zc, &za)) == 0) {
-		uchar_t cbuf[sizeof (dde->dde_phys) + 1];
+		uchar_t cbuf[DDT_ZAP_CBUF_SIZE];
 		uint64_t csize = za.za_num_integers;
 		ASSERT(za.za_integer_length == 1);
+		ASSERT(csize <= sizeof (cbuf));
 		error = zap_lookup_uint64(os, object, (uint64_t *)za.za_name,
 		    DDT_KEY_WORDS, 1, csize, cbuf);
 		ASSERT(error == 0);
 		if (error == 0) {
-			ddt_decompress(cbuf, dde->dde_phys, csize,
-			    sizeof (dde->dde_phys));
+			ddt_zap_decode(cbuf, csize, dde);
 			dde->dde_key = *(ddt_key_t *)za.za_name;
 		}
 		zap_cursor_advance(&zc);
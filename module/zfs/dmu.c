@@ -54,6 +54,7 @@
 #include <sys/trace_zfs.h>
 #include <sys/zfs_racct.h>
 #include <sys/zfs_rlock.h>
+#include <sys/brt.h>
 #ifdef _KERNEL
 #include <sys/vmsystm.h>
 #include <sys/zfs_znode.h>
@@ -1465,9 +1466,9 @@ dmu_assign_arcbuf_by_dnode(dnode_t *dn, uint64_t offset, arc_buf_t *buf,
 	rw_enter(&dn->dn_struct_rwlock, RW_READER);
 	blkid = dbuf_whichblock(dn, 0, offset);
 	db = dbuf_hold(dn, blkid, FTAG);
+	rw_exit(&dn->dn_struct_rwlock);
 	if (db == NULL)
 		return (SET_ERROR(EIO));
-	rw_exit(&dn->dn_struct_rwlock);
 
 	/*
 	 * We can only assign if the offset is aligned and the arc buf is the
@@ -1514,9 +1515,7 @@ typedef struct {
 static void
 dmu_sync_ready(zio_t *zio, arc_buf_t *buf, void *varg)
 {
-	(void) buf;
-	dmu_sync_arg_t *dsa = varg;
-	dmu_buf_t *db = dsa->dsa_zgd->zgd_db;
+	(void) buf, (void) varg;
 	blkptr_t *bp = zio->io_bp;
 
 	if (zio->io_error == 0) {
@@ -1525,7 +1524,7 @@ dmu_sync_ready(zio_t *zio, arc_buf_t *buf, void *varg)
 			 * A block of zeros may compress to a hole, but the
 			 * block size still needs to be known for replay.
 			 */
-			BP_SET_LSIZE(bp, db->db_size);
+			BP_SET_LSIZE(bp, zio->io_lsize);
 		} else if (!BP_IS_EMBEDDED(bp)) {
 			ASSERT(BP_GET_LEVEL(bp) == 0);
 			BP_SET_FILL(bp, 1);
@@ -1539,6 +1538,48 @@ dmu_sync_late_arrival_ready(zio_t *zio)
 	dmu_sync_ready(zio, NULL, zio->io_private);
 }
 
+/*
+ * Override the dirty record with the block pointer written by zio.
+ */
+static void
+dmu_sync_override(zio_t *zio, dbuf_dirty_record_t *dr)
+{
+	dmu_buf_impl_t *db __maybe_unused = dr->dr_dbuf;
+
+	ASSERT(MUTEX_HELD(&db->db_mtx));
+	ASSERT0(zio->io_error);
+
+	dr->dt.dl.dr_nopwrite = !!(zio->io_flags & ZIO_FLAG_NOPWRITE);
+	if (dr->dt.dl.dr_nopwrite) {
+		blkptr_t *bp = zio->io_bp;
+		blkptr_t *bp_orig = &zio->io_bp_orig;
+		uint8_t chksum = BP_GET_CHECKSUM(bp_orig);
+
+		ASSERT(BP_EQUAL(bp, bp_orig));
+		VERIFY(BP_EQUAL(bp, db->db_blkptr));
+		ASSERT(zio->io_prop.zp_compress != ZIO_COMPRESS_OFF);
+		VERIFY(zio_checksum_table[chksum].ci_flags &
+		    ZCHECKSUM_FLAG_NOPWRITE);
+	}
+	dr->dt.dl.dr_overridden_by = *zio->io_bp;
+	dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+	dr->dt.dl.dr_copies = zio->io_prop.zp_copies;
+
+	/*
+	 * Old style holes are filled with all zeros, whereas
+	 * new-style holes maintain their lsize, type, level,
+	 * and birth time (see zio_write_compress). While we
+	 * need to reset the BP_SET_LSIZE() call that happened
+	 * in dmu_sync_ready for old style holes, we do *not*
+	 * want to wipe out the information contained in new
+	 * style holes. Thus, only zero out the block pointer if
+	 * it's an old style hole.
+	 */
+	if (BP_IS_HOLE(&dr->dt.dl.dr_overridden_by) &&
+	    dr->dt.dl.dr_overridden_by.blk_birth == 0)
+		BP_ZERO(&dr->dt.dl.dr_overridden_by);
+}
+
 static void
 dmu_sync_done(zio_t *zio, arc_buf_t *buf, void *varg)
 {
@@ -1558,39 +1599,10 @@ dmu_sync_done(zio_t *zio, arc_buf_t *buf, void *varg)
 
 	mutex_enter(&db->db_mtx);
 	ASSERT(dr->dt.dl.dr_override_state == DR_IN_DMU_SYNC);
-	if (zio->io_error == 0) {
-		dr->dt.dl.dr_nopwrite = !!(zio->io_flags & ZIO_FLAG_NOPWRITE);
-		if (dr->dt.dl.dr_nopwrite) {
-			blkptr_t *bp = zio->io_bp;
-			blkptr_t *bp_orig = &zio->io_bp_orig;
-			uint8_t chksum = BP_GET_CHECKSUM(bp_orig);
-
-			ASSERT(BP_EQUAL(bp, bp_orig));
-			VERIFY(BP_EQUAL(bp, db->db_blkptr));
-			ASSERT(zio->io_prop.zp_compress != ZIO_COMPRESS_OFF);
-			VERIFY(zio_checksum_table[chksum].ci_flags &
-			    ZCHECKSUM_FLAG_NOPWRITE);
-		}
-		dr->dt.dl.dr_overridden_by = *zio->io_bp;
-		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
-		dr->dt.dl.dr_copies = zio->io_prop.zp_copies;
-
-		/*
-		 * Old style holes are filled with all zeros, whereas
-		 * new-style holes maintain their lsize, type, level,
-		 * and birth time (see zio_write_compress). While we
-		 * need to reset the BP_SET_LSIZE() call that happened
-		 * in dmu_sync_ready for old style holes, we do *not*
-		 * want to wipe out the information contained in new
-		 * style holes. Thus, only zero out the block pointer if
-		 * it's an old style hole.
-		 */
-		if (BP_IS_HOLE(&dr->dt.dl.dr_overridden_by) &&
-		    dr->dt.dl.dr_overridden_by.blk_birth == 0)
-			BP_ZERO(&dr->dt.dl.dr_overridden_by);
-	} else {
+	if (zio->io_error == 0)
+		dmu_sync_override(zio, dr);
+	else
 		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
-	}
 	cv_broadcast(&db->db_changed);
 	mutex_exit(&db->db_mtx);
 
@@ -1638,6 +1650,16 @@ dmu_sync_late_arrival(zio_t *pio, objset_t *os, dmu_sync_cb_t *done, zgd_t *zgd,
 	dmu_sync_arg_t *dsa;
 	dmu_tx_t *tx;
 
+	/*
+	 * The caller need not have read the dbuf, if it is being
+	 * synced the data is written from it again.
+	 */
+	if (dbuf_read((dmu_buf_impl_t *)zgd->zgd_db, NULL,
+	    DB_RF_CANFAIL | DB_RF_NOPREFETCH) != 0) {
+		/* Make zl_get_data do txg_waited_synced() */
+		return (SET_ERROR(EIO));
+	}
+
 	tx = dmu_tx_create(os);
 	dmu_tx_hold_space(tx, zgd->zgd_db->db_size);
 	if (dmu_tx_assign(tx, TXG_WAIT) != 0) {
@@ -1714,7 +1736,9 @@ dmu_sync_late_arrival(zio_t *pio, objset_t *os, dmu_sync_cb_t *done, zgd_t *zgd,
  *		The caller should log this blkptr in the done callback.
  *		It is possible that the I/O will fail, in which case
  *		the error will be reported to the done callback and
- *		propagated to pio from zio_done().
+ *		propagated to pio from zio_done().  If the block was
+ *		written by dmu_write_direct() no I/O is needed and the
+ *		done callback has already been called.
  */
 int
 dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
@@ -1739,12 +1763,6 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	dmu_write_policy(os, dn, db->db_level, WP_DMU_SYNC, &zp);
 	DB_DNODE_EXIT(db);
 
-	/*
-	 * If we're frozen (running ziltest), we always need to generate a bp.
-	 */
-	if (txg > spa_freeze_txg(os->os_spa))
-		return (dmu_sync_late_arrival(pio, os, done, zgd, &zp, &zb));
-
 	/*
 	 * Grabbing db_mtx now provides a barrier between dbuf_sync_leaf()
 	 * and us.  If we determine that this txg is not yet syncing,
@@ -1761,6 +1779,30 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 		return (SET_ERROR(EEXIST));
 	}
 
+	dr = dbuf_find_dirty_eq(db, txg);
+
+	if (dr != NULL && dr->dt.dl.dr_diowrite) {
+		/*
+		 * The block was written by dmu_write_direct(), which waited
+		 * for the write to complete.  Only its bp needs to be logged.
+		 */
+		ASSERT3U(dr->dt.dl.dr_override_state, ==, DR_OVERRIDDEN);
+		*zgd->zgd_bp = dr->dt.dl.dr_overridden_by;
+		mutex_exit(&db->db_mtx);
+
+		zil_lwb_add_block(zgd->zgd_lwb, zgd->zgd_bp);
+		done(zgd, 0);
+		return (0);
+	}
+
+	/*
+	 * If we're frozen (running ziltest), we always need to generate a bp.
+	 */
+	if (txg > spa_freeze_txg(os->os_spa)) {
+		mutex_exit(&db->db_mtx);
+		return (dmu_sync_late_arrival(pio, os, done, zgd, &zp, &zb));
+	}
+
 	if (txg <= spa_syncing_txg(os->os_spa)) {
 		/*
 		 * This txg is currently syncing, so we can't mess with
@@ -1770,8 +1812,6 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 		return (dmu_sync_late_arrival(pio, os, done, zgd, &zp, &zb));
 	}
 
-	dr = dbuf_find_dirty_eq(db, txg);
-
 	if (dr == NULL) {
 		/*
 		 * There's no dr for this dbuf, so it must have been freed.
@@ -1857,6 +1897,234 @@ dmu_sync(zio_t *pio, uint64_t txg, dmu_sync_cb_t *done, zgd_t *zgd)
 	return (0);
 }
 
+static void
+dmu_write_direct_ready(zio_t *zio)
+{
+	dmu_sync_ready(zio, NULL, zio->io_private);
+}
+
+static void
+dmu_write_direct_done(zio_t *zio)
+{
+	dbuf_dirty_record_t *dr = zio->io_private;
+	dmu_buf_impl_t *db = dr->dr_dbuf;
+
+	mutex_enter(&db->db_mtx);
+	ASSERT3U(dr->dt.dl.dr_override_state, ==, DR_IN_DMU_SYNC);
+	if (zio->io_error == 0) {
+		dmu_sync_override(zio, dr);
+	} else {
+		BP_ZERO(&dr->dt.dl.dr_overridden_by);
+		dr->dt.dl.dr_override_state = DR_NOT_OVERRIDDEN;
+		dr->dt.dl.dr_diowrite = B_FALSE;
+	}
+	cv_broadcast(&db->db_changed);
+	mutex_exit(&db->db_mtx);
+
+	abd_free(zio->io_abd);
+}
+
+/*
+ * Direct I/O: write whole blocks straight from the caller's data, without
+ * copying them into the ARC.  The blocks are written in open context, like
+ * dmu_sync() does, and the dbufs are overridden with the resulting bps so
+ * that syncing context only has to link them into the tree.  The range must
+ * be block aligned.  Blocks that fail to be written are dirtied the regular
+ * way from the same data, leaving it to syncing context to write them.
+ */
+int
+dmu_write_direct(dnode_t *dn, uint64_t offset, uint64_t size, abd_t *data,
+    dmu_tx_t *tx)
+{
+	objset_t *os = dn->dn_objset;
+	uint64_t txg = dmu_tx_get_txg(tx);
+	dmu_buf_t **dbp;
+	int numbufs, err;
+	zio_t *pio;
+
+	ASSERT3U(abd_get_size(data), >=, size);
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, B_FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err != 0)
+		return (err);
+
+	pio = zio_root(os->os_spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dbuf_dirty_record_t *dr;
+		zbookmark_phys_t zb;
+		zio_prop_t zp;
+
+		ASSERT0(db->db_level);
+		ASSERT3U(db->db.db_offset, >=, offset);
+		ASSERT3U(db->db.db_offset + db->db.db_size, <=, offset + size);
+
+		SET_BOOKMARK(&zb, dmu_objset_id(os), db->db.db_object,
+		    db->db_level, db->db_blkid);
+
+		/*
+		 * Whether the bp will change before this txg syncs is not
+		 * known here, so nopwrite is not safe (see dmu_sync()).
+		 */
+		dmu_write_policy(os, dn, db->db_level, WP_DMU_SYNC, &zp);
+		zp.zp_nopwrite = B_FALSE;
+
+		dmu_buf_will_clone(&db->db, tx);
+
+		mutex_enter(&db->db_mtx);
+		dr = dbuf_find_dirty_eq(db, txg);
+		VERIFY3P(dr, !=, NULL);
+		ASSERT3U(dr->dt.dl.dr_override_state, ==, DR_NOT_OVERRIDDEN);
+		BP_ZERO(&dr->dt.dl.dr_overridden_by);
+		dr->dt.dl.dr_override_state = DR_IN_DMU_SYNC;
+		dr->dt.dl.dr_diowrite = B_TRUE;
+		mutex_exit(&db->db_mtx);
+
+		zio_nowait(zio_write(pio, os->os_spa, txg,
+		    &dr->dt.dl.dr_overridden_by,
+		    abd_get_offset_size(data, db->db.db_offset - offset,
+		    db->db.db_size), db->db.db_size, db->db.db_size, &zp,
+		    dmu_write_direct_ready, NULL, NULL, dmu_write_direct_done,
+		    dr, ZIO_PRIORITY_SYNC_WRITE, ZIO_FLAG_CANFAIL, &zb));
+	}
+
+	if (zio_wait(pio) != 0) {
+		for (int i = 0; i < numbufs; i++) {
+			dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+			dbuf_dirty_record_t *dr;
+			boolean_t written;
+
+			mutex_enter(&db->db_mtx);
+			dr = dbuf_find_dirty_eq(db, txg);
+			written = (dr != NULL && dr->dt.dl.dr_diowrite);
+			mutex_exit(&db->db_mtx);
+			if (written)
+				continue;
+
+			dmu_buf_will_fill(&db->db, tx);
+			abd_copy_to_buf_off(db->db.db_data, data,
+			    db->db.db_offset - offset, db->db.db_size);
+			dmu_buf_fill_done(&db->db, tx);
+		}
+	}
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+	return (0);
+}
+
+static void
+dmu_read_direct_done(zio_t *zio)
+{
+	abd_free(zio->io_abd);
+}
+
+/*
+ * Direct I/O: read whole blocks straight into the caller's data, without
+ * caching them in the ARC.  Blocks which are already cached or dirty are
+ * copied from their dbufs, and those whose bp can't be read without the
+ * ARC (i.e. encrypted ones) are read through it.  The range must be block
+ * aligned.
+ */
+int
+dmu_read_direct(dnode_t *dn, uint64_t offset, uint64_t size, abd_t *data)
+{
+	spa_t *spa = dn->dn_objset->os_spa;
+	dmu_buf_t **dbp;
+	int numbufs, err;
+	zio_t *rio;
+
+	ASSERT3U(abd_get_size(data), >=, size);
+
+	err = dmu_buf_hold_array_by_dnode(dn, offset, size, B_FALSE, FTAG,
+	    &numbufs, &dbp, DMU_READ_NO_PREFETCH);
+	if (err != 0)
+		return (err);
+
+	rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < numbufs && err == 0; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		uint64_t bufoff = db->db.db_offset - offset;
+		dbuf_dirty_record_t *dr;
+		db_lock_type_t dblt;
+		zbookmark_phys_t zb;
+		blkptr_t bp;
+
+		ASSERT0(db->db_level);
+		ASSERT3U(db->db.db_offset, >=, offset);
+		ASSERT3U(db->db.db_offset + db->db.db_size, <=, offset + size);
+
+		mutex_enter(&db->db_mtx);
+		while (db->db_state == DB_READ || db->db_state == DB_FILL)
+			cv_wait(&db->db_changed, &db->db_mtx);
+
+		if (db->db_state == DB_CACHED) {
+			abd_copy_from_buf_off(data, db->db.db_data, bufoff,
+			    db->db.db_size);
+			mutex_exit(&db->db_mtx);
+			continue;
+		}
+
+		if (db->db_state == DB_NOFILL) {
+			/*
+			 * A pending clone or Direct I/O write, read the
+			 * block it is overridden by.
+			 */
+			dr = list_head(&db->db_dirty_records);
+			if (dr == NULL || (!dr->dt.dl.dr_brtwrite &&
+			    !(dr->dt.dl.dr_diowrite &&
+			    dr->dt.dl.dr_override_state == DR_OVERRIDDEN)))
+				goto buffered;
+			bp = dr->dt.dl.dr_overridden_by;
+			mutex_exit(&db->db_mtx);
+		} else {
+			ASSERT3U(db->db_state, ==, DB_UNCACHED);
+			mutex_exit(&db->db_mtx);
+
+			dblt = dmu_buf_lock_parent(db, RW_READER, FTAG);
+			if (db->db_blkptr == NULL ||
+			    dnode_block_freed(dn, db->db_blkid)) {
+				BP_ZERO(&bp);
+			} else {
+				bp = *db->db_blkptr;
+			}
+			dmu_buf_unlock_parent(db, dblt, FTAG);
+		}
+
+		if (BP_IS_HOLE(&bp)) {
+			abd_zero_off(data, bufoff, db->db.db_size);
+			continue;
+		}
+
+		if (BP_USES_CRYPT(&bp) || BP_IS_REDACTED(&bp)) {
+			mutex_enter(&db->db_mtx);
+			goto buffered;
+		}
+
+		ASSERT3U(BP_GET_LSIZE(&bp), ==, db->db.db_size);
+		SET_BOOKMARK(&zb, dmu_objset_id(dn->dn_objset),
+		    db->db.db_object, db->db_level, db->db_blkid);
+		zfs_racct_read(db->db.db_size, 1);
+		zio_nowait(zio_read(rio, spa, &bp,
+		    abd_get_offset_size(data, bufoff, db->db.db_size),
+		    db->db.db_size, dmu_read_direct_done, NULL,
+		    ZIO_PRIORITY_SYNC_READ, ZIO_FLAG_CANFAIL, &zb));
+		continue;
+
+buffered:
+		mutex_exit(&db->db_mtx);
+		err = dbuf_read(db, NULL, DB_RF_CANFAIL | DB_RF_NOPREFETCH);
+		if (err == 0) {
+			abd_copy_from_buf_off(data, db->db.db_data, bufoff,
+			    db->db.db_size);
+		}
+	}
+
+	err = zio_worst_error(err, zio_wait(rio));
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+	return (err);
+}
+
 int
 dmu_object_set_nlevels(objset_t *os, uint64_t object, int nlevels, dmu_tx_t *tx)
 {
@@ -2081,6 +2349,7 @@ dmu_write_policy(objset_t *os, dnode_t *dn, int level, int wp, zio_prop_t *zp)
 	zp->zp_dedup = dedup;
 	zp->zp_dedup_verify = dedup && dedup_verify;
 	zp->zp_nopwrite = nopwrite;
+	zp->zp_brtwrite = B_FALSE;
 	zp->zp_encrypt = encrypt;
 	zp->zp_byteorder = ZFS_HOST_BYTEORDER;
 	memset(zp->zp_salt, 0, ZIO_DATA_SALT_LEN);
@@ -2144,6 +2413,144 @@ restart:
 	return (err);
 }
 
+int
+dmu_read_l0_bps(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, blkptr_t *bps, size_t *nbpsp)
+{
+	dmu_buf_t **dbp;
+	int error, numbufs;
+
+	error = dmu_buf_hold_array(os, object, offset, length, FALSE, FTAG,
+	    &numbufs, &dbp);
+	if (error != 0)
+		return (error);
+
+	ASSERT3U(numbufs, <=, *nbpsp);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		dbuf_dirty_record_t *dr;
+		const blkptr_t *bp;
+		boolean_t freed;
+		dnode_t *dn;
+
+		mutex_enter(&db->db_mtx);
+		dr = list_head(&db->db_dirty_records);
+		if (dr != NULL && dr->dt.dl.dr_brtwrite) {
+			/*
+			 * The block was cloned in an open txg and is being
+			 * cloned again; reuse the block pointer it was
+			 * cloned from.
+			 */
+			ASSERT3U(dr->dt.dl.dr_override_state, ==,
+			    DR_OVERRIDDEN);
+			bp = &dr->dt.dl.dr_overridden_by;
+		} else if (dr != NULL) {
+			/*
+			 * The block was modified and its new contents have
+			 * no block pointer yet.
+			 */
+			bp = NULL;
+		} else {
+			bp = db->db_blkptr;
+		}
+
+		if (bp == NULL) {
+			mutex_exit(&db->db_mtx);
+			error = SET_ERROR(EAGAIN);
+			break;
+		}
+		if (BP_IS_REDACTED(bp)) {
+			mutex_exit(&db->db_mtx);
+			error = SET_ERROR(EIO);
+			break;
+		}
+		bps[i] = *bp;
+
+		/*
+		 * A pending free in an open txg does not dirty the dbuf,
+		 * the on-disk block pointer is stale in that case.
+		 */
+		DB_DNODE_ENTER(db);
+		dn = DB_DNODE(db);
+		freed = (dr == NULL && dnode_block_freed(dn, db->db_blkid));
+		DB_DNODE_EXIT(db);
+		mutex_exit(&db->db_mtx);
+
+		if (freed) {
+			error = SET_ERROR(EAGAIN);
+			break;
+		}
+	}
+
+	if (error == 0)
+		*nbpsp = numbufs;
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+
+	return (error);
+}
+
+void
+dmu_brt_clone(objset_t *os, uint64_t object, uint64_t offset,
+    uint64_t length, dmu_tx_t *tx, const blkptr_t *bps, size_t nbps)
+{
+	spa_t *spa = dmu_objset_spa(os);
+	dmu_buf_t **dbp;
+	int numbufs;
+
+	VERIFY0(dmu_buf_hold_array(os, object, offset, length, FALSE, FTAG,
+	    &numbufs, &dbp));
+	ASSERT3U(numbufs, ==, nbps);
+
+	for (int i = 0; i < numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dbp[i];
+		const blkptr_t *bp = &bps[i];
+		dbuf_dirty_record_t *dr;
+		blkptr_t *obp;
+
+		ASSERT0(db->db_level);
+		ASSERT(db->db_blkid != DMU_BONUS_BLKID);
+		ASSERT(BP_IS_HOLE(bp) || db->db.db_size == BP_GET_LSIZE(bp));
+
+		dmu_buf_will_clone(&db->db, tx);
+
+		mutex_enter(&db->db_mtx);
+		dr = list_head(&db->db_dirty_records);
+		VERIFY(dr != NULL);
+		ASSERT3U(dr->dr_txg, ==, dmu_tx_get_txg(tx));
+
+		obp = &dr->dt.dl.dr_overridden_by;
+		*obp = *bp;
+		if (BP_IS_HOLE(bp)) {
+			if (bp->blk_birth != 0 &&
+			    spa_feature_is_active(spa, SPA_FEATURE_HOLE_BIRTH))
+				obp->blk_birth = dr->dr_txg;
+			else
+				obp->blk_birth = 0;
+			obp->blk_phys_birth = 0;
+		} else if (BP_IS_EMBEDDED(bp)) {
+			obp->blk_birth = dr->dr_txg;
+		} else {
+			BP_SET_BIRTH(obp, dr->dr_txg, BP_PHYSICAL_BIRTH(bp));
+		}
+		dr->dt.dl.dr_override_state = DR_OVERRIDDEN;
+		dr->dt.dl.dr_brtwrite = B_TRUE;
+		dr->dt.dl.dr_copies = 0;
+		dr->dt.dl.dr_nopwrite = B_FALSE;
+		mutex_exit(&db->db_mtx);
+
+		/*
+		 * Holes and embedded blocks carry no allocated space, only
+		 * real blocks need an additional reference in the BRT.
+		 */
+		if (!BP_IS_HOLE(bp) && !BP_IS_EMBEDDED(bp))
+			brt_pending_add(spa, bp, tx);
+	}
+
+	dmu_buf_rele_array(dbp, numbufs, FTAG);
+}
+
 void
 __dmu_object_info_from_dnode(dnode_t *dn, dmu_object_info_t *doi)
 {
@@ -2343,6 +2750,8 @@ EXPORT_SYMBOL(dmu_object_set_maxblkid);
 EXPORT_SYMBOL(dmu_object_set_checksum);
 EXPORT_SYMBOL(dmu_object_set_compress);
 EXPORT_SYMBOL(dmu_offset_next);
+EXPORT_SYMBOL(dmu_read_l0_bps);
+EXPORT_SYMBOL(dmu_brt_clone);
 EXPORT_SYMBOL(dmu_write_policy);
 EXPORT_SYMBOL(dmu_sync);
 EXPORT_SYMBOL(dmu_request_arcbuf);
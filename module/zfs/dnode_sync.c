@@ -546,6 +546,8 @@ dnode_undirty_dbufs(list_t *list)
 		db->db_dirtycnt -= 1;
 		if (db->db_level == 0) {
 			ASSERT(db->db_blkid == DMU_BONUS_BLKID ||
+			    dr->dt.dl.dr_brtwrite ||
+			    dr->dt.dl.dr_diowrite ||
 			    dr->dt.dl.dr_data == db->db_buf);
 			dbuf_unoverride(dr);
 		} else {
@@ -34,6 +34,7 @@
 #include <sys/dsl_dir.h>
 #include <sys/dsl_synctask.h>
 #include <sys/dnode.h>
+#include <sys/dbuf.h>
 #include <sys/dmu_tx.h>
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
@@ -126,6 +127,8 @@ static boolean_t scan_ds_queue_contains(dsl_scan_t *scn, uint64_t dsobj,
 static void scan_ds_queue_insert(dsl_scan_t *scn, uint64_t dsobj, uint64_t txg);
 static void scan_ds_queue_remove(dsl_scan_t *scn, uint64_t dsobj);
 static void scan_ds_queue_sync(dsl_scan_t *scn, dmu_tx_t *tx);
+static void dsl_errorscrub_done(dsl_scan_t *scn, boolean_t complete,
+    dmu_tx_t *tx);
 static uint64_t dsl_scan_count_data_disks(vdev_t *vd);
 
 extern int zfs_vdev_async_write_active_min_dirty_percent;
@@ -171,7 +174,11 @@ static int zfs_scrub_min_time_ms = 1000; /* min millis to scrub per txg */
 static int zfs_obsolete_min_time_ms = 500; /* min millis to obsolete per txg */
 static int zfs_free_min_time_ms = 1000; /* min millis to free per txg */
 static int zfs_resilver_min_time_ms = 3000; /* min millis to resilver per txg */
+/* max number of error log entries to scrub per txg */
+static uint_t zfs_scrub_error_blocks_per_txg = 1 << 12;
 static int zfs_scan_checkpoint_intval = 7200; /* in seconds */
+/* threads walking dnode blocks in parallel; 1 to walk them serially */
+static uint_t zfs_scan_walk_threads = 8;
 int zfs_scan_suspend_progress = 0; /* set to prevent scans from progressing */
 static int zfs_no_scrub_io = B_FALSE; /* set to disable scrub i/o */
 static int zfs_no_scrub_prefetch = B_FALSE; /* set to disable scrub prefetch */
@@ -463,6 +470,17 @@ dsl_scan_init(dsl_pool_t *dp, uint64_t txg)
 	    sizeof (scan_prefetch_issue_ctx_t),
 	    offsetof(scan_prefetch_issue_ctx_t, spic_avl_node));
 
+	/*
+	 * Load the state of any error scrub.  It is tracked separately from
+	 * the regular scan, so it has to be read before we possibly bail out
+	 * below because there is no scan state.
+	 */
+	err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_ERRORSCRUB, sizeof (uint64_t), ERRORSCRUB_PHYS_NUMINTS,
+	    &scn->errorscrub_phys);
+	if (err != 0 && err != ENOENT)
+		return (err);
+
 	err = zap_lookup(dp->dp_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
 	    "scrub_func", sizeof (uint64_t), 1, &f);
 	if (err == 0) {
@@ -600,6 +618,8 @@ dsl_scan_fini(dsl_pool_t *dp)
 
 		if (scn->scn_taskq != NULL)
 			taskq_destroy(scn->scn_taskq);
+		if (scn->scn_walk_taskq != NULL)
+			taskq_destroy(scn->scn_walk_taskq);
 
 		scan_ds_queue_clear(scn);
 		avl_destroy(&scn->scn_queue);
@@ -641,6 +661,34 @@ dsl_scan_is_paused_scrub(const dsl_scan_t *scn)
 	    scn->scn_phys.scn_flags & DSF_SCRUB_PAUSED);
 }
 
+boolean_t
+dsl_errorscrubbing(const dsl_pool_t *dp)
+{
+	dsl_errorscrub_phys_t *dep = &dp->dp_scan->errorscrub_phys;
+
+	return (dep->dep_state == DSS_ERRORSCRUBBING &&
+	    dep->dep_func == POOL_SCAN_ERRORSCRUB);
+}
+
+boolean_t
+dsl_errorscrub_is_paused(const dsl_scan_t *scn)
+{
+	return (dsl_errorscrubbing(scn->scn_dp) &&
+	    scn->errorscrub_phys.dep_paused_flags & DSF_SCRUB_PAUSED);
+}
+
+/*
+ * Unlike the regular scan there is nothing queued in-core for an error
+ * scrub, its on-disk state is consistent as of the end of every txg.
+ */
+static void
+dsl_errorscrub_sync_state(dsl_scan_t *scn, dmu_tx_t *tx)
+{
+	VERIFY0(zap_update(scn->scn_dp->dp_meta_objset,
+	    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_ERRORSCRUB, sizeof (uint64_t),
+	    ERRORSCRUB_PHYS_NUMINTS, &scn->errorscrub_phys, tx));
+}
+
 /*
  * Writes out a persistent dsl_scan_phys_t record to the pool directory.
  * Because we can be running in the block sorting algorithm, we do not always
@@ -726,15 +774,27 @@ void
 dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 {
 	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
-	pool_scan_func_t *funcp = arg;
+	setup_sync_arg_t *setup_sync_arg = arg;
+	pool_scan_func_t func = setup_sync_arg->func;
 	dmu_object_type_t ot = 0;
 	dsl_pool_t *dp = scn->scn_dp;
 	spa_t *spa = dp->dp_spa;
 
 	ASSERT(!dsl_scan_is_running(scn));
-	ASSERT(*funcp > POOL_SCAN_NONE && *funcp < POOL_SCAN_FUNCS);
+	ASSERT(func > POOL_SCAN_NONE && func < POOL_SCAN_FUNCS);
+	ASSERT3U(func, !=, POOL_SCAN_ERRORSCRUB);
+
+	/*
+	 * A regular scrub or resilver also covers every block the error
+	 * scrub would have looked at, so it simply replaces it.
+	 */
+	if (dsl_errorscrubbing(dp)) {
+		dsl_errorscrub_done(scn, B_FALSE, tx);
+		dsl_errorscrub_sync_state(scn, tx);
+	}
+
 	memset(&scn->scn_phys, 0, sizeof (scn->scn_phys));
-	scn->scn_phys.scn_func = *funcp;
+	scn->scn_phys.scn_func = func;
 	scn->scn_phys.scn_state = DSS_SCANNING;
 	scn->scn_phys.scn_min_txg = 0;
 	scn->scn_phys.scn_max_txg = tx->tx_txg;
@@ -764,6 +824,23 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 			    ESC_ZFS_RESILVER_START);
 			nvlist_free(aux);
 		} else {
+			/*
+			 * A scrub limited to a birth txg range only visits
+			 * blocks born after txgstart (and before txgend).
+			 * The rest of the tree is pruned top-down exactly
+			 * like for a healing resilver.
+			 */
+			if (setup_sync_arg->txgstart != 0 ||
+			    setup_sync_arg->txgend != 0) {
+				scn->scn_phys.scn_min_txg =
+				    setup_sync_arg->txgstart;
+				if (setup_sync_arg->txgend != 0) {
+					scn->scn_phys.scn_max_txg = MIN(
+					    setup_sync_arg->txgend + 1,
+					    tx->tx_txg);
+				}
+				scn->scn_phys.scn_flags |= DSF_SCRUB_TXG_RANGE;
+			}
 			spa_event_notify(spa, NULL, NULL, ESC_ZFS_SCRUB_START);
 		}
 
@@ -821,19 +898,80 @@ dsl_scan_setup_sync(void *arg, dmu_tx_t *tx)
 
 	spa_history_log_internal(spa, "scan setup", tx,
 	    "func=%u mintxg=%llu maxtxg=%llu",
-	    *funcp, (u_longlong_t)scn->scn_phys.scn_min_txg,
+	    func, (u_longlong_t)scn->scn_phys.scn_min_txg,
 	    (u_longlong_t)scn->scn_phys.scn_max_txg);
 }
 
+static int
+dsl_errorscrub_setup_check(void *arg, dmu_tx_t *tx)
+{
+	(void) arg;
+	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
+	vdev_t *rvd = scn->scn_dp->dp_spa->spa_root_vdev;
+
+	/*
+	 * An error scrub can't run alongside (or instead of a paused)
+	 * regular scrub or resilver, nor can two of them run at once.
+	 */
+	if (dsl_scan_is_running(scn) || dsl_errorscrubbing(scn->scn_dp) ||
+	    vdev_rebuild_active(rvd))
+		return (SET_ERROR(EBUSY));
+
+	return (0);
+}
+
+static void
+dsl_errorscrub_setup_sync(void *arg, dmu_tx_t *tx)
+{
+	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
+	pool_scan_func_t *funcp = arg;
+	dsl_pool_t *dp = scn->scn_dp;
+	spa_t *spa = dp->dp_spa;
+
+	ASSERT(!dsl_scan_is_running(scn));
+	ASSERT(!dsl_errorscrubbing(dp));
+	ASSERT3U(*funcp, ==, POOL_SCAN_ERRORSCRUB);
+
+	memset(&scn->errorscrub_phys, 0, sizeof (scn->errorscrub_phys));
+	scn->errorscrub_phys.dep_func = *funcp;
+	scn->errorscrub_phys.dep_state = DSS_ERRORSCRUBBING;
+	scn->errorscrub_phys.dep_start_time = gethrestime_sec();
+	scn->errorscrub_phys.dep_to_examine = spa_get_last_errlog_size(spa);
+	spa->spa_scan_pass_errorscrub_pause = 0;
+
+	/*
+	 * From now on new errors go to the scrub error log, which replaces
+	 * the last one once we are done.  See spa_log_error().
+	 */
+	spa->spa_scrub_active = B_TRUE;
+
+	spa_event_notify(spa, NULL, NULL, ESC_ZFS_ERRORSCRUB_START);
+	dsl_errorscrub_sync_state(scn, tx);
+
+	spa_history_log_internal(spa, "error scrub setup", tx,
+	    "func=%u errors=%llu", *funcp,
+	    (u_longlong_t)scn->errorscrub_phys.dep_to_examine);
+}
+
 /*
- * Called by the ZFS_IOC_POOL_SCAN ioctl to start a scrub or resilver.
- * Can also be called to resume a paused scrub.
+ * Called by the ZFS_IOC_POOL_SCAN and ZFS_IOC_POOL_SCRUB ioctls to start a
+ * scrub or resilver.  A scrub may be limited to blocks born in the txg range
+ * (txgstart, txgend]; zero means unbounded.  Can also be called to resume a
+ * paused scrub.
  */
 int
-dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
+dsl_scan(dsl_pool_t *dp, pool_scan_func_t func, uint64_t txgstart,
+    uint64_t txgend)
 {
 	spa_t *spa = dp->dp_spa;
 	dsl_scan_t *scn = dp->dp_scan;
+	setup_sync_arg_t setup_sync_arg;
+
+	if (func != POOL_SCAN_SCRUB && (txgstart != 0 || txgend != 0))
+		return (SET_ERROR(ENOTSUP));
+
+	if (txgend != 0 && txgstart >= txgend)
+		return (SET_ERROR(EINVAL));
 
 	/*
 	 * Purge all vdev caches and probe all devices.  We do this here
@@ -853,6 +991,25 @@ dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
 		return (0);
 	}
 
+	if (func == POOL_SCAN_ERRORSCRUB) {
+		if (dsl_errorscrub_is_paused(scn)) {
+			/* got error scrub start cmd, resume paused one */
+			int err = dsl_scrub_set_pause_resume(scn->scn_dp,
+			    POOL_SCRUB_NORMAL);
+			if (err == 0) {
+				spa_event_notify(spa, NULL, NULL,
+				    ESC_ZFS_ERRORSCRUB_RESUME);
+				return (SET_ERROR(ECANCELED));
+			}
+
+			return (SET_ERROR(err));
+		}
+
+		return (dsl_sync_task(spa_name(spa),
+		    dsl_errorscrub_setup_check, dsl_errorscrub_setup_sync,
+		    &func, 0, ZFS_SPACE_CHECK_RESERVED));
+	}
+
 	if (func == POOL_SCAN_SCRUB && dsl_scan_is_paused_scrub(scn)) {
 		/* got scrub start cmd, resume paused scrub */
 		int err = dsl_scrub_set_pause_resume(scn->scn_dp,
@@ -865,8 +1022,13 @@ dsl_scan(dsl_pool_t *dp, pool_scan_func_t func)
 		return (SET_ERROR(err));
 	}
 
+	setup_sync_arg.func = func;
+	setup_sync_arg.txgstart = txgstart;
+	setup_sync_arg.txgend = txgend;
+
 	return (dsl_sync_task(spa_name(spa), dsl_scan_setup_check,
-	    dsl_scan_setup_sync, &func, 0, ZFS_SPACE_CHECK_EXTRA_RESERVED));
+	    dsl_scan_setup_sync, &setup_sync_arg, 0,
+	    ZFS_SPACE_CHECK_EXTRA_RESERVED));
 }
 
 static void
@@ -923,6 +1085,11 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 		}
 	}
 
+	if (scn->scn_walk_taskq != NULL) {
+		taskq_destroy(scn->scn_walk_taskq);
+		scn->scn_walk_taskq = NULL;
+	}
+
 	scn->scn_phys.scn_state = complete ? DSS_FINISHED : DSS_CANCELED;
 
 	spa_notify_waiters(spa);
@@ -938,6 +1105,9 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 		    "errors=%llu", (u_longlong_t)spa_get_errlog_size(spa));
 
 	if (DSL_SCAN_IS_SCRUB_RESILVER(scn)) {
+		boolean_t txg_range =
+		    (scn->scn_phys.scn_flags & DSF_SCRUB_TXG_RANGE) != 0;
+
 		spa->spa_scrub_active = B_FALSE;
 
 		/*
@@ -948,14 +1118,16 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 		 * As the scrub does not currently support traversing
 		 * data that have been freed but are part of a checkpoint,
 		 * we don't mark the scrub as done in the DTLs as faults
-		 * may still exist in those vdevs.
+		 * may still exist in those vdevs.  Likewise a scrub of
+		 * a txg range didn't look at anything born outside it.
 		 */
 		if (complete &&
 		    !spa_feature_is_active(spa, SPA_FEATURE_POOL_CHECKPOINT)) {
 			vdev_dtl_reassess(spa->spa_root_vdev, tx->tx_txg,
-			    scn->scn_phys.scn_max_txg, B_TRUE, B_FALSE);
+			    txg_range ? 0 : scn->scn_phys.scn_max_txg, B_TRUE,
+			    B_FALSE);
 
-			if (scn->scn_phys.scn_min_txg) {
+			if (scn->scn_phys.scn_min_txg && !txg_range) {
 				nvlist_t *aux = fnvlist_alloc();
 				fnvlist_add_string(aux, ZFS_EV_RESILVER_TYPE,
 				    "healing");
@@ -970,7 +1142,34 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 			vdev_dtl_reassess(spa->spa_root_vdev, tx->tx_txg,
 			    0, B_TRUE, B_FALSE);
 		}
-		spa_errlog_rotate(spa);
+
+		/*
+		 * Rotating the error log drops every entry the scrub did
+		 * not hit again, so only do it when every block was looked
+		 * at.  Errors found by a txg range scrub are kept in the
+		 * scrub log until the next full scrub.
+		 */
+		if (!txg_range)
+			spa_errlog_rotate(spa);
+
+		/*
+		 * Remember the highest birth txg below which every block has
+		 * been verified, provided this scrub picked up where the
+		 * previous one left off.  "zpool scrub --since-last" starts
+		 * from here.
+		 */
+		if (complete && scn->scn_phys.scn_func == POOL_SCAN_SCRUB &&
+		    (scn->scn_phys.scn_min_txg == 0 || txg_range) &&
+		    scn->scn_phys.scn_min_txg <= spa->spa_scrubbed_last_txg &&
+		    scn->scn_phys.scn_max_txg - 1 >
+		    spa->spa_scrubbed_last_txg) {
+			spa->spa_scrubbed_last_txg =
+			    scn->scn_phys.scn_max_txg - 1;
+			VERIFY0(zap_update(dp->dp_meta_objset,
+			    DMU_POOL_DIRECTORY_OBJECT,
+			    DMU_POOL_LAST_SCRUBBED_TXG, sizeof (uint64_t), 1,
+			    &spa->spa_scrubbed_last_txg, tx));
+		}
 
 		/*
 		 * Don't clear flag until after vdev_dtl_reassess to ensure that
@@ -1015,13 +1214,44 @@ dsl_scan_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
 	ASSERT(!dsl_scan_is_running(scn));
 }
 
+static void
+dsl_errorscrub_done(dsl_scan_t *scn, boolean_t complete, dmu_tx_t *tx)
+{
+	spa_t *spa = scn->scn_dp->dp_spa;
+
+	ASSERT(dsl_errorscrubbing(scn->scn_dp));
+
+	scn->errorscrub_phys.dep_state = complete ? DSS_FINISHED : DSS_CANCELED;
+	scn->errorscrub_phys.dep_paused_flags &= ~DSF_SCRUB_PAUSED;
+	scn->errorscrub_phys.dep_end_time = gethrestime_sec();
+	spa->spa_scan_pass_errorscrub_pause = 0;
+	spa->spa_scrub_active = B_FALSE;
+
+	if (complete) {
+		/*
+		 * Every entry of the last error log has been re-read and
+		 * those that failed again were logged anew, so the last log
+		 * can be replaced just like at the end of a regular scrub.
+		 */
+		spa_errlog_rotate(spa);
+		spa_event_notify(spa, NULL, NULL, ESC_ZFS_ERRORSCRUB_FINISH);
+		spa_history_log_internal(spa, "error scrub done", tx,
+		    "errors=%llu", (u_longlong_t)spa_get_errlog_size(spa));
+	} else {
+		spa_history_log_internal(spa, "error scrub cancelled", tx,
+		    "errors=%llu", (u_longlong_t)spa_get_errlog_size(spa));
+	}
+
+	spa_notify_waiters(spa);
+}
+
 static int
 dsl_scan_cancel_check(void *arg, dmu_tx_t *tx)
 {
 	(void) arg;
 	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
 
-	if (!dsl_scan_is_running(scn))
+	if (!dsl_scan_is_running(scn) && !dsl_errorscrubbing(scn->scn_dp))
 		return (SET_ERROR(ENOENT));
 	return (0);
 }
@@ -1032,6 +1262,14 @@ dsl_scan_cancel_sync(void *arg, dmu_tx_t *tx)
 	(void) arg;
 	dsl_scan_t *scn = dmu_tx_pool(tx)->dp_scan;
 
+	if (dsl_errorscrubbing(scn->scn_dp)) {
+		dsl_errorscrub_done(scn, B_FALSE, tx);
+		dsl_errorscrub_sync_state(scn, tx);
+		spa_event_notify(scn->scn_dp->dp_spa, NULL, NULL,
+		    ESC_ZFS_ERRORSCRUB_ABORT);
+		return;
+	}
+
 	dsl_scan_done(scn, B_FALSE, tx);
 	dsl_scan_sync_state(scn, tx, SYNC_MANDATORY);
 	spa_event_notify(scn->scn_dp->dp_spa, NULL, NULL, ESC_ZFS_SCRUB_ABORT);
@@ -1051,7 +1289,11 @@ dsl_scrub_pause_resume_check(void *arg, dmu_tx_t *tx)
 	dsl_pool_t *dp = dmu_tx_pool(tx);
 	dsl_scan_t *scn = dp->dp_scan;
 
-	if (*cmd == POOL_SCRUB_PAUSE) {
+	if (*cmd == POOL_SCRUB_PAUSE && dsl_errorscrubbing(dp)) {
+		/* can't pause a paused error scrub */
+		if (dsl_errorscrub_is_paused(scn))
+			return (SET_ERROR(EBUSY));
+	} else if (*cmd == POOL_SCRUB_PAUSE) {
 		/* can't pause a scrub when there is no in-progress scrub */
 		if (!dsl_scan_scrubbing(dp))
 			return (SET_ERROR(ENOENT));
@@ -1074,6 +1316,25 @@ dsl_scrub_pause_resume_sync(void *arg, dmu_tx_t *tx)
 	spa_t *spa = dp->dp_spa;
 	dsl_scan_t *scn = dp->dp_scan;
 
+	if (dsl_errorscrubbing(dp)) {
+		if (*cmd == POOL_SCRUB_PAUSE) {
+			spa->spa_scan_pass_errorscrub_pause = gethrestime_sec();
+			scn->errorscrub_phys.dep_paused_flags |=
+			    DSF_SCRUB_PAUSED;
+			dsl_errorscrub_sync_state(scn, tx);
+			spa_event_notify(spa, NULL, NULL,
+			    ESC_ZFS_ERRORSCRUB_PAUSED);
+			spa_notify_waiters(spa);
+		} else {
+			ASSERT3U(*cmd, ==, POOL_SCRUB_NORMAL);
+			spa->spa_scan_pass_errorscrub_pause = 0;
+			scn->errorscrub_phys.dep_paused_flags &=
+			    ~DSF_SCRUB_PAUSED;
+			dsl_errorscrub_sync_state(scn, tx);
+		}
+		return;
+	}
+
 	if (*cmd == POOL_SCRUB_PAUSE) {
 		/* can't pause a scrub when there is no in-progress scrub */
 		spa->spa_scan_pass_scrub_pause = gethrestime_sec();
@@ -1314,22 +1575,8 @@ dsl_scan_should_clear(dsl_scan_t *scn)
 }
 
 static boolean_t
-dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
+dsl_scan_suspend_due(dsl_scan_t *scn)
 {
-	/* we never skip user/group accounting objects */
-	if (zb && (int64_t)zb->zb_object < 0)
-		return (B_FALSE);
-
-	if (scn->scn_suspending)
-		return (B_TRUE); /* we're already suspending */
-
-	if (!ZB_IS_ZERO(&scn->scn_phys.scn_bookmark))
-		return (B_FALSE); /* we're resuming */
-
-	/* We only know how to resume from level-0 and objset blocks. */
-	if (zb && (zb->zb_level != 0 && zb->zb_level != ZB_ROOT_LEVEL))
-		return (B_FALSE);
-
 	/*
 	 * We suspend if:
 	 *  - we have scanned for at least the minimum time (default 1 sec
@@ -1353,12 +1600,32 @@ dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
 	int mintime = (scn->scn_phys.scn_func == POOL_SCAN_RESILVER) ?
 	    zfs_resilver_min_time_ms : zfs_scrub_min_time_ms;
 
-	if ((NSEC2MSEC(scan_time_ns) > mintime &&
+	return ((NSEC2MSEC(scan_time_ns) > mintime &&
 	    (scn->scn_dp->dp_dirty_total >= dirty_min_bytes ||
 	    txg_sync_waiting(scn->scn_dp) ||
 	    NSEC2SEC(sync_time_ns) >= zfs_txg_timeout)) ||
 	    spa_shutting_down(scn->scn_dp->dp_spa) ||
-	    (zfs_scan_strict_mem_lim && dsl_scan_should_clear(scn))) {
+	    (zfs_scan_strict_mem_lim && dsl_scan_should_clear(scn)));
+}
+
+static boolean_t
+dsl_scan_check_suspend(dsl_scan_t *scn, const zbookmark_phys_t *zb)
+{
+	/* we never skip user/group accounting objects */
+	if (zb && (int64_t)zb->zb_object < 0)
+		return (B_FALSE);
+
+	if (scn->scn_suspending)
+		return (B_TRUE); /* we're already suspending */
+
+	if (!ZB_IS_ZERO(&scn->scn_phys.scn_bookmark))
+		return (B_FALSE); /* we're resuming */
+
+	/* We only know how to resume from level-0 and objset blocks. */
+	if (zb && (zb->zb_level != 0 && zb->zb_level != ZB_ROOT_LEVEL))
+		return (B_FALSE);
+
+	if (dsl_scan_suspend_due(scn)) {
 		if (zb && zb->zb_level == ZB_ROOT_LEVEL) {
 			dprintf("suspending at first available bookmark "
 			    "%llx/%llx/%llx/%llx\n",
@@ -1818,12 +2085,188 @@ dsl_scan_check_resume(dsl_scan_t *scn, const dnode_phys_t *dnp,
 	return (B_FALSE);
 }
 
+/*
+ * Parallel metadata walk.
+ *
+ * The dnode blocks referenced by a level 1 block of a dataset's meta-dnode
+ * are independent subtrees, so instead of visiting them one after another
+ * in syncing context they are handed to zfs_scan_walk_threads walkers
+ * running on scn_walk_taskq, while the syncing thread waits for them.
+ * The walkers feed the same per-vdev sorted queues, whose memory usage is
+ * still checked against the same limits.
+ *
+ * Each walker claims the next unclaimed dnode block, so every block below
+ * the lowest one that a walker stopped in has been completely visited.
+ * When it is time to suspend, each walker stops at the next level 0 block
+ * it would visit and remembers its bookmark; the bookmark of the walker
+ * that stopped in the lowest dnode block becomes the scan bookmark. Any
+ * dnode blocks past it that other walkers finished will be visited again
+ * after resuming, which only costs some duplicate work.
+ */
+typedef struct scan_walk_batch {
+	dsl_scan_t	*swb_scn;
+	dsl_dataset_t	*swb_ds;
+	dmu_objset_type_t swb_ostype;
+	dnode_phys_t	*swb_dnp;	/* the meta-dnode */
+	blkptr_t	*swb_bps;	/* children of the level 1 block */
+	const zbookmark_phys_t *swb_zb;	/* bookmark of the level 1 block */
+	uint64_t	swb_epb;
+	uint64_t	swb_next;	/* next child to claim */
+	dmu_tx_t	*swb_tx;
+} scan_walk_batch_t;
+
+typedef struct scan_walk {
+	scan_walk_batch_t *sw_batch;
+	uint64_t	sw_child;	/* child being visited */
+	boolean_t	sw_suspended;
+	zbookmark_phys_t sw_bookmark;	/* where we stopped, if suspended */
+	uint64_t	sw_visited;
+	uint64_t	sw_holes;
+	uint64_t	sw_lt_min;
+	uint64_t	sw_ddt_contained;
+	uint64_t	sw_gt_max;
+	taskq_ent_t	sw_tqent;
+} scan_walk_t;
+
+/* Bump a per txg statistic, per walker if we are a parallel walker. */
+#define	SCAN_WALK_STAT_BUMP(scn, sw, stat)	\
+	((sw) != NULL ? (void) (sw)->sw_##stat++ :	\
+	    (void) (scn)->scn_##stat##_this_txg++)
+
 static void dsl_scan_visitbp(blkptr_t *bp, const zbookmark_phys_t *zb,
     dnode_phys_t *dnp, dsl_dataset_t *ds, dsl_scan_t *scn,
-    dmu_objset_type_t ostype, dmu_tx_t *tx);
+    dmu_objset_type_t ostype, dmu_tx_t *tx, scan_walk_t *sw);
 inline __attribute__((always_inline)) static void dsl_scan_visitdnode(
     dsl_scan_t *, dsl_dataset_t *ds, dmu_objset_type_t ostype,
-    dnode_phys_t *dnp, uint64_t object, dmu_tx_t *tx);
+    dnode_phys_t *dnp, uint64_t object, dmu_tx_t *tx, scan_walk_t *sw);
+
+static boolean_t
+dsl_scan_walk_check_suspend(dsl_scan_t *scn, scan_walk_t *sw,
+    const zbookmark_phys_t *zb)
+{
+	if (sw->sw_suspended)
+		return (B_TRUE);
+
+	/*
+	 * Like dsl_scan_check_suspend(), we can only resume from level 0
+	 * blocks. Walkers never see objset blocks or accounting objects,
+	 * and never run while resuming.
+	 */
+	ASSERT3S((int64_t)zb->zb_object, >=, 0);
+	if (zb->zb_level != 0)
+		return (B_FALSE);
+
+	if (scn->scn_suspending || dsl_scan_suspend_due(scn)) {
+		sw->sw_bookmark = *zb;
+		sw->sw_suspended = B_TRUE;
+		scn->scn_suspending = B_TRUE;
+		return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+static void
+dsl_scan_walk_thread(void *arg)
+{
+	scan_walk_t *sw = arg;
+	scan_walk_batch_t *swb = sw->sw_batch;
+	dsl_scan_t *scn = swb->swb_scn;
+	const zbookmark_phys_t *zb = swb->swb_zb;
+
+	while (!scn->scn_suspending) {
+		uint64_t i = atomic_inc_64_nv(&swb->swb_next) - 1;
+		zbookmark_phys_t czb;
+
+		if (i >= swb->swb_epb)
+			break;
+
+		SET_BOOKMARK(&czb, zb->zb_objset, zb->zb_object,
+		    zb->zb_level - 1, zb->zb_blkid * swb->swb_epb + i);
+		sw->sw_child = i;
+		dsl_scan_visitbp(&swb->swb_bps[i], &czb, swb->swb_dnp,
+		    swb->swb_ds, scn, swb->swb_ostype, swb->swb_tx, sw);
+		if (sw->sw_suspended)
+			break;
+	}
+}
+
+static boolean_t
+dsl_scan_walk_parallel(dsl_scan_t *scn)
+{
+	return (zfs_scan_walk_threads > 1 && !scn->scn_suspending &&
+	    ZB_IS_ZERO(&scn->scn_phys.scn_bookmark) &&
+	    scn->scn_dp->dp_blkstats == NULL);
+}
+
+/*
+ * Visit the dnode blocks referenced by a level 1 block of a meta-dnode
+ * in parallel. See the comment above scan_walk_batch_t.
+ */
+static void
+dsl_scan_walk_dnode_blocks(dsl_scan_t *scn, dsl_dataset_t *ds,
+    dmu_objset_type_t ostype, dnode_phys_t *dnp, blkptr_t *bps, uint64_t epb,
+    const zbookmark_phys_t *zb, dmu_tx_t *tx)
+{
+	uint_t nthreads = MIN(zfs_scan_walk_threads, 256);
+	uint_t nwalkers = MIN(nthreads, epb);
+	scan_walk_batch_t swb = {
+		.swb_scn = scn,
+		.swb_ds = ds,
+		.swb_ostype = ostype,
+		.swb_dnp = dnp,
+		.swb_bps = bps,
+		.swb_zb = zb,
+		.swb_epb = epb,
+		.swb_next = 0,
+		.swb_tx = tx,
+	};
+	scan_walk_t *walkers, *stopped = NULL;
+
+	if (scn->scn_walk_taskq == NULL) {
+		/*
+		 * The syncing thread waits for the walkers, so run them at
+		 * the same priority as the other sync tasks.
+		 */
+		scn->scn_walk_taskq = taskq_create("dsl_scan_walk", nthreads,
+		    maxclsyspri, 1, nthreads, TASKQ_DYNAMIC);
+	}
+
+	walkers = kmem_zalloc(nwalkers * sizeof (scan_walk_t), KM_SLEEP);
+	for (uint_t w = 0; w < nwalkers; w++) {
+		scan_walk_t *sw = &walkers[w];
+
+		sw->sw_batch = &swb;
+		taskq_init_ent(&sw->sw_tqent);
+		taskq_dispatch_ent(scn->scn_walk_taskq, dsl_scan_walk_thread,
+		    sw, 0, &sw->sw_tqent);
+	}
+	taskq_wait(scn->scn_walk_taskq);
+
+	for (uint_t w = 0; w < nwalkers; w++) {
+		scan_walk_t *sw = &walkers[w];
+
+		scn->scn_visited_this_txg += sw->sw_visited;
+		scn->scn_holes_this_txg += sw->sw_holes;
+		scn->scn_lt_min_this_txg += sw->sw_lt_min;
+		scn->scn_ddt_contained_this_txg += sw->sw_ddt_contained;
+		scn->scn_gt_max_this_txg += sw->sw_gt_max;
+
+		if (sw->sw_suspended &&
+		    (stopped == NULL || sw->sw_child < stopped->sw_child))
+			stopped = sw;
+	}
+
+	if (stopped != NULL) {
+		ASSERT(scn->scn_suspending);
+		dprintf("suspending at bookmark %llx/%llx/%llx/%llx\n",
+		    (longlong_t)stopped->sw_bookmark.zb_objset,
+		    (longlong_t)stopped->sw_bookmark.zb_object,
+		    (longlong_t)stopped->sw_bookmark.zb_level,
+		    (longlong_t)stopped->sw_bookmark.zb_blkid);
+		scn->scn_phys.scn_bookmark = stopped->sw_bookmark;
+	}
+	kmem_free(walkers, nwalkers * sizeof (scan_walk_t));
+}
 
 /*
  * Return nonzero on i/o error.
@@ -1832,7 +2275,7 @@ inline __attribute__((always_inline)) static void dsl_scan_visitdnode(
 inline __attribute__((always_inline)) static int
 dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
     dnode_phys_t *dnp, const blkptr_t *bp,
-    const zbookmark_phys_t *zb, dmu_tx_t *tx)
+    const zbookmark_phys_t *zb, dmu_tx_t *tx, scan_walk_t *sw)
 {
 	dsl_pool_t *dp = scn->scn_dp;
 	spa_t *spa = dp->dp_spa;
@@ -1849,7 +2292,7 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 	 */
 	if (dnp != NULL &&
 	    dnp->dn_bonuslen > DN_MAX_BONUS_LEN(dnp)) {
-		scn->scn_phys.scn_errors++;
+		atomic_inc_64(&scn->scn_phys.scn_errors);
 		spa_log_error(spa, zb);
 		return (SET_ERROR(EINVAL));
 	}
@@ -1864,9 +2307,16 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 		err = arc_read(NULL, spa, bp, arc_getbuf_func, &buf,
 		    ZIO_PRIORITY_SCRUB, zio_flags, &flags, zb);
 		if (err) {
-			scn->scn_phys.scn_errors++;
+			atomic_inc_64(&scn->scn_phys.scn_errors);
 			return (err);
 		}
+		if (BP_GET_LEVEL(bp) == 1 && BP_GET_TYPE(bp) == DMU_OT_DNODE &&
+		    sw == NULL && dsl_scan_walk_parallel(scn)) {
+			dsl_scan_walk_dnode_blocks(scn, ds, ostype, dnp,
+			    buf->b_data, epb, zb, tx);
+			arc_buf_destroy(buf, &buf);
+			return (0);
+		}
 		for (i = 0, cbp = buf->b_data; i < epb; i++, cbp++) {
 			zbookmark_phys_t czb;
 
@@ -1874,7 +2324,7 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			    zb->zb_level - 1,
 			    zb->zb_blkid * epb + i);
 			dsl_scan_visitbp(cbp, &czb, dnp,
-			    ds, scn, ostype, tx);
+			    ds, scn, ostype, tx, sw);
 		}
 		arc_buf_destroy(buf, &buf);
 	} else if (BP_GET_TYPE(bp) == DMU_OT_DNODE) {
@@ -1892,14 +2342,14 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 		err = arc_read(NULL, spa, bp, arc_getbuf_func, &buf,
 		    ZIO_PRIORITY_SCRUB, zio_flags, &flags, zb);
 		if (err) {
-			scn->scn_phys.scn_errors++;
+			atomic_inc_64(&scn->scn_phys.scn_errors);
 			return (err);
 		}
 		for (i = 0, cdnp = buf->b_data; i < epb;
 		    i += cdnp->dn_extra_slots + 1,
 		    cdnp += cdnp->dn_extra_slots + 1) {
 			dsl_scan_visitdnode(scn, ds, ostype,
-			    cdnp, zb->zb_blkid * epb + i, tx);
+			    cdnp, zb->zb_blkid * epb + i, tx, sw);
 		}
 
 		arc_buf_destroy(buf, &buf);
@@ -1911,14 +2361,14 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 		err = arc_read(NULL, spa, bp, arc_getbuf_func, &buf,
 		    ZIO_PRIORITY_SCRUB, zio_flags, &flags, zb);
 		if (err) {
-			scn->scn_phys.scn_errors++;
+			atomic_inc_64(&scn->scn_phys.scn_errors);
 			return (err);
 		}
 
 		osp = buf->b_data;
 
 		dsl_scan_visitdnode(scn, ds, osp->os_type,
-		    &osp->os_meta_dnode, DMU_META_DNODE_OBJECT, tx);
+		    &osp->os_meta_dnode, DMU_META_DNODE_OBJECT, tx, sw);
 
 		if (OBJSET_BUF_HAS_USERUSED(buf)) {
 			/*
@@ -1930,13 +2380,13 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 			if (OBJSET_BUF_HAS_PROJECTUSED(buf))
 				dsl_scan_visitdnode(scn, ds, osp->os_type,
 				    &osp->os_projectused_dnode,
-				    DMU_PROJECTUSED_OBJECT, tx);
+				    DMU_PROJECTUSED_OBJECT, tx, sw);
 			dsl_scan_visitdnode(scn, ds, osp->os_type,
 			    &osp->os_groupused_dnode,
-			    DMU_GROUPUSED_OBJECT, tx);
+			    DMU_GROUPUSED_OBJECT, tx, sw);
 			dsl_scan_visitdnode(scn, ds, osp->os_type,
 			    &osp->os_userused_dnode,
-			    DMU_USERUSED_OBJECT, tx);
+			    DMU_USERUSED_OBJECT, tx, sw);
 		}
 		arc_buf_destroy(buf, &buf);
 	} else if (!zfs_blkptr_verify(spa, bp, B_FALSE, BLK_VERIFY_LOG)) {
@@ -1944,7 +2394,7 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 		 * Sanity check the block pointer contents, this is handled
 		 * by arc_read() for the cases above.
 		 */
-		scn->scn_phys.scn_errors++;
+		atomic_inc_64(&scn->scn_phys.scn_errors);
 		spa_log_error(spa, zb);
 		return (SET_ERROR(EINVAL));
 	}
@@ -1955,7 +2405,7 @@ dsl_scan_recurse(dsl_scan_t *scn, dsl_dataset_t *ds, dmu_objset_type_t ostype,
 inline __attribute__((always_inline)) static void
 dsl_scan_visitdnode(dsl_scan_t *scn, dsl_dataset_t *ds,
     dmu_objset_type_t ostype, dnode_phys_t *dnp,
-    uint64_t object, dmu_tx_t *tx)
+    uint64_t object, dmu_tx_t *tx, scan_walk_t *sw)
 {
 	int j;
 
@@ -1965,7 +2415,7 @@ dsl_scan_visitdnode(dsl_scan_t *scn, dsl_dataset_t *ds,
 		SET_BOOKMARK(&czb, ds ? ds->ds_object : 0, object,
 		    dnp->dn_nlevels - 1, j);
 		dsl_scan_visitbp(&dnp->dn_blkptr[j],
-		    &czb, dnp, ds, scn, ostype, tx);
+		    &czb, dnp, ds, scn, ostype, tx, sw);
 	}
 
 	if (dnp->dn_flags & DNODE_FLAG_SPILL_BLKPTR) {
@@ -1973,7 +2423,7 @@ dsl_scan_visitdnode(dsl_scan_t *scn, dsl_dataset_t *ds,
 		SET_BOOKMARK(&czb, ds ? ds->ds_object : 0, object,
 		    0, DMU_SPILL_BLKID);
 		dsl_scan_visitbp(DN_SPILL_BLKPTR(dnp),
-		    &czb, dnp, ds, scn, ostype, tx);
+		    &czb, dnp, ds, scn, ostype, tx, sw);
 	}
 }
 
@@ -1984,21 +2434,26 @@ dsl_scan_visitdnode(dsl_scan_t *scn, dsl_dataset_t *ds,
 static void
 dsl_scan_visitbp(blkptr_t *bp, const zbookmark_phys_t *zb,
     dnode_phys_t *dnp, dsl_dataset_t *ds, dsl_scan_t *scn,
-    dmu_objset_type_t ostype, dmu_tx_t *tx)
+    dmu_objset_type_t ostype, dmu_tx_t *tx, scan_walk_t *sw)
 {
 	dsl_pool_t *dp = scn->scn_dp;
 	blkptr_t *bp_toread = NULL;
 
-	if (dsl_scan_check_suspend(scn, zb))
-		return;
+	if (sw != NULL) {
+		if (dsl_scan_walk_check_suspend(scn, sw, zb))
+			return;
+	} else {
+		if (dsl_scan_check_suspend(scn, zb))
+			return;
 
-	if (dsl_scan_check_resume(scn, dnp, zb))
-		return;
+		if (dsl_scan_check_resume(scn, dnp, zb))
+			return;
+	}
 
-	scn->scn_visited_this_txg++;
+	SCAN_WALK_STAT_BUMP(scn, sw, visited);
 
 	if (BP_IS_HOLE(bp)) {
-		scn->scn_holes_this_txg++;
+		SCAN_WALK_STAT_BUMP(scn, sw, holes);
 		return;
 	}
 
@@ -2024,14 +2479,14 @@ dsl_scan_visitbp(blkptr_t *bp, const zbookmark_phys_t *zb,
 		ASSERT3B(dsl_dataset_feature_is_active(ds, f), ==, B_TRUE);
 
 	if (bp->blk_birth <= scn->scn_phys.scn_cur_min_txg) {
-		scn->scn_lt_min_this_txg++;
+		SCAN_WALK_STAT_BUMP(scn, sw, lt_min);
 		return;
 	}
 
 	bp_toread = kmem_alloc(sizeof (blkptr_t), KM_SLEEP);
 	*bp_toread = *bp;
 
-	if (dsl_scan_recurse(scn, ds, ostype, dnp, bp_toread, zb, tx) != 0)
+	if (dsl_scan_recurse(scn, ds, ostype, dnp, bp_toread, zb, tx, sw) != 0)
 		goto out;
 
 	/*
@@ -2041,7 +2496,7 @@ dsl_scan_visitbp(blkptr_t *bp, const zbookmark_phys_t *zb,
 	 */
 	if (ddt_class_contains(dp->dp_spa,
 	    scn->scn_phys.scn_ddt_class_max, bp)) {
-		scn->scn_ddt_contained_this_txg++;
+		SCAN_WALK_STAT_BUMP(scn, sw, ddt_contained);
 		goto out;
 	}
 
@@ -2053,7 +2508,7 @@ dsl_scan_visitbp(blkptr_t *bp, const zbookmark_phys_t *zb,
 	 * under it was modified.
 	 */
 	if (BP_PHYSICAL_BIRTH(bp) > scn->scn_phys.scn_cur_max_txg) {
-		scn->scn_gt_max_this_txg++;
+		SCAN_WALK_STAT_BUMP(scn, sw, gt_max);
 		goto out;
 	}
 
@@ -2086,7 +2541,7 @@ dsl_scan_visit_rootbp(dsl_scan_t *scn, dsl_dataset_t *ds, blkptr_t *bp,
 	dsl_scan_prefetch(spc, bp, &zb);
 	scan_prefetch_ctx_rele(spc, FTAG);
 
-	dsl_scan_visitbp(bp, &zb, NULL, ds, scn, DMU_OST_NONE, tx);
+	dsl_scan_visitbp(bp, &zb, NULL, ds, scn, DMU_OST_NONE, tx, NULL);
 
 	dprintf_ds(ds, "finished scan%s", "");
 }
@@ -2679,6 +3134,18 @@ dsl_scan_ddt(dsl_scan_t *scn, dmu_tx_t *tx)
 	int error;
 	uint64_t n = 0;
 
+	/*
+	 * Entries that are only in a DDT log would be missed by the walk, so
+	 * before starting it wait for the logs to be flushed into the ZAP
+	 * objects.  Later changes are picked up by dsl_scan_ddt_entry().
+	 */
+	if (ddb->ddb_class == 0 && ddb->ddb_type == 0 &&
+	    ddb->ddb_checksum == 0 && ddb->ddb_cursor == 0 &&
+	    !ddt_walk_ready(scn->scn_dp->dp_spa)) {
+		scn->scn_suspending = B_TRUE;
+		return;
+	}
+
 	while ((error = ddt_walk(scn->scn_dp->dp_spa, ddb, &dde)) == 0) {
 		ddt_t *ddt;
 
@@ -2692,7 +3159,7 @@ dsl_scan_ddt(dsl_scan_t *scn, dmu_tx_t *tx)
 
 		/* There should be no pending changes to the dedup table */
 		ddt = scn->scn_dp->dp_spa->spa_ddt[ddb->ddb_checksum];
-		ASSERT(avl_first(&ddt->ddt_tree) == NULL);
+		ASSERT(ddt_tree_empty(ddt));
 
 		dsl_scan_ddt_entry(scn, ddb->ddb_checksum, &dde, tx);
 		n++;
@@ -3308,6 +3775,8 @@ dsl_scan_active(dsl_scan_t *scn)
 	if (spa_shutting_down(spa))
 		return (B_FALSE);
 	if ((dsl_scan_is_running(scn) && !dsl_scan_is_paused_scrub(scn)) ||
+	    (dsl_errorscrubbing(scn->scn_dp) &&
+	    !dsl_errorscrub_is_paused(scn)) ||
 	    (scn->scn_async_destroying && !scn->scn_async_stalled))
 		return (B_TRUE);
 
@@ -3563,13 +4032,18 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	 */
 	if (dsl_scan_restarting(scn, tx) ||
 	    (spa->spa_resilver_deferred && zfs_resilver_disable_defer)) {
-		pool_scan_func_t func = POOL_SCAN_SCRUB;
+		setup_sync_arg_t setup_sync_arg = {
+			.func = POOL_SCAN_SCRUB,
+			.txgstart = 0,
+			.txgend = 0,
+		};
 		dsl_scan_done(scn, B_FALSE, tx);
 		if (vdev_resilver_needed(spa->spa_root_vdev, NULL, NULL))
-			func = POOL_SCAN_RESILVER;
+			setup_sync_arg.func = POOL_SCAN_RESILVER;
 		zfs_dbgmsg("restarting scan func=%u on %s txg=%llu",
-		    func, dp->dp_spa->spa_name, (longlong_t)tx->tx_txg);
-		dsl_scan_setup_sync(&func, tx);
+		    setup_sync_arg.func, dp->dp_spa->spa_name,
+		    (longlong_t)tx->tx_txg);
+		dsl_scan_setup_sync(&setup_sync_arg, tx);
 	}
 
 	/*
@@ -3707,6 +4181,8 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		/* Need to scan metadata for more blocks to scrub */
 		dsl_scan_phys_t *scnp = &scn->scn_phys;
 		taskqid_t prefetch_tqid;
+		uint64_t exam_before = spa->spa_scan_pass_exam;
+		hrtime_t walk_start = gethrtime();
 
 		/*
 		 * Recalculate the max number of in-flight bytes for pool-wide
@@ -3771,6 +4247,9 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		    (longlong_t)scn->scn_lt_min_this_txg,
 		    (longlong_t)scn->scn_ddt_contained_this_txg,
 		    (longlong_t)scn->scn_gt_max_this_txg);
+		spa_iostats_scan_walk_add(spa, scn->scn_visited_this_txg,
+		    spa->spa_scan_pass_exam - exam_before,
+		    gethrtime() - walk_start);
 
 		if (!scn->scn_suspending) {
 			ASSERT0(avl_numnodes(&scn->scn_queue));
@@ -3784,6 +4263,9 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 			    (longlong_t)tx->tx_txg);
 		}
 	} else if (scn->scn_is_sorted && scn->scn_queues_pending != 0) {
+		uint64_t issued_before = spa->spa_scan_pass_issued;
+		hrtime_t issue_start = gethrtime();
+
 		ASSERT(scn->scn_clearing);
 
 		/* need to issue scrubbing IOs from per-vdev queues */
@@ -3792,6 +4274,9 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 		scan_io_queues_run(scn);
 		(void) zio_wait(scn->scn_zio_root);
 		scn->scn_zio_root = NULL;
+		spa_iostats_scan_issue_add(spa,
+		    spa->spa_scan_pass_issued - issued_before,
+		    gethrtime() - issue_start);
 
 		/* calculate and dprintf the current memory usage */
 		(void) dsl_scan_should_clear(scn);
@@ -3821,6 +4306,163 @@ dsl_scan_sync(dsl_pool_t *dp, dmu_tx_t *tx)
 	dsl_scan_sync_state(scn, tx, sync_type);
 }
 
+/*
+ * Look up the block pointer currently referenced by the bookmark "zb" in
+ * dataset "ds". Returns ENOENT if the object or block no longer exists.
+ */
+static int
+dsl_errorscrub_findbp(dsl_dataset_t *ds, const zbookmark_phys_t *zb,
+    blkptr_t *bp)
+{
+	objset_t *os;
+	dnode_t *dn;
+	int error;
+
+	error = dmu_objset_from_ds(ds, &os);
+	if (error != 0)
+		return (error);
+
+	if (zb->zb_object == DMU_META_DNODE_OBJECT) {
+		dn = DMU_META_DNODE(os);
+		dnode_add_ref(dn, FTAG);
+	} else {
+		error = dnode_hold(os, zb->zb_object, FTAG, &dn);
+		if (error != 0)
+			return (error);
+	}
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	error = dbuf_dnode_findbp(dn, zb->zb_level, zb->zb_blkid, bp,
+	    NULL, NULL);
+	rw_exit(&dn->dn_struct_rwlock);
+	dnode_rele(dn, FTAG);
+
+	if (error == 0 && BP_IS_HOLE(bp))
+		error = SET_ERROR(ENOENT);
+
+	return (error);
+}
+
+/*
+ * Called for every entry of the persistent error log. The block is looked
+ * up in the head dataset first; if it has been rewritten since the error
+ * was logged (and the log recorded its birth txg) the snapshots are
+ * searched for the original copy. Blocks which no longer exist anywhere
+ * are simply dropped from the log; blocks which still fail to read are
+ * logged again by zio_done().
+ */
+static void
+dsl_errorscrub_block_cb(spa_t *spa, const zbookmark_phys_t *zb,
+    uint64_t birth, void *arg)
+{
+	dsl_scan_t *scn = arg;
+	dsl_pool_t *dp = scn->scn_dp;
+	zbookmark_phys_t bzb = *zb;
+	dsl_dataset_t *ds;
+	blkptr_t bp;
+	int error;
+
+	scn->errorscrub_phys.dep_examined++;
+	if (scn->errorscrub_phys.dep_to_examine > 0)
+		scn->errorscrub_phys.dep_to_examine--;
+
+	/* Entries without a resolvable block are carried over verbatim. */
+	if (zb->zb_level < 0) {
+		spa_log_error(spa, zb);
+		return;
+	}
+
+	dsl_pool_config_enter(dp, FTAG);
+	error = dsl_dataset_hold_obj(dp, zb->zb_objset, FTAG, &ds);
+	if (error != 0) {
+		dsl_pool_config_exit(dp, FTAG);
+		if (error != ENOENT)
+			spa_log_error(spa, zb);
+		return;
+	}
+
+	error = dsl_errorscrub_findbp(ds, zb, &bp);
+	while (birth != 0 && (error == ENOENT ||
+	    (error == 0 && bp.blk_birth != birth)) &&
+	    dsl_dataset_phys(ds)->ds_prev_snap_obj != 0 &&
+	    dsl_dataset_phys(ds)->ds_prev_snap_txg >= birth) {
+		uint64_t prev = dsl_dataset_phys(ds)->ds_prev_snap_obj;
+
+		dsl_dataset_rele(ds, FTAG);
+		error = dsl_dataset_hold_obj(dp, prev, FTAG, &ds);
+		if (error != 0) {
+			ds = NULL;
+			break;
+		}
+		error = dsl_errorscrub_findbp(ds, zb, &bp);
+	}
+
+	if (error == 0 && birth != 0 && bp.blk_birth != birth)
+		error = SET_ERROR(ENOENT);
+	if (error == 0)
+		bzb.zb_objset = ds->ds_object;
+	if (ds != NULL)
+		dsl_dataset_rele(ds, FTAG);
+	dsl_pool_config_exit(dp, FTAG);
+
+	if (error != 0) {
+		if (error != ENOENT)
+			spa_log_error(spa, zb);
+		return;
+	}
+
+	/* Embedded block pointers have no on-disk data to verify. */
+	if (BP_IS_EMBEDDED(&bp))
+		return;
+
+	scan_exec_io(dp, &bp, ZIO_FLAG_SCAN_THREAD | ZIO_FLAG_RAW |
+	    ZIO_FLAG_CANFAIL | ZIO_FLAG_SCRUB, &bzb, NULL);
+}
+
+/*
+ * Called from spa_sync() once per txg. Re-reads up to
+ * zfs_scrub_error_blocks_per_txg blocks from the persistent error log,
+ * resuming from the cursor saved in the previous txg. Once the whole log
+ * has been visited the error lists are rotated, which drops every entry
+ * that read back cleanly.
+ */
+void
+dsl_errorscrub_sync(dsl_pool_t *dp, dmu_tx_t *tx)
+{
+	dsl_scan_t *scn = dp->dp_scan;
+	spa_t *spa = dp->dp_spa;
+
+	if (spa_sync_pass(spa) > 1 || spa_shutting_down(spa))
+		return;
+
+	if (!dsl_errorscrubbing(dp) || dsl_errorscrub_is_paused(scn))
+		return;
+
+	if (spa->spa_syncing_txg < spa->spa_first_txg + SCAN_IMPORT_WAIT_TXGS)
+		return;
+
+	if (zfs_scan_suspend_progress)
+		return;
+
+	spa->spa_scrub_active = B_TRUE;
+	scn->scn_maxinflight_bytes = MAX(zfs_scan_vdev_limit *
+	    dsl_scan_count_data_disks(spa->spa_root_vdev), 1ULL << 20);
+	scn->scn_zio_root = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+
+	boolean_t done = spa_errlog_walk_last(spa,
+	    &scn->errorscrub_phys.dep_cursor,
+	    MAX(zfs_scrub_error_blocks_per_txg, 1),
+	    dsl_errorscrub_block_cb, scn);
+
+	(void) zio_wait(scn->scn_zio_root);
+	scn->scn_zio_root = NULL;
+
+	if (done)
+		dsl_errorscrub_done(scn, B_TRUE, tx);
+
+	dsl_errorscrub_sync_state(scn, tx);
+}
+
 static void
 count_block_issued(spa_t *spa, const blkptr_t *bp, boolean_t all)
 {
@@ -4016,8 +4658,8 @@ dsl_scan_scrub_cb(dsl_pool_t *dp,
 		 * zpool(8) status can make useful progress reports.
 		 */
 		uint64_t asize = DVA_GET_ASIZE(dva);
-		scn->scn_phys.scn_examined += asize;
-		spa->spa_scan_pass_exam += asize;
+		atomic_add_64(&scn->scn_phys.scn_examined, asize);
+		atomic_add_64(&spa->spa_scan_pass_exam, asize);
 
 		/* if it's a resilver, this may not be in the target range */
 		if (!needs_io)
@@ -4060,7 +4702,12 @@ dsl_scan_scrub_done(zio_t *zio)
 
 	if (zio->io_error && (zio->io_error != ECKSUM ||
 	    !(zio->io_flags & ZIO_FLAG_SPECULATIVE))) {
-		atomic_inc_64(&spa->spa_dsl_pool->dp_scan->scn_phys.scn_errors);
+		dsl_scan_t *scn = spa->spa_dsl_pool->dp_scan;
+
+		if (dsl_errorscrubbing(spa->spa_dsl_pool))
+			atomic_inc_64(&scn->errorscrub_phys.dep_errors);
+		else
+			atomic_inc_64(&scn->scn_phys.scn_errors);
 	}
 }
 
@@ -4457,6 +5104,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, obsolete_min_time_ms, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, free_min_time_ms, INT, ZMOD_RW,
 	"Min millisecs to free per txg");
 
+ZFS_MODULE_PARAM(zfs, zfs_, scrub_error_blocks_per_txg, UINT, ZMOD_RW,
+	"Error blocks to be scrubbed in one txg");
+
 ZFS_MODULE_PARAM(zfs, zfs_, resilver_min_time_ms, INT, ZMOD_RW,
 	"Min millisecs to resilver per txg");
 
@@ -4502,6 +5152,9 @@ ZFS_MODULE_PARAM(zfs, zfs_, scan_mem_lim_soft_fact, INT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs, zfs_, scan_strict_mem_lim, INT, ZMOD_RW,
 	"Tunable to attempt to reduce lock contention");
 
+ZFS_MODULE_PARAM(zfs, zfs_, scan_walk_threads, UINT, ZMOD_RW,
+	"Threads walking dnode blocks in parallel during the metadata scan");
+
 ZFS_MODULE_PARAM(zfs, zfs_, scan_fill_weight, INT, ZMOD_RW,
 	"Tunable to adjust bias towards more filled segments during scans");
 
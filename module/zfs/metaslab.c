@@ -33,6 +33,7 @@
 #include <sys/metaslab_impl.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_draid.h>
+#include <sys/vdev_trim.h>
 #include <sys/zio.h>
 #include <sys/spa_impl.h>
 #include <sys/zfeature.h>
@@ -357,6 +358,9 @@ typedef struct metaslab_stats {
 	kstat_named_t metaslabstat_reload_tree;
 	kstat_named_t metaslabstat_too_many_tries;
 	kstat_named_t metaslabstat_try_hard;
+	kstat_named_t metaslabstat_alloc_fast;
+	kstat_named_t metaslabstat_alloc_fallback;
+	kstat_named_t metaslabstat_mg_lock_contended;
 } metaslab_stats_t;
 
 static metaslab_stats_t metaslab_stats = {
@@ -364,6 +368,9 @@ static metaslab_stats_t metaslab_stats = {
 	{ "reload_tree",		KSTAT_DATA_UINT64 },
 	{ "too_many_tries",		KSTAT_DATA_UINT64 },
 	{ "try_hard",			KSTAT_DATA_UINT64 },
+	{ "alloc_fast",			KSTAT_DATA_UINT64 },
+	{ "alloc_fallback",		KSTAT_DATA_UINT64 },
+	{ "mg_lock_contended",		KSTAT_DATA_UINT64 },
 };
 
 #define	METASLABSTAT_BUMP(stat) \
@@ -1487,6 +1494,42 @@ static const range_tree_ops_t metaslab_rt_ops = {
 	.rtop_vacate = metaslab_rt_vacate
 };
 
+/*
+ * The ms_trim trees account the space they hold in spa_trim_pending, so
+ * that the TRIM backlog can be reported without walking the metaslabs.
+ */
+static void
+metaslab_trim_rt_add(range_tree_t *rt, range_seg_t *rs, void *arg)
+{
+	spa_t *spa = arg;
+
+	atomic_add_64(&spa->spa_trim_pending,
+	    rs_get_end(rs, rt) - rs_get_start(rs, rt));
+}
+
+static void
+metaslab_trim_rt_remove(range_tree_t *rt, range_seg_t *rs, void *arg)
+{
+	spa_t *spa = arg;
+
+	atomic_sub_64(&spa->spa_trim_pending,
+	    rs_get_end(rs, rt) - rs_get_start(rs, rt));
+}
+
+static void
+metaslab_trim_rt_vacate(range_tree_t *rt, void *arg)
+{
+	spa_t *spa = arg;
+
+	atomic_sub_64(&spa->spa_trim_pending, range_tree_space(rt));
+}
+
+static const range_tree_ops_t metaslab_trim_ops = {
+	.rtop_add = metaslab_trim_rt_add,
+	.rtop_remove = metaslab_trim_rt_remove,
+	.rtop_vacate = metaslab_trim_rt_vacate
+};
+
 /*
  * ==========================================================================
  * Common allocator routines
@@ -1599,6 +1642,83 @@ metaslab_block_find(zfs_btree_t *t, range_tree_t *rt, uint64_t start,
 	return (rs);
 }
 
+/*
+ * ==========================================================================
+ * Sequential block allocator
+ *
+ * Used instead of the class allocator for top-level vdevs with the
+ * "sequential" property set, e.g. drives that prefer (or require) to be
+ * written like an append-only log such as shingled (SMR) disks.  Every
+ * metaslab maps to a device region with a write pointer; allocations are
+ * carved at or after the write pointer, which moves forward.  When no free
+ * segment past the write pointer is large enough, the write pointer wraps
+ * to the start of the metaslab and the holes freed behind it are reused in
+ * offset order, like a circular log.  Freed space is therefore never
+ * stranded and the metaslab's free space (and the space accounting built
+ * on it) stays usable.  Once the whole metaslab is free again the write
+ * pointer rewinds to its start (and, with autotrim, the region is
+ * discarded).
+ *
+ * The write pointer is kept in core only.  When it is unknown (e.g. after
+ * import) it is derived from the metaslab's free space: it is the end of
+ * the highest allocated extent, i.e. the start of the free tail.  If the
+ * last block of the metaslab is allocated there is no tail, and the write
+ * pointer starts at the beginning of the metaslab to reclaim the holes.
+ * ==========================================================================
+ */
+static uint64_t
+metaslab_seq_wp(metaslab_t *msp)
+{
+	range_tree_t *rt = msp->ms_allocatable;
+
+	if (range_tree_space(rt) == msp->ms_size)
+		return (msp->ms_start);
+	if (msp->ms_seq_wp != 0)
+		return (msp->ms_seq_wp);
+
+	range_seg_t *rs = zfs_btree_last(&rt->rt_root, NULL);
+	if (rs == NULL || rs_get_end(rs, rt) != msp->ms_start + msp->ms_size)
+		return (msp->ms_start);
+	return (rs_get_start(rs, rt));
+}
+
+/*
+ * Find the first free segment at or after "wp" (and before "limit") that
+ * can hold "size" bytes.
+ */
+static uint64_t
+metaslab_seq_find(metaslab_t *msp, uint64_t wp, uint64_t limit, uint64_t size)
+{
+	range_tree_t *rt = msp->ms_allocatable;
+	zfs_btree_t *t = &rt->rt_root;
+	zfs_btree_index_t where;
+
+	for (range_seg_t *rs = metaslab_block_find(t, rt, wp, size, &where);
+	    rs != NULL && rs_get_start(rs, rt) < limit;
+	    rs = zfs_btree_next(t, &where, &where)) {
+		uint64_t start = MAX(rs_get_start(rs, rt), wp);
+		if (start + size <= rs_get_end(rs, rt))
+			return (start);
+	}
+	return (-1ULL);
+}
+
+static uint64_t
+metaslab_seq_alloc(metaslab_t *msp, uint64_t size)
+{
+	uint64_t wp = metaslab_seq_wp(msp);
+	uint64_t start;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+
+	start = metaslab_seq_find(msp, wp, msp->ms_start + msp->ms_size, size);
+	if (start == -1ULL && wp != msp->ms_start)
+		start = metaslab_seq_find(msp, msp->ms_start, wp, size);
+	if (start != -1ULL)
+		msp->ms_seq_wp = start + size;
+	return (start);
+}
+
 #if defined(WITH_DF_BLOCK_ALLOCATOR) || \
     defined(WITH_CF_BLOCK_ALLOCATOR)
 
@@ -2428,6 +2548,7 @@ metaslab_load_impl(metaslab_t *msp)
 	ASSERT3U(max_size, <=, msp->ms_max_size);
 	hrtime_t load_end = gethrtime();
 	msp->ms_load_time = load_end;
+	spa_iostats_metaslab_load(spa, load_end - load_start);
 	zfs_dbgmsg("metaslab_load: txg %llu, spa %s, vdev_id %llu, "
 	    "ms_id %llu, smp_length %llu, "
 	    "unflushed_allocs %llu, unflushed_frees %llu, "
@@ -2541,6 +2662,7 @@ metaslab_unload(metaslab_t *msp)
 		multilist_sublist_unlock(mls);
 
 		spa_t *spa = msp->ms_group->mg_vd->vdev_spa;
+		spa_iostats_metaslab_unload(spa);
 		zfs_dbgmsg("metaslab_unload: txg %llu, spa %s, vdev_id %llu, "
 		    "ms_id %llu, weight %llx, "
 		    "selected txg %llu (%llu ms ago), alloc_txg %llu, "
@@ -2704,7 +2826,8 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object,
 	ms->ms_unflushed_frees = range_tree_create(&metaslab_rt_ops,
 	    type, mrap, start, shift);
 
-	ms->ms_trim = range_tree_create(NULL, type, NULL, start, shift);
+	ms->ms_trim = range_tree_create(&metaslab_trim_ops, type, spa,
+	    start, shift);
 
 	metaslab_group_add(mg, ms);
 	metaslab_set_fragmentation(ms, B_FALSE);
@@ -2819,6 +2942,7 @@ metaslab_fini(metaslab_t *msp)
 
 	range_tree_vacate(msp->ms_trim, NULL, NULL);
 	range_tree_destroy(msp->ms_trim);
+	vdev_trim_defer_clear(msp);
 
 	mutex_exit(&msp->ms_lock);
 	cv_destroy(&msp->ms_load_cv);
@@ -4587,7 +4711,10 @@ metaslab_block_alloc(metaslab_t *msp, uint64_t size, uint64_t txg)
 	VERIFY(!msp->ms_condensing);
 	VERIFY0(msp->ms_disabled);
 
-	start = mc->mc_ops->msop_alloc(msp, size);
+	if (msp->ms_group->mg_vd->vdev_sequential)
+		start = metaslab_seq_alloc(msp, size);
+	else
+		start = mc->mc_ops->msop_alloc(msp, size);
 	if (start != -1ULL) {
 		metaslab_group_t *mg = msp->ms_group;
 		vdev_t *vd = mg->mg_vd;
@@ -4727,6 +4854,62 @@ metaslab_active_mask_verify(metaslab_t *msp)
 	}
 }
 
+/*
+ * Try to allocate from the metaslab that is already active for this
+ * allocator without taking the mg_lock.  The mga_primary and mga_secondary
+ * pointers only change while the metaslab's ms_lock is held (see
+ * metaslab_activate_allocator() and metaslab_passivate_allocator()), and
+ * metaslabs can't be removed from the group while we hold SCL_ALLOC, so it
+ * is safe to read the pointer racily and then revalidate the activation
+ * under the ms_lock.  This is the common case for a busy allocator, and it
+ * keeps all allocators from serializing on the group's mg_lock.
+ *
+ * Anything out of the ordinary (no active metaslab, it's full, condensing,
+ * or disabled) returns -1ULL, and the caller falls back to the normal
+ * search which knows how to deal with it.
+ */
+static uint64_t
+metaslab_group_alloc_fast(metaslab_group_t *mg, zio_alloc_list_t *zal,
+    uint64_t asize, uint64_t txg, int d, int allocator,
+    uint64_t activation_weight, boolean_t try_hard)
+{
+	metaslab_group_allocator_t *mga = &mg->mg_allocator[allocator];
+	metaslab_t *msp;
+	uint64_t offset = -1ULL;
+
+	if (activation_weight == METASLAB_WEIGHT_PRIMARY)
+		msp = mga->mga_primary;
+	else if (activation_weight == METASLAB_WEIGHT_SECONDARY)
+		msp = mga->mga_secondary;
+	else
+		return (-1ULL);
+
+	if (msp == NULL)
+		return (-1ULL);
+
+	mutex_enter(&msp->ms_lock);
+	if (!(msp->ms_weight & activation_weight) ||
+	    msp->ms_allocator != allocator || !msp->ms_loaded ||
+	    msp->ms_condensing || msp->ms_disabled > 0 ||
+	    !metaslab_should_allocate(msp, asize, try_hard)) {
+		mutex_exit(&msp->ms_lock);
+		return (-1ULL);
+	}
+	ASSERT3B(msp->ms_primary, ==,
+	    (activation_weight == METASLAB_WEIGHT_PRIMARY));
+	metaslab_active_mask_verify(msp);
+
+	metaslab_set_selected_txg(msp, txg);
+	offset = metaslab_block_alloc(msp, asize, txg);
+	if (offset != -1ULL) {
+		metaslab_trace_add(zal, mg, msp, asize, d, offset, allocator);
+		metaslab_segment_may_passivate(msp);
+	}
+	mutex_exit(&msp->ms_lock);
+
+	return (offset);
+}
+
 static uint64_t
 metaslab_group_alloc_normal(metaslab_group_t *mg, zio_alloc_list_t *zal,
     uint64_t asize, uint64_t txg, boolean_t want_unique, dva_t *dva, int d,
@@ -4757,6 +4940,14 @@ metaslab_group_alloc_normal(metaslab_group_t *mg, zio_alloc_list_t *zal,
 
 	ASSERT3U(mg->mg_vd->vdev_ms_count, >=, 2);
 
+	offset = metaslab_group_alloc_fast(mg, zal, asize, txg, d, allocator,
+	    activation_weight, try_hard);
+	if (offset != -1ULL) {
+		METASLABSTAT_BUMP(metaslabstat_alloc_fast);
+		return (offset);
+	}
+	METASLABSTAT_BUMP(metaslabstat_alloc_fallback);
+
 	metaslab_t *search = kmem_alloc(sizeof (*search), KM_SLEEP);
 	search->ms_weight = UINT64_MAX;
 	search->ms_start = 0;
@@ -4772,7 +4963,10 @@ metaslab_group_alloc_normal(metaslab_group_t *mg, zio_alloc_list_t *zal,
 	for (;;) {
 		boolean_t was_active = B_FALSE;
 
-		mutex_enter(&mg->mg_lock);
+		if (!mutex_tryenter(&mg->mg_lock)) {
+			METASLABSTAT_BUMP(metaslabstat_mg_lock_contended);
+			mutex_enter(&mg->mg_lock);
+		}
 
 		if (activation_weight == METASLAB_WEIGHT_PRIMARY &&
 		    mga->mga_primary != NULL) {
@@ -5044,8 +5238,8 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 	offset = metaslab_group_alloc_normal(mg, zal, asize, txg, want_unique,
 	    dva, d, allocator, try_hard);
 
-	mutex_enter(&mg->mg_lock);
 	if (offset == -1ULL) {
+		mutex_enter(&mg->mg_lock);
 		mg->mg_failed_allocations++;
 		metaslab_trace_add(zal, mg, NULL, asize, d,
 		    TRACE_GROUP_FAILURE, allocator);
@@ -5063,9 +5257,9 @@ metaslab_group_alloc(metaslab_group_t *mg, zio_alloc_list_t *zal,
 			 */
 			mg->mg_no_free_space = B_TRUE;
 		}
+		mutex_exit(&mg->mg_lock);
 	}
-	mg->mg_allocations++;
-	mutex_exit(&mg->mg_lock);
+	atomic_inc_64(&mg->mg_allocations);
 	return (offset);
 }
 
@@ -5215,7 +5409,7 @@ top:
 
 		ASSERT(mg->mg_class == mc);
 
-		uint64_t asize = vdev_psize_to_asize(vd, psize);
+		uint64_t asize = vdev_psize_to_asize_txg(vd, psize, txg);
 		ASSERT(P2PHASE(asize, 1ULL << vd->vdev_ashift) == 0);
 
 		/*
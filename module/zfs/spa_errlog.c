@@ -943,6 +943,139 @@ spa_get_errlog(spa_t *spa, void *uaddr, uint64_t *count)
 	return (ret);
 }
 
+/*
+ * Return the number of blocks recorded in the last on-disk error log.  Unlike
+ * spa_get_errlog_size() this neither includes the pending in-core lists nor
+ * expands blocks shared by snapshots and clones; it is the number of entries
+ * spa_errlog_walk_last() is going to visit.
+ */
+uint64_t
+spa_get_last_errlog_size(spa_t *spa)
+{
+	uint64_t total = 0, count;
+
+	mutex_enter(&spa->spa_errlog_lock);
+	if (spa->spa_errlog_last == 0) {
+		mutex_exit(&spa->spa_errlog_lock);
+		return (0);
+	}
+
+	if (!spa_feature_is_enabled(spa, SPA_FEATURE_HEAD_ERRLOG)) {
+		if (zap_count(spa->spa_meta_objset, spa->spa_errlog_last,
+		    &count) == 0)
+			total = count;
+	} else {
+		zap_cursor_t zc;
+		zap_attribute_t za;
+		for (zap_cursor_init(&zc, spa->spa_meta_objset,
+		    spa->spa_errlog_last); zap_cursor_retrieve(&zc, &za) == 0;
+		    zap_cursor_advance(&zc)) {
+			if (zap_count(spa->spa_meta_objset,
+			    za.za_first_integer, &count) == 0)
+				total += count;
+		}
+		zap_cursor_fini(&zc);
+	}
+	mutex_exit(&spa->spa_errlog_lock);
+
+	return (total);
+}
+
+typedef struct errlog_walk_entry {
+	zbookmark_phys_t	ewe_zb;
+	uint64_t		ewe_birth;
+	list_node_t		ewe_node;
+} errlog_walk_entry_t;
+
+static void
+errlog_walk_add(list_t *list, const zbookmark_phys_t *zb, uint64_t birth)
+{
+	errlog_walk_entry_t *ewe = kmem_alloc(sizeof (*ewe), KM_SLEEP);
+	ewe->ewe_zb = *zb;
+	ewe->ewe_birth = birth;
+	list_insert_tail(list, ewe);
+}
+
+/*
+ * Visit up to (about) limit entries of the last on-disk error log, starting
+ * at the serialized zap cursor *cursorp, and advance *cursorp past them.
+ * For each entry cb is called with the bookmark of the damaged block and,
+ * if the head_errlog feature is enabled, its birth txg.  In that case the
+ * bookmark's objset is the head dataset the error was logged against and
+ * all entries of one head dataset are visited together, so the limit may
+ * be exceeded.  Without head_errlog the birth txg is unknown and passed as
+ * zero.  The callbacks are made without holding spa_errlog_lock, so they
+ * are free to issue I/O.  Returns B_TRUE once the whole log was visited.
+ */
+boolean_t
+spa_errlog_walk_last(spa_t *spa, uint64_t *cursorp, uint64_t limit,
+    spa_errlog_cb_t *cb, void *arg)
+{
+	boolean_t done = B_TRUE;
+	uint64_t visited = 0;
+	zap_cursor_t zc;
+	zap_attribute_t za;
+	list_t list;
+
+	list_create(&list, sizeof (errlog_walk_entry_t),
+	    offsetof(errlog_walk_entry_t, ewe_node));
+
+	mutex_enter(&spa->spa_errlog_lock);
+	if (spa->spa_errlog_last == 0) {
+		mutex_exit(&spa->spa_errlog_lock);
+		list_destroy(&list);
+		return (B_TRUE);
+	}
+
+	boolean_t head_errlog =
+	    spa_feature_is_enabled(spa, SPA_FEATURE_HEAD_ERRLOG);
+	for (zap_cursor_init_serialized(&zc, spa->spa_meta_objset,
+	    spa->spa_errlog_last, *cursorp);
+	    zap_cursor_retrieve(&zc, &za) == 0; zap_cursor_advance(&zc)) {
+		if (visited >= limit) {
+			done = B_FALSE;
+			break;
+		}
+
+		zbookmark_phys_t zb;
+		if (!head_errlog) {
+			name_to_bookmark(za.za_name, &zb);
+			errlog_walk_add(&list, &zb, 0);
+			visited++;
+			continue;
+		}
+
+		zap_cursor_t head_ds_cursor;
+		zap_attribute_t head_ds_attr;
+		zbookmark_err_phys_t zep;
+		uint64_t head_ds;
+
+		name_to_object(za.za_name, &head_ds);
+		for (zap_cursor_init(&head_ds_cursor, spa->spa_meta_objset,
+		    za.za_first_integer); zap_cursor_retrieve(&head_ds_cursor,
+		    &head_ds_attr) == 0; zap_cursor_advance(&head_ds_cursor)) {
+			name_to_errphys(head_ds_attr.za_name, &zep);
+			SET_BOOKMARK(&zb, head_ds, zep.zb_object,
+			    zep.zb_level, zep.zb_blkid);
+			errlog_walk_add(&list, &zb, zep.zb_birth);
+			visited++;
+		}
+		zap_cursor_fini(&head_ds_cursor);
+	}
+	*cursorp = zap_cursor_serialize(&zc);
+	zap_cursor_fini(&zc);
+	mutex_exit(&spa->spa_errlog_lock);
+
+	errlog_walk_entry_t *ewe;
+	while ((ewe = list_remove_head(&list)) != NULL) {
+		cb(spa, &ewe->ewe_zb, ewe->ewe_birth, arg);
+		kmem_free(ewe, sizeof (*ewe));
+	}
+	list_destroy(&list);
+
+	return (done);
+}
+
 /*
  * Called when a scrub completes.  This simply set a bit which tells which AVL
  * tree to add new errors.  spa_errlog_sync() is responsible for actually
@@ -1284,6 +1417,8 @@ spa_swap_errlog(spa_t *spa, uint64_t new_head_ds, uint64_t old_head_ds,
 /* error handling */
 EXPORT_SYMBOL(spa_log_error);
 EXPORT_SYMBOL(spa_get_errlog_size);
+EXPORT_SYMBOL(spa_get_last_errlog_size);
+EXPORT_SYMBOL(spa_errlog_walk_last);
 EXPORT_SYMBOL(spa_get_errlog);
 EXPORT_SYMBOL(spa_errlog_rotate);
 EXPORT_SYMBOL(spa_errlog_drain);
@@ -58,6 +58,7 @@
 #include <sys/metaslab_impl.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/kstat.h>
 #include "zfs_prop.h"
 #include <sys/btree.h>
@@ -386,7 +387,20 @@ int spa_asize_inflation = 24;
 int spa_slop_shift = 5;
 static const uint64_t spa_min_slop = 128ULL * 1024 * 1024;
 static const uint64_t spa_max_slop = 128ULL * 1024 * 1024 * 1024;
-static const int spa_allocators = 4;
+
+/*
+ * Number of allocators to use, per spa instance.  Each allocator keeps its
+ * own set of active metaslabs in every metaslab group, so concurrent writers
+ * hashed to different allocators rarely contend on the same ms_lock.  By
+ * default (spa_num_allocators == 0) one allocator is created for every
+ * spa_cpus_per_allocator CPUs, so the count grows with the host, but never
+ * fewer than SPA_ALLOCATORS_MIN, the fixed count used before.  A non-zero
+ * spa_num_allocators sets the count explicitly.  Both values are sampled
+ * when the pool is opened.
+ */
+#define	SPA_ALLOCATORS_MIN	4
+static uint_t spa_num_allocators = 0;
+static uint_t spa_cpus_per_allocator = 4;
 
 
 void
@@ -699,7 +713,12 @@ spa_add(const char *name, nvlist_t *config, const char *altroot)
 	if (altroot)
 		spa->spa_root = spa_strdup(altroot);
 
-	spa->spa_alloc_count = spa_allocators;
+	if (spa_num_allocators != 0) {
+		spa->spa_alloc_count = spa_num_allocators;
+	} else {
+		spa->spa_alloc_count = MAX(boot_ncpus /
+		    MAX(spa_cpus_per_allocator, 1), SPA_ALLOCATORS_MIN);
+	}
 	spa->spa_allocs = kmem_zalloc(spa->spa_alloc_count *
 	    sizeof (spa_alloc_t), KM_SLEEP);
 	for (int i = 0; i < spa->spa_alloc_count; i++) {
@@ -781,6 +800,7 @@ spa_remove(spa_t *spa)
 	ASSERT(spa_state(spa) == POOL_STATE_UNINITIALIZED);
 	ASSERT3U(zfs_refcount_count(&spa->spa_refcount), ==, 0);
 	ASSERT0(spa->spa_waiters);
+	ASSERT0(spa->spa_trim_pending);
 
 	nvlist_free(spa->spa_config_splitting);
 
@@ -1834,7 +1854,7 @@ void
 spa_update_dspace(spa_t *spa)
 {
 	spa->spa_dspace = metaslab_class_get_dspace(spa_normal_class(spa)) +
-	    ddt_get_dedup_dspace(spa);
+	    ddt_get_dedup_dspace(spa) + brt_get_dspace(spa);
 	if (spa->spa_nonallocating_dspace > 0) {
 		/*
 		 * Subtract the space provided by all non-allocating vdevs that
@@ -2411,11 +2431,13 @@ spa_init(spa_mode_t mode)
 	zfs_btree_init();
 	metaslab_stat_init();
 	ddt_init();
+	brt_init();
 	zio_init();
 	dmu_init();
 	zil_init();
 	vdev_cache_stat_init();
 	vdev_mirror_stat_init();
+	vdev_queue_stat_init();
 	vdev_raidz_math_init();
 	vdev_file_init();
 	zfs_prop_init();
@@ -2440,11 +2462,13 @@ spa_fini(void)
 	vdev_file_fini();
 	vdev_cache_stat_fini();
 	vdev_mirror_stat_fini();
+	vdev_queue_stat_fini();
 	vdev_raidz_math_fini();
 	chksum_fini();
 	zil_fini();
 	dmu_fini();
 	zio_fini();
+	brt_fini();
 	ddt_fini();
 	metaslab_stat_fini();
 	zfs_btree_fini();
@@ -2567,7 +2591,8 @@ spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps)
 {
 	dsl_scan_t *scn = spa->spa_dsl_pool ? spa->spa_dsl_pool->dp_scan : NULL;
 
-	if (scn == NULL || scn->scn_phys.scn_func == POOL_SCAN_NONE)
+	if (scn == NULL || (scn->scn_phys.scn_func == POOL_SCAN_NONE &&
+	    scn->errorscrub_phys.dep_func == POOL_SCAN_NONE))
 		return (SET_ERROR(ENOENT));
 	memset(ps, 0, sizeof (pool_scan_stat_t));
 
@@ -2591,6 +2616,19 @@ spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps)
 	ps->pss_issued =
 	    scn->scn_issued_before_pass + spa->spa_scan_pass_issued;
 
+	/* error scrub data stored on disk */
+	ps->pss_error_scrub_func = scn->errorscrub_phys.dep_func;
+	ps->pss_error_scrub_state = scn->errorscrub_phys.dep_state;
+	ps->pss_error_scrub_start = scn->errorscrub_phys.dep_start_time;
+	ps->pss_error_scrub_end = scn->errorscrub_phys.dep_end_time;
+	ps->pss_error_scrub_examined = scn->errorscrub_phys.dep_examined;
+	ps->pss_error_scrub_errors = scn->errorscrub_phys.dep_errors;
+	ps->pss_error_scrub_to_be_examined =
+	    scn->errorscrub_phys.dep_to_examine;
+
+	/* error scrub data not stored on disk */
+	ps->pss_pass_error_scrub_pause = spa->spa_scan_pass_errorscrub_pause;
+
 	return (0);
 }
 
@@ -2955,5 +2993,11 @@ ZFS_MODULE_PARAM(zfs, zfs_, special_class_metadata_reserve_pct, INT, ZMOD_RW,
 	"free space available");
 /* END CSTYLED */
 
+ZFS_MODULE_PARAM(zfs_spa, spa_, num_allocators, UINT, ZMOD_RW,
+	"Number of allocators per spa, 0 to derive from CPU count");
+
+ZFS_MODULE_PARAM(zfs_spa, spa_, cpus_per_allocator, UINT, ZMOD_RW,
+	"Number of CPUs per allocator");
+
 ZFS_MODULE_PARAM_CALL(zfs_spa, spa_, slop_shift, param_set_slop_shift,
 	param_get_int, ZMOD_RW, "Reserved free space in pool");
@@ -22,6 +22,7 @@
 #include <sys/zfs_context.h>
 #include <sys/spa_impl.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_trim.h>
 #include <sys/spa.h>
 #include <zfs_comutil.h>
 
@@ -895,6 +896,20 @@ static const spa_iostats_t spa_iostats_template = {
 	{ "simple_trim_bytes_skipped",		KSTAT_DATA_UINT64 },
 	{ "simple_trim_extents_failed",		KSTAT_DATA_UINT64 },
 	{ "simple_trim_bytes_failed",		KSTAT_DATA_UINT64 },
+	{ "trim_bytes_pending",			KSTAT_DATA_UINT64 },
+	{ "trim_queue_depth",			KSTAT_DATA_UINT64 },
+	{ "scan_walk_blocks",			KSTAT_DATA_UINT64 },
+	{ "scan_walk_bytes",			KSTAT_DATA_UINT64 },
+	{ "scan_walk_time_ns",			KSTAT_DATA_UINT64 },
+	{ "scan_issue_bytes",			KSTAT_DATA_UINT64 },
+	{ "scan_issue_time_ns",			KSTAT_DATA_UINT64 },
+	{ "metaslab_loads",			KSTAT_DATA_UINT64 },
+	{ "metaslab_unloads",			KSTAT_DATA_UINT64 },
+	{ "metaslab_load_time_ns",		KSTAT_DATA_UINT64 },
+	{ "flush_issued",			KSTAT_DATA_UINT64 },
+	{ "flush_skipped",			KSTAT_DATA_UINT64 },
+	{ "bg_limit_decreases",			KSTAT_DATA_UINT64 },
+	{ "bg_limit_increases",			KSTAT_DATA_UINT64 },
 };
 
 #define	SPA_IOSTATS_ADD(stat, val) \
@@ -938,12 +953,142 @@ spa_iostats_trim_add(spa_t *spa, trim_type_t type,
 	}
 }
 
+/*
+ * Account one txg worth of scan metadata traversal (the "walk" phase) or
+ * of sorted scan I/O issuing (the "issue" phase).  Dividing the bytes by
+ * the time of either phase gives its throughput.
+ */
+void
+spa_iostats_scan_walk_add(spa_t *spa, uint64_t blocks, uint64_t bytes,
+    hrtime_t time)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(scan_walk_blocks, blocks);
+	SPA_IOSTATS_ADD(scan_walk_bytes, bytes);
+	SPA_IOSTATS_ADD(scan_walk_time_ns, time);
+}
+
+void
+spa_iostats_scan_issue_add(spa_t *spa, uint64_t bytes, hrtime_t time)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(scan_issue_bytes, bytes);
+	SPA_IOSTATS_ADD(scan_issue_time_ns, time);
+}
+
+/*
+ * Metaslabs are only summarized (by their space map header) at import and
+ * their space maps are loaded lazily as they are selected for allocation or
+ * preloaded in the background.  The difference between the load and unload
+ * counters is the number of metaslabs currently loaded, which lets one
+ * follow the background loading after an import.
+ */
+void
+spa_iostats_metaslab_load(spa_t *spa, hrtime_t time)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(metaslab_loads, 1);
+	SPA_IOSTATS_ADD(metaslab_load_time_ns, time);
+}
+
+void
+spa_iostats_metaslab_unload(spa_t *spa)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(metaslab_unloads, 1);
+}
+
+/*
+ * Leaf vdev cache flushes, as issued or skipped by zio_flush() for leaves
+ * which report no volatile write cache.
+ */
+void
+spa_iostats_flush_add(spa_t *spa, uint64_t issued, uint64_t skipped)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(flush_issued, issued);
+	SPA_IOSTATS_ADD(flush_skipped, skipped);
+}
+
+/*
+ * Changes of the latency-driven background I/O limit of any of the pool's
+ * vdev queues, see zfs_vdev_latency_target_us.
+ */
+void
+spa_iostats_bg_limit_add(spa_t *spa, uint64_t decreases, uint64_t increases)
+{
+	spa_history_kstat_t *shk = &spa->spa_stats.iostats;
+	kstat_t *ksp = shk->kstat;
+	spa_iostats_t *iostats;
+
+	if (ksp == NULL)
+		return;
+
+	iostats = ksp->ks_data;
+	SPA_IOSTATS_ADD(bg_limit_decreases, decreases);
+	SPA_IOSTATS_ADD(bg_limit_increases, increases);
+}
+
 static int
 spa_iostats_update(kstat_t *ksp, int rw)
 {
 	if (rw == KSTAT_WRITE) {
 		memcpy(ksp->ks_data, &spa_iostats_template,
 		    sizeof (spa_iostats_t));
+		return (0);
+	}
+
+	/*
+	 * The TRIM queue depth is sampled when read.  If the config lock
+	 * isn't readily available, or the vdev tree is still being set up
+	 * by an import, the previous sample is reported.
+	 */
+	spa_t *spa = ksp->ks_private;
+	spa_iostats_t *iostats = ksp->ks_data;
+	iostats->trim_bytes_pending.value.ui64 =
+	    atomic_load_64(&spa->spa_trim_pending);
+	if (spa->spa_load_state == SPA_LOAD_NONE &&
+	    spa_config_tryenter(spa, SCL_CONFIG, FTAG, RW_READER)) {
+		if (spa->spa_root_vdev != NULL) {
+			iostats->trim_queue_depth.value.ui64 =
+			    vdev_trim_queue_depth(spa->spa_root_vdev);
+		}
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
 	}
 
 	return (0);
@@ -297,13 +297,13 @@ vdev_derive_alloc_bias(const char *bias)
  * all children.  This is what's used by anything other than RAID-Z.
  */
 uint64_t
-vdev_default_asize(vdev_t *vd, uint64_t psize)
+vdev_default_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	uint64_t asize = P2ROUNDUP(psize, 1ULL << vd->vdev_top->vdev_ashift);
 	uint64_t csize;
 
 	for (int c = 0; c < vd->vdev_children; c++) {
-		csize = vdev_psize_to_asize(vd->vdev_child[c], psize);
+		csize = vdev_psize_to_asize_txg(vd->vdev_child[c], psize, txg);
 		asize = MAX(asize, csize);
 	}
 
@@ -615,6 +615,9 @@ vdev_alloc_common(spa_t *spa, uint_t id, uint64_t guid, vdev_ops_t *ops)
 	vd->vdev_ops = ops;
 	vd->vdev_state = VDEV_STATE_CLOSED;
 	vd->vdev_ishole = (ops == &vdev_hole_ops);
+	vd->vdev_queue_depth_pct = UINT64_MAX;
+	vd->vdev_trim_extent_bytes_max = UINT64_MAX;
+	vd->vdev_trim_extent_bytes_min = UINT64_MAX;
 	vic->vic_prev_indirect_vdev = UINT64_MAX;
 
 	rw_init(&vd->vdev_indirect_rwlock, NULL, RW_DEFAULT, NULL);
@@ -791,6 +794,11 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	if (top_level && alloc_bias != VDEV_BIAS_NONE)
 		vd->vdev_alloc_bias = alloc_bias;
 
+	if (ops == &vdev_raidz_ops) {
+		vd->vdev_rz_expanding = nvlist_exists(nv,
+		    ZPOOL_CONFIG_RAIDZ_EXPANDING);
+	}
+
 	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &vd->vdev_path) == 0)
 		vd->vdev_path = spa_strdup(vd->vdev_path);
 
@@ -1192,6 +1200,8 @@ vdev_top_transfer(vdev_t *svd, vdev_t *tvd)
 	ASSERT0(tvd->vdev_removing);
 	ASSERT0(tvd->vdev_rebuilding);
 	tvd->vdev_noalloc = svd->vdev_noalloc;
+	tvd->vdev_sequential = svd->vdev_sequential;
+	tvd->vdev_queue_depth_pct = svd->vdev_queue_depth_pct;
 	tvd->vdev_removing = svd->vdev_removing;
 	tvd->vdev_rebuilding = svd->vdev_rebuilding;
 	tvd->vdev_rebuild_config = svd->vdev_rebuild_config;
@@ -1208,6 +1218,8 @@ vdev_top_transfer(vdev_t *svd, vdev_t *tvd)
 	svd->vdev_indirect_births = NULL;
 	svd->vdev_obsolete_sm = NULL;
 	svd->vdev_noalloc = 0;
+	svd->vdev_sequential = B_FALSE;
+	svd->vdev_queue_depth_pct = UINT64_MAX;
 	svd->vdev_removing = 0;
 	svd->vdev_rebuilding = 0;
 
@@ -1433,33 +1445,56 @@ vdev_metaslab_init(vdev_t *vd, uint64_t txg)
 	vd->vdev_ms = mspp;
 	vd->vdev_ms_count = newc;
 
-	for (uint64_t m = oldc; m < newc; m++) {
-		uint64_t object = 0;
-		/*
-		 * vdev_ms_array may be 0 if we are creating the "fake"
-		 * metaslabs for an indirect vdev for zdb's leak detection.
-		 * See zdb_leak_init().
-		 */
-		if (txg == 0 && vd->vdev_ms_array != 0) {
-			error = dmu_read(spa->spa_meta_objset,
-			    vd->vdev_ms_array,
-			    m * sizeof (uint64_t), sizeof (uint64_t), &object,
-			    DMU_READ_PREFETCH);
-			if (error != 0) {
-				vdev_dbgmsg(vd, "unable to read the metaslab "
-				    "array [error=%d]", error);
-				return (error);
+	/*
+	 * When opening an existing pool, everything metaslab_init() needs to
+	 * weigh a metaslab (its allocated space and free segment histogram)
+	 * is in the header of its space map, which lives in the bonus buffer
+	 * of the space map object; the space map itself is only read when the
+	 * metaslab is loaded.  Read the whole metaslab array at once and
+	 * prefetch all of the space map dnodes so that large vdevs don't
+	 * wait on one synchronous MOS read per metaslab.
+	 *
+	 * vdev_ms_array may be 0 if we are creating the "fake" metaslabs
+	 * for an indirect vdev for zdb's leak detection. See zdb_leak_init().
+	 */
+	uint64_t *objects = NULL;
+	uint64_t objects_size = (newc - oldc) * sizeof (uint64_t);
+	if (txg == 0 && vd->vdev_ms_array != 0 && newc > oldc) {
+		objects = vmem_alloc(objects_size, KM_SLEEP);
+		error = dmu_read(spa->spa_meta_objset, vd->vdev_ms_array,
+		    oldc * sizeof (uint64_t), objects_size, objects,
+		    DMU_READ_PREFETCH);
+		if (error != 0) {
+			vdev_dbgmsg(vd, "unable to read the metaslab "
+			    "array [error=%d]", error);
+			vmem_free(objects, objects_size);
+			return (error);
+		}
+		if (!(spa->spa_mode == SPA_MODE_READ &&
+		    !spa->spa_read_spacemaps)) {
+			for (uint64_t m = oldc; m < newc; m++) {
+				dmu_prefetch(spa->spa_meta_objset,
+				    objects[m - oldc], 0, 0, 0,
+				    ZIO_PRIORITY_SYNC_READ);
 			}
 		}
+	}
+
+	for (uint64_t m = oldc; m < newc; m++) {
+		uint64_t object = (objects != NULL) ? objects[m - oldc] : 0;
 
 		error = metaslab_init(vd->vdev_mg, m, object, txg,
 		    &(vd->vdev_ms[m]));
 		if (error != 0) {
 			vdev_dbgmsg(vd, "metaslab_init failed [error=%d]",
 			    error);
+			if (objects != NULL)
+				vmem_free(objects, objects_size);
 			return (error);
 		}
 	}
+	if (objects != NULL)
+		vmem_free(objects, objects_size);
 
 	/*
 	 * Find the emptiest metaslab on the vdev and mark it for use for
@@ -1733,6 +1768,168 @@ vdev_probe(vdev_t *vd, zio_t *zio)
 	return (NULL);
 }
 
+/*
+ * Return the in-core value backing a settable tuning property, or NULL if
+ * the property doesn't apply to this vdev.  I/O queue and TRIM properties
+ * apply to leaf vdevs, the allocation queue depth to top-level vdevs.
+ * UINT64_MAX ("auto") defers to the module parameter.
+ */
+static uint64_t *
+vdev_prop_tunable(vdev_t *vd, vdev_prop_t prop)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	uint64_t *valp;
+
+	switch (prop) {
+	case VDEV_PROP_QUEUE_DEPTH_PCT:
+		if (vd != vd->vdev_top || !vdev_is_concrete(vd))
+			return (NULL);
+		return (&vd->vdev_queue_depth_pct);
+	case VDEV_PROP_AGGREGATION_LIMIT:
+		valp = &vq->vq_aggregation_limit;
+		break;
+	case VDEV_PROP_READ_GAP_LIMIT:
+		valp = &vq->vq_read_gap_limit;
+		break;
+	case VDEV_PROP_SYNC_READ_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_SYNC_READ];
+		break;
+	case VDEV_PROP_SYNC_WRITE_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_SYNC_WRITE];
+		break;
+	case VDEV_PROP_ASYNC_READ_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_ASYNC_READ];
+		break;
+	case VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_ASYNC_WRITE];
+		break;
+	case VDEV_PROP_SCRUB_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_SCRUB];
+		break;
+	case VDEV_PROP_REMOVAL_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_REMOVAL];
+		break;
+	case VDEV_PROP_INITIALIZING_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_INITIALIZING];
+		break;
+	case VDEV_PROP_TRIM_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_TRIM];
+		break;
+	case VDEV_PROP_REBUILD_MAX_ACTIVE:
+		valp = &vq->vq_max_active[ZIO_PRIORITY_REBUILD];
+		break;
+	case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+		valp = &vd->vdev_trim_extent_bytes_max;
+		break;
+	case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+		valp = &vd->vdev_trim_extent_bytes_min;
+		break;
+	default:
+		return (NULL);
+	}
+
+	return (vd->vdev_ops->vdev_op_leaf ? valp : NULL);
+}
+
+/*
+ * Verify that a new value for a tuning property is "auto" or in range.
+ */
+static int
+vdev_prop_tunable_check(vdev_prop_t prop, uint64_t intval)
+{
+	uint64_t min, max;
+
+	switch (prop) {
+	case VDEV_PROP_AGGREGATION_LIMIT:
+	case VDEV_PROP_READ_GAP_LIMIT:
+		min = 0;
+		max = SPA_MAXBLOCKSIZE;
+		break;
+	case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+		min = SPA_MINBLOCKSIZE;
+		max = UINT32_MAX;
+		break;
+	case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+		min = 0;
+		max = UINT32_MAX;
+		break;
+	case VDEV_PROP_QUEUE_DEPTH_PCT:
+		min = 1;
+		max = 100000;
+		break;
+	default:
+		/* *_max_active */
+		min = 1;
+		max = UINT16_MAX;
+		break;
+	}
+
+	if (intval != UINT64_MAX && (intval < min || intval > max))
+		return (SET_ERROR(EINVAL));
+	return (0);
+}
+
+/*
+ * Return the value of a read-only I/O queue statistics property.
+ */
+static uint64_t
+vdev_prop_queue_stat(vdev_t *vd, vdev_prop_t prop)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	zio_priority_t p;
+
+	switch (prop) {
+	case VDEV_PROP_SYNC_READ_LATENCY:
+		p = ZIO_PRIORITY_SYNC_READ;
+		break;
+	case VDEV_PROP_SYNC_WRITE_LATENCY:
+		p = ZIO_PRIORITY_SYNC_WRITE;
+		break;
+	case VDEV_PROP_ASYNC_READ_LATENCY:
+		p = ZIO_PRIORITY_ASYNC_READ;
+		break;
+	case VDEV_PROP_ASYNC_WRITE_LATENCY:
+		p = ZIO_PRIORITY_ASYNC_WRITE;
+		break;
+	case VDEV_PROP_QUEUE_ACTIVE:
+		return (vdev_queue_length(vd));
+	case VDEV_PROP_QUEUE_PENDING:
+		return (vdev_queue_pending(vd));
+	case VDEV_PROP_AGGREGATED_IOS:
+		return (vq->vq_agg_ios);
+	case VDEV_PROP_UNAGGREGATED_IOS:
+		return (vq->vq_unagg_ios);
+	default:
+		panic("invalid vdev queue property %d", prop);
+		return (0);
+	}
+
+	return (MAX(vq->vq_class[p].vqc_latency, 0));
+}
+
+/*
+ * Look up a numeric property in the vdev's property ZAP, returning the
+ * property's default value if it has never been set.
+ */
+static int
+vdev_prop_lookup_numeric(vdev_t *vd, vdev_prop_t prop, uint64_t *valp)
+{
+	uint64_t objid = (vd->vdev_top_zap != 0) ?
+	    vd->vdev_top_zap : vd->vdev_leaf_zap;
+	int error = ENOENT;
+
+	if (objid != 0) {
+		error = zap_lookup(spa_meta_objset(vd->vdev_spa), objid,
+		    vdev_prop_to_name(prop), sizeof (uint64_t), 1, valp);
+	}
+	if (error == ENOENT) {
+		*valp = vdev_prop_default_numeric(prop);
+		error = 0;
+	}
+
+	return (error);
+}
+
 static void
 vdev_load_child(void *arg)
 {
@@ -3111,6 +3308,14 @@ vdev_dtl_reassess(vdev_t *vd, uint64_t txg, uint64_t scrub_txg,
 
 		if (txg != 0)
 			vdev_dirty(vd->vdev_top, VDD_DTL, vd, txg);
+
+		/*
+		 * A RAID-Z expansion which was paused because of i/o errors
+		 * can resume once the children are whole again.
+		 */
+		if (vd->vdev_top->vdev_ops == &vdev_raidz_ops &&
+		    vdev_dtl_empty(vd, DTL_MISSING))
+			raidz_dtl_reassessed(vd);
 		return;
 	}
 
@@ -3498,6 +3703,38 @@ vdev_load(vdev_t *vd)
 			    (u_longlong_t)vd->vdev_top_zap, error);
 			return (error);
 		}
+
+		uint64_t sequential = 0;
+		error = zap_lookup(spa->spa_meta_objset, vd->vdev_top_zap,
+		    vdev_prop_to_name(VDEV_PROP_SEQUENTIAL), sizeof (uint64_t),
+		    1, &sequential);
+		if (error != 0 && error != ENOENT) {
+			vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
+			    VDEV_AUX_CORRUPT_DATA);
+			vdev_dbgmsg(vd, "vdev_load: zap_lookup(top_zap=%llu) "
+			    "failed [error=%d]",
+			    (u_longlong_t)vd->vdev_top_zap, error);
+			return (error);
+		}
+		vd->vdev_sequential = (sequential != 0);
+	}
+
+	/*
+	 * Load the tuning properties that apply to this vdev.  These are
+	 * only hints, so fall back to the defaults if they can't be read.
+	 */
+	for (vdev_prop_t prop = 0; prop < VDEV_NUM_PROPS; prop++) {
+		uint64_t *valp = vdev_prop_tunable(vd, prop);
+
+		if (valp == NULL)
+			continue;
+		error = vdev_prop_lookup_numeric(vd, prop, valp);
+		if (error != 0) {
+			vdev_dbgmsg(vd, "vdev_load: failed to load property "
+			    "%s [error=%d]", vdev_prop_to_name(prop), error);
+			*valp = vdev_prop_default_numeric(prop);
+			error = 0;
+		}
 	}
 
 	/*
@@ -3514,6 +3751,20 @@ vdev_load(vdev_t *vd)
 		}
 	}
 
+	/*
+	 * Load any RAID-Z expansion state from the top-level vdev zap.
+	 */
+	if (vd == vd->vdev_top && vd->vdev_ops == &vdev_raidz_ops) {
+		error = vdev_raidz_load(vd);
+		if (error != 0) {
+			vdev_set_state(vd, B_FALSE, VDEV_STATE_CANT_OPEN,
+			    VDEV_AUX_CORRUPT_DATA);
+			vdev_dbgmsg(vd, "vdev_load: vdev_raidz_load "
+			    "failed [error=%d]", error);
+			return (error);
+		}
+	}
+
 	/*
 	 * If this is a top-level vdev, initialize its metaslabs.
 	 */
@@ -3801,10 +4052,26 @@ vdev_sync(vdev_t *vd, uint64_t txg)
 	dmu_tx_commit(tx);
 }
 
+/*
+ * Return the allocated size of a block of the given psize written in the
+ * given txg.  The txg only matters for RAID-Z vdevs which have been
+ * expanded, where the stripe width depends on when the block was born.
+ */
+uint64_t
+vdev_psize_to_asize_txg(vdev_t *vd, uint64_t psize, uint64_t txg)
+{
+	return (vd->vdev_ops->vdev_op_asize(vd, psize, txg));
+}
+
+/*
+ * Return the allocated size of a block of the given psize, using the
+ * original geometry of the vdev.  This is what is used for space
+ * accounting, which must remain constant over the life of the vdev.
+ */
 uint64_t
 vdev_psize_to_asize(vdev_t *vd, uint64_t psize)
 {
-	return (vd->vdev_ops->vdev_op_asize(vd, psize));
+	return (vdev_psize_to_asize_txg(vd, psize, 0));
 }
 
 /*
@@ -3940,7 +4207,13 @@ vdev_online(spa_t *spa, uint64_t guid, uint64_t flags, vdev_state_t *newstate)
 	if ((vd = spa_lookup_by_guid(spa, guid, B_TRUE)) == NULL)
 		return (spa_vdev_state_exit(spa, NULL, SET_ERROR(ENODEV)));
 
-	if (!vd->vdev_ops->vdev_op_leaf)
+	/*
+	 * The only interior vdev which can be onlined is a RAID-Z vdev
+	 * which is expanded to its new size once a reflow has completed.
+	 */
+	if (!vd->vdev_ops->vdev_op_leaf &&
+	    !(vd->vdev_ops == &vdev_raidz_ops && vd == vd->vdev_top &&
+	    (flags & ZFS_ONLINE_EXPAND)))
 		return (spa_vdev_state_exit(spa, NULL, SET_ERROR(ENOTSUP)));
 
 	wasoffline = (vd->vdev_offline || vd->vdev_tmpoffline);
@@ -5479,6 +5752,7 @@ vdev_props_set_sync(void *arg, dmu_tx_t *tx)
 
 	while ((elem = nvlist_next_nvpair(nvprops, elem)) != NULL) {
 		uint64_t intval, objid = 0;
+		uint64_t *valp;
 		char *strval;
 		vdev_prop_t prop;
 		const char *propname = nvpair_name(elem);
@@ -5537,6 +5811,11 @@ vdev_props_set_sync(void *arg, dmu_tx_t *tx)
 				}
 				VERIFY0(zap_update(mos, objid, propname,
 				    sizeof (uint64_t), 1, &intval, tx));
+				if (prop == VDEV_PROP_SEQUENTIAL)
+					vd->vdev_sequential = (intval != 0);
+				else if ((valp = vdev_prop_tunable(vd,
+				    prop)) != NULL)
+					*valp = intval;
 				spa_history_log_internal(spa, "vdev set", tx,
 				    "vdev_guid=%llu: %s=%lld",
 				    (u_longlong_t)vdev_guid,
@@ -5620,6 +5899,38 @@ vdev_prop_set(vdev_t *vd, nvlist_t *innvl, nvlist_t *outnvl)
 			else
 				error = spa_vdev_alloc(spa, vdev_guid);
 			break;
+		case VDEV_PROP_SEQUENTIAL:
+			if (nvpair_value_uint64(elem, &intval) != 0) {
+				error = EINVAL;
+				break;
+			}
+			/* Only top-level vdevs allocate */
+			if (vd != vd->vdev_top || vd->vdev_mg == NULL)
+				error = ENOTSUP;
+			break;
+		case VDEV_PROP_AGGREGATION_LIMIT:
+		case VDEV_PROP_READ_GAP_LIMIT:
+		case VDEV_PROP_SYNC_READ_MAX_ACTIVE:
+		case VDEV_PROP_SYNC_WRITE_MAX_ACTIVE:
+		case VDEV_PROP_ASYNC_READ_MAX_ACTIVE:
+		case VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE:
+		case VDEV_PROP_SCRUB_MAX_ACTIVE:
+		case VDEV_PROP_REMOVAL_MAX_ACTIVE:
+		case VDEV_PROP_INITIALIZING_MAX_ACTIVE:
+		case VDEV_PROP_TRIM_MAX_ACTIVE:
+		case VDEV_PROP_REBUILD_MAX_ACTIVE:
+		case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+		case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+		case VDEV_PROP_QUEUE_DEPTH_PCT:
+			if (nvpair_value_uint64(elem, &intval) != 0) {
+				error = EINVAL;
+				break;
+			}
+			if (vdev_prop_tunable(vd, prop) == NULL)
+				error = ENOTSUP;
+			else
+				error = vdev_prop_tunable_check(prop, intval);
+			break;
 		default:
 			/* Most processing is done in vdev_props_set_sync */
 			break;
@@ -5909,6 +6220,7 @@ vdev_prop_get(vdev_t *vd, nvlist_t *innvl, nvlist_t *outnvl)
 				continue;
 			/* Numeric Properites */
 			case VDEV_PROP_ALLOCATING:
+			case VDEV_PROP_SEQUENTIAL:
 				src = ZPROP_SRC_LOCAL;
 				strval = NULL;
 
@@ -5933,6 +6245,47 @@ vdev_prop_get(vdev_t *vd, nvlist_t *innvl, nvlist_t *outnvl)
 				vdev_prop_add_list(outnvl, propname, strval,
 				    intval, src);
 				break;
+			case VDEV_PROP_SYNC_READ_LATENCY:
+			case VDEV_PROP_SYNC_WRITE_LATENCY:
+			case VDEV_PROP_ASYNC_READ_LATENCY:
+			case VDEV_PROP_ASYNC_WRITE_LATENCY:
+			case VDEV_PROP_QUEUE_ACTIVE:
+			case VDEV_PROP_QUEUE_PENDING:
+			case VDEV_PROP_AGGREGATED_IOS:
+			case VDEV_PROP_UNAGGREGATED_IOS:
+				/* Only leaf vdevs queue I/O */
+				if (!vd->vdev_ops->vdev_op_leaf)
+					continue;
+				vdev_prop_add_list(outnvl, propname, NULL,
+				    vdev_prop_queue_stat(vd, prop),
+				    ZPROP_SRC_NONE);
+				continue;
+			/* Tuning Properties */
+			case VDEV_PROP_AGGREGATION_LIMIT:
+			case VDEV_PROP_READ_GAP_LIMIT:
+			case VDEV_PROP_SYNC_READ_MAX_ACTIVE:
+			case VDEV_PROP_SYNC_WRITE_MAX_ACTIVE:
+			case VDEV_PROP_ASYNC_READ_MAX_ACTIVE:
+			case VDEV_PROP_ASYNC_WRITE_MAX_ACTIVE:
+			case VDEV_PROP_SCRUB_MAX_ACTIVE:
+			case VDEV_PROP_REMOVAL_MAX_ACTIVE:
+			case VDEV_PROP_INITIALIZING_MAX_ACTIVE:
+			case VDEV_PROP_TRIM_MAX_ACTIVE:
+			case VDEV_PROP_REBUILD_MAX_ACTIVE:
+			case VDEV_PROP_TRIM_EXTENT_BYTES_MAX:
+			case VDEV_PROP_TRIM_EXTENT_BYTES_MIN:
+			case VDEV_PROP_QUEUE_DEPTH_PCT: {
+				uint64_t *valp = vdev_prop_tunable(vd, prop);
+
+				if (valp == NULL)
+					continue;
+				intval = *valp;
+				if (intval != vdev_prop_default_numeric(prop))
+					src = ZPROP_SRC_LOCAL;
+				vdev_prop_add_list(outnvl, propname, NULL,
+				    intval, src);
+				break;
+			}
 			/* Text Properties */
 			case VDEV_PROP_COMMENT:
 				/* Exists in the ZAP below */
@@ -143,6 +143,7 @@
 #include <sys/vdev.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_draid.h>
+#include <sys/vdev_raidz.h>
 #include <sys/uberblock_impl.h>
 #include <sys/metaslab.h>
 #include <sys/metaslab_impl.h>
@@ -423,6 +424,13 @@ root_vdev_actions_getprogress(vdev_t *vd, nvlist_t *nvl)
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t *)&pcs,
 		    sizeof (pcs) / sizeof (uint64_t));
 	}
+
+	pool_raidz_expand_stat_t pres;
+	if (spa_raidz_expand_get_stats(spa, &pres) == 0) {
+		fnvlist_add_uint64_array(nvl,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t *)&pres,
+		    sizeof (pres) / sizeof (uint64_t));
+	}
 }
 
 static void
@@ -1234,6 +1242,40 @@ retry:
 	return (error);
 }
 
+/*
+ * Determine if the boot region of a leaf vdev is in use, by checking that
+ * its first sector is zero-filled.  RAID-Z expansion uses the boot region
+ * as scratch space.
+ */
+int
+vdev_check_boot_reserve(spa_t *spa, vdev_t *childvd)
+{
+	ASSERT(childvd->vdev_ops->vdev_op_leaf);
+
+	size_t size = SPA_MINBLOCKSIZE;
+	abd_t *abd = abd_alloc_linear(size, B_FALSE);
+
+	zio_t *pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	zio_nowait(zio_read_phys(pio, childvd, VDEV_BOOT_OFFSET, size, abd,
+	    ZIO_CHECKSUM_OFF, NULL, NULL, ZIO_PRIORITY_SYNC_READ,
+	    ZIO_FLAG_CANFAIL | ZIO_FLAG_SPECULATIVE, B_TRUE));
+	int error = zio_wait(pio);
+
+	if (error == 0) {
+		const uint64_t *buf = abd_to_buf(abd);
+		for (size_t i = 0; i < size / sizeof (uint64_t); i++) {
+			if (buf[i] != 0) {
+				error = SET_ERROR(EBUSY);
+				break;
+			}
+		}
+	}
+
+	abd_free(abd);
+
+	return (error);
+}
+
 /*
  * Done callback for vdev_label_read_bootenv_impl. If this is the first
  * callback to finish, store our abd in the callback pointer. Otherwise, we
@@ -1725,7 +1767,7 @@ vdev_uberblock_sync(zio_t *zio, uint64_t *good_writes,
 }
 
 /* Sync the uberblocks to all vdevs in svd[] */
-static int
+int
 vdev_uberblock_sync_list(vdev_t **svd, int svdcount, uberblock_t *ub, int flags)
 {
 	spa_t *spa = svd[0]->vdev_spa;
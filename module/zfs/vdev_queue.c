@@ -36,6 +36,8 @@
 #include <sys/metaslab_impl.h>
 #include <sys/spa.h>
 #include <sys/abd.h>
+#include <sys/kstat.h>
+#include <sys/wmsum.h>
 
 /*
  * ZFS I/O Scheduler
@@ -192,6 +194,20 @@ static uint_t zfs_vdev_nia_delay = 5;
  */
 static uint_t zfs_vdev_nia_credit = 5;
 
+/*
+ * Fixed *_max_active limits cannot know how much background I/O (scrub,
+ * resilver, removal, initialize, rebuild and TRIM) a device absorbs before
+ * foreground latency suffers.  When zfs_vdev_latency_target_us is non-zero,
+ * each vdev queue keeps an average completion latency per I/O class and,
+ * every zfs_vdev_latency_interval_ms, halves the number of background I/Os
+ * it allows while synchronous reads or writes are slower than the target.
+ * Otherwise, or when no synchronous I/O completed during the interval, the
+ * limit grows back by one I/O.  The *_min_active and *_max_active limits of
+ * the background classes still apply on top of this.
+ */
+static uint_t zfs_vdev_latency_target_us = 0;
+static uint_t zfs_vdev_latency_interval_ms = 100;
+
 /*
  * To reduce IOPs, we aggregate small adjacent I/Os into one large I/O.
  * For read I/Os, we also aggregate across small adjacency gaps; for writes
@@ -201,8 +217,26 @@ static uint_t zfs_vdev_nia_credit = 5;
 static int zfs_vdev_aggregation_limit = 1 << 20;
 static int zfs_vdev_aggregation_limit_non_rotating = SPA_OLD_MAXBLOCKSIZE;
 static int zfs_vdev_read_gap_limit = 32 << 10;
+static int zfs_vdev_read_gap_limit_non_rotating = 32 << 10;
 static int zfs_vdev_write_gap_limit = 4 << 10;
 
+/*
+ * The static limits above are only a per-profile (rotating or not) ceiling.
+ * With zfs_vdev_aggregation_auto set each leaf vdev keeps the average
+ * latency of its small and large reads and fits them to
+ * latency = overhead + size * cost.  Reading across a gap is worthwhile
+ * while transferring it is cheaper than issuing a separate I/O, so the
+ * read gap limit becomes overhead / cost; aggregation beyond the size at
+ * which the overhead is an eighth of the transfer time gains little, so
+ * that size becomes the aggregation limit.  On devices with negligible
+ * per-I/O overhead both drop to zero, disabling aggregation.  The
+ * aggregation_limit and read_gap_limit vdev properties override both.
+ */
+static int zfs_vdev_aggregation_auto = 0;
+
+#define	VDEV_QUEUE_SMALL_READ	(16 << 10)
+#define	VDEV_QUEUE_LARGE_READ	(128 << 10)
+
 /*
  * Define the queue depth percentage for each top-level. This percentage is
  * used in conjunction with zfs_vdev_async_max_active to determine how many
@@ -235,6 +269,86 @@ int zfs_vdev_def_queue_depth = 32;
  */
 static int zfs_vdev_aggregate_trim = 0;
 
+typedef struct vdev_queue_stats {
+	kstat_named_t vqs_aggregated_ios;
+	kstat_named_t vqs_aggregated_children;
+	kstat_named_t vqs_aggregated_bytes;
+	kstat_named_t vqs_unaggregated_ios;
+} vdev_queue_stats_t;
+
+static vdev_queue_stats_t vdev_queue_stats = {
+	/* Aggregate I/Os issued */
+	{ "aggregated_ios",			KSTAT_DATA_UINT64 },
+	/* Queued I/Os merged into those aggregates */
+	{ "aggregated_children",		KSTAT_DATA_UINT64 },
+	/* Bytes issued as aggregates, including gaps */
+	{ "aggregated_bytes",			KSTAT_DATA_UINT64 },
+	/* Queued I/Os issued on their own */
+	{ "unaggregated_ios",			KSTAT_DATA_UINT64 },
+};
+
+static struct {
+	wmsum_t vqs_aggregated_ios;
+	wmsum_t vqs_aggregated_children;
+	wmsum_t vqs_aggregated_bytes;
+	wmsum_t vqs_unaggregated_ios;
+} vdev_queue_sums;
+
+#define	VQSTAT_BUMP(stat)	wmsum_add(&vdev_queue_sums.stat, 1)
+#define	VQSTAT_INCR(stat, val)	wmsum_add(&vdev_queue_sums.stat, val)
+
+static kstat_t *vdev_queue_ksp = NULL;
+
+static int
+vdev_queue_kstats_update(kstat_t *ksp, int rw)
+{
+	vdev_queue_stats_t *vqs = ksp->ks_data;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+	vqs->vqs_aggregated_ios.value.ui64 =
+	    wmsum_value(&vdev_queue_sums.vqs_aggregated_ios);
+	vqs->vqs_aggregated_children.value.ui64 =
+	    wmsum_value(&vdev_queue_sums.vqs_aggregated_children);
+	vqs->vqs_aggregated_bytes.value.ui64 =
+	    wmsum_value(&vdev_queue_sums.vqs_aggregated_bytes);
+	vqs->vqs_unaggregated_ios.value.ui64 =
+	    wmsum_value(&vdev_queue_sums.vqs_unaggregated_ios);
+	return (0);
+}
+
+void
+vdev_queue_stat_init(void)
+{
+	wmsum_init(&vdev_queue_sums.vqs_aggregated_ios, 0);
+	wmsum_init(&vdev_queue_sums.vqs_aggregated_children, 0);
+	wmsum_init(&vdev_queue_sums.vqs_aggregated_bytes, 0);
+	wmsum_init(&vdev_queue_sums.vqs_unaggregated_ios, 0);
+
+	vdev_queue_ksp = kstat_create("zfs", 0, "vdev_queue_stats", "misc",
+	    KSTAT_TYPE_NAMED, sizeof (vdev_queue_stats) /
+	    sizeof (kstat_named_t), KSTAT_FLAG_VIRTUAL);
+	if (vdev_queue_ksp != NULL) {
+		vdev_queue_ksp->ks_data = &vdev_queue_stats;
+		vdev_queue_ksp->ks_update = vdev_queue_kstats_update;
+		kstat_install(vdev_queue_ksp);
+	}
+}
+
+void
+vdev_queue_stat_fini(void)
+{
+	if (vdev_queue_ksp != NULL) {
+		kstat_delete(vdev_queue_ksp);
+		vdev_queue_ksp = NULL;
+	}
+
+	wmsum_fini(&vdev_queue_sums.vqs_aggregated_ios);
+	wmsum_fini(&vdev_queue_sums.vqs_aggregated_children);
+	wmsum_fini(&vdev_queue_sums.vqs_aggregated_bytes);
+	wmsum_fini(&vdev_queue_sums.vqs_unaggregated_ios);
+}
+
 static int
 vdev_queue_offset_compare(const void *x1, const void *x2)
 {
@@ -281,6 +395,79 @@ vdev_queue_timestamp_compare(const void *x1, const void *x2)
 	return (TREE_PCMP(z1, z2));
 }
 
+static boolean_t
+vdev_queue_is_interactive(zio_priority_t p)
+{
+	switch (p) {
+	case ZIO_PRIORITY_SCRUB:
+	case ZIO_PRIORITY_REMOVAL:
+	case ZIO_PRIORITY_INITIALIZING:
+	case ZIO_PRIORITY_REBUILD:
+		return (B_FALSE);
+	default:
+		return (B_TRUE);
+	}
+}
+
+/*
+ * Background classes are subject to the latency-driven vq_bg_limit.
+ */
+static boolean_t
+vdev_queue_is_background(zio_priority_t p)
+{
+	return (!vdev_queue_is_interactive(p) || p == ZIO_PRIORITY_TRIM);
+}
+
+/*
+ * A *_max_active vdev property replaces the module parameter for that
+ * vdev's queue.
+ */
+static inline uint32_t
+vdev_queue_max(vdev_queue_t *vq, zio_priority_t p, uint32_t max_active)
+{
+	uint64_t prop = vq->vq_max_active[p];
+
+	return (prop != UINT64_MAX ? (uint32_t)prop : max_active);
+}
+
+/*
+ * The latency-driven vq_bg_limit is shared by all background classes, so
+ * it is bounded by the sum of their maximums.
+ */
+static uint32_t
+vdev_queue_bg_max_active(vdev_queue_t *vq)
+{
+	return (MAX(
+	    vdev_queue_max(vq, ZIO_PRIORITY_SCRUB, zfs_vdev_scrub_max_active) +
+	    vdev_queue_max(vq, ZIO_PRIORITY_REMOVAL,
+	    zfs_vdev_removal_max_active) +
+	    vdev_queue_max(vq, ZIO_PRIORITY_INITIALIZING,
+	    zfs_vdev_initializing_max_active) +
+	    vdev_queue_max(vq, ZIO_PRIORITY_TRIM, zfs_vdev_trim_max_active) +
+	    vdev_queue_max(vq, ZIO_PRIORITY_REBUILD,
+	    zfs_vdev_rebuild_max_active), 1));
+}
+
+static uint32_t
+vdev_queue_bg_active(vdev_queue_t *vq)
+{
+	uint32_t active = 0;
+
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if (vdev_queue_is_background(p))
+			active += vq->vq_class[p].vqc_active;
+	}
+	return (active);
+}
+
+static inline int
+vdev_queue_class_limit(vdev_queue_t *vq, zio_priority_t p, int active)
+{
+	if (vq->vq_max_active[p] != UINT64_MAX)
+		active = MIN(active, (int)vq->vq_max_active[p]);
+	return (active);
+}
+
 static int
 vdev_queue_class_min_active(vdev_queue_t *vq, zio_priority_t p)
 {
@@ -314,8 +501,9 @@ vdev_queue_class_min_active(vdev_queue_t *vq, zio_priority_t p)
 }
 
 static int
-vdev_queue_max_async_writes(spa_t *spa)
+vdev_queue_max_async_writes(spa_t *spa, uint32_t max_writes)
 {
+	uint32_t min_writes = MIN(zfs_vdev_async_write_min_active, max_writes);
 	int writes;
 	uint64_t dirty = 0;
 	dsl_pool_t *dp = spa_get_dsl(spa);
@@ -330,7 +518,7 @@ vdev_queue_max_async_writes(spa_t *spa)
 	 * completion of dmu_objset_open_impl().
 	 */
 	if (dp == NULL)
-		return (zfs_vdev_async_write_max_active);
+		return (max_writes);
 
 	/*
 	 * Sync tasks correspond to interactive user actions. To reduce the
@@ -338,10 +526,10 @@ vdev_queue_max_async_writes(spa_t *spa)
 	 */
 	dirty = dp->dp_dirty_total;
 	if (dirty > max_bytes || spa_has_pending_synctask(spa))
-		return (zfs_vdev_async_write_max_active);
+		return (max_writes);
 
 	if (dirty < min_bytes)
-		return (zfs_vdev_async_write_min_active);
+		return (min_writes);
 
 	/*
 	 * linear interpolation:
@@ -349,13 +537,10 @@ vdev_queue_max_async_writes(spa_t *spa)
 	 * move right by min_bytes
 	 * move up by min_writes
 	 */
-	writes = (dirty - min_bytes) *
-	    (zfs_vdev_async_write_max_active -
-	    zfs_vdev_async_write_min_active) /
-	    (max_bytes - min_bytes) +
-	    zfs_vdev_async_write_min_active;
-	ASSERT3U(writes, >=, zfs_vdev_async_write_min_active);
-	ASSERT3U(writes, <=, zfs_vdev_async_write_max_active);
+	writes = (dirty - min_bytes) * (max_writes - min_writes) /
+	    (max_bytes - min_bytes) + min_writes;
+	ASSERT3U(writes, >=, min_writes);
+	ASSERT3U(writes, <=, max_writes);
 	return (writes);
 }
 
@@ -364,43 +549,45 @@ vdev_queue_class_max_active(spa_t *spa, vdev_queue_t *vq, zio_priority_t p)
 {
 	switch (p) {
 	case ZIO_PRIORITY_SYNC_READ:
-		return (zfs_vdev_sync_read_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_sync_read_max_active));
 	case ZIO_PRIORITY_SYNC_WRITE:
-		return (zfs_vdev_sync_write_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_sync_write_max_active));
 	case ZIO_PRIORITY_ASYNC_READ:
-		return (zfs_vdev_async_read_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_async_read_max_active));
 	case ZIO_PRIORITY_ASYNC_WRITE:
-		return (vdev_queue_max_async_writes(spa));
+		return (vdev_queue_max_async_writes(spa,
+		    vdev_queue_max(vq, p, zfs_vdev_async_write_max_active)));
 	case ZIO_PRIORITY_SCRUB:
 		if (vq->vq_ia_active > 0) {
 			return (MIN(vq->vq_nia_credit,
 			    zfs_vdev_scrub_min_active));
 		} else if (vq->vq_nia_credit < zfs_vdev_nia_delay)
 			return (MAX(1, zfs_vdev_scrub_min_active));
-		return (zfs_vdev_scrub_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_scrub_max_active));
 	case ZIO_PRIORITY_REMOVAL:
 		if (vq->vq_ia_active > 0) {
 			return (MIN(vq->vq_nia_credit,
 			    zfs_vdev_removal_min_active));
 		} else if (vq->vq_nia_credit < zfs_vdev_nia_delay)
 			return (MAX(1, zfs_vdev_removal_min_active));
-		return (zfs_vdev_removal_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_removal_max_active));
 	case ZIO_PRIORITY_INITIALIZING:
 		if (vq->vq_ia_active > 0) {
 			return (MIN(vq->vq_nia_credit,
 			    zfs_vdev_initializing_min_active));
 		} else if (vq->vq_nia_credit < zfs_vdev_nia_delay)
 			return (MAX(1, zfs_vdev_initializing_min_active));
-		return (zfs_vdev_initializing_max_active);
+		return (vdev_queue_max(vq, p,
+		    zfs_vdev_initializing_max_active));
 	case ZIO_PRIORITY_TRIM:
-		return (zfs_vdev_trim_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_trim_max_active));
 	case ZIO_PRIORITY_REBUILD:
 		if (vq->vq_ia_active > 0) {
 			return (MIN(vq->vq_nia_credit,
 			    zfs_vdev_rebuild_min_active));
 		} else if (vq->vq_nia_credit < zfs_vdev_nia_delay)
 			return (MAX(1, zfs_vdev_rebuild_min_active));
-		return (zfs_vdev_rebuild_max_active);
+		return (vdev_queue_max(vq, p, zfs_vdev_rebuild_max_active));
 	default:
 		panic("invalid priority %u", p);
 		return (0);
@@ -428,8 +615,8 @@ vdev_queue_class_to_issue(vdev_queue_t *vq)
 	for (n = 0; n < ZIO_PRIORITY_NUM_QUEUEABLE; n++) {
 		p = (vq->vq_last_prio + n + 1) % ZIO_PRIORITY_NUM_QUEUEABLE;
 		if (avl_numnodes(vdev_queue_class_tree(vq, p)) > 0 &&
-		    vq->vq_class[p].vqc_active <
-		    vdev_queue_class_min_active(vq, p)) {
+		    vq->vq_class[p].vqc_active < vdev_queue_class_limit(vq, p,
+		    vdev_queue_class_min_active(vq, p))) {
 			vq->vq_last_prio = p;
 			return (p);
 		}
@@ -437,12 +624,17 @@ vdev_queue_class_to_issue(vdev_queue_t *vq)
 
 	/*
 	 * If we haven't found a queue, look for one that hasn't reached its
-	 * maximum # outstanding i/os.
+	 * maximum # outstanding i/os.  Beyond their minimums, background
+	 * classes together are also held to the latency-driven vq_bg_limit.
 	 */
+	boolean_t bg_limited = (zfs_vdev_latency_target_us != 0 &&
+	    vdev_queue_bg_active(vq) >= vq->vq_bg_limit);
 	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++) {
+		if (bg_limited && vdev_queue_is_background(p))
+			continue;
 		if (avl_numnodes(vdev_queue_class_tree(vq, p)) > 0 &&
-		    vq->vq_class[p].vqc_active <
-		    vdev_queue_class_max_active(spa, vq, p)) {
+		    vq->vq_class[p].vqc_active < vdev_queue_class_limit(vq, p,
+		    vdev_queue_class_max_active(spa, vq, p))) {
 			vq->vq_last_prio = p;
 			return (p);
 		}
@@ -494,6 +686,11 @@ vdev_queue_init(vdev_t *vd)
 	}
 
 	vq->vq_last_offset = 0;
+	vq->vq_aggregation_limit = UINT64_MAX;
+	vq->vq_read_gap_limit = UINT64_MAX;
+	for (p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
+		vq->vq_max_active[p] = UINT64_MAX;
+	vq->vq_bg_limit = vdev_queue_bg_max_active(vq);
 }
 
 void
@@ -527,20 +724,6 @@ vdev_queue_io_remove(vdev_queue_t *vq, zio_t *zio)
 	avl_remove(vdev_queue_type_tree(vq, zio->io_type), zio);
 }
 
-static boolean_t
-vdev_queue_is_interactive(zio_priority_t p)
-{
-	switch (p) {
-	case ZIO_PRIORITY_SCRUB:
-	case ZIO_PRIORITY_REMOVAL:
-	case ZIO_PRIORITY_INITIALIZING:
-	case ZIO_PRIORITY_REBUILD:
-		return (B_FALSE);
-	default:
-		return (B_TRUE);
-	}
-}
-
 static void
 vdev_queue_pending_add(vdev_queue_t *vq, zio_t *zio)
 {
@@ -572,6 +755,58 @@ vdev_queue_pending_remove(vdev_queue_t *vq, zio_t *zio)
 	avl_remove(&vq->vq_active_tree, zio);
 }
 
+/*
+ * Fold the completion latency of zio into its class average and, if a
+ * latency target is set, adjust the background I/O limit once per interval.
+ */
+static void
+vdev_queue_adapt(vdev_queue_t *vq, zio_t *zio, hrtime_t now)
+{
+	vdev_queue_class_t *vqc = &vq->vq_class[zio->io_priority];
+	hrtime_t target = USEC2NSEC(zfs_vdev_latency_target_us);
+	hrtime_t interval = MSEC2NSEC(MAX(zfs_vdev_latency_interval_ms, 1));
+
+	ASSERT(MUTEX_HELD(&vq->vq_lock));
+	ASSERT3U(zio->io_priority, <, ZIO_PRIORITY_NUM_QUEUEABLE);
+
+	vqc->vqc_latency += (zio->io_delta - vqc->vqc_latency) / 8;
+	if (zio->io_type == ZIO_TYPE_READ &&
+	    (zio->io_size <= VDEV_QUEUE_SMALL_READ ||
+	    zio->io_size >= VDEV_QUEUE_LARGE_READ)) {
+		int i = (zio->io_size >= VDEV_QUEUE_LARGE_READ);
+		if (vq->vq_read_size[i] == 0) {
+			vq->vq_read_lat[i] = zio->io_delta;
+			vq->vq_read_size[i] = zio->io_size;
+		} else {
+			vq->vq_read_lat[i] +=
+			    (zio->io_delta - vq->vq_read_lat[i]) / 8;
+			vq->vq_read_size[i] = vq->vq_read_size[i] -
+			    vq->vq_read_size[i] / 8 + zio->io_size / 8;
+		}
+	}
+	if (zio->io_priority == ZIO_PRIORITY_SYNC_READ ||
+	    zio->io_priority == ZIO_PRIORITY_SYNC_WRITE)
+		vq->vq_sync_ts = now;
+
+	if (target == 0 || now - vq->vq_bg_limit_ts < interval)
+		return;
+	vq->vq_bg_limit_ts = now;
+
+	uint32_t max = vdev_queue_bg_max_active(vq);
+	uint32_t limit = MIN(vq->vq_bg_limit, max);
+	if (now - vq->vq_sync_ts < interval &&
+	    (vq->vq_class[ZIO_PRIORITY_SYNC_READ].vqc_latency > target ||
+	    vq->vq_class[ZIO_PRIORITY_SYNC_WRITE].vqc_latency > target))
+		limit = MAX(limit / 2, 1);
+	else if (limit < max)
+		limit++;
+	if (limit != vq->vq_bg_limit) {
+		spa_iostats_bg_limit_add(vq->vq_vdev->vdev_spa,
+		    limit < vq->vq_bg_limit, limit > vq->vq_bg_limit);
+	}
+	vq->vq_bg_limit = limit;
+}
+
 static void
 vdev_queue_agg_io_done(zio_t *aio)
 {
@@ -587,6 +822,51 @@ vdev_queue_agg_io_done(zio_t *aio)
 #define	IO_SPAN(fio, lio) ((lio)->io_offset + (lio)->io_size - (fio)->io_offset)
 #define	IO_GAP(fio, lio) (-IO_SPAN(lio, fio))
 
+/*
+ * Return the aggregation and read gap limits for this vdev: the property
+ * values when set, otherwise the profile limits lowered to what the
+ * device's measured read overhead and per-byte cost justify.
+ */
+static void
+vdev_queue_agg_limits(vdev_queue_t *vq, uint64_t *limitp, uint64_t *gapp)
+{
+	uint64_t limit, gap;
+
+	ASSERT(MUTEX_HELD(&vq->vq_lock));
+
+	if (vq->vq_vdev->vdev_nonrot) {
+		limit = zfs_vdev_aggregation_limit_non_rotating;
+		gap = zfs_vdev_read_gap_limit_non_rotating;
+	} else {
+		limit = zfs_vdev_aggregation_limit;
+		gap = zfs_vdev_read_gap_limit;
+	}
+
+	if (zfs_vdev_aggregation_auto && vq->vq_read_size[0] != 0 &&
+	    vq->vq_read_size[1] != 0) {
+		hrtime_t dlat = vq->vq_read_lat[1] - vq->vq_read_lat[0];
+		hrtime_t dsize = vq->vq_read_size[1] - vq->vq_read_size[0];
+		hrtime_t overhead, auto_gap;
+
+		ASSERT3S(dsize, >, 0);
+		if (dlat > 0) {
+			overhead = vq->vq_read_lat[0] -
+			    dlat * vq->vq_read_size[0] / dsize;
+			auto_gap = (overhead > 0) ? overhead * dsize / dlat : 0;
+			gap = MIN(gap, (uint64_t)auto_gap);
+			limit = MIN(limit, (uint64_t)auto_gap * 8);
+		}
+	}
+
+	if (vq->vq_aggregation_limit != UINT64_MAX)
+		limit = vq->vq_aggregation_limit;
+	if (vq->vq_read_gap_limit != UINT64_MAX)
+		gap = vq->vq_read_gap_limit;
+
+	*limitp = limit;
+	*gapp = gap;
+}
+
 /*
  * Sufficiently adjacent io_offset's in ZIOs will be aggregated. We do this
  * by creating a gang ABD from the adjacent ZIOs io_abd's. By using
@@ -601,7 +881,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	zio_t *first, *last, *aio, *dio, *mandatory, *nio;
 	uint64_t maxgap = 0;
 	uint64_t size;
-	uint64_t limit;
+	uint64_t limit, read_gap;
 	int maxblocksize;
 	boolean_t stretch = B_FALSE;
 	avl_tree_t *t = vdev_queue_type_tree(vq, zio->io_type);
@@ -610,10 +890,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	abd_t *abd;
 
 	maxblocksize = spa_maxblocksize(vq->vq_vdev->vdev_spa);
-	if (vq->vq_vdev->vdev_nonrot)
-		limit = zfs_vdev_aggregation_limit_non_rotating;
-	else
-		limit = zfs_vdev_aggregation_limit;
+	vdev_queue_agg_limits(vq, &limit, &read_gap);
 	limit = MAX(MIN(limit, maxblocksize), 0);
 
 	if (zio->io_flags & ZIO_FLAG_DONT_AGGREGATE || limit == 0)
@@ -636,7 +913,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	first = last = zio;
 
 	if (zio->io_type == ZIO_TYPE_READ)
-		maxgap = zfs_vdev_read_gap_limit;
+		maxgap = read_gap;
 
 	/*
 	 * We can aggregate I/Os that are sufficiently adjacent and of
@@ -750,6 +1027,9 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	    flags | ZIO_FLAG_DONT_CACHE | ZIO_FLAG_DONT_QUEUE,
 	    vdev_queue_agg_io_done, NULL);
 	aio->io_timestamp = first->io_timestamp;
+	vq->vq_agg_ios++;
+	VQSTAT_BUMP(vqs_aggregated_ios);
+	VQSTAT_INCR(vqs_aggregated_bytes, size);
 
 	nio = first;
 	next_offset = first->io_offset;
@@ -758,6 +1038,7 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 		nio = AVL_NEXT(t, dio);
 		zio_add_child(dio, aio);
 		vdev_queue_io_remove(vq, dio);
+		VQSTAT_BUMP(vqs_aggregated_children);
 
 		if (dio->io_offset != next_offset) {
 			/* allocate a buffer for a read gap */
@@ -857,6 +1138,8 @@ again:
 			mutex_enter(&vq->vq_lock);
 			goto again;
 		}
+		vq->vq_unagg_ios++;
+		VQSTAT_BUMP(vqs_unaggregated_ios);
 	}
 
 	vdev_queue_pending_add(vq, zio);
@@ -942,6 +1225,7 @@ vdev_queue_io_done(zio_t *zio)
 
 	mutex_enter(&vq->vq_lock);
 	vdev_queue_pending_remove(vq, zio);
+	vdev_queue_adapt(vq, zio, now);
 
 	while ((nio = vdev_queue_io_to_issue(vq)) != NULL) {
 		mutex_exit(&vq->vq_lock);
@@ -1025,12 +1309,49 @@ vdev_queue_length(vdev_t *vd)
 	return (avl_numnodes(&vd->vdev_queue.vq_active_tree));
 }
 
+/*
+ * Return the number of I/Os waiting in the vdev queue.
+ */
+uint64_t
+vdev_queue_pending(vdev_t *vd)
+{
+	vdev_queue_t *vq = &vd->vdev_queue;
+	uint64_t pending = 0;
+
+	for (zio_priority_t p = 0; p < ZIO_PRIORITY_NUM_QUEUEABLE; p++)
+		pending += avl_numnodes(vdev_queue_class_tree(vq, p));
+
+	return (pending);
+}
+
 uint64_t
 vdev_queue_last_offset(vdev_t *vd)
 {
 	return (vd->vdev_queue.vq_last_offset);
 }
 
+/*
+ * Return the smallest async write max_active of the leaves below vd, taking
+ * the async_write_max_active vdev property into account.
+ */
+uint32_t
+vdev_queue_async_write_max_active(vdev_t *vd)
+{
+	uint32_t max_active = UINT32_MAX;
+
+	if (vd->vdev_ops->vdev_op_leaf) {
+		return (vdev_queue_max(&vd->vdev_queue,
+		    ZIO_PRIORITY_ASYNC_WRITE, zfs_vdev_async_write_max_active));
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		max_active = MIN(max_active,
+		    vdev_queue_async_write_max_active(vd->vdev_child[c]));
+	}
+	return (max_active != UINT32_MAX ? max_active :
+	    zfs_vdev_async_write_max_active);
+}
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, aggregation_limit, INT, ZMOD_RW,
 	"Max vdev I/O aggregation size");
 
@@ -1040,12 +1361,24 @@ ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, aggregation_limit_non_rotating, INT,
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, aggregate_trim, INT, ZMOD_RW,
 	"Allow TRIM I/O to be aggregated");
 
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, aggregation_auto, INT, ZMOD_RW,
+	"Lower aggregation limits to what measured read latency justifies");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, read_gap_limit_non_rotating, INT,
+	ZMOD_RW, "Aggregate read I/O over gap on non-rotating media");
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, read_gap_limit, INT, ZMOD_RW,
 	"Aggregate read I/O over gap");
 
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, write_gap_limit, INT, ZMOD_RW,
 	"Aggregate write I/O over gap");
 
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, latency_target_us, UINT, ZMOD_RW,
+	"Sync I/O latency target used to throttle background I/O (0 = off)");
+
+ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, latency_interval_ms, UINT, ZMOD_RW,
+	"Interval between background I/O limit adjustments");
+
 ZFS_MODULE_PARAM(zfs_vdev, zfs_vdev_, max_active, INT, ZMOD_RW,
 	"Maximum number of active I/Os per vdev");
 
@@ -27,7 +27,16 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/zap.h>
 #include <sys/vdev_impl.h>
+#include <sys/metaslab_impl.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/dsl_scan.h>
+#include <sys/mmp.h>
+#include <sys/zthr.h>
+#include <sys/zfeature.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/abd.h>
@@ -108,6 +117,54 @@
  * or in concert to recover missing data columns.
  */
 
+/*
+ * RAID-Z expansion
+ *
+ * A disk can be attached to an existing RAID-Z vdev with "zpool attach",
+ * which expands the vdev by one column.  The existing data is then
+ * "reflowed" onto the new, wider layout in the background by
+ * spa_raidz_expand_thread(), one metaslab at a time.
+ *
+ * Parity is not recalculated during the reflow: each sector of the vdev's
+ * logical address space is simply moved from the child and row it occupies
+ * in the old (N-wide) layout to the child and row it occupies in the new
+ * (N+1-wide) layout.  The logical sector s is always found at
+ *
+ *	child (s % physical width), offset (s / physical width)
+ *
+ * so every block keeps its logical width and parity (and therefore its
+ * allocated size), and only its location on the children changes.  The
+ * logical width of a block is determined by the txg it was born in (see
+ * vdev_raidz_get_logical_width()).  Blocks born while the expansion is in
+ * progress are spread across all the children, like all other blocks,
+ * but keep the old logical width; the new logical width is used for blocks
+ * born after the expansion has completed.  Since a block with the old
+ * logical width no longer covers whole rows of the children, it is
+ * described by a raidz_map_t with one row per logical row of the block
+ * (see vdev_raidz_map_alloc_expanded()).
+ *
+ * The progress of the reflow is stored in the uberblock (in
+ * ub_raidz_reflow_info), so that it is updated atomically with the rest of
+ * the pool.  Rows below the synced reflow offset are accessed at their new
+ * location and rows above it at their old location.  While a copy is in
+ * flight, writes to sectors which have already been copied also go to the
+ * new ("shadow") location.  Copying sector s overwrites the old location of
+ * an earlier sector, so a sector can only be copied once the sector it
+ * overwrites is known to have been copied in a synced txg.  At the start
+ * of the vdev this would make no progress at all, so the first few MB are
+ * reflowed through a scratch area in the (unused) boot region of each
+ * child, whose state is also recorded in the uberblock (see
+ * raidz_reflow_scratch_sync() and vdev_raidz_reflow_copy_scratch()).
+ * After that, the amount that can be copied per txg grows geometrically.
+ *
+ * While a metaslab is being reflowed it is disabled for allocations, and
+ * normal i/o to the region being copied is serialized with the copy by
+ * vre_rangelock.  If a child can not be read or written, the reflow is
+ * paused until the child has been resilvered (see raidz_dtl_reassessed()).
+ * Once all metaslabs have been reflowed, the vdev's capacity is increased
+ * to that of N+1 children.
+ */
+
 #define	VDEV_RAIDZ_P		0
 #define	VDEV_RAIDZ_Q		1
 #define	VDEV_RAIDZ_R		2
@@ -159,6 +216,9 @@ vdev_raidz_map_free(raidz_map_t *rm)
 	for (int i = 0; i < rm->rm_nrows; i++)
 		vdev_raidz_row_free(rm->rm_row[i]);
 
+	if (rm->rm_lr != NULL)
+		zfs_rangelock_exit(rm->rm_lr);
+
 	kmem_free(rm, offsetof(raidz_map_t, rm_row[rm->rm_nrows]));
 }
 
@@ -380,6 +440,9 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 		rc->rc_force_repair = 0;
 		rc->rc_allow_repair = 1;
 		rc->rc_need_orig_restore = B_FALSE;
+		rc->rc_shadow_devidx = INT_MAX;
+		rc->rc_shadow_offset = UINT64_MAX;
+		rc->rc_shadow_error = 0;
 
 		if (c >= acols)
 			rc->rc_size = 0;
@@ -442,6 +505,221 @@ vdev_raidz_map_alloc(zio_t *zio, uint64_t ashift, uint64_t dcols,
 	return (rm);
 }
 
+/*
+ * Divides the IO across the children of a RAID-Z vdev which has been
+ * expanded, i.e. whose physical width (number of children) differs from
+ * the logical width of this block.  Each logical row of the block (one
+ * sector per column) is mapped separately, since consecutive rows no longer
+ * start on the same child.  Rows which have not yet been reflowed (i.e. are
+ * not entirely below reflow_offset_synced) are accessed at their location
+ * in the old, narrower layout; sectors which are being copied (below
+ * reflow_offset_next) are additionally written to their "shadow" location
+ * in the new layout.
+ *
+ * Note that rr_cols is the entire logical width of the block even for a
+ * short last row.  The "phantom" columns past the end of the block have a
+ * size of zero, and are treated as if they were zero-filled by the parity
+ * generation and reconstruction code.
+ */
+noinline raidz_map_t *
+vdev_raidz_map_alloc_expanded(zio_t *zio, uint64_t ashift,
+    uint64_t physical_cols, uint64_t logical_cols, uint64_t nparity,
+    uint64_t reflow_offset_synced, uint64_t reflow_offset_next,
+    boolean_t use_scratch)
+{
+	uint64_t offset = zio->io_offset;
+	/* The zio's size in units of the vdev's minimum sector size. */
+	uint64_t s = zio->io_size >> ashift;
+	uint64_t q, r, bc, asize, tot;
+
+	/*
+	 * "Quotient": The number of data sectors for this stripe on all but
+	 * the "big column" child vdevs that also contain "remainder" data.
+	 * AKA the number of full rows.
+	 */
+	q = s / (logical_cols - nparity);
+
+	/*
+	 * "Remainder": The number of partial stripe data sectors in this I/O.
+	 * This will add a sector to some, but not all, child vdevs.
+	 */
+	r = s - q * (logical_cols - nparity);
+
+	/* The number of "big columns" - those which contain remainder data. */
+	bc = (r == 0 ? 0 : r + nparity);
+
+	/*
+	 * The total number of data and parity sectors associated with
+	 * this I/O.
+	 */
+	tot = s + nparity * (q + (r == 0 ? 0 : 1));
+
+	/* How many rows contain data (not skip) */
+	uint64_t rows = howmany(tot, logical_cols);
+	int cols = MIN(tot, logical_cols);
+
+	raidz_map_t *rm =
+	    kmem_zalloc(offsetof(raidz_map_t, rm_row[rows]), KM_SLEEP);
+	rm->rm_nrows = rows;
+	rm->rm_nskip = roundup(tot, nparity + 1) - tot;
+	rm->rm_skipstart = bc;
+	rm->rm_expanded = B_TRUE;
+	asize = 0;
+
+	for (uint64_t row = 0; row < rows; row++) {
+		boolean_t row_use_scratch = B_FALSE;
+		raidz_row_t *rr =
+		    kmem_alloc(offsetof(raidz_row_t, rr_col[cols]), KM_SLEEP);
+		rm->rm_row[row] = rr;
+
+		rr->rr_cols = cols;
+		rr->rr_scols = cols;
+		rr->rr_bigcols = bc;
+		rr->rr_missingdata = 0;
+		rr->rr_missingparity = 0;
+		rr->rr_firstdatacol = nparity;
+		rr->rr_abd_empty = NULL;
+		rr->rr_nempty = 0;
+
+		/* The starting RAIDZ (parent) vdev sector of the row. */
+		uint64_t b = (offset >> ashift) + row * logical_cols;
+#ifdef ZFS_DEBUG
+		rr->rr_offset = b << ashift;
+		rr->rr_size = (rr->rr_cols - rr->rr_firstdatacol) << ashift;
+#endif
+
+		/*
+		 * If the copy of any part of this row has not yet been
+		 * synced, the whole row is accessed at its old location.
+		 * reflow_offset_synced reflects the copies which have
+		 * completed, since it is only advanced in syncing context
+		 * once the copies of that txg have been waited for.
+		 */
+		uint64_t row_phys_cols = physical_cols;
+		if (b + cols > reflow_offset_synced >> ashift)
+			row_phys_cols--;
+		else if (use_scratch)
+			row_use_scratch = B_TRUE;
+
+		/* starting child of this row */
+		uint64_t child_id = b % row_phys_cols;
+		/* The starting byte offset on each child vdev. */
+		uint64_t child_offset = (b / row_phys_cols) << ashift;
+
+		for (int c = 0; c < rr->rr_cols; c++, child_id++) {
+			if (child_id >= row_phys_cols) {
+				child_id -= row_phys_cols;
+				child_offset += 1ULL << ashift;
+			}
+			raidz_col_t *rc = &rr->rr_col[c];
+			rc->rc_devidx = child_id;
+			rc->rc_offset = child_offset;
+			rc->rc_orig_data = NULL;
+			rc->rc_error = 0;
+			rc->rc_tried = 0;
+			rc->rc_skipped = 0;
+			rc->rc_force_repair = 0;
+			rc->rc_allow_repair = 1;
+			rc->rc_need_orig_restore = B_FALSE;
+			rc->rc_shadow_devidx = INT_MAX;
+			rc->rc_shadow_offset = UINT64_MAX;
+			rc->rc_shadow_error = 0;
+
+			/*
+			 * The start of the vdev is read from the scratch
+			 * area if we crashed while it was being reflowed
+			 * (see raidz_reflow_scratch_sync()).
+			 */
+			if (row_use_scratch)
+				rc->rc_offset -= VDEV_BOOT_SIZE;
+
+			uint64_t dc = c - rr->rr_firstdatacol;
+			if (c < rr->rr_firstdatacol) {
+				rc->rc_size = 1ULL << ashift;
+				rc->rc_abd = abd_alloc_linear(rc->rc_size,
+				    B_FALSE);
+			} else if (row == rows - 1 && bc != 0 && c >= bc) {
+				/*
+				 * Past the end of the block.  This sector is
+				 * part of the map so that we have full rows
+				 * for parity generation.
+				 */
+				rc->rc_size = 0;
+				rc->rc_abd = NULL;
+			} else {
+				/* "data column" (col excluding parity) */
+				uint64_t off;
+
+				if (c < bc || r == 0) {
+					off = dc * rows + row;
+				} else {
+					off = r * rows +
+					    (dc - r) * (rows - 1) + row;
+				}
+				rc->rc_size = 1ULL << ashift;
+				rc->rc_abd = abd_get_offset_struct(
+				    &rc->rc_abdstruct, zio->io_abd,
+				    off << ashift, rc->rc_size);
+			}
+
+			if (rc->rc_size == 0)
+				continue;
+
+			/*
+			 * If this row is still accessed at its old location
+			 * but this sector has already been copied to its new
+			 * location, writes must also go to the new "shadow"
+			 * location.  The copy has completed since we hold
+			 * the rangelock, which the copy holds as writer.
+			 * While the scratch area is in use, the real new
+			 * location is the shadow.
+			 */
+			if (row_use_scratch ||
+			    (row_phys_cols != physical_cols &&
+			    b + c < reflow_offset_next >> ashift)) {
+				rc->rc_shadow_devidx = (b + c) % physical_cols;
+				rc->rc_shadow_offset =
+				    ((b + c) / physical_cols) << ashift;
+			}
+
+			asize += rc->rc_size;
+		}
+
+		/*
+		 * See the comment in vdev_raidz_map_alloc(); the location of
+		 * the parity of single-parity RAID-Z is switched every 1MB.
+		 * This must be done the same way for each row of an expanded
+		 * map so that the block can be found after it was reflowed.
+		 */
+		if (rr->rr_firstdatacol == 1 && rr->rr_cols > 1 &&
+		    (offset & (1ULL << 20))) {
+			ASSERT(rr->rr_col[0].rc_size == rr->rr_col[1].rc_size);
+
+			raidz_col_t *rc0 = &rr->rr_col[0];
+			raidz_col_t *rc1 = &rr->rr_col[1];
+			uint64_t devidx = rc0->rc_devidx;
+			uint64_t off = rc0->rc_offset;
+			int shadow_devidx = rc0->rc_shadow_devidx;
+			uint64_t shadow_off = rc0->rc_shadow_offset;
+
+			rc0->rc_devidx = rc1->rc_devidx;
+			rc0->rc_offset = rc1->rc_offset;
+			rc0->rc_shadow_devidx = rc1->rc_shadow_devidx;
+			rc0->rc_shadow_offset = rc1->rc_shadow_offset;
+			rc1->rc_devidx = devidx;
+			rc1->rc_offset = off;
+			rc1->rc_shadow_devidx = shadow_devidx;
+			rc1->rc_shadow_offset = shadow_off;
+		}
+	}
+	ASSERT3U(asize, ==, tot << ashift);
+
+	/* init RAIDZ parity ops */
+	rm->rm_ops = vdev_raidz_math_get_ops();
+
+	return (rm);
+}
+
 struct pqr_struct {
 	uint64_t *p;
 	uint64_t *q;
@@ -1531,8 +1809,20 @@ vdev_raidz_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
 		    cvd->vdev_physical_ashift);
 	}
 
-	*asize *= vd->vdev_children;
-	*max_asize *= vd->vdev_children;
+	/*
+	 * While an expansion is in progress, the new child can not be used
+	 * to store any more data than before; the additional space becomes
+	 * available once the reflow has completed.
+	 */
+	if (vd->vdev_rz_expanding) {
+		*asize *= vd->vdev_children - 1;
+		*max_asize *= vd->vdev_children - 1;
+
+		vd->vdev_min_asize = *asize;
+	} else {
+		*asize *= vd->vdev_children;
+		*max_asize *= vd->vdev_children;
+	}
 
 	if (numerrors > nparity) {
 		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
@@ -1551,13 +1841,69 @@ vdev_raidz_close(vdev_t *vd)
 	}
 }
 
+static int
+vdev_raidz_reflow_compare(const void *x1, const void *x2)
+{
+	const reflow_node_t *l = x1;
+	const reflow_node_t *r = x2;
+
+	return (TREE_CMP(l->re_txg, r->re_txg));
+}
+
+/*
+ * Return the logical width of blocks born in the given txg.  This is the
+ * number of children the vdev had when the most recent expansion which
+ * completed before that txg was started (or the original width).
+ */
+static uint64_t
+vdev_raidz_get_logical_width(vdev_raidz_t *vdrz, uint64_t txg)
+{
+	reflow_node_t lookup = {
+		.re_txg = txg,
+	};
+	avl_index_t where;
+
+	uint64_t width;
+	mutex_enter(&vdrz->vd_expand_lock);
+	reflow_node_t *re = avl_find(&vdrz->vd_expand_txgs, &lookup, &where);
+	if (re != NULL) {
+		width = re->re_logical_width;
+	} else {
+		re = avl_nearest(&vdrz->vd_expand_txgs, where, AVL_BEFORE);
+		if (re != NULL)
+			width = re->re_logical_width;
+		else
+			width = vdrz->vd_original_width;
+	}
+	mutex_exit(&vdrz->vd_expand_lock);
+	return (width);
+}
+
+/*
+ * The txg which determines the logical width of the block this zio
+ * accesses.
+ */
+static uint64_t
+vdev_raidz_zio_birth(zio_t *zio)
+{
+	if (zio->io_bp != NULL && !BP_IS_HOLE(zio->io_bp))
+		return (BP_PHYSICAL_BIRTH(zio->io_bp));
+	return (zio->io_txg);
+}
+
+/*
+ * Note: If the RAIDZ vdev has been expanded, and this block was written
+ * before the expansion completed, then the returned asize is that of the
+ * old, narrower, logical width.  A txg of zero gives the asize of the
+ * original width, which is used for space accounting.
+ */
 static uint64_t
-vdev_raidz_asize(vdev_t *vd, uint64_t psize)
+vdev_raidz_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	vdev_raidz_t *vdrz = vd->vdev_tsd;
 	uint64_t asize;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
-	uint64_t cols = vdrz->vd_logical_width;
+	uint64_t cols = vdev_raidz_get_logical_width(vdrz, txg);
 	uint64_t nparity = vdrz->vd_nparity;
 
 	asize = ((psize - 1) >> ashift) + 1;
@@ -1590,21 +1936,45 @@ vdev_raidz_child_done(zio_t *zio)
 }
 
 static void
-vdev_raidz_io_verify(vdev_t *vd, raidz_row_t *rr, int col)
+vdev_raidz_shadow_child_done(zio_t *zio)
+{
+	raidz_col_t *rc = zio->io_private;
+
+	rc->rc_shadow_error = zio->io_error;
+}
+
+static void
+vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, raidz_row_t *rr, int col)
 {
 #ifdef ZFS_DEBUG
+	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
 
+	/*
+	 * The rows of an expanded map are not laid out the way that
+	 * vdev_xlate() assumes.
+	 */
+	if (rm->rm_expanded)
+		return;
+
 	range_seg64_t logical_rs, physical_rs, remain_rs;
 	logical_rs.rs_start = rr->rr_offset;
 	logical_rs.rs_end = logical_rs.rs_start +
-	    vdev_raidz_asize(vd, rr->rr_size);
+	    vdev_raidz_asize(vd, rr->rr_size, vdev_raidz_zio_birth(zio));
 
 	raidz_col_t *rc = &rr->rr_col[col];
 	vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
 
 	vdev_xlate(cvd, &logical_rs, &physical_rs, &remain_rs);
 	ASSERT(vdev_xlate_is_empty(&remain_rs));
+	if (vdev_xlate_is_empty(&physical_rs)) {
+		/*
+		 * If we are in the middle of expansion, the
+		 * physical->logical mapping is changing so vdev_xlate()
+		 * can't give us a reliable answer.
+		 */
+		return;
+	}
 	ASSERT3U(rc->rc_offset, ==, physical_rs.rs_start);
 	ASSERT3U(rc->rc_offset, <, physical_rs.rs_end);
 	/*
@@ -1635,7 +2005,7 @@ vdev_raidz_io_start_write(zio_t *zio, raidz_row_t *rr, uint64_t ashift)
 		vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
 
 		/* Verify physical to logical translation */
-		vdev_raidz_io_verify(vd, rr, c);
+		vdev_raidz_io_verify(zio, rm, rr, c);
 
 		if (rc->rc_size > 0) {
 			ASSERT3P(rc->rc_abd, !=, NULL);
@@ -1643,6 +2013,22 @@ vdev_raidz_io_start_write(zio_t *zio, raidz_row_t *rr, uint64_t ashift)
 			    rc->rc_offset, rc->rc_abd,
 			    abd_get_size(rc->rc_abd), zio->io_type,
 			    zio->io_priority, 0, vdev_raidz_child_done, rc));
+
+			if (rc->rc_shadow_devidx != INT_MAX) {
+				vdev_t *cvd2 =
+				    vd->vdev_child[rc->rc_shadow_devidx];
+				zio_nowait(zio_vdev_child_io(zio, NULL, cvd2,
+				    rc->rc_shadow_offset, rc->rc_abd,
+				    abd_get_size(rc->rc_abd), zio->io_type,
+				    zio->io_priority, 0,
+				    vdev_raidz_shadow_child_done, rc));
+			}
+		} else if (rm->rm_expanded) {
+			/*
+			 * Phantom columns of an expanded map are not
+			 * part of the allocation.
+			 */
+			ASSERT3P(rc->rc_abd, ==, NULL);
 		} else {
 			/*
 			 * Generate optional write for skip sector to improve
@@ -1724,24 +2110,70 @@ vdev_raidz_io_start(zio_t *zio)
 	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
 	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	raidz_map_t *rm;
+
+	uint64_t birth = vdev_raidz_zio_birth(zio);
+	uint64_t logical_width = vdev_raidz_get_logical_width(vdrz, birth);
+	if (logical_width != vdrz->vd_physical_width) {
+		vdev_raidz_expand_t *vre = &vdrz->vn_vre;
+		zfs_locked_range_t *lr = NULL;
+		uint64_t synced_offset = UINT64_MAX;
+		uint64_t next_offset = UINT64_MAX;
+		boolean_t use_scratch = B_FALSE;
+
+		/*
+		 * vre_state is only changed to DSS_FINISHED once the
+		 * progress of the last copy has been synced (see
+		 * spa_raidz_expand_thread()), so once it has changed all
+		 * rows are at their new location.
+		 */
+		if (vre->vre_state == DSS_SCANNING) {
+			spa_t *spa = vd->vdev_spa;
+
+			ASSERT3P(spa->spa_raidz_expand, ==, vre);
+			lr = zfs_rangelock_enter(&vre->vre_rangelock,
+			    zio->io_offset,
+			    vdev_raidz_asize(vd, zio->io_size, birth),
+			    RL_READER);
+			use_scratch = (RRSS_GET_STATE(&spa->spa_ubsync) ==
+			    RRSS_SCRATCH_VALID);
+			synced_offset = RRSS_GET_OFFSET(&spa->spa_ubsync);
+			next_offset = vre->vre_offset;
+
+			/*
+			 * If we haven't resumed expanding since importing
+			 * the pool, vre_offset won't have been set yet, in
+			 * which case the next offset to be copied is the
+			 * one that was synced.
+			 */
+			if (next_offset == UINT64_MAX)
+				next_offset = synced_offset;
+		}
 
-	raidz_map_t *rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift,
-	    vdrz->vd_logical_width, vdrz->vd_nparity);
+		rm = vdev_raidz_map_alloc_expanded(zio, tvd->vdev_ashift,
+		    vdrz->vd_physical_width, logical_width, vdrz->vd_nparity,
+		    synced_offset, next_offset, use_scratch);
+		rm->rm_lr = lr;
+	} else {
+		rm = vdev_raidz_map_alloc(zio, tvd->vdev_ashift,
+		    logical_width, vdrz->vd_nparity);
+	}
 	zio->io_vsd = rm;
 	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
 
-	/*
-	 * Until raidz expansion is implemented all maps for a raidz vdev
-	 * contain a single row.
-	 */
-	ASSERT3U(rm->rm_nrows, ==, 1);
-	raidz_row_t *rr = rm->rm_row[0];
-
 	if (zio->io_type == ZIO_TYPE_WRITE) {
-		vdev_raidz_io_start_write(zio, rr, tvd->vdev_ashift);
+		for (int i = 0; i < rm->rm_nrows; i++) {
+			vdev_raidz_io_start_write(zio, rm->rm_row[i],
+			    tvd->vdev_ashift);
+		}
 	} else {
 		ASSERT(zio->io_type == ZIO_TYPE_READ);
-		vdev_raidz_io_start_read(zio, rr);
+		/*
+		 * Iterate over the rows in reverse order, like the columns
+		 * of each row (see vdev_raidz_io_start_read()).
+		 */
+		for (int i = rm->rm_nrows - 1; i >= 0; i--)
+			vdev_raidz_io_start_read(zio, rm->rm_row[i]);
 	}
 
 	zio_execute(zio);
@@ -1856,8 +2288,10 @@ vdev_raidz_worst_error(raidz_row_t *rr)
 {
 	int error = 0;
 
-	for (int c = 0; c < rr->rr_cols; c++)
+	for (int c = 0; c < rr->rr_cols; c++) {
 		error = zio_worst_error(error, rr->rr_col[c].rc_error);
+		error = zio_worst_error(error, rr->rr_col[c].rc_shadow_error);
+	}
 
 	return (error);
 }
@@ -1923,6 +2357,13 @@ vdev_raidz_io_done_verified(zio_t *zio, raidz_row_t *rr)
 				continue;
 			}
 
+			/*
+			 * We do not repair phantom columns of an expanded
+			 * map; they are not part of the allocation.
+			 */
+			if (rc->rc_size == 0)
+				continue;
+
 			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
 			    rc->rc_offset, rc->rc_abd, rc->rc_size,
 			    ZIO_TYPE_WRITE,
@@ -1930,6 +2371,24 @@ vdev_raidz_io_done_verified(zio_t *zio, raidz_row_t *rr)
 			    ZIO_PRIORITY_REBUILD : ZIO_PRIORITY_ASYNC_WRITE,
 			    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
 			    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
+
+			/*
+			 * If this column is also being copied to its new
+			 * location by an in-progress expansion, repair the
+			 * copy as well.
+			 */
+			if (rc->rc_shadow_devidx != INT_MAX) {
+				vdev_t *cvd2 =
+				    vd->vdev_child[rc->rc_shadow_devidx];
+				zio_nowait(zio_vdev_child_io(zio, NULL, cvd2,
+				    rc->rc_shadow_offset, rc->rc_abd,
+				    rc->rc_size, ZIO_TYPE_WRITE,
+				    zio->io_priority == ZIO_PRIORITY_REBUILD ?
+				    ZIO_PRIORITY_REBUILD :
+				    ZIO_PRIORITY_ASYNC_WRITE,
+				    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
+				    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
+			}
 		}
 	}
 }
@@ -2205,7 +2664,8 @@ vdev_raidz_reconstruct(raidz_map_t *rm, const int *t, int nt)
 static void
 vdev_raidz_io_done_write_impl(zio_t *zio, raidz_row_t *rr)
 {
-	int total_errors = 0;
+	int normal_errors = 0;
+	int shadow_errors = 0;
 
 	ASSERT3U(rr->rr_missingparity, <=, rr->rr_firstdatacol);
 	ASSERT3U(rr->rr_missingdata, <=, rr->rr_cols - rr->rr_firstdatacol);
@@ -2214,10 +2674,13 @@ vdev_raidz_io_done_write_impl(zio_t *zio, raidz_row_t *rr)
 	for (int c = 0; c < rr->rr_cols; c++) {
 		raidz_col_t *rc = &rr->rr_col[c];
 
-		if (rc->rc_error) {
+		if (rc->rc_error != 0) {
 			ASSERT(rc->rc_error != ECKSUM);	/* child has no bp */
-
-			total_errors++;
+			normal_errors++;
+		}
+		if (rc->rc_shadow_error != 0) {
+			ASSERT(rc->rc_shadow_error != ECKSUM);
+			shadow_errors++;
 		}
 	}
 
@@ -2231,7 +2694,8 @@ vdev_raidz_io_done_write_impl(zio_t *zio, raidz_row_t *rr)
 	 * no non-degraded top-level vdevs left, and not update DTLs
 	 * if we intend to reallocate.
 	 */
-	if (total_errors > rr->rr_firstdatacol) {
+	if (normal_errors > rr->rr_firstdatacol ||
+	    shadow_errors > rr->rr_firstdatacol) {
 		zio->io_error = zio_worst_error(zio->io_error,
 		    vdev_raidz_worst_error(rr));
 	}
@@ -2474,13 +2938,24 @@ vdev_raidz_need_resilver(vdev_t *vd, const dva_t *dva, size_t psize,
     uint64_t phys_birth)
 {
 	vdev_raidz_t *vdrz = vd->vdev_tsd;
-	uint64_t dcols = vd->vdev_children;
-	uint64_t nparity = vdrz->vd_nparity;
+
+	/*
+	 * If we're in the middle of a RAIDZ expansion, this block may be in
+	 * the old and/or new location.  For simplicity, always resilver it.
+	 */
+	if (vdrz->vn_vre.vre_state == DSS_SCANNING)
+		return (B_TRUE);
+
+	uint64_t dcols = vdrz->vd_physical_width;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
 	/* The starting RAIDZ (parent) vdev sector of the block. */
 	uint64_t b = DVA_GET_OFFSET(dva) >> ashift;
-	/* The zio's size in units of the vdev's minimum sector size. */
-	uint64_t s = ((psize - 1) >> ashift) + 1;
+	/*
+	 * The total number of sectors (data, parity and padding) of the
+	 * block.  Blocks written with an older, narrower logical width are
+	 * still contiguous on the physical width.
+	 */
+	uint64_t s = vdev_raidz_asize(vd, psize, phys_birth) >> ashift;
 	/* The first column for this stripe. */
 	uint64_t f = b % dcols;
 
@@ -2490,10 +2965,10 @@ vdev_raidz_need_resilver(vdev_t *vd, const dva_t *dva, size_t psize,
 	if (!vdev_dtl_contains(vd, DTL_PARTIAL, phys_birth, 1))
 		return (B_FALSE);
 
-	if (s + nparity >= dcols)
+	if (s >= dcols)
 		return (B_TRUE);
 
-	for (uint64_t c = 0; c < s + nparity; c++) {
+	for (uint64_t c = 0; c < s; c++) {
 		uint64_t devidx = (f + c) % dcols;
 		vdev_t *cvd = vd->vdev_child[devidx];
 
@@ -2513,12 +2988,27 @@ static void
 vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *logical_rs,
     range_seg64_t *physical_rs, range_seg64_t *remain_rs)
 {
-	(void) remain_rs;
-
 	vdev_t *raidvd = cvd->vdev_parent;
 	ASSERT(raidvd->vdev_ops == &vdev_raidz_ops);
 
-	uint64_t width = raidvd->vdev_children;
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+
+	if (vdrz->vn_vre.vre_state == DSS_SCANNING) {
+		/*
+		 * We're in the middle of expansion, in which case the
+		 * translation is in flux.  Any answer we give may be wrong
+		 * by the time we return, so it isn't safe for the caller to
+		 * act on it.  Therefore we say that this range isn't present
+		 * on any children.  The only consumers of this are "zpool
+		 * initialize" and trimming, both of which are "best effort"
+		 * anyway.
+		 */
+		physical_rs->rs_start = physical_rs->rs_end = 0;
+		remain_rs->rs_start = remain_rs->rs_end = 0;
+		return;
+	}
+
+	uint64_t width = vdrz->vd_physical_width;
 	uint64_t tgt_col = cvd->vdev_id;
 	uint64_t ashift = raidvd->vdev_top->vdev_ashift;
 
@@ -2545,91 +3035,1395 @@ vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *logical_rs,
 }
 
 /*
- * Initialize private RAIDZ specific fields from the nvlist.
+ * Maximum amount of copy i/o outstanding for a RAID-Z expansion.
  */
-static int
-vdev_raidz_init(spa_t *spa, nvlist_t *nv, void **tsd)
-{
-	vdev_raidz_t *vdrz;
-	uint64_t nparity;
-
-	uint_t children;
-	nvlist_t **child;
-	int error = nvlist_lookup_nvlist_array(nv,
-	    ZPOOL_CONFIG_CHILDREN, &child, &children);
-	if (error != 0)
-		return (SET_ERROR(EINVAL));
-
-	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY, &nparity) == 0) {
-		if (nparity == 0 || nparity > VDEV_RAIDZ_MAXPARITY)
-			return (SET_ERROR(EINVAL));
-
-		/*
-		 * Previous versions could only support 1 or 2 parity
-		 * device.
-		 */
-		if (nparity > 1 && spa_version(spa) < SPA_VERSION_RAIDZ2)
-			return (SET_ERROR(EINVAL));
-		else if (nparity > 2 && spa_version(spa) < SPA_VERSION_RAIDZ3)
-			return (SET_ERROR(EINVAL));
-	} else {
-		/*
-		 * We require the parity to be specified for SPAs that
-		 * support multiple parity levels.
-		 */
-		if (spa_version(spa) >= SPA_VERSION_RAIDZ2)
-			return (SET_ERROR(EINVAL));
-
-		/*
-		 * Otherwise, we default to 1 parity device for RAID-Z.
-		 */
-		nparity = 1;
-	}
-
-	vdrz = kmem_zalloc(sizeof (*vdrz), KM_SLEEP);
-	vdrz->vd_logical_width = children;
-	vdrz->vd_nparity = nparity;
-
-	*tsd = vdrz;
+static unsigned long raidz_expand_max_copy_bytes = 10 * SPA_MAXBLOCKSIZE;
 
-	return (0);
-}
+/*
+ * Automatically start a pool scrub when a RAID-Z expansion completes, in
+ * order to verify the checksums of all blocks which have been copied.
+ */
+static int zfs_scrub_after_expand = 1;
+
+typedef struct raidz_reflow_arg {
+	vdev_raidz_expand_t *rra_vre;
+	zfs_locked_range_t *rra_lr;
+	uint64_t rra_txg;
+	uint_t rra_tbd;
+	uint_t rra_writes;
+	uint32_t rra_reads;
+	zio_t *rra_zio[];
+} raidz_reflow_arg_t;
 
-static void
-vdev_raidz_fini(vdev_t *vd)
+/*
+ * Return B_TRUE if any child of the RAID-Z vdev is being replaced (or is a
+ * spare which is in use), in which case the reflow is paused.
+ */
+static boolean_t
+vdev_raidz_expand_child_replacing(vdev_t *raidz_vd)
 {
-	kmem_free(vd->vdev_tsd, sizeof (vdev_raidz_t));
+	for (int i = 0; i < raidz_vd->vdev_children; i++) {
+		if (!raidz_vd->vdev_child[i]->vdev_ops->vdev_op_leaf)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
 }
 
 /*
- * Add RAIDZ specific fields to the config nvlist.
+ * Write the progress of the copies of the given txg to the uberblock.
  */
 static void
-vdev_raidz_config_generate(vdev_t *vd, nvlist_t *nv)
+raidz_reflow_sync(void *arg, dmu_tx_t *tx)
 {
-	ASSERT3P(vd->vdev_ops, ==, &vdev_raidz_ops);
-	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	spa_t *spa = arg;
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	uint64_t old_offset = RRSS_GET_OFFSET(&spa->spa_uberblock);
+	ASSERT3U(vre->vre_offset_pertxg[txgoff], >=, old_offset);
 
+	mutex_enter(&vre->vre_lock);
+	uint64_t new_offset =
+	    MIN(vre->vre_offset_pertxg[txgoff], vre->vre_failed_offset);
 	/*
-	 * Make sure someone hasn't managed to sneak a fancy new vdev
-	 * into a crufty old storage pool.
+	 * We should not have committed anything that failed.
 	 */
-	ASSERT(vdrz->vd_nparity == 1 ||
-	    (vdrz->vd_nparity <= 2 &&
-	    spa_version(vd->vdev_spa) >= SPA_VERSION_RAIDZ2) ||
-	    (vdrz->vd_nparity <= 3 &&
-	    spa_version(vd->vdev_spa) >= SPA_VERSION_RAIDZ3));
+	VERIFY3U(vre->vre_failed_offset, >=, old_offset);
+	mutex_exit(&vre->vre_lock);
 
 	/*
-	 * Note that we'll add these even on storage pools where they
-	 * aren't strictly required -- older software will just ignore
-	 * it.
+	 * Wait for any i/o which decided to access the rows being committed
+	 * at their old location before updating the uberblock.
 	 */
-	fnvlist_add_uint64(nv, ZPOOL_CONFIG_NPARITY, vdrz->vd_nparity);
+	zfs_locked_range_t *lr = zfs_rangelock_enter(&vre->vre_rangelock,
+	    old_offset, new_offset - old_offset, RL_WRITER);
+
+	RAIDZ_REFLOW_SET(&spa->spa_uberblock,
+	    RRSS_SCRATCH_INVALID_SYNCED_REFLOW, new_offset);
+	vre->vre_offset_pertxg[txgoff] = 0;
+	zfs_rangelock_exit(lr);
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_bytes_copied += vre->vre_bytes_copied_pertxg[txgoff];
+	vre->vre_bytes_copied_pertxg[txgoff] = 0;
+	mutex_exit(&vre->vre_lock);
+
+	vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED,
+	    sizeof (vre->vre_bytes_copied), 1, &vre->vre_bytes_copied, tx));
 }
 
-static uint64_t
-vdev_raidz_nparity(vdev_t *vd)
+static void
+raidz_reflow_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+
+	for (int i = 0; i < TXG_SIZE; i++)
+		VERIFY0(vre->vre_offset_pertxg[i]);
+
+	/*
+	 * Blocks which are allocated from now on use the new logical width.
+	 * The txgs which are already open may have allocated blocks with the
+	 * old width, so the new width only applies to blocks born after them.
+	 */
+	reflow_node_t *re = kmem_zalloc(sizeof (*re), KM_SLEEP);
+	re->re_txg = tx->tx_txg + TXG_CONCURRENT_STATES;
+	re->re_logical_width = vdrz->vd_physical_width;
+	mutex_enter(&vdrz->vd_expand_lock);
+	avl_add(&vdrz->vd_expand_txgs, re);
+	mutex_exit(&vdrz->vd_expand_lock);
+
+	/*
+	 * Dirty the config so that the updated ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS
+	 * will get written (based on vd_expand_txgs).
+	 */
+	vdev_config_dirty(raidvd);
+
+	/*
+	 * Before we change vre_state, the on-disk state must reflect that we
+	 * have completed all copying, so that vdev_raidz_io_start() can use
+	 * vre_state to determine if the reflow is in progress.  See also the
+	 * end of spa_raidz_expand_thread().
+	 */
+	VERIFY3U(RRSS_GET_OFFSET(&spa->spa_ubsync), ==,
+	    raidvd->vdev_ms_count << raidvd->vdev_ms_shift);
+
+	vre->vre_end_time = gethrestime_sec();
+	vre->vre_state = DSS_FINISHED;
+
+	uint64_t state = vre->vre_state;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+	    sizeof (state), 1, &state, tx));
+
+	uint64_t end_time = vre->vre_end_time;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME,
+	    sizeof (end_time), 1, &end_time, tx));
+
+	spa->spa_uberblock.ub_raidz_reflow_info = 0;
+
+	spa_history_log_internal(spa, "raidz vdev expansion completed", tx,
+	    "%s vdev %llu new width %llu", spa_name(spa),
+	    (u_longlong_t)raidvd->vdev_id,
+	    (u_longlong_t)raidvd->vdev_children);
+
+	spa->spa_raidz_expand = NULL;
+	raidvd->vdev_rz_expanding = B_FALSE;
+
+	spa_async_request(spa, SPA_ASYNC_INITIALIZE_RESTART);
+	spa_async_request(spa, SPA_ASYNC_TRIM_RESTART);
+	spa_async_request(spa, SPA_ASYNC_AUTOTRIM_RESTART);
+
+	spa_notify_waiters(spa);
+
+	/*
+	 * While we're in syncing context take the opportunity to
+	 * setup a scrub.  All the data has been successfully copied
+	 * but we have not validated any checksums.
+	 */
+	setup_sync_arg_t setup_sync_arg = {
+		.func = POOL_SCAN_SCRUB,
+		.txgstart = 0,
+		.txgend = 0,
+	};
+	if (zfs_scrub_after_expand &&
+	    dsl_scan_setup_check(&setup_sync_arg, tx) == 0)
+		dsl_scan_setup_sync(&setup_sync_arg, tx);
+}
+
+/*
+ * Record that the copies up to the given offset have been issued in this
+ * txg.  The progress is written to the uberblock by raidz_reflow_sync()
+ * once the txg (and therefore the copies) have completed.
+ */
+static void
+raidz_reflow_record_progress(vdev_raidz_expand_t *vre, uint64_t offset,
+    dmu_tx_t *tx)
+{
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+
+	if (offset == 0)
+		return;
+
+	mutex_enter(&vre->vre_lock);
+	ASSERT3U(vre->vre_offset, <=, offset);
+	vre->vre_offset = offset;
+	mutex_exit(&vre->vre_lock);
+
+	if (vre->vre_offset_pertxg[txgoff] == 0) {
+		dsl_sync_task_nowait(dmu_tx_pool(tx), raidz_reflow_sync,
+		    spa, tx);
+	}
+	vre->vre_offset_pertxg[txgoff] = offset;
+}
+
+static void
+raidz_reflow_write_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+
+	abd_free(zio->io_abd);
+
+	mutex_enter(&vre->vre_lock);
+	if (zio->io_error != 0) {
+		/* Force a reflow pause on errors */
+		vre->vre_failed_offset =
+		    MIN(vre->vre_failed_offset, rra->rra_lr->lr_offset);
+	}
+	ASSERT3U(vre->vre_outstanding_bytes, >=, zio->io_size);
+	vre->vre_outstanding_bytes -= zio->io_size;
+	if (rra->rra_lr->lr_offset + rra->rra_lr->lr_length <
+	    vre->vre_failed_offset) {
+		vre->vre_bytes_copied_pertxg[rra->rra_txg & TXG_MASK] +=
+		    zio->io_size;
+	}
+	cv_signal(&vre->vre_cv);
+	boolean_t done = (--rra->rra_writes == 0);
+	mutex_exit(&vre->vre_lock);
+
+	if (!done)
+		return;
+	spa_config_exit(zio->io_spa, SCL_STATE, zio->io_spa);
+	zfs_rangelock_exit(rra->rra_lr);
+	kmem_free(rra, sizeof (*rra) + sizeof (zio_t *) * rra->rra_tbd);
+}
+
+static void
+raidz_reflow_read_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+
+	/*
+	 * If the read failed, or if it was done on a vdev that is not fully
+	 * healthy (e.g. a child that has a resilver in progress), we may not
+	 * have the correct data.  Note that it's OK if the write proceeds.
+	 * It may write garbage but the location is otherwise unused and we
+	 * will retry later due to vre_failed_offset.
+	 */
+	if (zio->io_error != 0 || !vdev_dtl_empty(zio->io_vd, DTL_MISSING)) {
+		zfs_dbgmsg("reflow read failed off=%llu size=%llu txg=%llu "
+		    "err=%u partial_dtl_empty=%u missing_dtl_empty=%u",
+		    (u_longlong_t)rra->rra_lr->lr_offset,
+		    (u_longlong_t)rra->rra_lr->lr_length,
+		    (u_longlong_t)rra->rra_txg,
+		    zio->io_error,
+		    vdev_dtl_empty(zio->io_vd, DTL_PARTIAL),
+		    vdev_dtl_empty(zio->io_vd, DTL_MISSING));
+		mutex_enter(&vre->vre_lock);
+		/* Force a reflow pause on errors */
+		vre->vre_failed_offset =
+		    MIN(vre->vre_failed_offset, rra->rra_lr->lr_offset);
+		mutex_exit(&vre->vre_lock);
+	}
+
+	/* The read's abd is a gang of views of the write abds. */
+	abd_free(zio->io_abd);
+
+	if (atomic_dec_32_nv(&rra->rra_reads) > 0)
+		return;
+
+	for (int i = 0; i < rra->rra_tbd; i++)
+		zio_nowait(rra->rra_zio[i]);
+}
+
+/*
+ * Copy the next chunk of the range tree (the allocated part of a metaslab)
+ * from the old layout to the new layout.  Returns B_TRUE if the caller
+ * needs to wait for the txg to sync before calling this again, because
+ * the next copy would overwrite data whose copy has not been synced yet.
+ */
+static boolean_t
+raidz_reflow_impl(vdev_t *vd, vdev_raidz_expand_t *vre, range_tree_t *rt,
+    dmu_tx_t *tx)
+{
+	spa_t *spa = vd->vdev_spa;
+	int ashift = vd->vdev_top->vdev_ashift;
+	uint64_t offset, size;
+
+	if (!range_tree_find_in(rt, 0, vd->vdev_top->vdev_asize,
+	    &offset, &size)) {
+		return (B_FALSE);
+	}
+	ASSERT(IS_P2ALIGNED(offset, 1 << ashift));
+	ASSERT3U(size, >=, 1 << ashift);
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+
+	uint64_t blkid = offset >> ashift;
+
+	int old_children = vd->vdev_children - 1;
+
+	/*
+	 * We can only progress to the point that writes will not overlap
+	 * with blocks whose progress has not yet been recorded on disk.
+	 * Since partially-copied rows are still read from the old location,
+	 * we need to stop one row before the sector-wise overlap, to prevent
+	 * row-wise overlap.
+	 *
+	 * Note that even if we are skipping over a large unallocated region,
+	 * we can't move the on-disk progress to `offset`, because concurrent
+	 * writes/allocations could still use the currently-unallocated
+	 * region.
+	 */
+	uint64_t ubsync_blkid =
+	    RRSS_GET_OFFSET(&spa->spa_ubsync) >> ashift;
+	uint64_t next_overwrite_blkid = ubsync_blkid +
+	    ubsync_blkid / old_children - old_children;
+	VERIFY3U(next_overwrite_blkid, >, ubsync_blkid);
+
+	if (blkid >= next_overwrite_blkid) {
+		raidz_reflow_record_progress(vre,
+		    next_overwrite_blkid << ashift, tx);
+		return (B_TRUE);
+	}
+
+	size = MIN(size, raidz_expand_max_copy_bytes);
+	size = MIN(size, (uint64_t)old_children * SPA_MAXBLOCKSIZE);
+	size = MAX(size, 1 << ashift);
+	uint_t blocks = MIN(size >> ashift, next_overwrite_blkid - blkid);
+	size = (uint64_t)blocks << ashift;
+
+	range_tree_remove(rt, offset, size);
+
+	uint_t reads = MIN(blocks, old_children);
+	uint_t writes = MIN(blocks, vd->vdev_children);
+
+	raidz_reflow_arg_t *rra = kmem_zalloc(sizeof (*rra) +
+	    sizeof (zio_t *) * writes, KM_SLEEP);
+	rra->rra_vre = vre;
+	rra->rra_lr = zfs_rangelock_enter(&vre->vre_rangelock,
+	    offset, size, RL_WRITER);
+	rra->rra_txg = dmu_tx_get_txg(tx);
+	rra->rra_tbd = writes;
+	rra->rra_writes = writes;
+	rra->rra_reads = reads;
+
+	raidz_reflow_record_progress(vre, offset + size, tx);
+
+	/*
+	 * SCL_STATE will be released when the read and write are done,
+	 * by raidz_reflow_write_done().
+	 */
+	spa_config_enter(spa, SCL_STATE, spa, RW_READER);
+
+	/* check if a replacing vdev was added, if so treat it as an error */
+	if (vdev_raidz_expand_child_replacing(vd)) {
+		zfs_dbgmsg("replacing vdev encountered, reflow paused at "
+		    "offset=%llu txg=%llu",
+		    (u_longlong_t)rra->rra_lr->lr_offset,
+		    (u_longlong_t)rra->rra_txg);
+
+		mutex_enter(&vre->vre_lock);
+		vre->vre_failed_offset =
+		    MIN(vre->vre_failed_offset, rra->rra_lr->lr_offset);
+		cv_signal(&vre->vre_cv);
+		mutex_exit(&vre->vre_lock);
+
+		/* drop everything we acquired */
+		spa_config_exit(spa, SCL_STATE, spa);
+		zfs_rangelock_exit(rra->rra_lr);
+		kmem_free(rra, sizeof (*rra) + sizeof (zio_t *) * writes);
+		return (B_TRUE);
+	}
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_outstanding_bytes += size;
+	mutex_exit(&vre->vre_lock);
+
+	/*
+	 * The copies are children of the txg's zio, so that the txg can't
+	 * sync (and record the progress) until they have completed.
+	 */
+	zio_t *pio = spa->spa_txg_zio[txgoff];
+
+	/*
+	 * Sector k of this copy (i.e. sector blkid + k of the vdev) is
+	 * written to child (blkid + k) % children.  Each write zio covers
+	 * the contiguous sectors of one child.
+	 */
+	uint_t b = blocks / vd->vdev_children;
+	uint_t bb = blocks % vd->vdev_children;
+	for (int i = 0; i < writes; i++) {
+		uint_t n = b + (i < bb);
+		abd_t *abd = abd_alloc_for_io(n << ashift, B_FALSE);
+		rra->rra_zio[i] = zio_vdev_child_io(pio, NULL,
+		    vd->vdev_child[(blkid + i) % vd->vdev_children],
+		    ((blkid + i) / vd->vdev_children) << ashift,
+		    abd, n << ashift, ZIO_TYPE_WRITE, ZIO_PRIORITY_REMOVAL,
+		    ZIO_FLAG_CANFAIL, raidz_reflow_write_done, rra);
+	}
+
+	/*
+	 * Each read zio covers the contiguous sectors of one child in the
+	 * old layout, and reads them directly into the write buffers.
+	 */
+	b = blocks / old_children;
+	bb = blocks % old_children;
+	for (int i = 0; i < reads; i++) {
+		uint_t n = b + (i < bb);
+		abd_t *abd = abd_alloc_gang();
+		for (int j = 0; j < n; j++) {
+			uint_t k = i + j * old_children;
+			abd_gang_add(abd, abd_get_offset_size(
+			    rra->rra_zio[k % vd->vdev_children]->io_abd,
+			    (k / vd->vdev_children) << ashift, 1 << ashift),
+			    B_TRUE);
+		}
+
+		zio_nowait(zio_vdev_child_io(pio, NULL,
+		    vd->vdev_child[(blkid + i) % old_children],
+		    ((blkid + i) / old_children) << ashift, abd,
+		    n << ashift, ZIO_TYPE_READ, ZIO_PRIORITY_REMOVAL,
+		    ZIO_FLAG_CANFAIL, raidz_reflow_read_done, rra));
+	}
+
+	return (B_FALSE);
+}
+
+/*
+ * Child i/os do not propagate their errors to the parent, so pass them up
+ * to the root zio of the scratch area copy explicitly.
+ */
+static void
+raidz_scratch_child_done(zio_t *zio)
+{
+	zio_t *pio = zio->io_private;
+
+	mutex_enter(&pio->io_lock);
+	pio->io_error = zio_worst_error(pio->io_error, zio->io_error);
+	mutex_exit(&pio->io_lock);
+}
+
+static void
+raidz_scratch_clear_done(zio_t *zio)
+{
+	abd_free(zio->io_abd);
+	raidz_scratch_child_done(zio);
+}
+
+/*
+ * Once the scratch area is no longer needed, zero it again, so that the
+ * boot area is found unused by the next expansion (see
+ * vdev_check_boot_reserve()).  This is best effort; if it fails, the next
+ * expansion of this vdev is refused with EADDRINUSE.
+ */
+static void
+raidz_reflow_scratch_clear(spa_t *spa, vdev_t *raidvd, uint64_t size)
+{
+	zio_t *pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE,
+		    abd_get_zeros(size), size, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL,
+		    raidz_scratch_clear_done, pio));
+	}
+	(void) zio_wait(pio);
+}
+
+/*
+ * Reflow the beginning portion of the vdev into an intermediate scratch
+ * area in memory and on disk.  This operation must be persisted on disk
+ * before we proceed to overwrite the beginning portion with the reflowed
+ * data.
+ *
+ * This multi-step task can fail to complete if disk errors are encountered
+ * and we can return here after a pause (waiting for disk to become healthy).
+ */
+static void
+raidz_reflow_scratch_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_raidz_expand_t *vre = arg;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	zio_t *pio;
+	int error;
+
+	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	int ashift = raidvd->vdev_ashift;
+	uint64_t write_size = P2ALIGN(VDEV_BOOT_SIZE, 1 << ashift);
+	uint64_t logical_size = write_size * raidvd->vdev_children;
+	uint64_t read_size =
+	    P2ROUNDUP(DIV_ROUND_UP(logical_size, (raidvd->vdev_children - 1)),
+	    1 << ashift);
+
+	/*
+	 * The scratch space must be large enough to get us to the point
+	 * that one row does not overlap itself when moved.  This is checked
+	 * by vdev_raidz_attach_check().
+	 */
+	VERIFY3U(write_size, >=, raidvd->vdev_children << ashift);
+	VERIFY3U(write_size, <=, VDEV_BOOT_SIZE);
+	VERIFY3U(write_size, <=, read_size);
+
+	zfs_locked_range_t *lr = zfs_rangelock_enter(&vre->vre_rangelock,
+	    0, logical_size, RL_WRITER);
+
+	abd_t **abds = kmem_alloc(raidvd->vdev_children * sizeof (abd_t *),
+	    KM_SLEEP);
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abds[i] = abd_alloc_linear(read_size, B_FALSE);
+
+	raidz_reflow_scratch_state_t state = RRSS_GET_STATE(&spa->spa_ubsync);
+
+	/*
+	 * If we have already written the scratch area then we must read from
+	 * there, since new writes were redirected there while we were paused
+	 * or the original location may have been partially overwritten with
+	 * reflowed data.
+	 */
+	if (state == RRSS_SCRATCH_VALID) {
+		VERIFY3U(RRSS_GET_OFFSET(&spa->spa_ubsync), ==, logical_size);
+		/*
+		 * Read from scratch space.
+		 */
+		pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+		for (int i = 0; i < raidvd->vdev_children; i++) {
+			/*
+			 * Note: zio_vdev_child_io() adds VDEV_LABEL_START_SIZE
+			 * to the offset to calculate the physical offset to
+			 * write to.  Passing in a negative offset makes us
+			 * access the scratch area.
+			 */
+			zio_nowait(zio_vdev_child_io(pio, NULL,
+			    raidvd->vdev_child[i],
+			    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+			    write_size, ZIO_TYPE_READ, ZIO_PRIORITY_ASYNC_READ,
+			    ZIO_FLAG_CANFAIL, raidz_scratch_child_done, pio));
+		}
+		error = zio_wait(pio);
+		if (error != 0) {
+			zfs_dbgmsg("reflow: error %d reading scratch location",
+			    error);
+			goto io_error_exit;
+		}
+		goto overwrite;
+	}
+
+	/*
+	 * Read from original location.
+	 */
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children - 1; i++) {
+		ASSERT0(vdev_is_dead(raidvd->vdev_child[i]));
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], read_size, ZIO_TYPE_READ,
+		    ZIO_PRIORITY_ASYNC_READ, ZIO_FLAG_CANFAIL,
+		    raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		zfs_dbgmsg("reflow: error %d reading original location", error);
+		goto io_error_exit;
+	}
+
+	/*
+	 * Reflow in memory.  Sector i moves from its old location to its new
+	 * location, which is the old location of a sector that has already
+	 * been moved (or of itself, for the first row), so this can be done
+	 * in place.
+	 */
+	uint64_t logical_sectors = logical_size >> ashift;
+	for (int i = raidvd->vdev_children - 1; i < logical_sectors; i++) {
+		int oldchild = i % (raidvd->vdev_children - 1);
+		uint64_t oldoff = (i / (raidvd->vdev_children - 1)) << ashift;
+
+		int newchild = i % raidvd->vdev_children;
+		uint64_t newoff = (i / raidvd->vdev_children) << ashift;
+
+		/* a single sector should not be copying over itself */
+		ASSERT(!(newchild == oldchild && newoff == oldoff));
+
+		abd_copy_off(abds[newchild], abds[oldchild],
+		    newoff, oldoff, 1 << ashift);
+	}
+
+	/*
+	 * Write to scratch location (boot area).
+	 */
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+		    write_size, ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
+		    ZIO_FLAG_CANFAIL, raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		zfs_dbgmsg("reflow: error %d writing scratch location", error);
+		goto io_error_exit;
+	}
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow: wrote %llu bytes (logical) to scratch area",
+	    (u_longlong_t)logical_size);
+
+	/*
+	 * Update uberblock to indicate that scratch space is valid.  This is
+	 * needed because after this point, the real location may be
+	 * overwritten.  If we crash, we need to get the data from the
+	 * scratch space, rather than the real location.
+	 *
+	 * Note: ub_timestamp is bumped so that vdev_uberblock_compare()
+	 * will prefer this uberblock.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync, RRSS_SCRATCH_VALID, logical_size);
+	spa->spa_ubsync.ub_timestamp++;
+	ASSERT0(vdev_uberblock_sync_list(&spa->spa_root_vdev, 1,
+	    &spa->spa_ubsync, ZIO_FLAG_CONFIG_WRITER));
+	if (spa_multihost(spa))
+		mmp_update_uberblock(spa, &spa->spa_ubsync);
+
+	zfs_dbgmsg("reflow: uberblock updated "
+	    "(txg %llu, SCRATCH_VALID, size %llu, ts %llu)",
+	    (u_longlong_t)spa->spa_ubsync.ub_txg,
+	    (u_longlong_t)logical_size,
+	    (u_longlong_t)spa->spa_ubsync.ub_timestamp);
+
+overwrite:
+	/*
+	 * Overwrite with reflowed data.
+	 */
+	pio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], write_size, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_ASYNC_WRITE, ZIO_FLAG_CANFAIL,
+		    raidz_scratch_child_done, pio));
+	}
+	error = zio_wait(pio);
+	if (error != 0) {
+		zfs_dbgmsg("reflow: error %d writing real location", error);
+		/*
+		 * The scratch area remains valid, so keep it that way in the
+		 * uberblock of this txg.  When we exit early here and drop
+		 * the range lock, new writes will go into the scratch area,
+		 * so we'll need to read from there when we return after
+		 * pausing.
+		 */
+		RAIDZ_REFLOW_SET(&spa->spa_uberblock, RRSS_SCRATCH_VALID,
+		    logical_size);
+		goto io_error_exit;
+	}
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow: overwrote %llu bytes (logical) to real location",
+	    (u_longlong_t)logical_size);
+
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+
+	/*
+	 * Update uberblock to indicate that the initial part has been
+	 * reflowed.  This is needed because after this point (when we exit
+	 * the rangelock), we allow regular writes to this region, which will
+	 * be written to the new location only (because reflow_offset_next ==
+	 * reflow_offset_synced).  If we crashed and re-copied from the
+	 * scratch space, we would lose the regular writes.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync, RRSS_SCRATCH_INVALID_SYNCED,
+	    logical_size);
+	spa->spa_ubsync.ub_timestamp++;
+	ASSERT0(vdev_uberblock_sync_list(&spa->spa_root_vdev, 1,
+	    &spa->spa_ubsync, ZIO_FLAG_CONFIG_WRITER));
+	if (spa_multihost(spa))
+		mmp_update_uberblock(spa, &spa->spa_ubsync);
+
+	zfs_dbgmsg("reflow: uberblock updated "
+	    "(txg %llu, SCRATCH_NOT_IN_USE, size %llu, ts %llu)",
+	    (u_longlong_t)spa->spa_ubsync.ub_txg,
+	    (u_longlong_t)logical_size,
+	    (u_longlong_t)spa->spa_ubsync.ub_timestamp);
+
+	raidz_reflow_scratch_clear(spa, raidvd, write_size);
+
+	/*
+	 * Update progress.
+	 */
+	vre->vre_offset = logical_size;
+	zfs_rangelock_exit(lr);
+	spa_config_exit(spa, SCL_STATE, FTAG);
+
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	vre->vre_offset_pertxg[txgoff] = vre->vre_offset;
+	vre->vre_bytes_copied_pertxg[txgoff] = 0;
+	/*
+	 * Note - raidz_reflow_sync() will update the uberblock state to
+	 * RRSS_SCRATCH_INVALID_SYNCED_REFLOW
+	 */
+	raidz_reflow_sync(spa, tx);
+	return;
+
+io_error_exit:
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+	zfs_rangelock_exit(lr);
+	spa_config_exit(spa, SCL_STATE, FTAG);
+}
+
+/*
+ * We crashed in the middle of raidz_reflow_scratch_sync(); complete its
+ * actions.  This must be done before any writes to the pool, since the
+ * start of the vdev must be read from the scratch area until then.
+ */
+void
+vdev_raidz_reflow_copy_scratch(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	uint64_t logical_size = RRSS_GET_OFFSET(&spa->spa_uberblock);
+	ASSERT3U(RRSS_GET_STATE(&spa->spa_uberblock), ==, RRSS_SCRATCH_VALID);
+
+	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	ASSERT0(logical_size % raidvd->vdev_children);
+	uint64_t write_size = logical_size / raidvd->vdev_children;
+
+	zio_t *pio;
+
+	/*
+	 * Read from scratch space.
+	 */
+	abd_t **abds = kmem_alloc(raidvd->vdev_children * sizeof (abd_t *),
+	    KM_SLEEP);
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abds[i] = abd_alloc_linear(write_size, B_FALSE);
+
+	pio = zio_root(spa, NULL, NULL, 0);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    VDEV_BOOT_OFFSET - VDEV_LABEL_START_SIZE, abds[i],
+		    write_size, ZIO_TYPE_READ, ZIO_PRIORITY_ASYNC_READ, 0,
+		    raidz_scratch_child_done, pio));
+	}
+	zio_wait(pio);
+
+	/*
+	 * Overwrite real location with reflowed data.
+	 */
+	pio = zio_root(spa, NULL, NULL, 0);
+	for (int i = 0; i < raidvd->vdev_children; i++) {
+		zio_nowait(zio_vdev_child_io(pio, NULL, raidvd->vdev_child[i],
+		    0, abds[i], write_size, ZIO_TYPE_WRITE,
+		    ZIO_PRIORITY_ASYNC_WRITE, 0,
+		    raidz_scratch_child_done, pio));
+	}
+	zio_wait(pio);
+	pio = zio_root(spa, NULL, NULL, 0);
+	zio_flush(pio, raidvd);
+	zio_wait(pio);
+
+	zfs_dbgmsg("reflow recovery: overwrote %llu bytes (logical) "
+	    "to real location", (u_longlong_t)logical_size);
+
+	for (int i = 0; i < raidvd->vdev_children; i++)
+		abd_free(abds[i]);
+	kmem_free(abds, raidvd->vdev_children * sizeof (abd_t *));
+
+	/*
+	 * Update uberblock.
+	 */
+	RAIDZ_REFLOW_SET(&spa->spa_ubsync,
+	    RRSS_SCRATCH_INVALID_SYNCED_ON_IMPORT, logical_size);
+	spa->spa_ubsync.ub_timestamp++;
+	VERIFY0(vdev_uberblock_sync_list(&spa->spa_root_vdev, 1,
+	    &spa->spa_ubsync, ZIO_FLAG_CONFIG_WRITER));
+	if (spa_multihost(spa))
+		mmp_update_uberblock(spa, &spa->spa_ubsync);
+
+	zfs_dbgmsg("reflow recovery: uberblock updated "
+	    "(txg %llu, SCRATCH_NOT_IN_USE, size %llu, ts %llu)",
+	    (u_longlong_t)spa->spa_ubsync.ub_txg,
+	    (u_longlong_t)logical_size,
+	    (u_longlong_t)spa->spa_ubsync.ub_timestamp);
+
+	raidz_reflow_scratch_clear(spa, raidvd, write_size);
+
+	dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool,
+	    spa_first_txg(spa));
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	vre->vre_offset = logical_size;
+	vre->vre_offset_pertxg[txgoff] = vre->vre_offset;
+	vre->vre_bytes_copied_pertxg[txgoff] = 0;
+	/*
+	 * Note that raidz_reflow_sync() will update the uberblock once more
+	 */
+	raidz_reflow_sync(spa, tx);
+
+	dmu_tx_commit(tx);
+
+	spa_config_exit(spa, SCL_STATE, FTAG);
+}
+
+static boolean_t
+spa_raidz_expand_thread_check(void *arg, zthr_t *zthr)
+{
+	(void) zthr;
+	spa_t *spa = arg;
+
+	return (spa->spa_raidz_expand != NULL &&
+	    !spa->spa_raidz_expand->vre_waiting_for_resilver);
+}
+
+/*
+ * RAIDZ expansion background thread
+ *
+ * Can be called multiple times if the reflow is paused
+ */
+static void
+spa_raidz_expand_thread(void *arg, zthr_t *zthr)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (RRSS_GET_STATE(&spa->spa_ubsync) == RRSS_SCRATCH_VALID)
+		vre->vre_offset = 0;
+	else
+		vre->vre_offset = RRSS_GET_OFFSET(&spa->spa_ubsync);
+
+	/* Reflow the beginning portion using the scratch area */
+	if (vre->vre_offset == 0) {
+		VERIFY0(dsl_sync_task(spa_name(spa),
+		    NULL, raidz_reflow_scratch_sync,
+		    vre, 0, ZFS_SPACE_CHECK_NONE));
+
+		/* if we encountered errors then pause */
+		if (vre->vre_offset == 0) {
+			mutex_enter(&vre->vre_lock);
+			vre->vre_waiting_for_resilver = B_TRUE;
+			mutex_exit(&vre->vre_lock);
+			return;
+		}
+	}
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+	vdev_t *raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+
+	uint64_t guid = raidvd->vdev_guid;
+
+	/* Iterate over all the remaining metaslabs */
+	for (uint64_t i = vre->vre_offset >> raidvd->vdev_ms_shift;
+	    i < raidvd->vdev_ms_count &&
+	    !zthr_iscancelled(zthr) &&
+	    vre->vre_failed_offset == UINT64_MAX; i++) {
+		metaslab_t *msp = raidvd->vdev_ms[i];
+
+		metaslab_disable(msp);
+		mutex_enter(&msp->ms_lock);
+
+		/*
+		 * The metaslab may be newly created (for the expanded
+		 * space), in which case its trees won't exist yet,
+		 * so we need to bail out early.
+		 */
+		if (msp->ms_new) {
+			mutex_exit(&msp->ms_lock);
+			metaslab_enable(msp, B_FALSE, B_FALSE);
+			continue;
+		}
+
+		VERIFY0(metaslab_load(msp));
+
+		/*
+		 * We want to copy everything except the free (allocatable)
+		 * space.  Note that there may be a little bit more free
+		 * space (e.g. in ms_defer), and it's fine to copy that too.
+		 */
+		range_tree_t *rt = range_tree_create(NULL, RANGE_SEG64,
+		    NULL, 0, 0);
+		range_tree_add(rt, msp->ms_start, msp->ms_size);
+		range_tree_walk(msp->ms_allocatable, range_tree_remove, rt);
+		mutex_exit(&msp->ms_lock);
+
+		/*
+		 * Force the last sector of each metaslab to be copied.  This
+		 * ensures that we advance the on-disk progress to the end of
+		 * this metaslab while the metaslab is disabled.  Otherwise, we
+		 * could move past this metaslab without advancing the on-disk
+		 * progress, and then an allocation to this metaslab would not
+		 * be copied.
+		 */
+		int sectorsz = 1 << raidvd->vdev_ashift;
+		uint64_t ms_last_offset = msp->ms_start +
+		    msp->ms_size - sectorsz;
+		if (!range_tree_contains(rt, ms_last_offset, sectorsz))
+			range_tree_add(rt, ms_last_offset, sectorsz);
+
+		/*
+		 * When we are resuming from a paused expansion (i.e.
+		 * when importing a pool with a expansion in progress),
+		 * discard any state that we have already processed.
+		 */
+		range_tree_clear(rt, 0, vre->vre_offset);
+
+		while (!zthr_iscancelled(zthr) &&
+		    !range_tree_is_empty(rt) &&
+		    vre->vre_failed_offset == UINT64_MAX) {
+
+			/*
+			 * We need to periodically drop the config lock so that
+			 * writers can get in.  Additionally, we can't wait
+			 * for a txg to sync while holding a config lock
+			 * (since a waiting writer could cause a 3-way deadlock
+			 * with the sync thread, which also gets a config
+			 * lock for reader).  So we can't hold the config lock
+			 * while calling dmu_tx_assign().
+			 */
+			spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+			mutex_enter(&vre->vre_lock);
+			while (vre->vre_outstanding_bytes >
+			    raidz_expand_max_copy_bytes) {
+				cv_wait(&vre->vre_cv, &vre->vre_lock);
+			}
+			mutex_exit(&vre->vre_lock);
+
+			dmu_tx_t *tx =
+			    dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+
+			VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+			uint64_t txg = dmu_tx_get_txg(tx);
+
+			/*
+			 * Reacquire the vdev_config lock.  Theoretically, the
+			 * vdev_t that we're expanding may have changed.
+			 */
+			spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+			raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+
+			boolean_t needsync =
+			    raidz_reflow_impl(raidvd, vre, rt, tx);
+
+			dmu_tx_commit(tx);
+
+			if (needsync) {
+				spa_config_exit(spa, SCL_CONFIG, FTAG);
+				txg_wait_synced(spa->spa_dsl_pool, txg);
+				spa_config_enter(spa, SCL_CONFIG, FTAG,
+				    RW_READER);
+			}
+		}
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+		metaslab_enable(msp, B_FALSE, B_FALSE);
+		range_tree_vacate(rt, NULL, NULL);
+		range_tree_destroy(rt);
+
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+		raidvd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	}
+
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	/*
+	 * The txg_wait_synced() here ensures that all reflow zio's have
+	 * completed, and vre_failed_offset has been set if necessary.  It
+	 * also ensures that the progress of the last raidz_reflow_sync() is
+	 * written to disk before raidz_reflow_complete_sync() changes the
+	 * in-memory vre_state.  vdev_raidz_io_start() uses vre_state to
+	 * determine if a reflow is in progress, in which case we may need to
+	 * write to both old and new locations.  Therefore we can only change
+	 * vre_state once this is not necessary, which is once the on-disk
+	 * progress (in spa_ubsync) has been set past any possible writes (to
+	 * the end of the last metaslab).
+	 */
+	txg_wait_synced(spa->spa_dsl_pool, 0);
+
+	if (!zthr_iscancelled(zthr) &&
+	    vre->vre_offset == raidvd->vdev_ms_count << raidvd->vdev_ms_shift) {
+		/*
+		 * We are not being canceled or paused, so the reflow must be
+		 * complete.  In that case also mark it as completed on disk.
+		 */
+		ASSERT3U(vre->vre_failed_offset, ==, UINT64_MAX);
+		VERIFY0(dsl_sync_task(spa_name(spa), NULL,
+		    raidz_reflow_complete_sync, spa,
+		    0, ZFS_SPACE_CHECK_NONE));
+		(void) vdev_online(spa, guid, ZFS_ONLINE_EXPAND, NULL);
+	} else {
+		/*
+		 * Wait for all copy zio's to complete and for all the
+		 * raidz_reflow_sync() synctasks to be run.
+		 */
+		spa_history_log_internal(spa, "reflow pause",
+		    NULL, "offset=%llu failed_offset=%lld",
+		    (long long)vre->vre_offset,
+		    (long long)vre->vre_failed_offset);
+		mutex_enter(&vre->vre_lock);
+		if (vre->vre_failed_offset != UINT64_MAX) {
+			/*
+			 * Reset progress so that we will retry everything
+			 * after the point that something failed.
+			 */
+			vre->vre_offset = vre->vre_failed_offset;
+			vre->vre_failed_offset = UINT64_MAX;
+			vre->vre_waiting_for_resilver = B_TRUE;
+		}
+		mutex_exit(&vre->vre_lock);
+	}
+}
+
+void
+spa_start_raidz_expansion_thread(spa_t *spa)
+{
+	ASSERT3P(spa->spa_raidz_expand_zthr, ==, NULL);
+	spa->spa_raidz_expand_zthr = zthr_create("raidz_expand",
+	    spa_raidz_expand_thread_check, spa_raidz_expand_thread,
+	    spa, defclsyspri);
+}
+
+/*
+ * Called from vdev_dtl_reassess() once a child of the vdev being expanded
+ * is healthy again, to resume a reflow which was paused because of i/o
+ * errors.
+ */
+void
+raidz_dtl_reassessed(vdev_t *vd)
+{
+	spa_t *spa = vd->vdev_spa;
+	if (spa->spa_raidz_expand != NULL) {
+		vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+		/*
+		 * we get called often from vdev_dtl_reassess() so make
+		 * sure it's our vdev and any replacing is complete
+		 */
+		if (vd->vdev_top->vdev_id == vre->vre_vdev_id &&
+		    !vdev_raidz_expand_child_replacing(vd->vdev_top)) {
+			mutex_enter(&vre->vre_lock);
+			if (vre->vre_waiting_for_resilver) {
+				vdev_dbgmsg(vd, "DTL reassessed, "
+				    "continuing raidz expansion");
+				vre->vre_waiting_for_resilver = B_FALSE;
+				zthr_wakeup(spa->spa_raidz_expand_zthr);
+			}
+			mutex_exit(&vre->vre_lock);
+		}
+	}
+}
+
+/*
+ * Check whether the given RAID-Z vdev can be expanded by one more child.
+ */
+int
+vdev_raidz_attach_check(vdev_t *raidvd)
+{
+	uint64_t new_children = raidvd->vdev_children + 1;
+
+	ASSERT3P(raidvd->vdev_ops, ==, &vdev_raidz_ops);
+
+	/*
+	 * We use the "boot" space as scratch space to handle overwriting the
+	 * initial part of the vdev.  If it is too small, then this expansion
+	 * is not allowed.  This would be very unusual (e.g. ashift > 13 and
+	 * >200 children).
+	 */
+	if (new_children << raidvd->vdev_ashift > VDEV_BOOT_SIZE)
+		return (SET_ERROR(EINVAL));
+	return (0);
+}
+
+/*
+ * Start the expansion of a RAID-Z vdev, in the txg in which the new child
+ * was added to it (see spa_vdev_attach()).
+ */
+void
+vdev_raidz_attach_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *new_child = arg;
+	spa_t *spa = new_child->vdev_spa;
+	vdev_t *raidvd = new_child->vdev_parent;
+	vdev_raidz_t *vdrz = raidvd->vdev_tsd;
+	ASSERT3P(raidvd->vdev_ops, ==, &vdev_raidz_ops);
+	ASSERT3P(raidvd->vdev_top, ==, raidvd);
+	ASSERT3U(raidvd->vdev_children, >, vdrz->vd_original_width);
+	ASSERT3U(raidvd->vdev_children, ==, vdrz->vd_physical_width + 1);
+	ASSERT3P(raidvd->vdev_child[raidvd->vdev_children - 1], ==,
+	    new_child);
+
+	spa_feature_incr(spa, SPA_FEATURE_RAIDZ_EXPANSION, tx);
+
+	VERIFY0(spa->spa_uberblock.ub_raidz_reflow_info);
+	vdrz->vn_vre.vre_vdev_id = raidvd->vdev_id;
+	vdrz->vn_vre.vre_offset = 0;
+	vdrz->vn_vre.vre_failed_offset = UINT64_MAX;
+	vdrz->vn_vre.vre_start_time = gethrestime_sec();
+	vdrz->vn_vre.vre_end_time = 0;
+	vdrz->vn_vre.vre_bytes_copied = 0;
+	vdrz->vn_vre.vre_state = DSS_SCANNING;
+	spa->spa_raidz_expand = &vdrz->vn_vre;
+
+	/*
+	 * vdev_raidz_io_start() must see that the reflow is in progress
+	 * before it sees the new physical width, otherwise it would access
+	 * the existing blocks at their new location.
+	 */
+	membar_producer();
+	vdrz->vd_physical_width++;
+
+	zthr_wakeup(spa->spa_raidz_expand_zthr);
+
+	/*
+	 * Dirty the config so that ZPOOL_CONFIG_RAIDZ_EXPANDING will get
+	 * written to the config.
+	 */
+	vdev_config_dirty(raidvd);
+
+	uint64_t state = vdrz->vn_vre.vre_state;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+	    sizeof (state), 1, &state, tx));
+
+	uint64_t start_time = vdrz->vn_vre.vre_start_time;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_START_TIME,
+	    sizeof (start_time), 1, &start_time, tx));
+
+	(void) zap_remove(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME, tx);
+	(void) zap_remove(spa->spa_meta_objset,
+	    raidvd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED, tx);
+
+	spa_history_log_internal(spa, "raidz vdev expansion started", tx,
+	    "%s vdev %llu new width %llu", spa_name(spa),
+	    (u_longlong_t)raidvd->vdev_id,
+	    (u_longlong_t)raidvd->vdev_children);
+}
+
+/*
+ * Load the state of the last (or current) expansion of this vdev from the
+ * vdev_top_zap.
+ */
+int
+vdev_raidz_load(vdev_t *vd)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	int err;
+
+	uint64_t state = DSS_NONE;
+	uint64_t start_time = 0;
+	uint64_t end_time = 0;
+	uint64_t bytes_copied = 0;
+
+	if (vd->vdev_top_zap != 0) {
+		err = zap_lookup(vd->vdev_spa->spa_meta_objset,
+		    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_STATE,
+		    sizeof (state), 1, &state);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(vd->vdev_spa->spa_meta_objset,
+		    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_START_TIME,
+		    sizeof (start_time), 1, &start_time);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(vd->vdev_spa->spa_meta_objset,
+		    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_END_TIME,
+		    sizeof (end_time), 1, &end_time);
+		if (err != 0 && err != ENOENT)
+			return (err);
+
+		err = zap_lookup(vd->vdev_spa->spa_meta_objset,
+		    vd->vdev_top_zap, VDEV_TOP_ZAP_RAIDZ_EXPAND_BYTES_COPIED,
+		    sizeof (bytes_copied), 1, &bytes_copied);
+		if (err != 0 && err != ENOENT)
+			return (err);
+	}
+
+	/*
+	 * If we are in the middle of expansion, vre_state should have
+	 * already been set by vdev_raidz_init().
+	 */
+	EQUIV(vdrz->vn_vre.vre_state == DSS_SCANNING, state == DSS_SCANNING);
+	vdrz->vn_vre.vre_state = (dsl_scan_state_t)state;
+	vdrz->vn_vre.vre_start_time = start_time;
+	vdrz->vn_vre.vre_end_time = end_time;
+	vdrz->vn_vre.vre_bytes_copied = bytes_copied;
+
+	return (0);
+}
+
+int
+spa_raidz_expand_get_stats(spa_t *spa, pool_raidz_expand_stat_t *pres)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL) {
+		/* no expansion in progress; find most recent completed */
+		for (int c = 0; c < spa->spa_root_vdev->vdev_children; c++) {
+			vdev_t *vd = spa->spa_root_vdev->vdev_child[c];
+			if (vd->vdev_ops == &vdev_raidz_ops) {
+				vdev_raidz_t *vdrz = vd->vdev_tsd;
+
+				if (vdrz->vn_vre.vre_end_time != 0 &&
+				    (vre == NULL ||
+				    vdrz->vn_vre.vre_end_time >
+				    vre->vre_end_time)) {
+					vre = &vdrz->vn_vre;
+				}
+			}
+		}
+	}
+
+	if (vre == NULL)
+		return (SET_ERROR(ENOENT));
+
+	pres->pres_state = vre->vre_state;
+	pres->pres_expanding_vdev = vre->vre_vdev_id;
+
+	vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	pres->pres_to_reflow = vd->vdev_stat.vs_alloc;
+
+	mutex_enter(&vre->vre_lock);
+	pres->pres_reflowed = vre->vre_bytes_copied;
+	for (int i = 0; i < TXG_SIZE; i++)
+		pres->pres_reflowed += vre->vre_bytes_copied_pertxg[i];
+	mutex_exit(&vre->vre_lock);
+
+	pres->pres_start_time = vre->vre_start_time;
+	pres->pres_end_time = vre->vre_end_time;
+	pres->pres_waiting_for_resilver = vre->vre_waiting_for_resilver;
+
+	return (0);
+}
+
+/*
+ * Initialize private RAIDZ specific fields from the nvlist.
+ */
+static int
+vdev_raidz_init(spa_t *spa, nvlist_t *nv, void **tsd)
+{
+	vdev_raidz_t *vdrz;
+	uint64_t nparity;
+
+	uint_t children;
+	nvlist_t **child;
+	int error = nvlist_lookup_nvlist_array(nv,
+	    ZPOOL_CONFIG_CHILDREN, &child, &children);
+	if (error != 0)
+		return (SET_ERROR(EINVAL));
+
+	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY, &nparity) == 0) {
+		if (nparity == 0 || nparity > VDEV_RAIDZ_MAXPARITY)
+			return (SET_ERROR(EINVAL));
+
+		/*
+		 * Previous versions could only support 1 or 2 parity
+		 * device.
+		 */
+		if (nparity > 1 && spa_version(spa) < SPA_VERSION_RAIDZ2)
+			return (SET_ERROR(EINVAL));
+		else if (nparity > 2 && spa_version(spa) < SPA_VERSION_RAIDZ3)
+			return (SET_ERROR(EINVAL));
+	} else {
+		/*
+		 * We require the parity to be specified for SPAs that
+		 * support multiple parity levels.
+		 */
+		if (spa_version(spa) >= SPA_VERSION_RAIDZ2)
+			return (SET_ERROR(EINVAL));
+
+		/*
+		 * Otherwise, we default to 1 parity device for RAID-Z.
+		 */
+		nparity = 1;
+	}
+
+	vdrz = kmem_zalloc(sizeof (*vdrz), KM_SLEEP);
+	vdrz->vn_vre.vre_vdev_id = -1;
+	vdrz->vn_vre.vre_offset = UINT64_MAX;
+	vdrz->vn_vre.vre_failed_offset = UINT64_MAX;
+	mutex_init(&vdrz->vn_vre.vre_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vdrz->vn_vre.vre_cv, NULL, CV_DEFAULT, NULL);
+	zfs_rangelock_init(&vdrz->vn_vre.vre_rangelock, NULL, NULL);
+	mutex_init(&vdrz->vd_expand_lock, NULL, MUTEX_DEFAULT, NULL);
+	avl_create(&vdrz->vd_expand_txgs, vdev_raidz_reflow_compare,
+	    sizeof (reflow_node_t), offsetof(reflow_node_t, re_link));
+
+	vdrz->vd_physical_width = children;
+	vdrz->vd_nparity = nparity;
+
+	/* note, the ID does not exist when creating a pool */
+	(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_ID,
+	    &vdrz->vn_vre.vre_vdev_id);
+
+	boolean_t reflow_in_progress =
+	    nvlist_exists(nv, ZPOOL_CONFIG_RAIDZ_EXPANDING);
+	if (reflow_in_progress) {
+		spa->spa_raidz_expand = &vdrz->vn_vre;
+		vdrz->vn_vre.vre_state = DSS_SCANNING;
+	}
+
+	vdrz->vd_original_width = children;
+	uint64_t *txgs;
+	unsigned int txgs_size = 0;
+	error = nvlist_lookup_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+	    &txgs, &txgs_size);
+	if (error == 0) {
+		for (int i = 0; i < txgs_size; i++) {
+			reflow_node_t *re = kmem_zalloc(sizeof (*re), KM_SLEEP);
+			re->re_txg = txgs[txgs_size - i - 1];
+			re->re_logical_width = vdrz->vd_physical_width - i;
+
+			if (reflow_in_progress)
+				re->re_logical_width--;
+
+			avl_add(&vdrz->vd_expand_txgs, re);
+		}
+
+		vdrz->vd_original_width = vdrz->vd_physical_width - txgs_size;
+	}
+	if (reflow_in_progress)
+		vdrz->vd_original_width--;
+
+	*tsd = vdrz;
+
+	return (0);
+}
+
+static void
+vdev_raidz_fini(vdev_t *vd)
+{
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+	if (vd->vdev_spa->spa_raidz_expand == &vdrz->vn_vre)
+		vd->vdev_spa->spa_raidz_expand = NULL;
+	reflow_node_t *re;
+	void *cookie = NULL;
+	avl_tree_t *tree = &vdrz->vd_expand_txgs;
+	while ((re = avl_destroy_nodes(tree, &cookie)) != NULL)
+		kmem_free(re, sizeof (*re));
+	avl_destroy(&vdrz->vd_expand_txgs);
+	mutex_destroy(&vdrz->vd_expand_lock);
+	mutex_destroy(&vdrz->vn_vre.vre_lock);
+	cv_destroy(&vdrz->vn_vre.vre_cv);
+	zfs_rangelock_fini(&vdrz->vn_vre.vre_rangelock);
+	kmem_free(vdrz, sizeof (*vdrz));
+}
+
+/*
+ * Add RAIDZ specific fields to the config nvlist.
+ */
+static void
+vdev_raidz_config_generate(vdev_t *vd, nvlist_t *nv)
+{
+	ASSERT3P(vd->vdev_ops, ==, &vdev_raidz_ops);
+	vdev_raidz_t *vdrz = vd->vdev_tsd;
+
+	/*
+	 * Make sure someone hasn't managed to sneak a fancy new vdev
+	 * into a crufty old storage pool.
+	 */
+	ASSERT(vdrz->vd_nparity == 1 ||
+	    (vdrz->vd_nparity <= 2 &&
+	    spa_version(vd->vdev_spa) >= SPA_VERSION_RAIDZ2) ||
+	    (vdrz->vd_nparity <= 3 &&
+	    spa_version(vd->vdev_spa) >= SPA_VERSION_RAIDZ3));
+
+	/*
+	 * Note that we'll add these even on storage pools where they
+	 * aren't strictly required -- older software will just ignore
+	 * it.
+	 */
+	fnvlist_add_uint64(nv, ZPOOL_CONFIG_NPARITY, vdrz->vd_nparity);
+
+	if (vd->vdev_rz_expanding)
+		fnvlist_add_boolean(nv, ZPOOL_CONFIG_RAIDZ_EXPANDING);
+
+	mutex_enter(&vdrz->vd_expand_lock);
+	if (avl_numnodes(&vdrz->vd_expand_txgs) > 0) {
+		uint64_t count = avl_numnodes(&vdrz->vd_expand_txgs);
+		uint64_t *txgs = kmem_alloc(sizeof (uint64_t) * count,
+		    KM_SLEEP);
+		uint64_t i = 0;
+
+		for (reflow_node_t *re = avl_first(&vdrz->vd_expand_txgs);
+		    re != NULL; re = AVL_NEXT(&vdrz->vd_expand_txgs, re)) {
+			txgs[i++] = re->re_txg;
+		}
+
+		fnvlist_add_uint64_array(nv, ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+		    txgs, count);
+
+		kmem_free(txgs, sizeof (uint64_t) * count);
+	}
+	mutex_exit(&vdrz->vd_expand_lock);
+}
+
+static uint64_t
+vdev_raidz_nparity(vdev_t *vd)
 {
 	vdev_raidz_t *vdrz = vd->vdev_tsd;
 	return (vdrz->vd_nparity);
@@ -2665,3 +4459,11 @@ vdev_ops_t vdev_raidz_ops = {
 	.vdev_op_type = VDEV_TYPE_RAIDZ,	/* name of this vdev type */
 	.vdev_op_leaf = B_FALSE			/* not a leaf vdev */
 };
+
+/* BEGIN CSTYLED */
+ZFS_MODULE_PARAM(zfs_vdev, raidz_, expand_max_copy_bytes, ULONG, ZMOD_RW,
+	"Max amount of concurrent i/o for RAIDZ expansion");
+ZFS_MODULE_PARAM(zfs, zfs_, scrub_after_expand, INT, ZMOD_RW,
+	"For expanded RAIDZ, automatically start a pool scrub when expansion "
+	"completes");
+/* END CSTYLED */
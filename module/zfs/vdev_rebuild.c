@@ -331,10 +331,14 @@ vdev_rebuild_complete_sync(void *arg, dmu_tx_t *tx)
 	 * While we're in syncing context take the opportunity to
 	 * setup the scrub when there are no more active rebuilds.
 	 */
-	pool_scan_func_t func = POOL_SCAN_SCRUB;
-	if (dsl_scan_setup_check(&func, tx) == 0 &&
+	setup_sync_arg_t setup_sync_arg = {
+		.func = POOL_SCAN_SCRUB,
+		.txgstart = 0,
+		.txgend = 0,
+	};
+	if (dsl_scan_setup_check(&setup_sync_arg, tx) == 0 &&
 	    zfs_rebuild_scrub_enabled) {
-		dsl_scan_setup_sync(&func, tx);
+		dsl_scan_setup_sync(&setup_sync_arg, tx);
 	}
 
 	cv_broadcast(&vd->vdev_rebuild_cv);
@@ -749,7 +753,7 @@ vdev_rebuild_thread(void *arg)
 	 * emulate the resilver behavior as much as possible.
 	 */
 	dsl_pool_t *dsl = spa_get_dsl(spa);
-	if (dsl_scan_scrubbing(dsl))
+	if (dsl_scan_scrubbing(dsl) || dsl_errorscrubbing(dsl))
 		dsl_scan_cancel(dsl);
 
 	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
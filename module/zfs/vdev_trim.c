@@ -82,8 +82,17 @@
  * While the automatic TRIM process is highly effective it is more likely
  * than a manual TRIM to encounter tiny ranges.  Ranges less than or equal to
  * 'zfs_trim_extent_bytes_min' (32k) are considered too small to efficiently
- * TRIM and are skipped.  This means small amounts of freed space may not
- * be automatically trimmed.
+ * TRIM.  Rather than issuing them, they are left in ms_trim for up to
+ * 'zfs_trim_defer_passes' further passes over the metaslab, giving them
+ * time to coalesce with neighbouring frees into a range worth trimming.
+ * The pass in which each range was first deferred is remembered, so that
+ * ranges freed recently get their full number of passes.  Ranges still
+ * too small after that are skipped.  This means small amounts
+ * of freed space may not be automatically trimmed.
+ *
+ * The rate of automatic TRIM can be limited per leaf vdev with
+ * 'zfs_trim_autotrim_rate' so that TRIM doesn't compete with reads and
+ * writes on devices where discards are expensive.
  *
  * Furthermore, devices with attached hot spares and devices being actively
  * replaced are skipped.  This is done to avoid adding additional stress to
@@ -136,6 +145,21 @@ static unsigned int zfs_trim_queue_limit = 10;
  */
 static unsigned int zfs_trim_txg_batch = 32;
 
+/*
+ * The number of automatic TRIM passes over a metaslab during which ranges
+ * smaller than the leaves' minimum TRIM extent size are kept back, in the
+ * hope that they coalesce with later frees, before they are given up on.
+ * Each pass is at least zfs_trim_txg_batch txgs apart.  Setting this to
+ * zero skips small ranges right away.
+ */
+static unsigned int zfs_trim_defer_passes = 4;
+
+/*
+ * Maximum rate, in bytes per second, at which automatic TRIM is issued
+ * to each leaf vdev.  Zero means unlimited.
+ */
+static unsigned long zfs_trim_autotrim_rate = 0;
+
 /*
  * The trim_args are a control structure which describe how a leaf vdev
  * should be trimmed.  The core elements are the vdev, the metaslab being
@@ -161,6 +185,47 @@ typedef struct trim_args {
 	uint64_t	trim_bytes_done;	/* Bytes trimmed */
 } trim_args_t;
 
+/*
+ * The TRIM extent size limits of a leaf vdev, which may be overridden
+ * with the trim_extent_bytes_max and trim_extent_bytes_min vdev properties.
+ */
+static uint64_t
+vdev_trim_extent_max(vdev_t *vd)
+{
+	if (vd->vdev_trim_extent_bytes_max != UINT64_MAX)
+		return (vd->vdev_trim_extent_bytes_max);
+	return (zfs_trim_extent_bytes_max);
+}
+
+static uint64_t
+vdev_trim_extent_min(vdev_t *vd)
+{
+	if (vd->vdev_trim_extent_bytes_min != UINT64_MAX)
+		return (vd->vdev_trim_extent_bytes_min);
+	return (zfs_trim_extent_bytes_min);
+}
+
+/*
+ * The smallest minimum TRIM extent size of the leaves an automatic TRIM of
+ * top-level vdev vd is issued to.  Smaller ranges aren't trimmed by any of
+ * them, so they are deferred.
+ */
+static uint64_t
+vdev_autotrim_extent_min(vdev_t *vd)
+{
+	uint64_t extent_bytes_min;
+
+	if (vd->vdev_children == 0)
+		return (vdev_trim_extent_min(vd));
+
+	extent_bytes_min = UINT64_MAX;
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		extent_bytes_min = MIN(extent_bytes_min,
+		    vdev_trim_extent_min(vd->vdev_child[c]));
+	}
+	return (extent_bytes_min);
+}
+
 /*
  * Determines whether a vdev_trim_thread() should be stopped.
  */
@@ -480,8 +545,11 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 	mutex_enter(&vd->vdev_trim_io_lock);
 
 	/*
-	 * Limit manual TRIM I/Os to the requested rate.  This does not
-	 * apply to automatic TRIM since no per vdev rate can be specified.
+	 * Limit manual TRIM I/Os to the requested rate, and automatic TRIM
+	 * I/Os to zfs_trim_autotrim_rate.  Automatic TRIM accounts for the
+	 * I/O about to be issued so that the first (up to
+	 * zfs_trim_extent_bytes_max sized) TRIM of every metaslab isn't a
+	 * free burst.
 	 */
 	if (ta->trim_type == TRIM_TYPE_MANUAL) {
 		while (vd->vdev_trim_rate != 0 && !vdev_trim_should_stop(vd) &&
@@ -490,6 +558,16 @@ vdev_trim_range(trim_args_t *ta, uint64_t start, uint64_t size)
 			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
 			    MSEC_TO_TICK(10));
 		}
+	} else if (ta->trim_type == TRIM_TYPE_AUTO) {
+		while (zfs_trim_autotrim_rate != 0 &&
+		    !vdev_autotrim_should_stop(vd->vdev_top) &&
+		    (ta->trim_bytes_done + size) * 1000 /
+		    (NSEC2MSEC(gethrtime() - ta->trim_start_time) + 1) >
+		    zfs_trim_autotrim_rate) {
+			cv_timedwait_idle(&vd->vdev_trim_io_cv,
+			    &vd->vdev_trim_io_lock, ddi_get_lbolt() +
+			    MSEC_TO_TICK(10));
+		}
 	}
 	ta->trim_bytes_done += size;
 
@@ -860,8 +938,8 @@ vdev_trim_thread(void *arg)
 	VERIFY0(vdev_trim_load(vd));
 
 	ta.trim_vdev = vd;
-	ta.trim_extent_bytes_max = zfs_trim_extent_bytes_max;
-	ta.trim_extent_bytes_min = zfs_trim_extent_bytes_min;
+	ta.trim_extent_bytes_max = vdev_trim_extent_max(vd);
+	ta.trim_extent_bytes_min = vdev_trim_extent_min(vd);
 	ta.trim_tree = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
 	ta.trim_type = TRIM_TYPE_MANUAL;
 	ta.trim_flags = 0;
@@ -910,6 +988,7 @@ vdev_trim_thread(void *arg)
 		ta.trim_msp = msp;
 		range_tree_walk(msp->ms_allocatable, vdev_trim_range_add, &ta);
 		range_tree_vacate(msp->ms_trim, NULL, NULL);
+		vdev_trim_defer_clear(msp);
 		mutex_exit(&msp->ms_lock);
 
 		error = vdev_trim_ranges(&ta);
@@ -1168,6 +1247,111 @@ vdev_trim_range_verify(void *arg, uint64_t start, uint64_t size)
 	VERIFY(range_tree_contains(msp->ms_allocatable, start, size));
 }
 
+/*
+ * A range handed back to ms_trim by vdev_autotrim_defer_small(), and the
+ * automatic TRIM pass of the metaslab in which it was first deferred.
+ */
+typedef struct trim_defer_seg {
+	uint64_t	tds_start;
+	uint64_t	tds_end;
+	uint64_t	tds_pass;
+} trim_defer_seg_t;
+
+static int
+vdev_trim_defer_compare(const void *x1, const void *x2)
+{
+	const trim_defer_seg_t *s1 = x1;
+	const trim_defer_seg_t *s2 = x2;
+
+	return (TREE_CMP(s1->tds_start, s2->tds_start));
+}
+
+/*
+ * Forget the deferral history of the metaslab, e.g. because its ms_trim
+ * tree was vacated.
+ */
+void
+vdev_trim_defer_clear(metaslab_t *msp)
+{
+	if (msp->ms_trim_defer == NULL)
+		return;
+
+	zfs_btree_clear(msp->ms_trim_defer);
+	zfs_btree_destroy(msp->ms_trim_defer);
+	kmem_free(msp->ms_trim_defer, sizeof (zfs_btree_t));
+	msp->ms_trim_defer = NULL;
+}
+
+/*
+ * Move the ranges of trim_tree smaller than extent_bytes_min back to the
+ * metaslab's ms_trim tree, unless they were first deferred at least
+ * zfs_trim_defer_passes passes ago.  A range which has coalesced with
+ * earlier deferred ranges inherits the oldest of their ages.  Ranges which
+ * aren't deferred are left in trim_tree (and skipped by vdev_trim_ranges()
+ * if still too small).
+ */
+static void
+vdev_autotrim_defer_small(metaslab_t *msp, range_tree_t *trim_tree,
+    uint64_t extent_bytes_min)
+{
+	zfs_btree_t *t = &trim_tree->rt_root;
+	zfs_btree_t *old = msp->ms_trim_defer;
+	zfs_btree_t *new = NULL;
+	zfs_btree_index_t idx, old_idx;
+	trim_defer_seg_t *tds = NULL;
+	uint64_t pass = ++msp->ms_trim_passes;
+
+	ASSERT(MUTEX_HELD(&msp->ms_lock));
+	ASSERT(range_tree_is_empty(msp->ms_trim));
+
+	if (old != NULL)
+		tds = zfs_btree_first(old, &old_idx);
+
+	for (range_seg_t *rs = zfs_btree_first(t, &idx); rs != NULL;
+	    rs = zfs_btree_next(t, &idx, &idx)) {
+		uint64_t start = rs_get_start(rs, trim_tree);
+		uint64_t end = rs_get_end(rs, trim_tree);
+		uint64_t first = pass;
+
+		if (end - start >= extent_bytes_min)
+			continue;
+
+		/*
+		 * Both trees are sorted by offset.  A deferred range may
+		 * have been split by an allocation since, so one ending
+		 * past this range is kept for the next one.
+		 */
+		while (tds != NULL && tds->tds_end <= start)
+			tds = zfs_btree_next(old, &old_idx, &old_idx);
+		while (tds != NULL && tds->tds_start < end) {
+			first = MIN(first, tds->tds_pass);
+			if (tds->tds_end > end)
+				break;
+			tds = zfs_btree_next(old, &old_idx, &old_idx);
+		}
+
+		if (pass - first >= zfs_trim_defer_passes)
+			continue;
+
+		if (new == NULL) {
+			new = kmem_alloc(sizeof (zfs_btree_t), KM_SLEEP);
+			zfs_btree_create(new, vdev_trim_defer_compare,
+			    sizeof (trim_defer_seg_t));
+		}
+		trim_defer_seg_t seg = {
+			.tds_start = start,
+			.tds_end = end,
+			.tds_pass = first,
+		};
+		zfs_btree_add(new, &seg);
+		range_tree_add(msp->ms_trim, start, end - start);
+	}
+	range_tree_walk(msp->ms_trim, range_tree_remove, trim_tree);
+
+	vdev_trim_defer_clear(msp);
+	msp->ms_trim_defer = new;
+}
+
 /*
  * Each automatic TRIM thread is responsible for managing the trimming of a
  * top-level vdev in the pool.  No automatic TRIM state is maintained on-disk.
@@ -1188,11 +1372,9 @@ vdev_autotrim_thread(void *arg)
 	mutex_exit(&vd->vdev_autotrim_lock);
 	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 
-	uint64_t extent_bytes_max = zfs_trim_extent_bytes_max;
-	uint64_t extent_bytes_min = zfs_trim_extent_bytes_min;
-
 	while (!vdev_autotrim_should_stop(vd)) {
 		int txgs_per_trim = MAX(zfs_trim_txg_batch, 1);
+		uint64_t extent_bytes_min = vdev_autotrim_extent_min(vd);
 		boolean_t issued_trim = B_FALSE;
 
 		/*
@@ -1262,12 +1444,29 @@ vdev_autotrim_thread(void *arg)
 			/*
 			 * Allocate an empty range tree which is swapped in
 			 * for the existing ms_trim tree while it is processed.
+			 * It shares the ops of ms_trim, so its ranges are
+			 * still accounted as pending until they are trimmed.
 			 */
-			trim_tree = range_tree_create(NULL, RANGE_SEG64, NULL,
-			    0, 0);
+			trim_tree = range_tree_create(msp->ms_trim->rt_ops,
+			    RANGE_SEG64, msp->ms_trim->rt_arg, 0, 0);
 			range_tree_swap(&msp->ms_trim, &trim_tree);
 			ASSERT(range_tree_is_empty(msp->ms_trim));
 
+			/*
+			 * Hand ranges too small to be worth trimming back to
+			 * ms_trim, unless they've already waited for
+			 * zfs_trim_defer_passes passes.  No allocations can
+			 * happen while the metaslab is disabled, so they are
+			 * still free, and any range later allocated is
+			 * removed from ms_trim by metaslab_block_alloc().
+			 */
+			if (extent_bytes_min != 0) {
+				vdev_autotrim_defer_small(msp, trim_tree,
+				    extent_bytes_min);
+			} else {
+				vdev_trim_defer_clear(msp);
+			}
+
 			/*
 			 * There are two cases when constructing the per-vdev
 			 * trim trees for a metaslab.  If the top-level vdev
@@ -1296,8 +1495,10 @@ vdev_autotrim_thread(void *arg)
 				vdev_t *cvd = ta->trim_vdev;
 
 				ta->trim_msp = msp;
-				ta->trim_extent_bytes_max = extent_bytes_max;
-				ta->trim_extent_bytes_min = extent_bytes_min;
+				ta->trim_extent_bytes_max =
+				    vdev_trim_extent_max(cvd);
+				ta->trim_extent_bytes_min =
+				    vdev_trim_extent_min(cvd);
 				ta->trim_type = TRIM_TYPE_AUTO;
 				ta->trim_flags = 0;
 
@@ -1428,6 +1629,7 @@ vdev_autotrim_thread(void *arg)
 
 			mutex_enter(&msp->ms_lock);
 			range_tree_vacate(msp->ms_trim, NULL, NULL);
+			vdev_trim_defer_clear(msp);
 			mutex_exit(&msp->ms_lock);
 		}
 	}
@@ -1441,6 +1643,31 @@ vdev_autotrim_thread(void *arg)
 	thread_exit();
 }
 
+/*
+ * Returns the number of TRIM I/Os queued on the leaves below vd.  Used,
+ * together with spa_trim_pending, to report the TRIM backlog.
+ */
+uint64_t
+vdev_trim_queue_depth(vdev_t *vd)
+{
+	uint64_t ios = 0;
+
+	ASSERT(spa_config_held(vd->vdev_spa, SCL_CONFIG, RW_READER));
+
+	if (vd->vdev_ops->vdev_op_leaf) {
+		mutex_enter(&vd->vdev_trim_io_lock);
+		ios += vd->vdev_trim_inflight[TRIM_TYPE_MANUAL] +
+		    vd->vdev_trim_inflight[TRIM_TYPE_AUTO] +
+		    vd->vdev_trim_inflight[TRIM_TYPE_SIMPLE];
+		mutex_exit(&vd->vdev_trim_io_lock);
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		ios += vdev_trim_queue_depth(vd->vdev_child[c]);
+
+	return (ios);
+}
+
 /*
  * Starts an autotrim thread, if needed, for each top-level vdev which can be
  * trimmed.  A top-level vdev which has been evacuated will never be trimmed.
@@ -1534,7 +1761,7 @@ vdev_trim_l2arc_thread(void *arg)
 	ta.trim_vdev = vd;
 	ta.trim_tree = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
 	ta.trim_type = TRIM_TYPE_MANUAL;
-	ta.trim_extent_bytes_max = zfs_trim_extent_bytes_max;
+	ta.trim_extent_bytes_max = vdev_trim_extent_max(vd);
 	ta.trim_extent_bytes_min = SPA_MINBLOCKSIZE;
 	ta.trim_flags = 0;
 
@@ -1668,7 +1895,7 @@ vdev_trim_simple(vdev_t *vd, uint64_t start, uint64_t size)
 	ta.trim_vdev = vd;
 	ta.trim_tree = range_tree_create(NULL, RANGE_SEG64, NULL, 0, 0);
 	ta.trim_type = TRIM_TYPE_SIMPLE;
-	ta.trim_extent_bytes_max = zfs_trim_extent_bytes_max;
+	ta.trim_extent_bytes_max = vdev_trim_extent_max(vd);
 	ta.trim_extent_bytes_min = SPA_MINBLOCKSIZE;
 	ta.trim_flags = 0;
 
@@ -1719,5 +1946,11 @@ ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, metaslab_skip, UINT, ZMOD_RW,
 ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, txg_batch, UINT, ZMOD_RW,
 	"Min number of txgs to aggregate frees before issuing TRIM");
 
+ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, defer_passes, UINT, ZMOD_RW,
+	"Autotrim passes to hold back small ranges before skipping them");
+
+ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, autotrim_rate, ULONG, ZMOD_RW,
+	"Max autotrim rate per leaf vdev in bytes/sec, 0 for unlimited");
+
 ZFS_MODULE_PARAM(zfs_trim, zfs_trim_, queue_limit, UINT, ZMOD_RW,
 	"Max queued TRIMs outstanding per leaf vdev");
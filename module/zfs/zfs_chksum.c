@@ -30,6 +30,7 @@
 #include <sys/zfs_chksum.h>
 
 #include <sys/blake3.h>
+#include <sys/sha2.h>
 
 /* limit benchmarking to max 256KiB, when EdonR is slower then this: */
 #define	LIMIT_PERF_MBS	300
@@ -248,7 +249,9 @@ chksum_benchmark(void)
 	uint64_t max = 0;
 
 	/* space for the benchmark times */
-	chksum_stat_cnt = 4;
+	chksum_stat_cnt = 2;
+	chksum_stat_cnt += sha256_get_impl_count();
+	chksum_stat_cnt += sha512_get_impl_count();
 	chksum_stat_cnt += blake3_get_impl_count();
 	chksum_stat_data = (chksum_stat_t *)kmem_zalloc(
 	    sizeof (chksum_stat_t) * chksum_stat_cnt, KM_SLEEP);
@@ -272,25 +275,39 @@ chksum_benchmark(void)
 	chksum_benchit(cs);
 
 	/* sha256 */
-	cs = &chksum_stat_data[cbid++];
-	cs->init = 0;
-	cs->func = abd_checksum_SHA256;
-	cs->free = 0;
-	cs->name = "sha256";
-	cs->impl = "generic";
-	chksum_benchit(cs);
+	for (max = 0, id = 0; id < sha256_get_impl_count(); id++) {
+		sha256_set_impl_id(id);
+		cs = &chksum_stat_data[cbid++];
+		cs->init = 0;
+		cs->func = abd_checksum_SHA256;
+		cs->free = 0;
+		cs->name = "sha256";
+		cs->impl = sha256_get_impl_name();
+		chksum_benchit(cs);
+		if (cs->bs256k > max) {
+			max = cs->bs256k;
+			sha256_set_impl_fastest(id);
+		}
+	}
 
 	/* sha512 */
-	cs = &chksum_stat_data[cbid++];
-	cs->init = 0;
-	cs->func = abd_checksum_SHA512_native;
-	cs->free = 0;
-	cs->name = "sha512";
-	cs->impl = "generic";
-	chksum_benchit(cs);
+	for (max = 0, id = 0; id < sha512_get_impl_count(); id++) {
+		sha512_set_impl_id(id);
+		cs = &chksum_stat_data[cbid++];
+		cs->init = 0;
+		cs->func = abd_checksum_SHA512_native;
+		cs->free = 0;
+		cs->name = "sha512";
+		cs->impl = sha512_get_impl_name();
+		chksum_benchit(cs);
+		if (cs->bs256k > max) {
+			max = cs->bs256k;
+			sha512_set_impl_fastest(id);
+		}
+	}
 
 	/* blake3 */
-	for (id = 0; id < blake3_get_impl_count(); id++) {
+	for (max = 0, id = 0; id < blake3_get_impl_count(); id++) {
 		blake3_set_impl_id(id);
 		cs = &chksum_stat_data[cbid++];
 		cs->init = abd_checksum_blake3_tmpl_init;
@@ -331,6 +348,8 @@ chksum_init(void)
 	}
 
 	/* setup implementations */
+	sha256_setup_impl();
+	sha512_setup_impl();
 	blake3_setup_impl();
 }
 
@@ -207,6 +207,7 @@
 #include <sys/zfeature.h>
 #include <sys/zcp.h>
 #include <sys/zio_checksum.h>
+#include <sys/ddt.h>
 #include <sys/vdev_removal.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_initialize.h>
@@ -1686,6 +1687,58 @@ zfs_ioc_pool_scan(zfs_cmd_t *zc)
 	return (error);
 }
 
+/*
+ * Start, pause or stop a scrub or resilver.  Unlike ZFS_IOC_POOL_SCAN this
+ * allows a scrub to be limited to blocks born in a range of txgs.
+ *
+ * innvl: {
+ *     "scan_type" -> pool_scan_func_t
+ *     "scan_command" -> pool_scrub_cmd_t
+ *     (optional) "scan_txg_start" -> only blocks born after this txg
+ *     (optional) "scan_txg_end" -> only blocks born up to this txg
+ * }
+ *
+ * outnvl: empty
+ */
+static const zfs_ioc_key_t zfs_keys_pool_scrub[] = {
+	{ZPOOL_SCRUB_TYPE,	DATA_TYPE_UINT64,	0},
+	{ZPOOL_SCRUB_COMMAND,	DATA_TYPE_UINT64,	0},
+	{ZPOOL_SCRUB_TXG_START,	DATA_TYPE_UINT64,	ZK_OPTIONAL},
+	{ZPOOL_SCRUB_TXG_END,	DATA_TYPE_UINT64,	ZK_OPTIONAL},
+};
+
+static int
+zfs_ioc_pool_scrub(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
+{
+	(void) outnvl;
+	spa_t *spa;
+	uint64_t scan_type, scan_cmd;
+	uint64_t txgstart = 0, txgend = 0;
+	int error;
+
+	scan_type = fnvlist_lookup_uint64(innvl, ZPOOL_SCRUB_TYPE);
+	scan_cmd = fnvlist_lookup_uint64(innvl, ZPOOL_SCRUB_COMMAND);
+	(void) nvlist_lookup_uint64(innvl, ZPOOL_SCRUB_TXG_START, &txgstart);
+	(void) nvlist_lookup_uint64(innvl, ZPOOL_SCRUB_TXG_END, &txgend);
+
+	if (scan_cmd >= POOL_SCRUB_FLAGS_END || scan_type >= POOL_SCAN_FUNCS)
+		return (SET_ERROR(EINVAL));
+
+	if ((error = spa_open(poolname, &spa, FTAG)) != 0)
+		return (error);
+
+	if (scan_cmd == POOL_SCRUB_PAUSE)
+		error = spa_scrub_pause_resume(spa, POOL_SCRUB_PAUSE);
+	else if (scan_type == POOL_SCAN_NONE)
+		error = spa_scan_stop(spa);
+	else
+		error = spa_scan_range(spa, scan_type, txgstart, txgend);
+
+	spa_close(spa, FTAG);
+
+	return (error);
+}
+
 static int
 zfs_ioc_pool_freeze(zfs_cmd_t *zc)
 {
@@ -3027,6 +3080,43 @@ zfs_ioc_vdev_set_props(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
 	return (error);
 }
 
+/*
+ * Remove unique entries from the pool's dedup tables that have not been
+ * deduplicated against for at least "ddt_prune_age" seconds.
+ *
+ * innvl: {
+ *     "ddt_prune_age" -> uint64_t (seconds)
+ * }
+ *
+ * outnvl: "ddt_prune_pruned" -> uint64_t (entries removed)
+ */
+static const zfs_ioc_key_t zfs_keys_ddt_prune[] = {
+	{DDT_PRUNE_AGE,		DATA_TYPE_UINT64,	0},
+};
+
+static int
+zfs_ioc_ddt_prune(const char *poolname, nvlist_t *innvl, nvlist_t *outnvl)
+{
+	spa_t *spa;
+	uint64_t age, pruned = 0;
+	int error;
+
+	if (nvlist_lookup_uint64(innvl, DDT_PRUNE_AGE, &age) != 0)
+		return (SET_ERROR(EINVAL));
+
+	if ((error = spa_open(poolname, &spa, FTAG)) != 0)
+		return (error);
+
+	error = ddt_prune_unique_entries(spa, age, &pruned);
+
+	spa_close(spa, FTAG);
+
+	if (error == 0)
+		fnvlist_add_uint64(outnvl, DDT_PRUNE_PRUNED, pruned);
+
+	return (error);
+}
+
 /*
  * innvl: {
  *     "vdevprops_get_vdev" -> guid
@@ -7206,6 +7296,16 @@ zfs_ioctl_init(void)
 	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_FALSE, B_FALSE,
 	    zfs_keys_vdev_set_props, ARRAY_SIZE(zfs_keys_vdev_set_props));
 
+	zfs_ioctl_register("ddt_prune", ZFS_IOC_DDT_PRUNE,
+	    zfs_ioc_ddt_prune, zfs_secpolicy_config, POOL_NAME,
+	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE,
+	    zfs_keys_ddt_prune, ARRAY_SIZE(zfs_keys_ddt_prune));
+
+	zfs_ioctl_register("scrub", ZFS_IOC_POOL_SCRUB,
+	    zfs_ioc_pool_scrub, zfs_secpolicy_config, POOL_NAME,
+	    POOL_CHECK_SUSPENDED | POOL_CHECK_READONLY, B_TRUE, B_TRUE,
+	    zfs_keys_pool_scrub, ARRAY_SIZE(zfs_keys_pool_scrub));
+
 	/* IOCTLS that use the legacy function signature */
 
 	zfs_ioctl_register_legacy(ZFS_IOC_POOL_FREEZE, zfs_ioc_pool_freeze,
@@ -108,6 +108,21 @@
  * So if the block size needs to be grown then the whole file is
  * exclusively locked, then later the caller will reduce the lock
  * range to just the range to be written using rangelock_reduce().
+ *
+ * Sharding
+ * --------
+ * All ranges of a range lock share a single mutex, which becomes contended
+ * under highly concurrent non-overlapping I/O, e.g. to a zvol.  A range lock
+ * may therefore be split into a number of shards, each with its own AVL tree
+ * and mutex.  The offset space is divided into fixed size regions, which are
+ * assigned to the shards round-robin.  A range is locked, whole, in every
+ * shard owning one of the regions it covers, in ascending shard order.  Two
+ * overlapping ranges always meet in the shard owning a region both cover,
+ * and the fixed locking order avoids deadlocks between ranges spanning
+ * multiple shards.  In the common case a range covers a single region, and
+ * the lock taken in that region's shard is returned to the caller directly.
+ * Sharded range locks have no callback, so RL_APPEND and rangelock_reduce()
+ * are not supported.
  */
 
 #include <sys/zfs_context.h>
@@ -140,11 +155,39 @@ zfs_rangelock_init(zfs_rangelock_t *rl, zfs_rangelock_cb_t *cb, void *arg)
 	    sizeof (zfs_locked_range_t), offsetof(zfs_locked_range_t, lr_node));
 	rl->rl_cb = cb;
 	rl->rl_arg = arg;
+	rl->rl_shards = NULL;
+	rl->rl_nshards = 0;
+	rl->rl_shard_shift = 0;
+}
+
+/*
+ * Initialize a range lock sharded over "nshards" shards, assigned regions of
+ * (1 << shift) bytes of the offset space in turn.
+ */
+void
+zfs_rangelock_init_sharded(zfs_rangelock_t *rl, uint_t nshards, uint_t shift)
+{
+	zfs_rangelock_init(rl, NULL, NULL);
+	if (nshards < 2)
+		return;
+
+	rl->rl_shards = kmem_alloc(nshards * sizeof (zfs_rangelock_t),
+	    KM_SLEEP);
+	for (uint_t s = 0; s < nshards; s++)
+		zfs_rangelock_init(&rl->rl_shards[s], NULL, NULL);
+	rl->rl_nshards = nshards;
+	rl->rl_shard_shift = shift;
 }
 
 void
 zfs_rangelock_fini(zfs_rangelock_t *rl)
 {
+	if (rl->rl_shards != NULL) {
+		for (uint_t s = 0; s < rl->rl_nshards; s++)
+			zfs_rangelock_fini(&rl->rl_shards[s]);
+		kmem_free(rl->rl_shards,
+		    rl->rl_nshards * sizeof (zfs_rangelock_t));
+	}
 	mutex_destroy(&rl->rl_lock);
 	avl_destroy(&rl->rl_tree);
 }
@@ -470,6 +513,87 @@ got_lock:
 	return (B_TRUE);
 }
 
+static zfs_locked_range_t *zfs_rangelock_enter_impl(zfs_rangelock_t *,
+    uint64_t, uint64_t, zfs_rangelock_type_t, boolean_t);
+
+/*
+ * Check if the range covers any of the offset regions of the given shard.
+ */
+static boolean_t
+zfs_rangelock_in_shard(zfs_rangelock_t *rl, uint_t s, uint64_t off,
+    uint64_t len)
+{
+	uint_t nshards = rl->rl_nshards;
+	uint64_t first = off >> rl->rl_shard_shift;
+	uint64_t last = (len == 0) ? first :
+	    (off + len - 1) >> rl->rl_shard_shift;
+
+	if (last - first >= nshards - 1)
+		return (B_TRUE);
+
+	return ((s + nshards - first % nshards) % nshards <= last - first);
+}
+
+/*
+ * Release the shard locks of a range, starting from the given one.
+ */
+static void
+zfs_rangelock_exit_shards(zfs_locked_range_t *lr)
+{
+	zfs_locked_range_t *next;
+
+	for (; lr != NULL; lr = next) {
+		next = lr->lr_next;
+		zfs_rangelock_exit(lr);
+	}
+}
+
+/*
+ * Lock a range in every shard covering it.  If that's more than one shard,
+ * the shard locks are chained to a separate handle which is returned.
+ */
+static zfs_locked_range_t *
+zfs_rangelock_enter_sharded(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
+    zfs_rangelock_type_t type, boolean_t nonblock)
+{
+	zfs_locked_range_t *first = NULL, *last = NULL, *lr;
+
+	ASSERT(type == RL_READER || type == RL_WRITER);
+
+	for (uint_t s = 0; s < rl->rl_nshards; s++) {
+		if (!zfs_rangelock_in_shard(rl, s, off, len))
+			continue;
+
+		lr = zfs_rangelock_enter_impl(&rl->rl_shards[s], off, len,
+		    type, nonblock);
+		if (lr == NULL) {
+			zfs_rangelock_exit_shards(first);
+			return (NULL);
+		}
+		if (first == NULL)
+			first = lr;
+		else
+			last->lr_next = lr;
+		last = lr;
+	}
+	ASSERT3P(first, !=, NULL);
+
+	if (first == last)
+		return (first);
+
+	lr = kmem_alloc(sizeof (zfs_locked_range_t), KM_SLEEP);
+	lr->lr_rangelock = rl;
+	lr->lr_offset = off;
+	lr->lr_length = len;
+	lr->lr_count = 0;
+	lr->lr_type = type;
+	lr->lr_proxy = B_FALSE;
+	lr->lr_write_wanted = B_FALSE;
+	lr->lr_read_wanted = B_FALSE;
+	lr->lr_next = first;
+	return (lr);
+}
+
 /*
  * Lock a range (offset, length) as either shared (RL_READER) or exclusive
  * (RL_WRITER or RL_APPEND).  If RL_APPEND is specified, rl_cb() will convert
@@ -486,17 +610,24 @@ zfs_rangelock_enter_impl(zfs_rangelock_t *rl, uint64_t off, uint64_t len,
 
 	ASSERT(type == RL_READER || type == RL_WRITER || type == RL_APPEND);
 
+	if (len + off < off)	/* overflow */
+		len = UINT64_MAX - off;
+
+	if (rl->rl_shards != NULL) {
+		return (zfs_rangelock_enter_sharded(rl, off, len, type,
+		    nonblock));
+	}
+
 	new = kmem_alloc(sizeof (zfs_locked_range_t), KM_SLEEP);
 	new->lr_rangelock = rl;
 	new->lr_offset = off;
-	if (len + off < off)	/* overflow */
-		len = UINT64_MAX - off;
 	new->lr_length = len;
 	new->lr_count = 1; /* assume it's going to be in the tree */
 	new->lr_type = type;
 	new->lr_proxy = B_FALSE;
 	new->lr_write_wanted = B_FALSE;
 	new->lr_read_wanted = B_FALSE;
+	new->lr_next = NULL;
 
 	mutex_enter(&rl->rl_lock);
 	if (type == RL_READER) {
@@ -618,6 +749,13 @@ zfs_rangelock_exit(zfs_locked_range_t *lr)
 	list_t free_list;
 	zfs_locked_range_t *free_lr;
 
+	if (rl->rl_shards != NULL) {
+		/* a range spanning multiple shards */
+		zfs_rangelock_exit_shards(lr->lr_next);
+		kmem_free(lr, sizeof (zfs_locked_range_t));
+		return;
+	}
+
 	ASSERT(lr->lr_type == RL_WRITER || lr->lr_type == RL_READER);
 	ASSERT(lr->lr_count == 1 || lr->lr_count == 0);
 	ASSERT(!lr->lr_proxy);
@@ -664,6 +802,7 @@ zfs_rangelock_reduce(zfs_locked_range_t *lr, uint64_t off, uint64_t len)
 	zfs_rangelock_t *rl = lr->lr_rangelock;
 
 	/* Ensure there are no other locks */
+	ASSERT3P(rl->rl_shards, ==, NULL);
 	ASSERT3U(avl_numnodes(&rl->rl_tree), ==, 1);
 	ASSERT3U(lr->lr_offset, ==, 0);
 	ASSERT3U(lr->lr_type, ==, RL_WRITER);
@@ -683,6 +822,7 @@ zfs_rangelock_reduce(zfs_locked_range_t *lr, uint64_t off, uint64_t len)
 
 #if defined(_KERNEL)
 EXPORT_SYMBOL(zfs_rangelock_init);
+EXPORT_SYMBOL(zfs_rangelock_init_sharded);
 EXPORT_SYMBOL(zfs_rangelock_fini);
 EXPORT_SYMBOL(zfs_rangelock_enter);
 EXPORT_SYMBOL(zfs_rangelock_tryenter);
@@ -51,9 +51,12 @@
 #include <sys/dbuf.h>
 #include <sys/policy.h>
 #include <sys/zfs_vnops.h>
+#include <sys/abd.h>
 #include <sys/zfs_quota.h>
 #include <sys/zfs_vfsops.h>
 #include <sys/zfs_znode.h>
+#include <sys/zil.h>
+#include <sys/zfeature.h>
 
 
 static ulong_t zfs_fsync_sync_cnt = 4;
@@ -176,6 +179,90 @@ zfs_access(znode_t *zp, int mode, int flag, cred_t *cr)
 
 static unsigned long zfs_vnops_read_chunk_size = 1024 * 1024; /* Tunable */
 
+/*
+ * Direct I/O reads and writes whole blocks straight from and to the
+ * caller's pages, bypassing the ARC.  It is used for O_DIRECT requests, or
+ * all requests with direct=always, unless it is disabled or the file has
+ * pages cached which could go stale.
+ */
+static boolean_t
+zfs_dio_enabled(znode_t *zp, int ioflag)
+{
+	objset_t *os = ZTOZSB(zp)->z_os;
+
+	if (os->os_direct == ZFS_DIRECT_DISABLED || zn_has_cached_data(zp))
+		return (B_FALSE);
+
+	return (os->os_direct == ZFS_DIRECT_ALWAYS || (ioflag & O_DIRECT));
+}
+
+/*
+ * Get an ABD for the next nbytes of the uio for Direct I/O.  The user's
+ * pages are used when they can be pinned, otherwise a bounce buffer is
+ * allocated and, for writes, filled from the uio.  The uio is not advanced.
+ */
+static int
+zfs_dio_get_abd(zfs_uio_t *uio, zfs_uio_rw_t rw, ssize_t nbytes,
+    abd_t **abdp, void **bufp)
+{
+	size_t cbytes;
+	int error;
+
+	*bufp = NULL;
+	error = zfs_uio_get_dio_abd(uio, rw, nbytes, abdp);
+	if (error != ENOTSUP)
+		return (error);
+
+	*bufp = zio_data_buf_alloc(nbytes);
+	if (rw == UIO_WRITE) {
+		error = zfs_uiocopy(*bufp, nbytes, UIO_WRITE, uio, &cbytes);
+		if (error != 0) {
+			zio_data_buf_free(*bufp, nbytes);
+			return (error);
+		}
+		ASSERT3U(cbytes, ==, nbytes);
+	}
+	*abdp = abd_get_from_buf(*bufp, nbytes);
+
+	return (0);
+}
+
+static void
+zfs_dio_free_abd(abd_t *abd, void *buf, ssize_t nbytes)
+{
+	abd_free(abd);
+	if (buf != NULL)
+		zio_data_buf_free(buf, nbytes);
+}
+
+static int
+zfs_read_direct(znode_t *zp, zfs_uio_t *uio, ssize_t nbytes)
+{
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
+	abd_t *abd;
+	void *buf;
+	int error;
+
+	error = zfs_dio_get_abd(uio, UIO_READ, nbytes, &abd, &buf);
+	if (error != 0)
+		return (error);
+
+	DB_DNODE_ENTER(db);
+	error = dmu_read_direct(DB_DNODE(db), zfs_uio_offset(uio), nbytes,
+	    abd);
+	DB_DNODE_EXIT(db);
+
+	if (error == 0) {
+		if (buf != NULL)
+			error = zfs_uiomove(buf, nbytes, UIO_READ, uio);
+		else
+			zfs_uioskip(uio, nbytes);
+	}
+	zfs_dio_free_abd(abd, buf, nbytes);
+
+	return (error);
+}
+
 /*
  * Read bytes from specified file into supplied buffer.
  *
@@ -268,6 +355,14 @@ zfs_read(struct znode *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	ssize_t n = MIN(zfs_uio_resid(uio), zp->z_size - zfs_uio_offset(uio));
 	ssize_t start_resid = n;
 
+	/*
+	 * Blocks of encrypted datasets have to be decrypted by the ARC, so
+	 * they are always read through it.
+	 */
+	const uint64_t blksz = zp->z_blksz;
+	boolean_t dio = zfs_dio_enabled(zp, ioflag) && ISP2(blksz) &&
+	    !zfsvfs->z_os->os_encrypted;
+
 	while (n > 0) {
 		ssize_t nbytes = MIN(n, zfs_vnops_read_chunk_size -
 		    P2PHASE(zfs_uio_offset(uio), zfs_vnops_read_chunk_size));
@@ -276,7 +371,11 @@ zfs_read(struct znode *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			error = mappedread_sf(zp, nbytes, uio);
 		else
 #endif
-		if (zn_has_cached_data(zp) && !(ioflag & O_DIRECT)) {
+		if (dio && n >= blksz &&
+		    P2PHASE(zfs_uio_offset(uio), blksz) == 0) {
+			nbytes = P2ALIGN(MIN(n, SPA_MAXBLOCKSIZE), blksz);
+			error = zfs_read_direct(zp, uio, nbytes);
+		} else if (zn_has_cached_data(zp) && !(ioflag & O_DIRECT)) {
 			error = mappedread(zp, nbytes, uio);
 		} else {
 			error = dmu_read_uio_dbuf(sa_get_db(zp->z_sa_hdl),
@@ -512,6 +611,13 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 	const uint64_t gid = KGID_TO_SGID(ZTOGID(zp));
 	const uint64_t projid = zp->z_projid;
 
+	/*
+	 * Dedup'd blocks have to be entered in the DDT in syncing context,
+	 * so they are always written through the ARC.
+	 */
+	boolean_t dio = zfs_dio_enabled(zp, ioflag) &&
+	    zfsvfs->z_os->os_dedup_checksum == ZIO_CHECKSUM_OFF;
+
 	/*
 	 * Write the file in reasonable size chunks.  Each chunk is written
 	 * in a separate transaction; this keeps the intent log records small
@@ -529,8 +635,27 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			break;
 		}
 
+		/*
+		 * Direct I/O writes as many whole blocks as possible at once.
+		 * The data is mapped (or copied) before entering the
+		 * transaction for the same reason as for the borrowed buffer
+		 * below.
+		 */
+		abd_t *dio_abd = NULL;
+		void *dio_buf = NULL;
+		ssize_t dio_bytes = 0;
+		if (dio && n >= max_blksz && P2PHASE(woff, max_blksz) == 0 &&
+		    zp->z_blksz == max_blksz) {
+			dio_bytes = P2ALIGN(MIN(n, SPA_MAXBLOCKSIZE),
+			    max_blksz);
+			error = zfs_dio_get_abd(uio, UIO_WRITE, dio_bytes,
+			    &dio_abd, &dio_buf);
+			if (error != 0)
+				break;
+		}
+
 		arc_buf_t *abuf = NULL;
-		if (n >= max_blksz && woff >= zp->z_size &&
+		if (dio_abd == NULL && n >= max_blksz && woff >= zp->z_size &&
 		    P2PHASE(woff, max_blksz) == 0 &&
 		    zp->z_blksz == max_blksz) {
 			/*
@@ -562,7 +687,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
 		DB_DNODE_ENTER(db);
 		dmu_tx_hold_write_by_dnode(tx, DB_DNODE(db), woff,
-		    MIN(n, max_blksz));
+		    dio_abd != NULL ? dio_bytes : MIN(n, max_blksz));
 		DB_DNODE_EXIT(db);
 		zfs_sa_upgrade_txholds(tx, zp);
 		error = dmu_tx_assign(tx, TXG_WAIT);
@@ -570,6 +695,8 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 			dmu_tx_abort(tx);
 			if (abuf != NULL)
 				dmu_return_arcbuf(abuf);
+			if (dio_abd != NULL)
+				zfs_dio_free_abd(dio_abd, dio_buf, dio_bytes);
 			break;
 		}
 
@@ -607,11 +734,25 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		 * XXX - should we really limit each write to z_max_blksz?
 		 * Perhaps we should use SPA_MAXBLOCKSIZE chunks?
 		 */
-		const ssize_t nbytes =
+		const ssize_t nbytes = dio_abd != NULL ? dio_bytes :
 		    MIN(n, max_blksz - P2PHASE(woff, max_blksz));
 
 		ssize_t tx_bytes;
-		if (abuf == NULL) {
+		if (dio_abd != NULL) {
+			DB_DNODE_ENTER(db);
+			error = dmu_write_direct(DB_DNODE(db), woff, nbytes,
+			    dio_abd, tx);
+			DB_DNODE_EXIT(db);
+			zfs_dio_free_abd(dio_abd, dio_buf, dio_bytes);
+			if (error != 0) {
+				zfs_clear_setid_bits_if_necessary(zfsvfs, zp,
+				    cr, &clear_setid_bits_txg, tx);
+				dmu_tx_commit(tx);
+				break;
+			}
+			zfs_uioskip(uio, nbytes);
+			tx_bytes = nbytes;
+		} else if (abuf == NULL) {
 			tx_bytes = zfs_uio_resid(uio);
 			zfs_uio_fault_disable(uio, B_TRUE);
 			error = dmu_write_uio_dbuf(sa_get_db(zp->z_sa_hdl),
@@ -734,7 +875,7 @@ zfs_write(znode_t *zp, zfs_uio_t *uio, int ioflag, cred_t *cr)
 		 * the TX_WRITE records logged here.
 		 */
 		zfs_log_write(zilog, tx, TX_WRITE, zp, woff, tx_bytes, ioflag,
-		    NULL, NULL);
+		    dio_bytes != 0, NULL, NULL);
 
 		dmu_tx_commit(tx);
 
@@ -914,9 +1055,14 @@ zfs_get_data(void *arg, uint64_t gen, lr_write_t *lr, char *buf,
 			zil_fault_io = 0;
 		}
 #endif
+		/*
+		 * The block isn't read here, dmu_sync() only needs its data
+		 * if it has to be written again, and blocks written by
+		 * Direct I/O are logged without it.
+		 */
 		if (error == 0)
-			error = dmu_buf_hold(os, object, offset, zgd, &db,
-			    DMU_READ_NO_PREFETCH);
+			error = dmu_buf_hold_noread(os, object, offset, zgd,
+			    &db);
 
 		if (error == 0) {
 			blkptr_t *bp = &lr->lr_blkptr;
@@ -981,6 +1127,361 @@ zfs_get_done(zgd_t *zgd, int error)
 	kmem_free(zgd, sizeof (zgd_t));
 }
 
+/*
+ * Enable the experimental block cloning feature.  If this setting is 0, then
+ * even if feature@block_cloning is enabled, attempts to clone blocks will act
+ * as though the feature is disabled.
+ */
+static int zfs_bclone_enabled = 1;
+
+/*
+ * When requesting to clone a block that was modified in a not yet synced
+ * txg, wait for that txg to sync and retry instead of failing with EAGAIN.
+ */
+static int zfs_bclone_wait_dirty = 1;
+
+/*
+ * Clone a range of blocks from the source file to the destination file
+ * without copying the data.  Both files have to reside in the same pool,
+ * the offsets have to be aligned to the source file's block size and so
+ * does the length, unless the range ends at the source file's end.
+ *
+ * On return *inoffp and *outoffp are advanced and *lenp is set to the
+ * number of bytes cloned, which may be short of the request on error.
+ */
+int
+zfs_clone_range(znode_t *inzp, uint64_t *inoffp, znode_t *outzp,
+    uint64_t *outoffp, uint64_t *lenp, cred_t *cr)
+{
+	zfsvfs_t *inzfsvfs = ZTOZSB(inzp);
+	zfsvfs_t *outzfsvfs = ZTOZSB(outzp);
+	objset_t *inos = inzfsvfs->z_os;
+	objset_t *outos = outzfsvfs->z_os;
+	zilog_t *zilog = outzfsvfs->z_log;
+	zfs_locked_range_t *inlr, *outlr;
+	uint64_t inoff = *inoffp;
+	uint64_t outoff = *outoffp;
+	uint64_t len = *lenp;
+	uint64_t done = 0;
+	uint64_t clear_setid_bits_txg = 0;
+	int error = 0;
+
+	/*
+	 * Blocks can only be shared within a single pool.
+	 */
+	if (dmu_objset_spa(inos) != dmu_objset_spa(outos))
+		return (SET_ERROR(EXDEV));
+
+	ZFS_ENTER(inzfsvfs);
+	ZFS_VERIFY_ZP(inzp);
+	if (outzfsvfs != inzfsvfs) {
+		ZFS_TEARDOWN_ENTER_READ(outzfsvfs, FTAG);
+		if (outzfsvfs->z_unmounted) {
+			ZFS_TEARDOWN_EXIT_READ(outzfsvfs, FTAG);
+			ZFS_EXIT(inzfsvfs);
+			return (SET_ERROR(EIO));
+		}
+	}
+	if (outzp->z_sa_hdl == NULL) {
+		error = SET_ERROR(EIO);
+		goto out_exit;
+	}
+
+	if (!zfs_bclone_enabled || !spa_feature_is_enabled(
+	    dmu_objset_spa(outos), SPA_FEATURE_BLOCK_CLONING)) {
+		error = SET_ERROR(EOPNOTSUPP);
+		goto out_exit;
+	}
+
+	/*
+	 * Encrypted blocks can't be shared between datasets, the block
+	 * pointer's salt and MAC are only valid with the source's keys.
+	 */
+	if (inos != outos && (inos->os_encrypted || outos->os_encrypted)) {
+		error = SET_ERROR(EXDEV);
+		goto out_exit;
+	}
+
+	if (zfs_is_readonly(outzfsvfs)) {
+		error = SET_ERROR(EROFS);
+		goto out_exit;
+	}
+
+	if (outzp->z_pflags & (ZFS_IMMUTABLE | ZFS_APPENDONLY)) {
+		error = SET_ERROR(EPERM);
+		goto out_exit;
+	}
+
+	if (inoff >= MAXOFFSET_T || outoff >= MAXOFFSET_T) {
+		error = SET_ERROR(EFBIG);
+		goto out_exit;
+	}
+	if (len > MAXOFFSET_T - MAX(inoff, outoff))
+		len = MAXOFFSET_T - MAX(inoff, outoff);
+
+	if (inzp == outzp && inoff < outoff + len && outoff < inoff + len) {
+		error = SET_ERROR(EINVAL);
+		goto out_exit;
+	}
+
+	/*
+	 * Maintain a predictable lock order between the two range locks.
+	 */
+	if (inzp < outzp || (inzp == outzp && inoff < outoff)) {
+		inlr = zfs_rangelock_enter(&inzp->z_rangelock, inoff, len,
+		    RL_READER);
+		outlr = zfs_rangelock_enter(&outzp->z_rangelock, outoff, len,
+		    RL_WRITER);
+	} else {
+		outlr = zfs_rangelock_enter(&outzp->z_rangelock, outoff, len,
+		    RL_WRITER);
+		inlr = zfs_rangelock_enter(&inzp->z_rangelock, inoff, len,
+		    RL_READER);
+	}
+
+	const uint64_t inblksz = inzp->z_blksz;
+
+	if (inoff >= inzp->z_size) {
+		len = 0;
+		goto out_unlock;
+	}
+	if (len > inzp->z_size - inoff)
+		len = inzp->z_size - inoff;
+	if (len == 0)
+		goto out_unlock;
+
+	/*
+	 * Only whole blocks can be cloned.  A partial last block is allowed
+	 * if it is the source file's last block; then the destination's
+	 * size is set to cover exactly the cloned data.
+	 */
+	if (inoff % inblksz != 0) {
+		error = SET_ERROR(EINVAL);
+		goto out_unlock;
+	}
+	if (outoff % inblksz != 0 ||
+	    (len % inblksz != 0 && inoff + len < inzp->z_size)) {
+		error = SET_ERROR(EINVAL);
+		goto out_unlock;
+	}
+
+	/*
+	 * A block size which is not a power of two is only possible for
+	 * single block files, so such a block can only be cloned to the
+	 * destination's first block.
+	 */
+	if (!ISP2(inblksz) && outoff != 0) {
+		error = SET_ERROR(EINVAL);
+		goto out_unlock;
+	}
+
+	/*
+	 * The destination must either have the source's block size already
+	 * or be a single block file whose block size can still be changed.
+	 */
+	if (outzp->z_blksz != inblksz &&
+	    (outzp->z_size > outzp->z_blksz || outzp->z_blksz > inblksz)) {
+		error = SET_ERROR(EINVAL);
+		goto out_unlock;
+	}
+
+	const uint64_t uid = KUID_TO_SUID(ZTOUID(outzp));
+	const uint64_t gid = KGID_TO_SGID(ZTOGID(outzp));
+	const uint64_t projid = outzp->z_projid;
+
+	sa_bulk_attr_t bulk[3];
+	int count = 0;
+	uint64_t mtime[2], ctime[2];
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(outzfsvfs), NULL,
+	    &mtime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(outzfsvfs), NULL,
+	    &ctime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_SIZE(outzfsvfs), NULL,
+	    &outzp->z_size, 8);
+
+	/*
+	 * Each transaction clones as many blocks as fit into a single log
+	 * record, bounded by the amount of data a transaction may touch.
+	 */
+	size_t maxblocks = MIN(zil_max_log_data(zilog) / sizeof (blkptr_t),
+	    MAX(DMU_MAX_ACCESS / inblksz, 1));
+	blkptr_t *bps = vmem_alloc(sizeof (blkptr_t) * maxblocks, KM_SLEEP);
+
+	while (len > 0) {
+		uint64_t size = MIN(inblksz * maxblocks, len);
+		size_t nbps = maxblocks;
+
+		if (zfs_id_overblockquota(outzfsvfs, DMU_USERUSED_OBJECT,
+		    uid) ||
+		    zfs_id_overblockquota(outzfsvfs, DMU_GROUPUSED_OBJECT,
+		    gid) ||
+		    (projid != ZFS_DEFAULT_PROJID &&
+		    zfs_id_overblockquota(outzfsvfs, DMU_PROJECTUSED_OBJECT,
+		    projid))) {
+			error = SET_ERROR(EDQUOT);
+			break;
+		}
+
+		error = dmu_read_l0_bps(inos, inzp->z_id, inoff, size, bps,
+		    &nbps);
+		if (error == EAGAIN && zfs_bclone_wait_dirty) {
+			/*
+			 * Part of the range was modified in an open txg and
+			 * has no final block pointer yet; the range lock
+			 * keeps it stable while waiting for it to sync.
+			 */
+			txg_wait_synced(dmu_objset_pool(inos), 0);
+			continue;
+		}
+		if (error != 0)
+			break;
+
+		dmu_tx_t *tx = dmu_tx_create(outos);
+		dmu_tx_hold_sa(tx, outzp->z_sa_hdl, B_FALSE);
+		dmu_buf_impl_t *db =
+		    (dmu_buf_impl_t *)sa_get_db(outzp->z_sa_hdl);
+		DB_DNODE_ENTER(db);
+		dmu_tx_hold_clone_by_dnode(tx, DB_DNODE(db), outoff, size);
+		DB_DNODE_EXIT(db);
+		zfs_sa_upgrade_txholds(tx, outzp);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error != 0) {
+			dmu_tx_abort(tx);
+			break;
+		}
+
+		/*
+		 * Copy the source's block size to a single block destination.
+		 */
+		if (outzp->z_blksz < inblksz)
+			zfs_grow_blocksize(outzp, inblksz, tx);
+
+		dmu_brt_clone(outos, outzp->z_id, outoff, size, tx, bps, nbps);
+
+		if (zn_has_cached_data(outzp))
+			update_pages(outzp, outoff, size, outos);
+
+		zfs_clear_setid_bits_if_necessary(outzfsvfs, outzp, cr,
+		    &clear_setid_bits_txg, tx);
+
+		zfs_tstamp_update_setup(outzp, CONTENT_MODIFIED, mtime, ctime);
+
+		/*
+		 * Update the file size (z_size) if it has changed;
+		 * account for possible concurrent updates.
+		 */
+		uint64_t outsize;
+		while ((outsize = outzp->z_size) < outoff + size) {
+			(void) atomic_cas_64(&outzp->z_size, outsize,
+			    outoff + size);
+		}
+
+		error = sa_bulk_update(outzp->z_sa_hdl, bulk, count, tx);
+
+		zfs_log_clone_range(zilog, tx, TX_CLONE_RANGE, outzp, outoff,
+		    size, inblksz, bps, nbps);
+
+		dmu_tx_commit(tx);
+
+		if (error != 0)
+			break;
+
+		inoff += size;
+		outoff += size;
+		len -= size;
+		done += size;
+	}
+
+	vmem_free(bps, sizeof (blkptr_t) * maxblocks);
+	zfs_znode_update_vfs(outzp);
+
+out_unlock:
+	zfs_rangelock_exit(outlr);
+	zfs_rangelock_exit(inlr);
+
+	if (done > 0 && outzfsvfs->z_os->os_sync == ZFS_SYNC_ALWAYS)
+		zil_commit(zilog, outzp->z_id);
+
+	*inoffp += done;
+	*outoffp += done;
+	*lenp = done;
+
+out_exit:
+	if (outzfsvfs != inzfsvfs)
+		ZFS_EXIT(outzfsvfs);
+	ZFS_EXIT(inzfsvfs);
+
+	return (error);
+}
+
+/*
+ * Replay a TX_CLONE_RANGE record.  The block pointers were validated when
+ * the record was claimed, they only need to be attached to the file.
+ */
+int
+zfs_clone_range_replay(znode_t *zp, uint64_t off, uint64_t len,
+    uint64_t blksz, const blkptr_t *bps, size_t nbps)
+{
+	zfsvfs_t *zfsvfs = ZTOZSB(zp);
+	dmu_tx_t *tx;
+	int error;
+
+	ZFS_ENTER(zfsvfs);
+	ZFS_VERIFY_ZP(zp);
+
+	ASSERT(spa_feature_is_enabled(dmu_objset_spa(zfsvfs->z_os),
+	    SPA_FEATURE_BLOCK_CLONING));
+	ASSERT(zfsvfs->z_replay);
+
+	sa_bulk_attr_t bulk[3];
+	int count = 0;
+	uint64_t mtime[2], ctime[2];
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_MTIME(zfsvfs), NULL, &mtime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_CTIME(zfsvfs), NULL, &ctime, 16);
+	SA_ADD_BULK_ATTR(bulk, count, SA_ZPL_SIZE(zfsvfs), NULL,
+	    &zp->z_size, 8);
+
+	tx = dmu_tx_create(zfsvfs->z_os);
+	dmu_tx_hold_sa(tx, zp->z_sa_hdl, B_FALSE);
+	dmu_buf_impl_t *db = (dmu_buf_impl_t *)sa_get_db(zp->z_sa_hdl);
+	DB_DNODE_ENTER(db);
+	dmu_tx_hold_clone_by_dnode(tx, DB_DNODE(db), off, len);
+	DB_DNODE_EXIT(db);
+	zfs_sa_upgrade_txholds(tx, zp);
+	error = dmu_tx_assign(tx, TXG_WAIT);
+	if (error != 0) {
+		dmu_tx_abort(tx);
+		ZFS_EXIT(zfsvfs);
+		return (error);
+	}
+
+	if (zp->z_blksz < blksz)
+		zfs_grow_blocksize(zp, blksz, tx);
+
+	dmu_brt_clone(zfsvfs->z_os, zp->z_id, off, len, tx, bps, nbps);
+
+	zfs_tstamp_update_setup(zp, CONTENT_MODIFIED, mtime, ctime);
+
+	if (zp->z_size < off + len)
+		zp->z_size = off + len;
+
+	error = sa_bulk_update(zp->z_sa_hdl, bulk, count, tx);
+
+	/*
+	 * zil_replaying() not only checks if we are replaying the ZIL, but
+	 * also records the replay progress in the ZIL header.
+	 */
+	VERIFY(zil_replaying(zfsvfs->z_log, tx));
+
+	dmu_tx_commit(tx);
+
+	zfs_znode_update_vfs(zp);
+
+	ZFS_EXIT(zfsvfs);
+
+	return (error);
+}
+
 EXPORT_SYMBOL(zfs_access);
 EXPORT_SYMBOL(zfs_fsync);
 EXPORT_SYMBOL(zfs_holey);
@@ -988,6 +1489,14 @@ EXPORT_SYMBOL(zfs_read);
 EXPORT_SYMBOL(zfs_write);
 EXPORT_SYMBOL(zfs_getsecattr);
 EXPORT_SYMBOL(zfs_setsecattr);
+EXPORT_SYMBOL(zfs_clone_range);
+EXPORT_SYMBOL(zfs_clone_range_replay);
 
 ZFS_MODULE_PARAM(zfs_vnops, zfs_vnops_, read_chunk_size, ULONG, ZMOD_RW,
 	"Bytes to read per chunk");
+
+ZFS_MODULE_PARAM(zfs, zfs_, bclone_enabled, INT, ZMOD_RW,
+	"Enable block cloning");
+
+ZFS_MODULE_PARAM(zfs, zfs_, bclone_wait_dirty, INT, ZMOD_RW,
+	"Wait for dirty blocks when cloning");
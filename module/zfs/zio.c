@@ -42,6 +42,7 @@
 #include <sys/dmu_objset.h>
 #include <sys/arc.h>
 #include <sys/ddt.h>
+#include <sys/brt.h>
 #include <sys/blkptr.h>
 #include <sys/zfeature.h>
 #include <sys/dsl_scan.h>
@@ -1166,7 +1167,8 @@ zio_rewrite(zio_t *pio, spa_t *spa, uint64_t txg, blkptr_t *bp, abd_t *data,
 }
 
 void
-zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
+zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite,
+    boolean_t brtwrite)
 {
 	ASSERT(zio->io_type == ZIO_TYPE_WRITE);
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
@@ -1176,10 +1178,13 @@ zio_write_override(zio_t *zio, blkptr_t *bp, int copies, boolean_t nopwrite)
 	/*
 	 * We must reset the io_prop to match the values that existed
 	 * when the bp was first written by dmu_sync() keeping in mind
-	 * that nopwrite and dedup are mutually exclusive.
+	 * that nopwrite and dedup are mutually exclusive.  A cloned block
+	 * is written exactly as given, it is neither nopwrite nor dedup.
 	 */
-	zio->io_prop.zp_dedup = nopwrite ? B_FALSE : zio->io_prop.zp_dedup;
+	zio->io_prop.zp_dedup = (nopwrite || brtwrite) ?
+	    B_FALSE : zio->io_prop.zp_dedup;
 	zio->io_prop.zp_nopwrite = nopwrite;
+	zio->io_prop.zp_brtwrite = brtwrite;
 	zio->io_prop.zp_copies = copies;
 	zio->io_bp_override = bp;
 }
@@ -1201,9 +1206,9 @@ zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp)
 
 	/*
 	 * Frees that are for the currently-syncing txg, are not going to be
-	 * deferred, and which will not need to do a read (i.e. not GANG or
-	 * DEDUP), can be processed immediately.  Otherwise, put them on the
-	 * in-memory list for later processing.
+	 * deferred, and which will not need to do a read (i.e. not GANG,
+	 * DEDUP or cloned), can be processed immediately.  Otherwise, put
+	 * them on the in-memory list for later processing.
 	 *
 	 * Note that we only defer frees after zfs_sync_pass_deferred_free
 	 * when the log space map feature is disabled. [see relevant comment
@@ -1211,6 +1216,7 @@ zio_free(spa_t *spa, uint64_t txg, const blkptr_t *bp)
 	 */
 	if (BP_IS_GANG(bp) ||
 	    BP_GET_DEDUP(bp) ||
+	    brt_maybe_exists(spa, bp) ||
 	    txg != spa->spa_syncing_txg ||
 	    (spa_sync_pass(spa) >= zfs_sync_pass_deferred_free &&
 	    !spa_feature_is_active(spa, SPA_FEATURE_LOG_SPACEMAP))) {
@@ -1239,11 +1245,11 @@ zio_free_sync(zio_t *pio, spa_t *spa, uint64_t txg, const blkptr_t *bp,
 	arc_freed(spa, bp);
 	dsl_scan_freed(spa, bp);
 
-	if (BP_IS_GANG(bp) || BP_GET_DEDUP(bp)) {
+	if (BP_IS_GANG(bp) || BP_GET_DEDUP(bp) || brt_maybe_exists(spa, bp)) {
 		/*
-		 * GANG and DEDUP blocks can induce a read (for the gang block
-		 * header, or the DDT), so issue them asynchronously so that
-		 * this thread is not tied up.
+		 * GANG, DEDUP and cloned blocks can induce a read (for the gang
+		 * block header, the DDT or the BRT), so issue them
+		 * asynchronously so that this thread is not tied up.
 		 */
 		enum zio_stage stage =
 		    ZIO_FREE_PIPELINE | ZIO_STAGE_ISSUE_ASYNC;
@@ -1490,12 +1496,29 @@ zio_vdev_delegated_io(vdev_t *vd, uint64_t offset, abd_t *data, uint64_t size,
 	return (zio);
 }
 
+/*
+ * Flush the write caches of all leaves under vd.  Leaves without a volatile
+ * write cache are skipped individually, so an interior vdev always reaches
+ * those of its children which do need the flush.
+ */
 void
 zio_flush(zio_t *zio, vdev_t *vd)
 {
-	zio_nowait(zio_ioctl(zio, zio->io_spa, vd, DKIOCFLUSHWRITECACHE,
-	    NULL, NULL,
-	    ZIO_FLAG_CANFAIL | ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY));
+	if (vd->vdev_children == 0) {
+		if (vd->vdev_nowritecache) {
+			spa_iostats_flush_add(zio->io_spa, 0, 1);
+			return;
+		}
+
+		spa_iostats_flush_add(zio->io_spa, 1, 0);
+		zio_nowait(zio_ioctl(zio, zio->io_spa, vd,
+		    DKIOCFLUSHWRITECACHE, NULL, NULL, ZIO_FLAG_CANFAIL |
+		    ZIO_FLAG_DONT_PROPAGATE | ZIO_FLAG_DONT_RETRY));
+		return;
+	}
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++)
+		zio_flush(zio, vd->vdev_child[c]);
 }
 
 void
@@ -1584,11 +1607,20 @@ zio_write_bp_init(zio_t *zio)
 		zio_prop_t *zp = &zio->io_prop;
 
 		ASSERT(bp->blk_birth != zio->io_txg);
-		ASSERT(BP_GET_DEDUP(zio->io_bp_override) == 0);
 
 		*bp = *zio->io_bp_override;
 		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
 
+		/*
+		 * A cloned block pointer is used as is, the reference was
+		 * already accounted for in the BRT (or DDT) by
+		 * brt_pending_apply().
+		 */
+		if (zp->zp_brtwrite)
+			return (zio);
+
+		ASSERT(BP_GET_DEDUP(zio->io_bp_override) == 0);
+
 		if (BP_IS_EMBEDDED(bp))
 			return (zio);
 
@@ -1846,8 +1878,12 @@ zio_free_bp_init(zio_t *zio)
 	blkptr_t *bp = zio->io_bp;
 
 	if (zio->io_child_type == ZIO_CHILD_LOGICAL) {
-		if (BP_GET_DEDUP(bp))
+		if (BP_GET_DEDUP(bp)) {
 			zio->io_pipeline = ZIO_DDT_FREE_PIPELINE;
+		} else if (brt_maybe_exists(zio->io_spa, bp)) {
+			zio->io_pipeline = ZIO_BRT_FREE_PIPELINE |
+			    (zio->io_pipeline & ZIO_GANG_STAGES);
+		}
 	}
 
 	ASSERT3P(zio->io_bp, ==, &zio->io_bp_copy);
@@ -3179,7 +3215,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 			if (psize != zio->io_size)
 				return (B_TRUE);
 
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde->dde_key);
 
 			tmpabd = abd_alloc_for_io(psize, B_TRUE);
 
@@ -3194,7 +3230,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 			}
 
 			abd_free(tmpabd);
-			ddt_enter(ddt);
+			ddt_enter(ddt, &dde->dde_key);
 			return (error != 0);
 		} else if (ddp->ddp_phys_birth != 0) {
 			arc_buf_t *abuf = NULL;
@@ -3207,7 +3243,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 			if (BP_GET_LSIZE(&blk) != zio->io_orig_size)
 				return (B_TRUE);
 
-			ddt_exit(ddt);
+			ddt_exit(ddt, &dde->dde_key);
 
 			error = arc_read(NULL, spa, &blk,
 			    arc_getbuf_func, &abuf, ZIO_PRIORITY_SYNC_READ,
@@ -3221,7 +3257,7 @@ zio_ddt_collision(zio_t *zio, ddt_t *ddt, ddt_entry_t *dde)
 				arc_buf_destroy(abuf, &abuf);
 			}
 
-			ddt_enter(ddt);
+			ddt_enter(ddt, &dde->dde_key);
 			return (error != 0);
 		}
 	}
@@ -3241,7 +3277,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	if (zio->io_error)
 		return;
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key);
 
 	ASSERT(dde->dde_lead_zio[p] == zio);
 
@@ -3251,7 +3287,7 @@ zio_ddt_child_write_ready(zio_t *zio)
 	while ((pio = zio_walk_parents(zio, &zl)) != NULL)
 		ddt_bp_fill(ddp, pio->io_bp, zio->io_txg);
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key);
 }
 
 static void
@@ -3262,7 +3298,7 @@ zio_ddt_child_write_done(zio_t *zio)
 	ddt_entry_t *dde = zio->io_private;
 	ddt_phys_t *ddp = &dde->dde_phys[p];
 
-	ddt_enter(ddt);
+	ddt_enter(ddt, &dde->dde_key);
 
 	ASSERT(ddp->ddp_refcnt == 0);
 	ASSERT(dde->dde_lead_zio[p] == zio);
@@ -3276,7 +3312,26 @@ zio_ddt_child_write_done(zio_t *zio)
 		ddt_phys_clear(ddp);
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &dde->dde_key);
+}
+
+/*
+ * Returns B_TRUE if the entry was created by this lookup, i.e. it is not in
+ * the DDT on disk and no other write in this txg has claimed it.
+ */
+static boolean_t
+zio_ddt_new_entry(const ddt_entry_t *dde)
+{
+	if (dde->dde_type != DDT_TYPES)
+		return (B_FALSE);
+
+	for (int p = 0; p < DDT_PHYS_TYPES; p++) {
+		if (dde->dde_phys[p].ddp_phys_birth != 0 ||
+		    dde->dde_lead_zio[p] != NULL)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
 }
 
 static zio_t *
@@ -3291,13 +3346,15 @@ zio_ddt_write(zio_t *zio)
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
 	ddt_phys_t *ddp;
+	ddt_key_t ddk;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(BP_GET_CHECKSUM(bp) == zp->zp_checksum);
 	ASSERT(BP_IS_HOLE(bp) || zio->io_bp_override);
 	ASSERT(!(zio->io_bp_override && (zio->io_flags & ZIO_FLAG_RAW)));
 
-	ddt_enter(ddt);
+	ddt_key_fill(&ddk, bp);
+	ddt_enter(ddt, &ddk);
 	dde = ddt_lookup(ddt, bp, B_TRUE);
 	ddp = &dde->dde_phys[p];
 
@@ -3320,7 +3377,21 @@ zio_ddt_write(zio_t *zio)
 		}
 		ASSERT(!BP_GET_DEDUP(bp));
 		zio->io_pipeline = ZIO_WRITE_PIPELINE;
-		ddt_exit(ddt);
+		ddt_exit(ddt, &ddk);
+		return (zio);
+	}
+
+	/*
+	 * If the DDT has reached its quota, don't add new entries to it;
+	 * the block is written as an ordinary, non-dedup block instead.
+	 */
+	if (!zio->io_bp_override && zio_ddt_new_entry(dde) &&
+	    ddt_over_quota(spa)) {
+		ddt_remove(ddt, dde);
+		ddt_exit(ddt, &ddk);
+		zp->zp_dedup = B_FALSE;
+		BP_SET_DEDUP(bp, B_FALSE);
+		zio->io_pipeline = ZIO_WRITE_PIPELINE;
 		return (zio);
 	}
 
@@ -3347,7 +3418,7 @@ zio_ddt_write(zio_t *zio)
 		dde->dde_lead_zio[p] = cio;
 	}
 
-	ddt_exit(ddt);
+	ddt_exit(ddt, &ddk);
 
 	zio_nowait(cio);
 
@@ -3363,19 +3434,59 @@ zio_ddt_free(zio_t *zio)
 	blkptr_t *bp = zio->io_bp;
 	ddt_t *ddt = ddt_select(spa, bp);
 	ddt_entry_t *dde;
-	ddt_phys_t *ddp;
+	ddt_phys_t *ddp = NULL;
+	ddt_key_t ddk;
 
 	ASSERT(BP_GET_DEDUP(bp));
 	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
 
-	ddt_enter(ddt);
+	ddt_key_fill(&ddk, bp);
+	ddt_enter(ddt, &ddk);
 	freedde = dde = ddt_lookup(ddt, bp, B_TRUE);
 	if (dde) {
 		ddp = ddt_phys_select(dde, bp);
 		if (ddp)
 			ddt_phys_decref(ddp);
 	}
-	ddt_exit(ddt);
+	ddt_exit(ddt, &ddk);
+
+	/*
+	 * If the block's entry was pruned from the DDT (any entry found now
+	 * describes a later copy of the data), this was the only reference
+	 * the DDT knew about and the block is freed like any other.
+	 */
+	if (ddp == NULL) {
+		if (brt_maybe_exists(spa, bp))
+			zio->io_pipeline |= ZIO_STAGE_BRT_FREE;
+		if (BP_IS_GANG(bp))
+			zio->io_pipeline |= ZIO_GANG_STAGES;
+		zio->io_pipeline |= ZIO_STAGE_DVA_FREE;
+	}
+
+	return (zio);
+}
+
+/*
+ * ==========================================================================
+ * Block Reference Table
+ * ==========================================================================
+ */
+static zio_t *
+zio_brt_free(zio_t *zio)
+{
+	blkptr_t *bp = zio->io_bp;
+
+	ASSERT(zio->io_child_type == ZIO_CHILD_LOGICAL);
+
+	if (BP_GET_LEVEL(bp) > 0 || BP_IS_METADATA(bp))
+		return (zio);
+
+	/*
+	 * If the block is still referenced by a clone, only the BRT
+	 * reference was dropped and the block must not be freed.
+	 */
+	if (!brt_entry_decref(zio->io_spa, bp))
+		zio->io_pipeline = ZIO_INTERLOCK_PIPELINE;
 
 	return (zio);
 }
@@ -4881,6 +4992,7 @@ static zio_pipe_stage_t *zio_pipeline[] = {
 	zio_ddt_read_done,
 	zio_ddt_write,
 	zio_ddt_free,
+	zio_brt_free,
 	zio_gang_assemble,
 	zio_gang_issue,
 	zio_dva_throttle,
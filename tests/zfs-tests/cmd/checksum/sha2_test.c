@@ -173,6 +173,8 @@ main(int argc, char *argv[])
 {
 	boolean_t	failed = B_FALSE;
 	uint64_t	cpu_mhz = 0;
+	const char	*name;
+	int		id;
 
 	if (argc == 2)
 		cpu_mhz = atoi(argv[1]);
@@ -184,8 +186,8 @@ main(int argc, char *argv[])
 		SHA2Init(SHA ## mode ## _MECH_INFO_TYPE, &ctx);		\
 		SHA2Update(&ctx, _m, strlen(_m));			\
 		SHA2Final(digest, &ctx);				\
-		(void) printf("SHA%-9sMessage: " #_m			\
-		    "\tResult: ", #mode);				\
+		(void) printf("SHA%-9s%-8sMessage: " #_m		\
+		    "\tResult: ", #mode, name);				\
 		if (memcmp(digest, testdigest, diglen / 8) == 0) {	\
 			(void) printf("OK\n");				\
 		} else {						\
@@ -216,29 +218,51 @@ main(int argc, char *argv[])
 			cpb = (cpu_mhz * 1e6 * ((double)delta /		\
 			    1000000)) / (8192 * 128 * 1024);		\
 		}							\
-		(void) printf("SHA%-9s%llu us (%.02f CPB)\n", #mode,	\
-		    (u_longlong_t)delta, cpb);				\
+		(void) printf("SHA%-9s%-8s%llu us (%.02f CPB)\n", #mode, \
+		    name, (u_longlong_t)delta, cpb);			\
 	} while (0)
 
 	(void) printf("Running algorithm correctness tests:\n");
-	SHA2_ALGO_TEST(test_msg0, 256, 256, sha256_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg1, 256, 256, sha256_test_digests[1]);
-	SHA2_ALGO_TEST(test_msg0, 384, 384, sha384_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 384, 384, sha384_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512, 512, sha512_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512, 512, sha512_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512_224, 224, sha512_224_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512_224, 224, sha512_224_test_digests[2]);
-	SHA2_ALGO_TEST(test_msg0, 512_256, 256, sha512_256_test_digests[0]);
-	SHA2_ALGO_TEST(test_msg2, 512_256, 256, sha512_256_test_digests[2]);
+	for (id = 0; id < sha256_get_impl_count(); id++) {
+		sha256_set_impl_id(id);
+		name = sha256_get_impl_name();
+		SHA2_ALGO_TEST(test_msg0, 256, 256, sha256_test_digests[0]);
+		SHA2_ALGO_TEST(test_msg1, 256, 256, sha256_test_digests[1]);
+	}
+
+	for (id = 0; id < sha512_get_impl_count(); id++) {
+		sha512_set_impl_id(id);
+		name = sha512_get_impl_name();
+		SHA2_ALGO_TEST(test_msg0, 384, 384, sha384_test_digests[0]);
+		SHA2_ALGO_TEST(test_msg2, 384, 384, sha384_test_digests[2]);
+		SHA2_ALGO_TEST(test_msg0, 512, 512, sha512_test_digests[0]);
+		SHA2_ALGO_TEST(test_msg2, 512, 512, sha512_test_digests[2]);
+		SHA2_ALGO_TEST(test_msg0, 512_224, 224,
+		    sha512_224_test_digests[0]);
+		SHA2_ALGO_TEST(test_msg2, 512_224, 224,
+		    sha512_224_test_digests[2]);
+		SHA2_ALGO_TEST(test_msg0, 512_256, 256,
+		    sha512_256_test_digests[0]);
+		SHA2_ALGO_TEST(test_msg2, 512_256, 256,
+		    sha512_256_test_digests[2]);
+	}
 
 	if (failed)
 		return (1);
 
 	(void) printf("Running performance tests (hashing 1024 MiB of "
 	    "data):\n");
-	SHA2_PERF_TEST(256, 256);
-	SHA2_PERF_TEST(512, 512);
+	for (id = 0; id < sha256_get_impl_count(); id++) {
+		sha256_set_impl_id(id);
+		name = sha256_get_impl_name();
+		SHA2_PERF_TEST(256, 256);
+	}
+
+	for (id = 0; id < sha512_get_impl_count(); id++) {
+		sha512_set_impl_id(id);
+		name = sha512_get_impl_name();
+		SHA2_PERF_TEST(512, 512);
+	}
 
 	return (0);
 }
@@ -753,6 +753,35 @@ test_wait_fs(const char *dataset)
 	nvlist_free(required);
 }
 
+static void
+test_ddt_prune(const char *pool)
+{
+	nvlist_t *required = fnvlist_alloc();
+
+	fnvlist_add_uint64(required, "ddt_prune_age", UINT64_MAX);
+
+	IOC_INPUT_TEST(ZFS_IOC_DDT_PRUNE, pool, required, NULL, 0);
+
+	nvlist_free(required);
+}
+
+static void
+test_scrub(const char *pool)
+{
+	nvlist_t *required = fnvlist_alloc();
+	nvlist_t *optional = fnvlist_alloc();
+
+	fnvlist_add_uint64(required, "scan_type", POOL_SCAN_SCRUB);
+	fnvlist_add_uint64(required, "scan_command", POOL_SCRUB_NORMAL);
+	fnvlist_add_uint64(optional, "scan_txg_start", 0);
+	fnvlist_add_uint64(optional, "scan_txg_end", 0);
+
+	IOC_INPUT_TEST(ZFS_IOC_POOL_SCRUB, pool, required, optional, 0);
+
+	nvlist_free(required);
+	nvlist_free(optional);
+}
+
 static void
 test_get_bootenv(const char *pool)
 {
@@ -861,6 +890,9 @@ zfs_ioc_input_tests(const char *pool)
 	test_wait(pool);
 	test_wait_fs(dataset);
 
+	test_ddt_prune(pool);
+	test_scrub(pool);
+
 	test_set_bootenv(pool);
 	test_get_bootenv(pool);
 
@@ -1018,6 +1050,8 @@ validate_ioc_values(void)
 	CHECK(ZFS_IOC_BASE + 82 == ZFS_IOC_GET_BOOKMARK_PROPS);
 	CHECK(ZFS_IOC_BASE + 83 == ZFS_IOC_WAIT);
 	CHECK(ZFS_IOC_BASE + 84 == ZFS_IOC_WAIT_FS);
+	CHECK(ZFS_IOC_BASE + 87 == ZFS_IOC_DDT_PRUNE);
+	CHECK(ZFS_IOC_BASE + 88 == ZFS_IOC_POOL_SCRUB);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 1 == ZFS_IOC_EVENTS_NEXT);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 2 == ZFS_IOC_EVENTS_CLEAR);
 	CHECK(ZFS_IOC_PLATFORM_BASE + 3 == ZFS_IOC_EVENTS_SEEK);